@@ -0,0 +1,119 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+namespace program
+{
+    /// keeps the optimiser from discarding a benchmarked result
+    template < class T >
+    inline void
+    do_not_optimise(T const &x)
+    {
+        asm volatile("" : : "r,m"(x) : "memory");
+    }
+
+    /// bytes the allocator has handed out and not had back, or zero where the C library does not say
+    inline std::size_t
+    heap_in_use()
+    {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+        return mallinfo2().uordblks;
+#else
+        return 0;
+#endif
+    }
+
+    /// run f repeatedly for at least half a second and report the throughput over bytes per run.
+    /// The runs are timed in batches and the fastest batch is reported, which filters out noise from other
+    /// processes. Returns the time of one run in seconds.
+    template < class F >
+    double
+    measure(std::string_view name, std::size_t bytes, F &&f)
+    {
+        using clock = std::chrono::steady_clock;
+
+        f();   // warm up caches and allocator pools
+
+        auto best  = std::chrono::duration< double >::max();
+        auto start = clock::now();
+        while (clock::now() - start < std::chrono::milliseconds(500))
+        {
+            auto batch_start = clock::now();
+            f();
+            auto elapsed = std::chrono::duration< double >(clock::now() - batch_start);
+            if (elapsed < best)
+                best = elapsed;
+        }
+
+        auto per_run = best.count();
+        std::cout << std::left << std::setw(48) << name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(10) << double(bytes) / per_run / 1e6 << " MB/s" << std::setw(12)
+                  << per_run * 1e6 << " us/run" << std::endl;
+        return per_run;
+    }
+
+    /// print the cost of a variant relative to its baseline
+    inline void
+    report_overhead(std::string_view name, double baseline, double variant)
+    {
+        std::cout << std::left << std::setw(48) << name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(10) << (variant / baseline - 1.0) * 100.0 << " %" << std::endl;
+    }
+
+    /// time a baseline and a variant in alternating batches, so that drift in machine load affects both
+    /// equally, and report the best time of each and the overhead of the variant. The overhead is the median
+    /// of the ratios of each variant run to the mean of the baseline runs either side of it, which a single
+    /// lucky or unlucky run cannot move the way it moves the ratio of the best times.
+    template < class Base, class Variant >
+    void
+    measure_overhead(std::string_view name, std::size_t bytes, Base &&base, Variant &&variant)
+    {
+        using clock = std::chrono::steady_clock;
+
+        auto time = [](auto &f) {
+            auto start = clock::now();
+            f();
+            return std::chrono::duration< double >(clock::now() - start).count();
+        };
+
+        base();
+        variant();
+
+        auto                  previous     = time(base);
+        auto                  best_base    = previous;
+        auto                  best_variant = time(variant);
+        std::vector< double > ratios;
+        auto                  start = clock::now();
+        while (ratios.empty() || clock::now() - start < std::chrono::seconds(2))
+        {
+            auto v = time(variant);
+            auto b = time(base);
+            ratios.push_back(v * 2 / (previous + b));
+            best_base    = std::min(best_base, b);
+            best_variant = std::min(best_variant, v);
+            previous     = b;
+        }
+        auto middle = ratios.begin() + ratios.size() / 2;
+        std::nth_element(ratios.begin(), middle, ratios.end());
+
+        auto line = [&](std::string_view label, double per_run) {
+            std::cout << std::left << std::setw(48) << (std::string(name) + " " + std::string(label)) << std::right
+                      << std::fixed << std::setprecision(1) << std::setw(10) << double(bytes) / per_run / 1e6
+                      << " MB/s" << std::setw(12) << per_run * 1e6 << " us/run" << std::endl;
+        };
+        line("baseline", best_base);
+        line("variant", best_variant);
+        report_overhead(std::string(name) + " overhead", 1.0, *middle);
+    }
+}   // namespace program
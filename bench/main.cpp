@@ -0,0 +1,607 @@
+#include "bench.hpp"
+#include "codegen_order.hpp"
+#include "config.hpp"
+#include "corpus.hpp"
+#include "explain.hpp"
+#include "float32.hpp"
+#include "ingest_server.hpp"
+#include "perf_targets.hpp"
+#include "persistent.hpp"
+#include "pmr_value.hpp"
+#include "prefilter.hpp"
+#include "projection.hpp"
+#include "tokenizer.hpp"
+#include "unique_keys.hpp"
+#include "value.hpp"
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <thread>
+#include <string>
+#include <vector>
+
+namespace program
+{
+    /// an array of objects each with width distinct keys
+    std::string
+    wide_objects(std::size_t objects, std::size_t width)
+    {
+        std::string result = "[";
+        for (std::size_t o = 0; o < objects; ++o)
+        {
+            result += o ? ",{" : "{";
+            for (std::size_t k = 0; k < width; ++k)
+            {
+                if (k)
+                    result += ',';
+                result += "\"field_" + std::to_string(k) + "\":" + std::to_string(o * width + k);
+            }
+            result += '}';
+        }
+        result += ']';
+        return result;
+    }
+
+    template < class Handler >
+    void
+    tokenize_all(basic_tokenizer< Handler > &tk, std::string const &doc)
+    {
+        tk.reset();
+        auto ec = tokenize(tk, doc);
+        if (ec)
+            throw system::system_error(ec, "tokenize_all");
+    }
+
+    /// a consumer which looks at every key, as any real one would
+    struct key_consumer : null_handler
+    {
+        std::size_t total = 0;
+
+        void
+        on_key(std::string_view key, system::error_code &)
+        {
+            total += key.size();
+        }
+    };
+
+    void
+    bench_unique_keys()
+    {
+        for (auto width : { 8, 64, 1024 })
+        {
+            auto doc = wide_objects(200000 / width, width);
+
+            basic_tokenizer< key_consumer >               plain;
+            basic_tokenizer< unique_keys< key_consumer > > checked;
+            measure_overhead(
+                "unique_keys width=" + std::to_string(width),
+                doc.size(),
+                [&] {
+                    tokenize_all(plain, doc);
+                    do_not_optimise(plain.handler().total);
+                },
+                [&] {
+                    checked.handler().reset();
+                    tokenize_all(checked, doc);
+                    do_not_optimise(checked.handler().next().total);
+                });
+        }
+    }
+
+    /// NDJSON log lines in which one in a thousand is an error from the billing service
+    std::string
+    log_lines(std::size_t lines)
+    {
+        static const char *const services[] = { "auth", "search", "frontend", "storage" };
+        std::string              result;
+        for (std::size_t i = 0; i < lines; ++i)
+        {
+            bool hit = i % 1000 == 999;
+            result += "{\"ts\":" + std::to_string(1600000000000 + i * 37) + ",\"level\":\"" +
+                      (hit || i % 7 == 0 ? "error" : "info") + "\",\"service\":\"" +
+                      (hit ? "billing" : services[i % 4]) + "\",\"msg\":\"request " + std::to_string(i) +
+                      " completed with status " + std::to_string(200 + i % 300) + "\",\"latency_ms\":" +
+                      std::to_string(i % 997) + "}\n";
+        }
+        return result;
+    }
+
+    void
+    bench_prefilter()
+    {
+        auto data   = log_lines(200000);
+        auto blooms = block_bloom::build(data);
+
+        auto is = [](value const &v, const char *key, std::string_view s) {
+            auto m = v.if_is< object >() ? v.if_is< object >()->find(key) : nullptr;
+            return m && m->if_is< std::string >() && *m->if_is< std::string >() == s;
+        };
+        auto predicate = [&](value const &v) { return is(v, "level", "error") && is(v, "service", "billing"); };
+        std::size_t found = 0;
+        auto        count = [&](std::string_view, std::size_t) { ++found; };
+
+        measure("prefilter parse every record", data.size(), [&] {
+            filter_ndjson(data, prefilter {}, predicate, count);
+        });
+        prefilter filter { { "\"billing\"", "\"error\"" } };
+        measure("prefilter literals", data.size(), [&] { filter_ndjson(data, filter, predicate, count); });
+        measure("prefilter literals and block bloom", data.size(), [&] {
+            filter_ndjson(data, filter, predicate, count, &blooms);
+        });
+        do_not_optimise(found);
+    }
+
+    /// arrays of numbers with the profiles of typical feeds
+    std::string
+    number_array(std::string_view profile, std::size_t count)
+    {
+        std::string result = "[";
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            if (i)
+                result += ',';
+            if (profile == "short integers")
+                result += std::to_string(i % 1000);
+            else if (profile == "long decimals")
+                result += std::to_string(i) + "." + std::to_string(1000000000000000ull + i * 7919);
+            else
+                result += std::to_string(1 + i % 9) + "." + std::to_string(100 + i % 900) + "e-" + std::to_string(i % 30);
+        }
+        result += ']';
+        return result;
+    }
+
+    void
+    bench_number_engines()
+    {
+        for (auto profile : { "short integers", "long decimals", "scientific" })
+        {
+            auto doc = number_array(profile, 100000);
+
+            basic_tokenizer< null_handler > tk;
+            for (auto engine : { number_engine::bytewise, number_engine::swar, number_engine::simd })
+            {
+                tk.number_engines().pin(engine);
+                measure(std::string(profile) + " " + to_string(engine), doc.size(), [&] { tokenize_all(tk, doc); });
+            }
+            tk.number_engines().unpin();
+            measure(std::string(profile) + " adaptive", doc.size(), [&] { tokenize_all(tk, doc); });
+            std::cout << "    chose " << to_string(tk.number_stats().engine) << " after "
+                      << tk.number_stats().switches << " switches" << std::endl;
+        }
+    }
+
+    void
+    bench_object_lookup()
+    {
+        for (std::size_t width : { 8, 64, 10000 })
+        {
+            system::error_code ec;
+            auto               doc = parse(wide_objects(1, width), ec);
+            auto const &       obj = *std::get< array >(doc.data)[0].if_is< object >();
+
+            std::vector< std::string > keys;
+            std::size_t                bytes = 0;
+            for (auto &m : obj.members())
+            {
+                keys.push_back(m.first);
+                bytes += m.first.size();
+            }
+
+            auto label = std::to_string(width) + " keys";
+            measure(label + " scan", bytes, [&] {
+                for (auto &k : keys)
+                    for (auto &m : obj.members())
+                        if (m.first == k)
+                        {
+                            do_not_optimise(&m.second);
+                            break;
+                        }
+            });
+            measure(label + " find", bytes, [&] {
+                for (auto &k : keys)
+                    do_not_optimise(obj.find(k));
+            });
+            std::cout << "    " << (obj.indexed() ? "indexed" : "not indexed") << std::endl;
+        }
+    }
+
+    /// RPC sized messages: small objects of 100 to 300 bytes
+    struct rpc_messages
+    {
+        std::string                     text;
+        std::vector< std::string_view > messages;
+        std::size_t                     bytes = 0;
+
+        explicit rpc_messages(std::size_t count)
+        {
+            corpus_generator gen(corpus_shape::parse(R"({"depth": 2, "width": [3, 8], "array_length": [0, 4],
+                                                         "string_length": [2, 16], "numbers": {"digits": [1, 8]}})"),
+                                 1);
+            text = gen.generate(count * 1600);
+            for_each_record(text, 0, text.size(), [&](std::string_view line, std::size_t) {
+                if (line.size() >= 100 && line.size() <= 300 && messages.size() < count)
+                {
+                    messages.push_back(line);
+                    bytes += line.size();
+                }
+            });
+        }
+    };
+
+    void
+    bench_parse_batch()
+    {
+        rpc_messages m(20000);
+
+        std::vector< value >              outputs(m.messages.size());
+        std::vector< system::error_code > errors(m.messages.size());
+        // baseline a loop of single parses, variant one batch
+        measure_overhead(
+            "parse_batch",
+            m.bytes,
+            [&] {
+                for (std::size_t i = 0; i < m.messages.size(); ++i)
+                    outputs[i] = parse(m.messages[i], errors[i]);
+            },
+            [&] { parse_batch(m.messages, outputs, errors); });
+    }
+
+    void
+    bench_pmr()
+    {
+        rpc_messages m(20000);
+
+        // each message is parsed and dropped, as a request handler would
+        measure("global allocator", m.bytes, [&] {
+            for (auto msg : m.messages)
+            {
+                system::error_code ec;
+                do_not_optimise(parse(msg, ec));
+            }
+        });
+        measure("pmr new_delete_resource", m.bytes, [&] {
+            for (auto msg : m.messages)
+            {
+                system::error_code ec;
+                do_not_optimise(parse_pmr(msg, std::pmr::new_delete_resource(), ec));
+            }
+        });
+        std::pmr::unsynchronized_pool_resource pool;
+        measure("pmr unsynchronized_pool_resource", m.bytes, [&] {
+            for (auto msg : m.messages)
+            {
+                system::error_code ec;
+                do_not_optimise(parse_pmr(msg, &pool, ec));
+            }
+        });
+        measure("pmr monotonic buffer per message", m.bytes, [&] {
+            for (auto msg : m.messages)
+            {
+                alignas(std::max_align_t) char      buffer[16384];
+                std::pmr::monotonic_buffer_resource mono(buffer, sizeof(buffer));
+                system::error_code                  ec;
+                do_not_optimise(parse_pmr(msg, &mono, ec));
+            }
+        });
+    }
+
+    /// collects every number in a document
+    struct number_collector : null_handler
+    {
+        std::vector< number > numbers;
+
+        void
+        on_number(number const &n, system::error_code &)
+        {
+            numbers.push_back(n);
+        }
+    };
+
+    void
+    bench_float32()
+    {
+        // feature vectors: short decimals, some in scientific notation; then decimals with more digits than
+        // a float holds, which take the slow path
+        std::string features = "[", long_decimals = "[";
+        std::uint64_t x = 1;
+        for (std::size_t i = 0; i < 200000; ++i)
+        {
+            x         = x * 6364136223846793005ull + 1442695040888963407ull;
+            auto sep  = i ? "," : "";
+            auto frac = std::to_string(1000000 + (x >> 40) % 9000000);
+            features += sep;
+            if (i % 4 == 3)
+                features += std::string(x >> 63 ? "-" : "") + frac[0] + "." + frac.substr(1) + "e-" +
+                            std::to_string(1 + (x >> 32) % 8);
+            else
+                features += std::string(x >> 63 ? "-0." : "0.") + frac;
+            long_decimals += sep + std::to_string((x >> 33) % 1000) + "." + std::to_string(100000000000000ull + (x >> 20) % 900000000000000ull);
+        }
+        features += ']';
+        long_decimals += ']';
+
+        for (auto doc : { &features, &long_decimals })
+        {
+            basic_tokenizer< number_collector > tk;
+            tokenize(tk, *doc);
+            auto &      numbers = tk.handler().numbers;
+            std::size_t bytes   = 0;
+            for (auto &n : numbers)
+                bytes += n.mantissa.buffer.size() + n.exponent.buffer.size();
+
+            std::string label = doc == &features ? "features " : "long decimals ";
+            measure(label + "strtod then cast", bytes, [&] {
+                for (auto &n : numbers)
+                {
+                    auto text = n.mantissa.buffer + n.exponent.buffer;
+                    do_not_optimise(float(std::strtod(text.c_str(), nullptr)));
+                }
+            });
+            measure(label + "strtof", bytes, [&] {
+                for (auto &n : numbers)
+                {
+                    auto text = n.mantissa.buffer + n.exponent.buffer;
+                    do_not_optimise(std::strtof(text.c_str(), nullptr));
+                }
+            });
+            measure(label + "to_float", bytes, [&] {
+                for (auto &n : numbers)
+                {
+                    system::error_code ec;
+                    do_not_optimise(to_float(n, ec));
+                }
+            });
+        }
+    }
+
+    void
+    bench_ingest()
+    {
+        // records over loopback from a local load generator, to a sharded server and to one io_context shared
+        // by the same number of threads
+        auto                      threads = std::max(1u, std::thread::hardware_concurrency());
+        corpus_generator          gen(corpus_shape(), 11);
+        std::string               payload(gen.block(0, 4 << 20));
+        std::chrono::milliseconds duration(1500);
+
+        for (bool sharded : { false, true })
+        {
+            ingest_options options;
+            options.threads = threads;
+            options.sharded = sharded;
+            ingest_server server(asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), 0), options);
+            std::thread   runner([&] { server.run(); });
+            auto          load = ingest_load(server.local_endpoint(), 2 * threads, payload, duration);
+            auto          s    = server.stats();
+            server.stop();
+            runner.join();
+
+            std::cout << std::left << std::setw(48)
+                      << (std::string(sharded ? "sharded" : "shared io_context") + " x" + std::to_string(threads))
+                      << std::right << std::fixed << std::setprecision(1) << std::setw(10)
+                      << double(s.bytes) / load.seconds / 1e6 << " MB/s" << std::setw(12)
+                      << double(s.records) / load.seconds / 1e3 << " krecords/s" << std::endl;
+        }
+    }
+
+    void
+    bench_regressions()
+    {
+        // the pathological input families, so that a change which makes one of them superlinear shows up here
+        for (unsigned t = 0; t < perf_target_count; ++t)
+            for (unsigned f = 0; f < perf_family_count; ++f)
+            {
+                auto target = perf_target(t);
+                auto input  = make_perf_input(perf_family(f), 256 << 10);
+                // the number parser stops at the first character of anything but a number
+                if ((target == perf_target::number_parser || target == perf_target::number_parser_bytewise) &&
+                    !(input[0] >= '0' && input[0] <= '9'))
+                    continue;
+                measure(std::string(to_string(target)) + " " + to_string(perf_family(f)), input.size(),
+                        [&] { run_perf_target(target, input); });
+            }
+
+        // and whatever the performance fuzzer found, saved as <target>-<name>.json
+        std::error_code ec;
+        for (auto &entry : std::filesystem::directory_iterator(PROGRAM_REGRESSIONS_DIR, ec))
+        {
+            auto        name = entry.path().filename().string();
+            perf_target target;
+            if (!from_string(name.substr(0, name.find('-')), target))
+                continue;
+            std::ifstream is(entry.path(), std::ios::binary);
+            std::string   input(std::istreambuf_iterator< char >(is), {});
+            measure(name, input.size(), [&] { run_perf_target(target, input); });
+        }
+    }
+
+    /// orders of the shape bench/codegen_order.schema.json describes, one per line
+    std::string
+    order_records(std::size_t count)
+    {
+        static const char *const cities[] = { "Paris", "Oslo", "Lima", "Kyoto" };
+        static const char *const tags[]   = { "\"gift\"", "\"sale\"", "\"new\"", "\"bulk\"" };
+
+        std::string   result;
+        std::uint64_t x = 7;
+        auto          next = [&](std::uint64_t n) {
+            x = x * 6364136223846793005ull + 1442695040888963407ull;
+            return (x >> 33) % n;
+        };
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            auto cents = next(100000);
+            result += "{\"id\":" + std::to_string(i) + ",\"customer\":\"cust-" + std::to_string(next(100000)) +
+                      "\",\"price\":" + std::to_string(cents / 100) + "." + std::to_string(10 + cents % 90) +
+                      ",\"weight\":" + std::to_string(next(30)) + "." + std::to_string(next(1000000)) +
+                      ",\"paid\":" + (next(2) ? "true" : "false");
+            if (next(3) == 0)
+                result += next(2) ? ",\"note\":null" : ",\"note\":\"leave at the door\"";
+            result += ",\"tags\":[";
+            for (std::size_t t = 0, n = next(4); t < n; ++t)
+                result += std::string(t ? "," : "") + tags[next(4)];
+            result += std::string("],\"address\":{\"city\":\"") + cities[next(4)] + "\",\"zip\":\"" +
+                      std::to_string(10000 + next(90000)) + "\"},\"lines\":[";
+            for (std::size_t l = 0, n = 1 + next(3); l < n; ++l)
+                result += std::string(l ? "," : "") + "{\"sku\":\"s" + std::to_string(next(1000)) +
+                          "\",\"qty\":" + std::to_string(1 + next(8)) + "}";
+            result += "]}\n";
+        }
+        return result;
+    }
+
+    void
+    bench_codegen()
+    {
+        auto text = order_records(50000);
+
+        // baseline the DOM, variant the parser generated from the schema
+        measure_overhead(
+            "codegen parse",
+            text.size(),
+            [&] {
+                basic_tokenizer< value_builder > tk;
+                for_each_record(text, 0, text.size(), [&](std::string_view record, std::size_t) {
+                    tk.reset();
+                    tokenize(tk, record);
+                    do_not_optimise(tk.handler().get());
+                });
+            },
+            [&] {
+                codegen_bench::order_parser tk;
+                for_each_record(text, 0, text.size(), [&](std::string_view record, std::size_t) {
+                    tk.reset();
+                    tokenize(tk, record);
+                    do_not_optimise(tk.handler().get());
+                });
+            });
+
+        std::vector< value >               values;
+        std::vector< codegen_bench::order > orders;
+        for_each_record(text, 0, text.size(), [&](std::string_view record, std::size_t) {
+            system::error_code ec;
+            values.push_back(parse(record, ec));
+            orders.push_back(codegen_bench::parse_order(record, ec));
+            if (ec)
+                throw system::system_error(ec, "bench_codegen");
+        });
+        measure_overhead(
+            "codegen serialize",
+            text.size(),
+            [&] {
+                std::string out;
+                for (auto &v : values)
+                {
+                    out.clear();
+                    serialize(v, out);
+                    do_not_optimise(out);
+                }
+            },
+            [&] {
+                json_writer w;
+                for (auto &o : orders)
+                {
+                    w.reset();
+                    write_json(w, o);
+                    do_not_optimise(w.output());
+                }
+            });
+    }
+
+    void
+    bench_intern()
+    {
+        auto                            data = order_records(20000);
+        std::vector< std::string_view > records;
+        for_each_record(data, 0, data.size(), [&](std::string_view line, std::size_t) { records.push_back(line); });
+
+        auto parse_all = [&](pvalue_interner *interner) {
+            std::vector< pvalue > docs;
+            docs.reserve(records.size());
+            for (auto r : records)
+            {
+                system::error_code ec;
+                docs.push_back(parse_persistent(r, ec, interner));
+            }
+            return docs;
+        };
+        measure("persistent parse", data.size(), [&] { do_not_optimise(parse_all(nullptr)); });
+        measure("persistent parse interned", data.size(), [&] {
+            pvalue_interner interner;
+            do_not_optimise(parse_all(&interner));
+        });
+
+        // the heap the documents hold, with the interner's tables and then without them
+        auto report = [](std::string_view label, std::size_t bytes) {
+            std::cout << std::left << std::setw(48) << label << std::right << std::fixed << std::setprecision(1)
+                      << std::setw(10) << double(bytes) / 1e6 << " MB" << std::endl;
+        };
+        auto base = heap_in_use();
+        {
+            auto plain = parse_all(nullptr);
+            report("heap held, plain", heap_in_use() - base);
+        }
+        auto interner = std::make_unique< pvalue_interner >();
+        auto interned = parse_all(interner.get());
+        report("heap held, interned with the interner", heap_in_use() - base);
+        auto stats = interner->stats();
+        interner.reset();
+        report("heap held, interned after dropping the interner", heap_in_use() - base);
+        std::cout << "    " << stats.strings << " strings, " << stats.numbers << " numbers, " << stats.containers
+                  << " containers distinct; " << stats.hits << " values shared" << std::endl;
+    }
+
+    int
+    run(int argc, char **argv)
+    {
+        struct
+        {
+            const char *name;
+            void (*fn)();
+        } const benches[] = {
+            { "unique_keys", bench_unique_keys },
+            { "prefilter", bench_prefilter },
+            { "number_engines", bench_number_engines },
+            { "object_lookup", bench_object_lookup },
+            { "parse_batch", bench_parse_batch },
+            { "pmr", bench_pmr },
+            { "float32", bench_float32 },
+            { "ingest", bench_ingest },
+            { "regressions", bench_regressions },
+            { "codegen", bench_codegen },
+            { "intern", bench_intern },
+        };
+
+        for (auto &b : benches)
+        {
+            bool selected = argc < 2;
+            for (int i = 1; i < argc; ++i)
+                selected = selected || std::strcmp(argv[i], b.name) == 0;
+            if (selected)
+                b.fn();
+        }
+        return 0;
+    }
+}   // namespace program
+
+int
+main(int argc, char **argv)
+{
+    try
+    {
+        return program::run(argc, argv);
+    }
+    catch (...)
+    {
+        std::cerr << program::explain() << std::endl;
+        return 127;
+    }
+}
@@ -0,0 +1,392 @@
+// performance fuzzer for the number parser and the tokenizer
+//
+// Built with clang and -DFUZZ=ON this is a libFuzzer target. The first byte of an input picks the perf_target
+// and the rest is fed to it; an input whose cost exceeds a budget linear in its size is written to
+// $PERF_FUZZ_FINDINGS (default perf-findings) and reported as a crash, so libFuzzer keeps and minimises it.
+//
+// Built otherwise it is a standalone driver:
+//
+//   perf_fuzz scale [<max bytes>] [<save dir>]       grow each pathological family on each target by doubling
+//                                                    and flag costs growing faster than the input
+//   perf_fuzz run <file>...                          check saved findings, or inputs in the libFuzzer format, against
+//                                                    the budget
+//   perf_fuzz fuzz <seconds> [<seed>] [<save dir>]   mutate small seeds at random, checking each against the budget
+//
+// Findings are saved as <target>-<name>.json, holding the input without the byte which picked the target. The
+// regressions benchmark replays them, and so does run, which takes the target from the name.
+
+#include "config.hpp"
+#include "perf_targets.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <new>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// count every allocation, for perf_meter. GCC takes the malloc and free inside the replacements for mismatches.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void *
+operator new(std::size_t n)
+{
+    auto &counts = program::detail::allocation_counts::instance();
+    counts.allocations.fetch_add(1, std::memory_order_relaxed);
+    counts.bytes.fetch_add(n, std::memory_order_relaxed);
+    if (auto p = std::malloc(n ? n : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void
+operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void
+operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+namespace program
+{
+    /// the most an input of a given size may cost. Generous: ordinary documents cost a small fraction of it,
+    /// so anything over it does work out of proportion to its size.
+    struct perf_budget
+    {
+        std::uint64_t instructions_per_byte = 2000;
+        std::uint64_t instructions_fixed    = 200000;
+        std::uint64_t allocations_per_kib   = 16;
+        std::uint64_t allocations_fixed     = 64;
+        std::uint64_t nanoseconds_per_byte  = 2000;   // used only without an instruction counter
+        std::uint64_t nanoseconds_fixed     = 2000000;
+
+        /// a description of how cost exceeds the budget for bytes, or empty
+        std::string
+        exceeded(perf_cost const &cost, std::size_t bytes, bool counted) const
+        {
+            auto allowed_allocations = allocations_fixed + allocations_per_kib * bytes / 1024;
+            if (cost.allocations > allowed_allocations)
+                return std::to_string(cost.allocations) + " allocations, over " + std::to_string(allowed_allocations);
+            if (counted)
+            {
+                auto allowed = instructions_fixed + instructions_per_byte * bytes;
+                if (cost.instructions > allowed)
+                    return std::to_string(cost.instructions) + " instructions, over " + std::to_string(allowed);
+            }
+            else
+            {
+                auto allowed = nanoseconds_fixed + nanoseconds_per_byte * bytes;
+                if (cost.nanoseconds > allowed)
+                    return std::to_string(cost.nanoseconds) + " ns, over " + std::to_string(allowed);
+            }
+            return {};
+        }
+    };
+
+    /// the cheapest of a few runs, which filters out preemption when only time is measured
+    inline perf_cost
+    measure_target(perf_meter &meter, perf_target target, std::string_view input, int runs)
+    {
+        perf_cost best;
+        for (int i = 0; i < runs; ++i)
+        {
+            auto c = meter.measure([&] { run_perf_target(target, input); });
+            if (i == 0 || (meter.counts_instructions() ? c.instructions < best.instructions
+                                                       : c.nanoseconds < best.nanoseconds))
+                best = c;
+        }
+        return best;
+    }
+
+    inline std::uint64_t
+    fnv1a(std::string_view s)
+    {
+        std::uint64_t h = 0xcbf29ce484222325ull;
+        for (unsigned char c : s)
+            h = (h ^ c) * 0x100000001b3ull;
+        return h;
+    }
+
+    /// save input as a regression benchmark for target
+    inline void
+    save_finding(std::string const &dir, perf_target target, std::string const &name, std::string_view input)
+    {
+        std::string path = dir + "/" + to_string(target) + "-" + name + ".json";
+        std::ofstream os(path, std::ios::binary);
+        if (!os.write(input.data(), std::streamsize(input.size())))
+            throw system::system_error(system::error_code(errno, system::system_category()), "write " + path);
+        std::cerr << "saved " << path << '\n';
+    }
+
+    /// check input fed to target against the budget. Returns the finding, or empty.
+    inline std::string
+    check_target(perf_meter &meter, perf_target target, std::string_view input, perf_budget const &budget)
+    {
+        auto cost = measure_target(meter, target, input, 1);
+        auto over = budget.exceeded(cost, input.size(), meter.counts_instructions());
+        // time is noisy, so confirm before reporting
+        if (!over.empty() && !meter.counts_instructions())
+            over = budget.exceeded(measure_target(meter, target, input, 5), input.size(), false);
+        return over.empty() ? over : std::string(to_string(target)) + ": " + over;
+    }
+
+    /// check one input in the libFuzzer format against the budget. Returns the finding, or empty.
+    inline std::string
+    check_input(perf_meter &meter, std::string_view data, perf_budget const &budget)
+    {
+        if (data.empty())
+            return {};
+        auto target = perf_target(static_cast< unsigned char >(data[0]) % perf_target_count);
+        return check_target(meter, target, data.substr(1), budget);
+    }
+}   // namespace program
+
+#if defined(PROGRAM_LIBFUZZER)
+
+extern "C" int
+LLVMFuzzerTestOneInput(const std::uint8_t *data, std::size_t size)
+{
+    using namespace program;
+    static perf_meter  meter;
+    static perf_budget budget;
+
+    std::string_view in(reinterpret_cast< const char * >(data), size);
+    auto             finding = check_input(meter, in, budget);
+    if (!finding.empty())
+    {
+        auto dir = std::getenv("PERF_FUZZ_FINDINGS");
+        auto target = perf_target(static_cast< unsigned char >(in[0]) % perf_target_count);
+        char name[17];
+        std::snprintf(name, sizeof(name), "%016llx", static_cast< unsigned long long >(fnv1a(in)));
+        save_finding(dir ? dir : "perf-findings", target, name, in.substr(1));
+        std::cerr << finding << '\n';
+        std::abort();
+    }
+    return 0;
+}
+
+#else
+
+namespace program
+{
+    int
+    usage()
+    {
+        std::cerr << "usage: perf_fuzz scale [<max bytes>] [<save dir>]\n"
+                     "       perf_fuzz run <file>...\n"
+                     "       perf_fuzz fuzz <seconds> [<seed>] [<save dir>]\n";
+        return 2;
+    }
+
+    /// grow every family on every target and fit the growth of its cost over the larger half of the sizes.
+    /// Linear work gives an exponent near 1; anything much over it is flagged, and saved at the largest size
+    /// no bigger than 256 KiB.
+    int
+    scale(std::size_t max_bytes, std::string const &save)
+    {
+        perf_meter meter;
+        auto       counted = meter.counts_instructions();
+        std::cout << "cost measured in " << (counted ? "instructions" : "nanoseconds (min of 5 runs)") << '\n';
+
+        int flagged = 0;
+        for (unsigned t = 0; t < perf_target_count; ++t)
+            for (unsigned f = 0; f < perf_family_count; ++f)
+            {
+                auto target = perf_target(t);
+                auto family = perf_family(f);
+
+                std::vector< std::size_t > sizes;
+                std::vector< perf_cost >   costs;
+                for (std::size_t n = 1024; n <= max_bytes; n *= 2)
+                {
+                    auto input = make_perf_input(family, n);
+                    sizes.push_back(input.size());
+                    costs.push_back(measure_target(meter, target, input, counted ? 1 : 5));
+                }
+                if (sizes.size() < 2)
+                    continue;
+
+                auto work = [&](perf_cost const &c) { return double(counted ? c.instructions : c.nanoseconds); };
+                auto mid  = sizes.size() / 2;
+                auto growth =
+                    std::log(work(costs.back()) / std::max(1.0, work(costs[mid - 1]))) /
+                    std::log(double(sizes.back()) / double(sizes[mid - 1]));
+                auto allocation_growth =
+                    std::log(double(costs.back().allocations + 1) / double(costs[mid - 1].allocations + 1)) /
+                    std::log(double(sizes.back()) / double(sizes[mid - 1]));
+                bool superlinear = growth > (counted ? 1.15 : 1.3) || allocation_growth > 1.15;
+
+                std::cout << std::left << std::setw(24) << to_string(target) << std::setw(14) << to_string(family)
+                          << std::right << std::fixed << std::setprecision(2) << " growth " << growth
+                          << "  allocations " << allocation_growth << std::setprecision(1) << "  "
+                          << work(costs.back()) / double(sizes.back()) << (counted ? " instructions" : " ns")
+                          << "/byte at " << sizes.back() << (superlinear ? "  SUPERLINEAR" : "") << std::endl;
+
+                if (superlinear)
+                {
+                    ++flagged;
+                    if (!save.empty())
+                        save_finding(save, target, to_string(family),
+                                     make_perf_input(family, std::min< std::size_t >(max_bytes, 256 << 10)));
+                }
+            }
+        return flagged ? 1 : 0;
+    }
+
+    int
+    run_files(int argc, char **argv)
+    {
+        perf_meter  meter;
+        perf_budget budget;
+        int         flagged = 0;
+        for (int i = 2; i < argc; ++i)
+        {
+            std::ifstream is(argv[i], std::ios::binary);
+            if (!is)
+                throw system::system_error(system::error_code(errno, system::system_category()),
+                                           std::string("open ") + argv[i]);
+            std::string data(std::istreambuf_iterator< char >(is), {});
+
+            // a saved finding names its target and holds only the input; anything else is in the libFuzzer
+            // format, as are the crash files libFuzzer writes
+            auto        name = std::filesystem::path(argv[i]).filename().string();
+            perf_target target;
+            auto        finding = from_string(name.substr(0, name.find('-')), target)
+                                      ? check_target(meter, target, data, budget)
+                                      : check_input(meter, data, budget);
+            if (!finding.empty())
+            {
+                ++flagged;
+                std::cout << argv[i] << ": " << finding << '\n';
+            }
+        }
+        return flagged ? 1 : 0;
+    }
+
+    /// a small random mutation fuzzer, for machines without libFuzzer. Inputs grow from the family seeds by
+    /// inserting, repeating and deleting ranges, so costs which need size and structure together can be
+    /// reached.
+    int
+    fuzz(double seconds, std::uint64_t seed, std::string const &save)
+    {
+        perf_meter   meter;
+        perf_budget  budget;
+        std::mt19937_64 rng(seed);
+
+        std::vector< std::string > pool;
+        for (unsigned f = 0; f < perf_family_count; ++f)
+            pool.push_back(make_perf_input(perf_family(f), 64));
+        for (auto s : { "{\"a\":[1,2.5,-3e4,true,null,\"x\\u0041\"]}", "[0.1e-3]", "-12345678901234567890" })
+            pool.emplace_back(s);
+
+        auto          deadline = std::chrono::steady_clock::now() + std::chrono::duration< double >(seconds);
+        std::uint64_t tried    = 0;
+        int           flagged  = 0;
+        while (std::chrono::steady_clock::now() < deadline)
+        {
+            auto input = pool[rng() % pool.size()];
+            for (auto edits = 1 + rng() % 4; edits; --edits)
+            {
+                auto at  = input.empty() ? 0 : std::size_t(rng() % input.size());
+                auto len = std::min< std::size_t >(input.size() - at, 1 + rng() % 16);
+                switch (rng() % 4)
+                {
+                case 0:   // repeat a range
+                {
+                    auto piece = input.substr(at, len);
+                    for (auto n = 1 + rng() % 64; n && input.size() < (1 << 20); --n)
+                        input.insert(at, piece);
+                    break;
+                }
+                case 1:   // delete a range
+                    input.erase(at, len);
+                    break;
+                case 2:   // overwrite a byte with one from the JSON alphabet
+                    if (!input.empty())
+                        input[at] = "[]{}\",:0123456789.eE+-\\u tfn"[rng() % 29];
+                    break;
+                default:   // splice in a piece of another input
+                {
+                    auto &other = pool[rng() % pool.size()];
+                    auto  from  = other.empty() ? 0 : std::size_t(rng() % other.size());
+                    input.insert(at, other.substr(from, 1 + rng() % 32));
+                    break;
+                }
+                }
+            }
+
+            auto target = perf_target(rng() % perf_target_count);
+            auto cost   = measure_target(meter, target, input, 1);
+            auto over   = budget.exceeded(cost, input.size(), meter.counts_instructions());
+            if (!over.empty() && !meter.counts_instructions())
+                over = budget.exceeded(measure_target(meter, target, input, 5), input.size(), false);
+            ++tried;
+            if (!over.empty())
+            {
+                ++flagged;
+                std::cout << to_string(target) << " " << input.size() << " bytes: " << over << '\n';
+                if (!save.empty())
+                {
+                    char name[17];
+                    std::snprintf(name, sizeof(name), "%016llx", static_cast< unsigned long long >(fnv1a(input)));
+                    save_finding(save, target, name, input);
+                }
+            }
+            if (pool.size() < 4096 && input.size() < (1 << 16))
+                pool.push_back(std::move(input));
+        }
+        std::cout << tried << " inputs tried, " << flagged << " over budget\n";
+        return flagged ? 1 : 0;
+    }
+
+    int
+    run(int argc, char **argv)
+    {
+        if (argc < 2)
+            return usage();
+        std::string command = argv[1];
+        if (command == "scale" && argc <= 4)
+            return scale(argc > 2 ? std::stoull(argv[2]) : 1 << 20, argc > 3 ? argv[3] : "");
+        if (command == "run" && argc > 2)
+            return run_files(argc, argv);
+        if (command == "fuzz" && argc > 2 && argc <= 5)
+            return fuzz(std::stod(argv[2]), argc > 3 ? std::stoull(argv[3]) : 1, argc > 4 ? argv[4] : "");
+        return usage();
+    }
+}   // namespace program
+
+int
+main(int argc, char **argv)
+{
+    try
+    {
+        return program::run(argc, argv);
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+        return 2;
+    }
+}
+
+#endif
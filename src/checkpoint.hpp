@@ -0,0 +1,454 @@
+#pragma once
+
+#include "config.hpp"
+#include "error.hpp"
+#include "pointer.hpp"
+#include "tokenizer.hpp"
+#include "value.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace program
+{
+    /// a point in a document just after a value, from which parsing can resume.
+    /// path holds the open containers, outermost first, with the key or index of the value just completed in
+    /// each.
+    struct checkpoint
+    {
+        std::uint64_t               offset = 0;
+        std::vector< path_segment > path;
+
+        /// the tokenizer's nesting stack at this point
+        std::vector< char >
+        stack() const
+        {
+            std::vector< char > result;
+            result.reserve(path.size());
+            for (auto &s : path)
+                result.push_back(s.is_object ? '{' : '[');
+            return result;
+        }
+    };
+
+    /// continue tokenizing a document from a checkpoint. Feed the tokenizer the input starting at cp.offset.
+    template < class Handler >
+    void
+    resume(basic_tokenizer< Handler > &tk, checkpoint const &cp)
+    {
+        tk.resume(cp.stack(), std::size_t(cp.offset));
+    }
+
+    /// checkpoints taken at value boundaries roughly every interval bytes through a document.
+    /// Checkpoints are only ever taken between tokens, so resuming needs nothing but the nesting of the
+    /// containers; no partially parsed token is ever recorded.
+    struct checkpoint_index
+    {
+        std::uint64_t             interval = 0;
+        std::uint64_t             size     = 0;   // of the document indexed
+        std::vector< checkpoint > checkpoints;
+
+        /// index a whole document. Throws system_error if it is not valid JSON.
+        static checkpoint_index
+        build(std::string_view document, std::size_t interval)
+        {
+            checkpoint_index result;
+            result.interval = interval;
+            result.size     = document.size();
+
+            basic_tokenizer< recorder > tk(recorder { &result, nullptr, {}, 0 });
+            tk.handler().tk = &tk;
+            if (auto ec = tokenize(tk, document))
+                throw system::system_error(ec, "checkpoint_index::build");
+            return result;
+        }
+
+        /// the last checkpoint at or before offset, or nullptr if there is none
+        checkpoint const *
+        before(std::uint64_t offset) const
+        {
+            auto it = std::upper_bound(checkpoints.begin(),
+                                       checkpoints.end(),
+                                       offset,
+                                       [](std::uint64_t o, checkpoint const &cp) { return o < cp.offset; });
+            return it == checkpoints.begin() ? nullptr : &*(it - 1);
+        }
+
+        /// the last checkpoint before element index of a top level array, or nullptr if there is none
+        checkpoint const *
+        before_element(std::size_t index) const
+        {
+            auto it = std::partition_point(checkpoints.begin(), checkpoints.end(), [&](checkpoint const &cp) {
+                return !cp.path.empty() && !cp.path[0].is_object && cp.path[0].index < index;
+            });
+            return it == checkpoints.begin() ? nullptr : &*(it - 1);
+        }
+
+        void
+        save(std::ostream &os) const
+        {
+            os.write(magic, sizeof(magic));
+            put(os, interval);
+            put(os, size);
+            put(os, std::uint64_t(checkpoints.size()));
+            for (auto &cp : checkpoints)
+            {
+                put(os, cp.offset);
+                put(os, std::uint32_t(cp.path.size()));
+                for (auto &s : cp.path)
+                {
+                    put(os, std::uint8_t(s.is_object));
+                    put(os, std::uint64_t(s.index));
+                    put(os, std::uint32_t(s.key.size()));
+                    os.write(s.key.data(), std::streamsize(s.key.size()));
+                }
+            }
+            if (!os)
+                throw system::system_error(make_error_code(error::bad_index), "checkpoint_index::save");
+        }
+
+        /// Throws system_error(error::bad_index) if the index is malformed. Counts and lengths are checked against
+        /// the bytes left in the stream, so a corrupt index cannot make it allocate more than the stream holds.
+        static checkpoint_index
+        load(std::istream &is)
+        {
+            checkpoint_index result;
+            auto             left = remaining(is);
+            char             m[sizeof(magic)];
+            is.read(m, sizeof(m));
+            if (!is || !std::equal(m, m + sizeof(m), magic))
+                bad();
+            left -= sizeof(m);
+            result.interval = get< std::uint64_t >(is, left);
+            result.size     = get< std::uint64_t >(is, left);
+            auto count      = get< std::uint64_t >(is, left);
+            // the smallest checkpoint is an offset and a depth of zero; the smallest segment has an empty key
+            constexpr std::uint64_t checkpoint_bytes = 8 + 4, segment_bytes = 1 + 8 + 4;
+            if (count > left / checkpoint_bytes)
+                bad();
+            for (std::uint64_t i = 0; i < count; ++i)
+            {
+                checkpoint cp;
+                cp.offset  = get< std::uint64_t >(is, left);
+                auto depth = get< std::uint32_t >(is, left);
+                if (depth > left / segment_bytes)
+                    bad();
+                for (std::uint32_t d = 0; d < depth; ++d)
+                {
+                    path_segment s;
+                    s.is_object = get< std::uint8_t >(is, left) != 0;
+                    s.index     = std::size_t(get< std::uint64_t >(is, left));
+                    auto length = get< std::uint32_t >(is, left);
+                    if (length > left)
+                        bad();
+                    // in pieces, so that a stream which cannot tell its size must back a length with data
+                    while (s.key.size() < length)
+                    {
+                        auto n = std::min< std::size_t >(length - s.key.size(), 65536);
+                        s.key.resize(s.key.size() + n);
+                        is.read(&s.key[s.key.size() - n], std::streamsize(n));
+                        if (!is)
+                            bad();
+                    }
+                    left -= length;
+                    cp.path.push_back(std::move(s));
+                }
+                result.checkpoints.push_back(std::move(cp));
+            }
+            return result;
+        }
+
+      private:
+        static constexpr char magic[8] = { 'J', 'S', 'O', 'N', 'C', 'K', 'P', '1' };
+
+        /// takes a checkpoint at the first value boundary after each interval
+        struct recorder
+        {
+            checkpoint_index *                owner;
+            basic_tokenizer< recorder > const *tk;
+            std::vector< path_segment >       path;
+            std::uint64_t                     last;
+
+            void
+            on_object_begin(system::error_code &)
+            {
+                value_start();
+                path.push_back({ true, {}, std::size_t(-1) });
+            }
+            void
+            on_object_end(system::error_code &)
+            {
+                path.pop_back();
+                value_end();
+            }
+            void
+            on_array_begin(system::error_code &)
+            {
+                value_start();
+                path.push_back({ false, {}, std::size_t(-1) });
+            }
+            void
+            on_array_end(system::error_code &)
+            {
+                path.pop_back();
+                value_end();
+            }
+            void
+            on_key(std::string_view key, system::error_code &)
+            {
+                path.back().key.assign(key.data(), key.size());
+            }
+            void
+            on_string(std::string_view, system::error_code &)
+            {
+                scalar();
+            }
+            number_range const *
+            on_number_begin(system::error_code &)
+            {
+                return nullptr;
+            }
+            void
+            on_number(number const &, system::error_code &)
+            {
+                scalar();
+            }
+            void
+            on_bool(bool, system::error_code &)
+            {
+                scalar();
+            }
+            void
+            on_null(system::error_code &)
+            {
+                scalar();
+            }
+
+            void
+            scalar()
+            {
+                value_start();
+                value_end();
+            }
+
+            void
+            value_start()
+            {
+                if (!path.empty() && !path.back().is_object)
+                    ++path.back().index;
+            }
+
+            void
+            value_end()
+            {
+                auto offset = std::uint64_t(tk->offset());
+                if (path.empty() || offset - last < owner->interval)
+                    return;
+                owner->checkpoints.push_back({ offset, path });
+                last = offset;
+            }
+        };
+
+        [[noreturn]] static void
+        bad()
+        {
+            throw system::system_error(make_error_code(error::bad_index), "checkpoint_index::load");
+        }
+
+        template < class T >
+        static void
+        put(std::ostream &os, T x)
+        {
+            os.write(reinterpret_cast< const char * >(&x), sizeof(x));
+        }
+
+        /// the bytes from the read position to the end of is, or as many as could ever be read if it cannot seek
+        static std::uint64_t
+        remaining(std::istream &is)
+        {
+            auto here = is.tellg();
+            if (here == std::istream::pos_type(-1))
+            {
+                is.clear();
+                return std::numeric_limits< std::uint64_t >::max();
+            }
+            is.seekg(0, std::ios::end);
+            auto end = is.tellg();
+            is.seekg(here);
+            if (!is || end == std::istream::pos_type(-1))
+                bad();
+            return std::uint64_t(end - here);
+        }
+
+        template < class T >
+        static T
+        get(std::istream &is, std::uint64_t &left)
+        {
+            T x;
+            if (left < sizeof(x))
+                bad();
+            is.read(reinterpret_cast< char * >(&x), sizeof(x));
+            if (!is)
+                bad();
+            left -= sizeof(x);
+            return x;
+        }
+    };
+
+    namespace detail
+    {
+        /// counts the elements of the top level array and builds the one wanted
+        struct element_reader
+        {
+            std::size_t   depth;
+            std::size_t   index;
+            std::size_t   wanted;
+            std::size_t   capture_depth = 0;
+            bool          done          = false;
+            value_builder builder {};
+
+            void
+            on_object_begin(system::error_code &ec)
+            {
+                container_begin([&] { builder.on_object_begin(ec); });
+            }
+            void
+            on_object_end(system::error_code &ec)
+            {
+                container_end([&] { builder.on_object_end(ec); });
+            }
+            void
+            on_array_begin(system::error_code &ec)
+            {
+                container_begin([&] { builder.on_array_begin(ec); });
+            }
+            void
+            on_array_end(system::error_code &ec)
+            {
+                container_end([&] { builder.on_array_end(ec); });
+            }
+            void
+            on_key(std::string_view key, system::error_code &ec)
+            {
+                if (capture_depth)
+                    builder.on_key(key, ec);
+            }
+            void
+            on_string(std::string_view s, system::error_code &ec)
+            {
+                scalar([&] { builder.on_string(s, ec); });
+            }
+            number_range const *
+            on_number_begin(system::error_code &)
+            {
+                return nullptr;
+            }
+            void
+            on_number(number const &n, system::error_code &ec)
+            {
+                scalar([&] { builder.on_number(n, ec); });
+            }
+            void
+            on_bool(bool b, system::error_code &ec)
+            {
+                scalar([&] { builder.on_bool(b, ec); });
+            }
+            void
+            on_null(system::error_code &ec)
+            {
+                scalar([&] { builder.on_null(ec); });
+            }
+
+            /// true if the value starting now is the one wanted
+            bool
+            element_start()
+            {
+                return depth == 1 && ++index == wanted;
+            }
+
+            template < class Build >
+            void
+            container_begin(Build build)
+            {
+                if (done)
+                    return;
+                if (capture_depth || element_start())
+                {
+                    ++capture_depth;
+                    build();
+                }
+                ++depth;
+            }
+
+            template < class Build >
+            void
+            container_end(Build build)
+            {
+                --depth;
+                if (done || !capture_depth)
+                    return;
+                build();
+                done = --capture_depth == 0;
+            }
+
+            template < class Build >
+            void
+            scalar(Build build)
+            {
+                if (done)
+                    return;
+                if (capture_depth || element_start())
+                {
+                    build();
+                    done = capture_depth == 0;
+                }
+            }
+        };
+    }   // namespace detail
+
+    /// read element of the top level array of document, starting from the nearest checkpoint before it rather
+    /// than the beginning. Sets ec to error::no_such_path if there is no such element.
+    inline value
+    read_element(std::string_view       document,
+                 checkpoint_index const &index,
+                 std::size_t            element,
+                 system::error_code &   ec)
+    {
+        if (index.size != document.size())
+        {
+            ec = error::bad_index;
+            return {};
+        }
+
+        basic_tokenizer< detail::element_reader > tk(detail::element_reader { 0, std::size_t(-1), element });
+        std::size_t                               start = 0;
+        if (auto cp = index.before_element(element))
+        {
+            resume(tk, *cp);
+            tk.handler().depth = cp->path.size();
+            tk.handler().index = cp->path[0].index;
+            start              = std::size_t(cp->offset);
+        }
+
+        // feed in slices so that parsing stops soon after the element is complete
+        constexpr std::size_t slice = 65536;
+        auto                  p     = document.data() + start;
+        auto                  end   = document.data() + document.size();
+        while (p != end && !tk.is_complete() && !tk.error() && !tk.handler().done)
+            p = tk(p, p + std::min< std::size_t >(slice, std::size_t(end - p)));
+        if (!tk.handler().done)
+        {
+            tk.finalise();
+            ec = tk.error() ? tk.error() : system::error_code(error::no_such_path);
+            return {};
+        }
+        return std::move(tk.handler().builder.get());
+    }
+}   // namespace program
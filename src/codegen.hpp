@@ -0,0 +1,962 @@
+#pragma once
+
+#include "config.hpp"
+#include "decimal.hpp"
+#include "error.hpp"
+#include "schema.hpp"
+#include "serializer.hpp"
+#include "value.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <set>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace program
+{
+    struct codegen_options
+    {
+        /// the root type; the handler, parser and functions are named after it
+        std::string name = "document";
+        /// namespace of the generated code, which may be nested with ::, or empty for the global namespace
+        std::string name_space;
+        /// how the generated header includes codegen_support.hpp
+        std::string include = "codegen_support.hpp";
+    };
+
+    namespace detail
+    {
+        enum class codegen_kind
+        {
+            integer,   // std::int64_t
+            fixed,     // fixed_point< scale >, for numbers with a multipleOf of 10^-scale
+            number,    // double
+            string,
+            boolean,
+            array,
+            object,
+            any,   // value, for shapes with no single type
+        };
+
+        struct codegen_type
+        {
+            static constexpr std::size_t none = std::size_t(-1);
+
+            codegen_kind kind  = codegen_kind::any;
+            unsigned     scale = 0;
+            std::size_t  items = none;    // element type of an array
+            std::size_t  shape = none;    // struct of an object
+            std::size_t  slot  = none;    // where elements of an array are stored
+        };
+
+        struct codegen_field
+        {
+            std::string key;
+            std::string name;
+            std::size_t type;
+            std::size_t slot     = codegen_type::none;
+            bool        required = false;
+            bool        nullable = false;
+        };
+
+        struct codegen_struct
+        {
+            std::string                  name;
+            std::vector< codegen_field > fields;
+        };
+
+        /// a place a value is stored: the root, a field of a struct, or the elements of an array
+        struct codegen_slot
+        {
+            std::size_t type;
+            std::size_t shape = codegen_type::none;   // owning struct of a field
+            std::size_t field = codegen_type::none;
+            std::size_t array = codegen_type::none;   // array type of an element
+            std::string path;
+        };
+
+        /// the shape of the documents a schema describes, as the types, structs and slots to be generated
+        struct codegen_model
+        {
+            static constexpr std::size_t max_fields = 64;
+
+            std::vector< codegen_type >   types;
+            std::vector< codegen_struct > structs;
+            std::vector< codegen_slot >   slots;
+            std::set< std::string >       struct_names;
+            /// names of the members of every struct, which no struct may take: a member would hide it in the
+            /// struct holding a field of its type
+            std::set< std::string >       member_names;
+
+            void
+            build(value const &schema, std::string const &name)
+            {
+                // the names of structs and fields are joined to it by _
+                member_names = { "present", "null", "required" };
+                if (!is_identifier(name) || name.front() == '_' || name.back() == '_' ||
+                    name.find("__") != std::string::npos)
+                    invalid("name must be an identifier without a leading, trailing or double _");
+                if (member_names.count(name))
+                    invalid("name must not be present, null or required");
+                struct_names = { name + "_handler", name + "_parser" };
+                auto root = add(schema, name, false);
+                slots.push_back({ root, codegen_type::none, codegen_type::none, codegen_type::none, name });
+                for (std::size_t s = 0; s < slots.size(); ++s)
+                {
+                    // slots grows as it is walked, so copy what is needed first
+                    auto &t    = types[slots[s].type];
+                    auto  path = slots[s].path;
+                    if (t.kind == codegen_kind::array)
+                    {
+                        t.slot = slots.size();
+                        slots.push_back(
+                            { t.items, codegen_type::none, codegen_type::none, slots[s].type, path + "[]" });
+                    }
+                    else if (t.kind == codegen_kind::object)
+                    {
+                        auto shape = t.shape;
+                        for (std::size_t f = 0; f < structs[shape].fields.size(); ++f)
+                        {
+                            structs[shape].fields[f].slot = slots.size();
+                            slots.push_back({ structs[shape].fields[f].type, shape, f, codegen_type::none,
+                                              path + "." + structs[shape].fields[f].name });
+                        }
+                    }
+                }
+            }
+
+            std::string
+            cpp_type(std::size_t index) const
+            {
+                auto &t = types[index];
+                switch (t.kind)
+                {
+                case codegen_kind::integer:
+                    return "std::int64_t";
+                case codegen_kind::fixed:
+                    return "program::fixed_point< " + std::to_string(t.scale) + " >";
+                case codegen_kind::number:
+                    return "double";
+                case codegen_kind::string:
+                    return "std::string";
+                case codegen_kind::boolean:
+                    return "bool";
+                case codegen_kind::array:
+                    return "std::vector< " + cpp_type(t.items) + " >";
+                case codegen_kind::object:
+                    return structs[t.shape].name;
+                case codegen_kind::any:
+                    break;
+                }
+                return "program::value";
+            }
+
+            [[noreturn]] static void
+            invalid(const char *what)
+            {
+                throw system::system_error(make_error_code(error::invalid_schema), what);
+            }
+
+            static bool
+            is_identifier(std::string_view s)
+            {
+                if (s.empty() || (s[0] >= '0' && s[0] <= '9'))
+                    return false;
+                for (auto c : s)
+                    if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_'))
+                        return false;
+                return !is_keyword(s);
+            }
+
+            static bool
+            is_keyword(std::string_view s)
+            {
+                static const char *const keywords[] = {
+                    "alignas",   "alignof",   "and",        "asm",      "auto",     "bool",      "break",
+                    "case",      "catch",     "char",       "class",    "const",    "constexpr", "continue",
+                    "decltype",  "default",   "delete",     "do",       "double",   "else",      "enum",
+                    "explicit",  "export",    "extern",     "false",    "float",    "for",       "friend",
+                    "goto",      "if",        "inline",     "int",      "long",     "mutable",   "namespace",
+                    "new",       "noexcept",  "not",        "nullptr",  "operator", "or",        "private",
+                    "protected", "public",    "register",   "return",   "short",    "signed",    "sizeof",
+                    "static",    "struct",    "switch",     "template", "this",     "throw",     "true",
+                    "try",       "typedef",   "typeid",     "typename", "union",    "unsigned",  "using",
+                    "virtual",   "void",      "volatile",   "while",    "xor",
+                };
+                for (auto k : keywords)
+                    if (s == k)
+                        return true;
+                return false;
+            }
+
+            /// key made into an identifier: each run of other characters becomes one _, with none left at either
+            /// end, and a result which begins with a digit or is a keyword gains the prefix field_, or is field if
+            /// empty. The identifier never holds the double or leading _ of reserved names, nor do the struct
+            /// names joined from it by _.
+            static std::string
+            identifier(std::string_view key)
+            {
+                std::string result;
+                for (auto c : key)
+                    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))
+                        result += c;
+                    else if (!result.empty() && result.back() != '_')
+                        result += '_';
+                if (!result.empty() && result.back() == '_')
+                    result.pop_back();
+                if (result.empty())
+                    result = "field";
+                else if ((result[0] >= '0' && result[0] <= '9') || is_keyword(result))
+                    result.insert(0, "field_");
+                return result;
+            }
+
+            std::string
+            unique_struct_name(std::string name)
+            {
+                auto base = name;
+                for (int i = 2; member_names.count(name) || !struct_names.insert(name).second; ++i)
+                    name = base + "_" + std::to_string(i);
+                return name;
+            }
+
+            /// as compiled_schema reads type, except that number does not include integer
+            static unsigned
+            type_bits(value const &v)
+            {
+                auto s = v.if_is< std::string >();
+                if (!s)
+                    invalid("type must be a string");
+                if (*s == "null")
+                    return schema_null;
+                if (*s == "boolean")
+                    return schema_boolean;
+                if (*s == "integer")
+                    return schema_integer;
+                if (*s == "number")
+                    return schema_number;
+                if (*s == "string")
+                    return schema_string;
+                if (*s == "array")
+                    return schema_array;
+                if (*s == "object")
+                    return schema_object;
+                invalid("unknown type");
+            }
+
+            /// the scale of a multipleOf which is a power of ten no greater than one, or -1
+            static int
+            fixed_scale(value const &multiple)
+            {
+                auto n = multiple.if_is< number >();
+                if (!n)
+                    invalid("multipleOf must be a number");
+                auto d = to_decimal(*n);
+                if (d.negative || d.digits != "1" || d.exponent > 1 || d.exponent < -17)
+                    return -1;
+                return int(1 - d.exponent);
+            }
+
+            /// add the type schema describes, naming a struct for it name. Null among several types is taken
+            /// to mean a field may be null, when nullable permits that.
+            std::size_t
+            add(value const &schema, std::string const &name, bool nullable_permitted, bool *nullable = nullptr)
+            {
+                auto index = types.size();
+                types.emplace_back();
+                auto obj = schema.if_is< object >();
+                if (!obj)
+                {
+                    if (!schema.if_is< bool >())
+                        invalid("schema must be an object");
+                    return index;
+                }
+
+                unsigned bits = 0;
+                if (auto t = obj->find("type"))
+                {
+                    if (auto list = t->if_is< array >())
+                        for (auto &e : *list)
+                            bits |= type_bits(e);
+                    else
+                        bits = type_bits(*t);
+                }
+                else if (obj->find("properties"))
+                    bits = schema_object;
+                else if (obj->find("items"))
+                    bits = schema_array;
+
+                if ((bits & schema_null) && bits != schema_null && nullable_permitted)
+                {
+                    bits &= ~unsigned(schema_null);
+                    *nullable = true;
+                }
+                if (bits == (schema_integer | schema_number))
+                    bits = schema_number;
+
+                codegen_type t;
+                switch (bits)
+                {
+                case schema_integer:
+                    t.kind = codegen_kind::integer;
+                    break;
+                case schema_number:
+                    t.kind = codegen_kind::number;
+                    if (auto m = obj->find("multipleOf"))
+                    {
+                        auto scale = fixed_scale(*m);
+                        if (scale == 0)
+                            t.kind = codegen_kind::integer;
+                        else if (scale > 0)
+                        {
+                            t.kind  = codegen_kind::fixed;
+                            t.scale = unsigned(scale);
+                        }
+                    }
+                    break;
+                case schema_string:
+                    t.kind = codegen_kind::string;
+                    break;
+                case schema_boolean:
+                    t.kind = codegen_kind::boolean;
+                    break;
+                case schema_array:
+                    // elements which may be null have no place in a vector of their type, so become values
+                    t.kind = codegen_kind::array;
+                    if (auto items = obj->find("items"))
+                        t.items = add(*items, name + "_item", false);
+                    else
+                        t.items = add(true, name + "_item", false);
+                    break;
+                case schema_object:
+                {
+                    auto props = obj->find("properties");
+                    if (!props)
+                        break;
+                    auto p = props->if_is< object >();
+                    if (!p)
+                        invalid("properties must be an object");
+                    if (p->members().empty())
+                        break;
+                    if (p->members().size() > max_fields)
+                        invalid("an object may have at most 64 properties");
+                    t.kind  = codegen_kind::object;
+                    t.shape = structs.size();
+                    structs.push_back({ unique_struct_name(name), {} });
+
+                    // a member takes neither a name the struct already has nor that of a struct, which it would hide
+                    std::set< std::string > reserved = { "present", "null", "required" };
+                    auto taken = [&](std::string const &n) { return reserved.count(n) || struct_names.count(n); };
+                    for (auto &m : p->members())
+                    {
+                        auto base  = identifier(m.first);
+                        auto ident = base;
+                        for (int i = 2; taken(ident) || taken("has_" + ident); ++i)
+                            ident = base + "_" + std::to_string(i);
+                        reserved.insert(ident);
+                        reserved.insert("has_" + ident);
+                        member_names.insert(ident);
+                        member_names.insert("has_" + ident);
+
+                        codegen_field field;
+                        field.key   = m.first;
+                        field.name  = ident;
+                        field.type  = add(m.second, structs[t.shape].name + "_" + ident, true, &field.nullable);
+                        if (types[field.type].kind == codegen_kind::any)
+                            field.nullable = false;
+                        structs[t.shape].fields.push_back(std::move(field));
+                    }
+
+                    if (auto req = obj->find("required"))
+                    {
+                        auto list = req->if_is< array >();
+                        if (!list)
+                            invalid("required must be an array");
+                        for (auto &e : *list)
+                        {
+                            auto key = e.if_is< std::string >();
+                            if (!key)
+                                invalid("required keys must be strings");
+                            for (auto &f : structs[t.shape].fields)
+                                if (f.key == *key)
+                                    f.required = true;
+                        }
+                    }
+                    break;
+                }
+                default:
+                    break;
+                }
+                types[index] = t;
+                return index;
+            }
+        };
+
+        /// s as the body of a C++ string literal
+        inline std::string
+        cpp_string(std::string_view s)
+        {
+            static const char hex[] = "0123456789abcdef";
+            std::string       result;
+            bool              after_hex = false;
+            for (auto c : s)
+            {
+                auto u = static_cast< unsigned char >(c);
+                // a hex escape runs on through any hex digits, so one is never followed by a plain one
+                bool is_hex = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+                if (c == '"' || c == '\\')
+                {
+                    result += '\\';
+                    result += c;
+                }
+                else if (u >= 0x20 && u < 0x7f && !(after_hex && is_hex))
+                    result += c;
+                else
+                {
+                    result += "\\x";
+                    result += hex[u >> 4];
+                    result += hex[u & 15];
+                    after_hex = true;
+                    continue;
+                }
+                after_hex = false;
+            }
+            return result;
+        }
+
+        /// emits the header for a model
+        struct codegen_writer
+        {
+            codegen_model const &  m;
+            codegen_options const &options;
+            std::ostringstream     os;
+
+            enum class event
+            {
+                object_begin,
+                array_begin,
+                string,
+                number,
+                boolean,
+                null,
+            };
+
+            std::string
+            run()
+            {
+                auto &root = m.slots[0];
+                auto  type = m.cpp_type(root.type);
+                auto &name = options.name;
+
+                os << "// generated by json_codegen; do not edit\n"
+                      "\n"
+                      "#pragma once\n"
+                      "\n"
+                      "#include \""
+                   << options.include
+                   << "\"\n"
+                      "\n"
+                      "#include <cstdint>\n"
+                      "#include <cstring>\n"
+                      "#include <string>\n"
+                      "#include <string_view>\n"
+                      "#include <utility>\n"
+                      "#include <vector>\n"
+                      "\n";
+                if (!options.name_space.empty())
+                    os << "namespace " << options.name_space << "\n{\n";
+                os << "using program::write_json;\n";
+
+                // nested structs before the structs which hold them
+                std::vector< std::size_t > order;
+                for (auto s = m.slots.size(); s-- > 0;)
+                {
+                    auto &t = m.types[m.slots[s].type];
+                    if (t.kind == codegen_kind::object)
+                        order.push_back(t.shape);
+                }
+                for (auto i : order)
+                    emit_struct(m.structs[i]);
+                for (auto i : order)
+                    emit_writer(m.structs[i]);
+                if (m.types[root.type].kind != codegen_kind::object)
+                    os << "\nusing " << name << " = " << type << ";\n";
+
+                emit_handler();
+
+                os << "\n/// tokenizer which fills a " << name << ", resumable across chunks of input\n"
+                   << "using " << name << "_parser = program::basic_tokenizer< " << name << "_handler >;\n"
+                   << "\n"
+                      "/// parse a complete document held in memory\n"
+                      "inline "
+                   << name << "\nparse_" << name << "(std::string_view input, program::system::error_code &ec)\n"
+                   << "{\n"
+                   << "    " << name << "_parser tk;\n"
+                   << "    ec = program::tokenize(tk, input);\n"
+                   << "    return std::move(tk.handler().get());\n"
+                   << "}\n"
+                   << "\n"
+                      "/// v as compact JSON\n"
+                      "inline std::string\nserialize_"
+                   << name << "(" << name << " const &v)\n"
+                   << "{\n"
+                      "    program::json_writer w;\n"
+                      "    write_json(w, v);\n"
+                      "    return std::move(w.output());\n"
+                      "}\n";
+                if (!options.name_space.empty())
+                    os << "}   // namespace " << options.name_space << "\n";
+                return os.str();
+            }
+
+            void
+            emit_struct(codegen_struct const &s)
+            {
+                os << "\nstruct " << s.name << "\n{\n";
+                for (std::size_t i = 0; i < s.fields.size(); ++i)
+                    os << "    static constexpr std::uint64_t has_" << s.fields[i].name
+                       << " = std::uint64_t(1) << " << i << ";\n";
+                os << "    static constexpr std::uint64_t required = ";
+                bool any = false;
+                for (auto &f : s.fields)
+                    if (f.required)
+                    {
+                        os << (any ? " | " : "") << "has_" << f.name;
+                        any = true;
+                    }
+                os << (any ? ";\n" : "0;\n");
+                os << "\n    /// has_ bits of the fields which were present\n"
+                      "    std::uint64_t present = 0;\n"
+                      "    /// has_ bits of the fields which were present but null\n"
+                      "    std::uint64_t null = 0;\n\n";
+                for (auto &f : s.fields)
+                    os << "    " << m.cpp_type(f.type) << " " << f.name << " {};\n";
+                os << "};\n";
+            }
+
+            void
+            emit_writer(codegen_struct const &s)
+            {
+                os << "\ninline void\nwrite_json(program::json_writer &w, " << s.name << " const &v)\n"
+                   << "{\n"
+                      "    program::system::error_code ec;\n"
+                      "    w.on_object_begin(ec);\n";
+                for (auto &f : s.fields)
+                {
+                    std::string key;
+                    append_json_string(key, f.key);
+                    key += ':';
+                    auto indent = "    ";
+                    if (!f.required)
+                    {
+                        os << "    if (v.present & " << s.name << "::has_" << f.name << ")\n    {\n";
+                        indent = "        ";
+                    }
+                    os << indent << "w.raw_key(\"" << cpp_string(key) << "\");\n";
+                    if (f.nullable)
+                        os << indent << "if (v.null & " << s.name << "::has_" << f.name << ")\n"
+                           << indent << "    w.on_null(ec);\n"
+                           << indent << "else\n"
+                           << indent << "    write_json(w, v." << f.name << ");\n";
+                    else
+                        os << indent << "write_json(w, v." << f.name << ");\n";
+                    if (!f.required)
+                        os << "    }\n";
+                }
+                os << "    w.on_object_end(ec);\n"
+                      "}\n";
+            }
+
+            bool
+            accepts(std::size_t slot, event e) const
+            {
+                auto &t = m.types[m.slots[slot].type];
+                if (t.kind == codegen_kind::any)
+                    return true;
+                switch (e)
+                {
+                case event::object_begin:
+                    return t.kind == codegen_kind::object;
+                case event::array_begin:
+                    return t.kind == codegen_kind::array;
+                case event::string:
+                    return t.kind == codegen_kind::string;
+                case event::number:
+                    return t.kind == codegen_kind::integer || t.kind == codegen_kind::fixed ||
+                           t.kind == codegen_kind::number;
+                case event::boolean:
+                    return t.kind == codegen_kind::boolean;
+                case event::null:
+                    return is_nullable(slot);
+                }
+                return false;
+            }
+
+            bool
+            is_nullable(std::size_t slot) const
+            {
+                auto &s = m.slots[slot];
+                return s.shape != codegen_type::none && m.structs[s.shape].fields[s.field].nullable;
+            }
+
+            /// the cases of the switch on slot_ for event e, each leaving place bound to where the value goes
+            void
+            emit_cases(event e)
+            {
+                const char *in = "        ";
+                for (std::size_t slot = 0; slot < m.slots.size(); ++slot)
+                {
+                    if (!accepts(slot, e))
+                        continue;
+                    auto &s = m.slots[slot];
+                    auto &t = m.types[s.type];
+                    os << "    case " << slot << ":   // " << s.path << "\n    {\n";
+                    if (s.shape != codegen_type::none)
+                    {
+                        auto &owner = m.structs[s.shape];
+                        auto &f     = owner.fields[s.field];
+                        auto  bit   = owner.name + "::has_" + f.name;
+                        os << in << "auto &o = *static_cast< " << owner.name << " * >(stack_.back().target);\n"
+                           << in << "o.present |= " << bit << ";\n";
+                        if (f.nullable && e == event::null)
+                        {
+                            os << in << "o.null |= " << bit << ";\n" << in << "return;\n    }\n";
+                            continue;
+                        }
+                        if (f.nullable)
+                            os << in << "o.null &= ~" << bit << ";\n";
+                        os << in << "auto &&place = o." << f.name << ";\n";
+                    }
+                    else if (s.array != codegen_type::none)
+                        os << in << "auto &&place = static_cast< " << m.cpp_type(s.array)
+                           << " * >(stack_.back().target)->emplace_back();\n";
+                    else
+                        os << in << "auto &&place = value_;\n";
+
+                    if (t.kind == codegen_kind::any)
+                        switch (e)
+                        {
+                        case event::object_begin:
+                            os << in << "capture_ = &place;\n" << in << "nested_  = 1;\n"
+                               << in << "builder_.on_object_begin(ec);\n";
+                            break;
+                        case event::array_begin:
+                            os << in << "capture_ = &place;\n" << in << "nested_  = 1;\n"
+                               << in << "builder_.on_array_begin(ec);\n";
+                            break;
+                        case event::string:
+                            os << in << "place = std::string(s);\n";
+                            break;
+                        case event::number:
+                            os << in << "place = n;\n";
+                            break;
+                        case event::boolean:
+                            os << in << "place = b;\n";
+                            break;
+                        case event::null:
+                            os << in << "place = nullptr;\n";
+                            break;
+                        }
+                    else
+                        switch (e)
+                        {
+                        case event::object_begin:
+                            os << in << "place = " << m.cpp_type(s.type) << "();\n"
+                               << in << "stack_.push_back({ " << t.shape << ", false, &place });\n";
+                            break;
+                        case event::array_begin:
+                            os << in << "place.clear();\n"
+                               << in << "stack_.push_back({ " << t.slot << ", true, &place });\n"
+                               << in << "slot_ = " << t.slot << ";\n";
+                            break;
+                        case event::string:
+                            os << in << "place.assign(s.data(), s.size());\n";
+                            break;
+                        case event::number:
+                            os << in << "program::read_number(n, place, ec);\n";
+                            break;
+                        case event::boolean:
+                            os << in << "place = b;\n";
+                            break;
+                        case event::null:
+                            break;
+                        }
+                    os << in << "return;\n    }\n";
+                }
+            }
+
+            void
+            emit_value_event(const char *signature, event e, const char *forward)
+            {
+                os << "\nvoid\n" << signature << "\n{\n";
+                if (e == event::object_begin || e == event::array_begin)
+                    os << "    if (nested_)\n"
+                          "    {\n"
+                          "        ++nested_;\n"
+                          "        if (capture_)\n"
+                          "            builder_."
+                       << forward
+                       << ";\n"
+                          "        return;\n"
+                          "    }\n";
+                else
+                    os << "    if (nested_)\n"
+                          "    {\n"
+                          "        if (capture_)\n"
+                          "            builder_."
+                       << forward
+                       << ";\n"
+                          "        return;\n"
+                          "    }\n";
+                os << "    switch (slot_)\n"
+                      "    {\n"
+                      "    case skip:\n";
+                if (e == event::object_begin || e == event::array_begin)
+                    os << "        nested_ = 1;\n";
+                os << "        return;\n";
+                emit_cases(e);
+                os << "    default:\n"
+                      "        ec = program::error::type_mismatch;\n"
+                      "        return;\n"
+                      "    }\n"
+                      "}\n";
+            }
+
+            void
+            emit_key_match(codegen_struct const &s)
+            {
+                std::vector< std::size_t > lengths;
+                for (auto &f : s.fields)
+                    lengths.push_back(f.key.size());
+                std::sort(lengths.begin(), lengths.end());
+                lengths.erase(std::unique(lengths.begin(), lengths.end()), lengths.end());
+
+                os << "        switch (key.size())\n"
+                      "        {\n";
+                for (auto length : lengths)
+                {
+                    os << "        case " << length << ":\n";
+                    for (auto &f : s.fields)
+                    {
+                        if (f.key.size() != length)
+                            continue;
+                        if (length == 0)
+                            os << "            slot_ = " << f.slot << ";\n"
+                               << "            return;\n";
+                        else
+                            os << "            if (std::memcmp(key.data(), \"" << cpp_string(f.key) << "\", " << length
+                               << ") == 0)\n"
+                               << "            {\n"
+                               << "                slot_ = " << f.slot << ";\n"
+                               << "                return;\n"
+                               << "            }\n";
+                    }
+                    os << "            break;\n";
+                }
+                os << "        }\n"
+                      "        break;\n";
+            }
+
+            void
+            emit_handler()
+            {
+                auto &name = options.name;
+                auto  type = m.cpp_type(m.slots[0].type);
+
+                os << "\n/// tokenizer handler which fills a " << name
+                   << ". Unknown keys are skipped; values of the wrong type fail with\n"
+                      "/// error::type_mismatch, and objects missing a required key with error::missing_required_key.\n"
+                      "struct "
+                   << name << "_handler\n{\n";
+
+                std::ostringstream body;
+                std::swap(os, body);
+
+                os << "/// the document most recently parsed\n"
+                   << type << " &\nget()\n{\n    return value_;\n}\n"
+                   << "\n/// prepare for another document\n"
+                      "void\nreset()\n{\n"
+                      "    stack_.clear();\n"
+                      "    slot_    = 0;\n"
+                      "    nested_  = 0;\n"
+                      "    capture_ = nullptr;\n"
+                      "    builder_ = program::value_builder();\n"
+                      "}\n";
+
+                emit_value_event("on_object_begin(program::system::error_code &ec)", event::object_begin,
+                                 "on_object_begin(ec)");
+
+                os << "\nvoid\non_object_end(program::system::error_code &ec)\n"
+                      "{\n"
+                      "    if (nested_)\n"
+                      "    {\n"
+                      "        end_nested(ec, false);\n"
+                      "        return;\n"
+                      "    }\n"
+                      "    auto &top = stack_.back();\n"
+                      "    switch (top.id)\n"
+                      "    {\n";
+                for (std::size_t i = 0; i < m.structs.size(); ++i)
+                {
+                    auto &s = m.structs[i];
+                    bool  any_required = false;
+                    for (auto &f : s.fields)
+                        any_required = any_required || f.required;
+                    if (!any_required)
+                        continue;
+                    os << "    case " << i << ":   // " << s.name << "\n"
+                       << "        if ((static_cast< " << s.name << " * >(top.target)->present & " << s.name
+                       << "::required) != " << s.name << "::required)\n"
+                       << "        {\n"
+                          "            ec = program::error::missing_required_key;\n"
+                          "            return;\n"
+                          "        }\n"
+                          "        break;\n";
+                }
+                os << "    default:\n"
+                      "        break;\n"
+                      "    }\n"
+                      "    pop();\n"
+                      "}\n";
+
+                emit_value_event("on_array_begin(program::system::error_code &ec)", event::array_begin,
+                                 "on_array_begin(ec)");
+
+                os << "\nvoid\non_array_end(program::system::error_code &ec)\n"
+                      "{\n"
+                      "    if (nested_)\n"
+                      "    {\n"
+                      "        end_nested(ec, true);\n"
+                      "        return;\n"
+                      "    }\n"
+                      "    pop();\n"
+                      "}\n";
+
+                os << "\nvoid\non_key(std::string_view key, program::system::error_code &ec)\n"
+                      "{\n"
+                      "    if (nested_)\n"
+                      "    {\n"
+                      "        if (capture_)\n"
+                      "            builder_.on_key(key, ec);\n"
+                      "        return;\n"
+                      "    }\n"
+                      "    switch (stack_.back().id)\n"
+                      "    {\n";
+                for (std::size_t i = 0; i < m.structs.size(); ++i)
+                {
+                    os << "    case " << i << ":   // " << m.structs[i].name << "\n";
+                    emit_key_match(m.structs[i]);
+                }
+                os << "    default:\n"
+                      "        break;\n"
+                      "    }\n"
+                      "    slot_ = skip;\n"
+                      "}\n";
+
+                emit_value_event("on_string(std::string_view s, program::system::error_code &ec)", event::string,
+                                 "on_string(s, ec)");
+                os << "\nprogram::number_range const *\non_number_begin(program::system::error_code &)\n"
+                      "{\n"
+                      "    return nullptr;\n"
+                      "}\n";
+                emit_value_event("on_number(program::number const &n, program::system::error_code &ec)",
+                                 event::number, "on_number(n, ec)");
+                emit_value_event("on_bool(bool b, program::system::error_code &ec)", event::boolean,
+                                 "on_bool(b, ec)");
+                emit_value_event("on_null(program::system::error_code &ec)", event::null, "on_null(ec)");
+
+                os << "\nprivate:\n"
+                      "struct frame\n"
+                      "{\n"
+                      "    unsigned id;     // the struct of an object, or the slot of an array's elements\n"
+                      "    bool     array;\n"
+                      "    void *   target;\n"
+                      "};\n"
+                      "\n"
+                      "/// slot_ for the value of a key which is not in the schema\n"
+                      "static constexpr unsigned skip = "
+                   << m.slots.size()
+                   << ";\n"
+                      "\n"
+                      "void\npop()\n"
+                      "{\n"
+                      "    stack_.pop_back();\n"
+                      "    if (stack_.empty())\n"
+                      "        slot_ = 0;\n"
+                      "    else if (stack_.back().array)\n"
+                      "        slot_ = stack_.back().id;\n"
+                      "}\n"
+                      "\n"
+                      "/// the end of a container being skipped, or captured as a value\n"
+                      "void\nend_nested(program::system::error_code &ec, bool array)\n"
+                      "{\n"
+                      "    if (capture_)\n"
+                      "    {\n"
+                      "        if (array)\n"
+                      "            builder_.on_array_end(ec);\n"
+                      "        else\n"
+                      "            builder_.on_object_end(ec);\n"
+                      "    }\n"
+                      "    if (--nested_ == 0 && capture_)\n"
+                      "    {\n"
+                      "        *capture_ = std::move(builder_.get());\n"
+                      "        capture_  = nullptr;\n"
+                      "    }\n"
+                      "}\n"
+                      "\n"
+                   << type
+                   << " value_ {};\n"
+                      "std::vector< frame > stack_;\n"
+                      "/// where the next value goes\n"
+                      "unsigned slot_ = 0;\n"
+                      "/// depth within a value being skipped or captured\n"
+                      "unsigned nested_ = 0;\n"
+                      "program::value * capture_ = nullptr;\n"
+                      "program::value_builder builder_;\n";
+
+                std::swap(os, body);
+                std::istringstream lines(body.str());
+                std::string        line;
+                while (std::getline(lines, line))
+                {
+                    if (line.empty())
+                        os << '\n';
+                    else if (line == "private:")
+                        os << "  private:\n";
+                    else
+                        os << "    " << line << '\n';
+                }
+                os << "};\n";
+            }
+        };
+    }   // namespace detail
+
+    /// C++ source for a header declaring structs which hold documents matching schema, a tokenizer handler
+    /// which fills them, and functions writing them back out as JSON.
+    /// Objects with properties become structs, with a bit in a mask for each field recording whether it was
+    /// present; keys are matched by length and then by comparing bytes, with no lookup. Integers are read as
+    /// std::int64_t, numbers with a multipleOf of 10^-k as fixed_point< k > and other numbers as double. A field
+    /// whose types include null records a null in a second mask. Anything else, such as a value which may have
+    /// several types, is kept as a value. Fails with error::invalid_schema.
+    inline std::string
+    generate_parser(value const &schema, codegen_options const &options = {})
+    {
+        detail::codegen_model model;
+        model.build(schema, options.name);
+        detail::codegen_writer writer { model, options, {} };
+        return writer.run();
+    }
+
+    inline std::string
+    generate_parser(std::string_view schema_text, codegen_options const &options = {})
+    {
+        system::error_code ec;
+        auto               schema = parse(schema_text, ec);
+        if (ec)
+            throw system::system_error(ec, "generate_parser");
+        return generate_parser(schema, options);
+    }
+}   // namespace program
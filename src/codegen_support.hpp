@@ -0,0 +1,200 @@
+#pragma once
+
+#include "config.hpp"
+#include "decimal.hpp"
+#include "error.hpp"
+#include "float32.hpp"
+#include "number_parser.hpp"
+#include "serializer.hpp"
+#include "tokenizer.hpp"
+#include "value.hpp"
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace program
+{
+    // Conversions and writers used by the parsers and serializers which generate_parser emits.
+
+    /// a decimal held exactly as a count of units of 10^-Scale
+    template < unsigned Scale >
+    struct fixed_point
+    {
+        static_assert(Scale <= 18, "fixed_point scale is limited to 18 digits");
+
+        static constexpr unsigned scale = Scale;
+
+        std::int64_t units = 0;
+
+        friend bool
+        operator==(fixed_point l, fixed_point r)
+        {
+            return l.units == r.units;
+        }
+
+        friend bool
+        operator!=(fixed_point l, fixed_point r)
+        {
+            return l.units != r.units;
+        }
+    };
+
+    namespace detail
+    {
+        /// n * 10^scale, if that is an integer which fits
+        inline system::error_code
+        to_scaled_int64(number const &n, unsigned scale, std::int64_t &result)
+        {
+            auto d = to_decimal(n);
+            result = 0;
+            if (d.is_zero())
+                return {};
+            auto point = d.exponent + static_cast< long long >(scale);
+            if (point < static_cast< long long >(d.digits.size()))
+                return error::type_mismatch;
+            if (point > 19)
+                return error::out_of_range;
+            std::uint64_t magnitude = 0;
+            auto limit = std::uint64_t(std::numeric_limits< std::int64_t >::max()) + (d.negative ? 1 : 0);
+            for (long long i = 0; i < point; ++i)
+            {
+                auto digit = std::size_t(i) < d.digits.size() ? unsigned(d.digits[std::size_t(i)] - '0') : 0u;
+                if (magnitude > (limit - digit) / 10)
+                    return error::out_of_range;
+                magnitude = magnitude * 10 + digit;
+            }
+            result = d.negative ? std::int64_t(0 - magnitude) : std::int64_t(magnitude);
+            return {};
+        }
+
+        constexpr double exact_powers_of_ten[] = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                                   1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                                   1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    }   // namespace detail
+
+    /// fails with error::type_mismatch if n is not integral and error::out_of_range if it does not fit
+    inline void
+    read_number(number const &n, std::int64_t &result, system::error_code &ec)
+    {
+        if (auto e = detail::to_scaled_int64(n, 0, result))
+            ec = e;
+    }
+
+    /// fails with error::type_mismatch if n has more than Scale fraction digits and error::out_of_range if it
+    /// does not fit
+    template < unsigned Scale >
+    void
+    read_number(number const &n, fixed_point< Scale > &result, system::error_code &ec)
+    {
+        if (auto e = detail::to_scaled_int64(n, Scale, result.units))
+            ec = e;
+    }
+
+    /// the double nearest n. Numbers beyond the range of double set ec to error::out_of_range.
+    inline void
+    read_number(number const &n, double &result, system::error_code &ec)
+    {
+        // significands of 53 bits or fewer scaled by an exactly representable power of ten round once
+        auto d = detail::read_float_digits(n.mantissa.buffer, n.exponent.buffer);
+        if (!d.truncated && d.significand <= (std::uint64_t(1) << 53) && d.power >= -22 && d.power <= 22)
+        {
+            result = double(d.significand);
+            if (d.power < 0)
+                result /= detail::exact_powers_of_ten[-d.power];
+            else
+                result *= detail::exact_powers_of_ten[d.power];
+            if (d.negative)
+                result = -result;
+            return;
+        }
+        auto text = n.mantissa.buffer + n.exponent.buffer;
+        result    = std::strtod(text.c_str(), nullptr);
+        if (std::isinf(result))
+            ec = error::out_of_range;
+    }
+
+    inline void
+    write_json(json_writer &w, bool b)
+    {
+        w.raw(b ? std::string_view("true") : std::string_view("false"));
+    }
+
+    inline void
+    write_json(json_writer &w, std::int64_t i)
+    {
+        char buffer[24];
+        auto r = std::to_chars(buffer, buffer + sizeof(buffer), i);
+        w.raw(std::string_view(buffer, std::size_t(r.ptr - buffer)));
+    }
+
+    /// shortest text which reads back as d. JSON has no infinities or NaN, so those are written as null.
+    inline void
+    write_json(json_writer &w, double d)
+    {
+        if (!std::isfinite(d))
+        {
+            w.raw("null");
+            return;
+        }
+        char buffer[32];
+        auto r = std::to_chars(buffer, buffer + sizeof(buffer), d);
+        w.raw(std::string_view(buffer, std::size_t(r.ptr - buffer)));
+    }
+
+    /// every digit of the scale is written, so 1.5 with a scale of 2 is 1.50
+    template < unsigned Scale >
+    void
+    write_json(json_writer &w, fixed_point< Scale > f)
+    {
+        char buffer[48];
+        auto magnitude = f.units < 0 ? std::uint64_t(0) - std::uint64_t(f.units) : std::uint64_t(f.units);
+        auto end       = buffer + sizeof(buffer);
+        auto p         = end;
+        for (unsigned i = 0; i < Scale; ++i)
+        {
+            *--p = char('0' + magnitude % 10);
+            magnitude /= 10;
+        }
+        if (Scale)
+            *--p = '.';
+        do
+        {
+            *--p = char('0' + magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude);
+        if (f.units < 0)
+            *--p = '-';
+        w.raw(std::string_view(p, std::size_t(end - p)));
+    }
+
+    inline void
+    write_json(json_writer &w, std::string const &s)
+    {
+        system::error_code ec;
+        w.on_string(s, ec);
+    }
+
+    inline void
+    write_json(json_writer &w, value const &v)
+    {
+        w.write(v);
+    }
+
+    template < class T >
+    void
+    write_json(json_writer &w, std::vector< T > const &elements)
+    {
+        system::error_code ec;
+        w.on_array_begin(ec);
+        for (T const &e : elements)
+            write_json(w, e);
+        w.on_array_end(ec);
+    }
+}   // namespace program
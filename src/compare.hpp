@@ -0,0 +1,614 @@
+#pragma once
+
+#include "config.hpp"
+#include "decimal.hpp"
+#include "error.hpp"
+#include "pointer.hpp"
+#include "tokenizer.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <istream>
+#include <map>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace program
+{
+    /// compares two documents as they stream in, without building either of them.
+    /// Numbers are compared by value, so 1.0 == 1. Object members match by key in any order, unless
+    /// member_order_matters: the members of objects which list their keys alike are compared as they stream,
+    /// and once the keys of an object part company the rest of its members are buffered until their
+    /// counterparts arrive. A difference found among buffered members is followed down into them, so it is
+    /// reported as deep as one found in order. Among buffered members, and in objects nested in them, which of
+    /// two members with the same key to compare is ambiguous, so a repeated key is error::duplicate_key.
+    /// given sc is an instance of stream_comparator:
+    /// while there is input on either side and !sc.done()
+    ///   next = sc.feed(side, begin, end);
+    /// sc.finalise();
+    /// Feed whichever side has_pending() is false for; the events buffered are then bounded by
+    /// one chunk's worth.
+    struct stream_comparator
+    {
+        enum side_type
+        {
+            left  = 0,
+            right = 1,
+        };
+
+        explicit stream_comparator(bool member_order_matters = false)
+        : sides_ { side(recorder { this, left }), side(recorder { this, right }) }
+        , member_order_matters_(member_order_matters)
+        {
+        }
+
+        stream_comparator(stream_comparator const &) = delete;
+        stream_comparator &
+        operator=(stream_comparator const &) = delete;
+
+        using const_iterator = const char *;
+
+        const_iterator
+        feed(side_type s, const_iterator begin, const_iterator end)
+        {
+            auto &tk = sides_[s];
+            if (done() || tk.is_complete())
+                return begin;
+            auto next = tk(begin, end);
+            check_side(s);
+            return next;
+        }
+
+        /// signal the end of one input
+        void
+        finalise(side_type s)
+        {
+            if (done())
+                return;
+            sides_[s].finalise();
+            check_side(s);
+        }
+
+        /// signal the end of both inputs
+        void
+        finalise()
+        {
+            finalise(left);
+            finalise(right);
+            if (!done() && (!queue(left).empty() || !queue(right).empty()))
+                differ();
+        }
+
+        /// true once a difference or an error has been found, or both documents are complete and equal
+        bool
+        done() const
+        {
+            return difference_ || error_ || (sides_[left].is_complete() && sides_[right].is_complete());
+        }
+
+        bool
+        has_pending(side_type s) const
+        {
+            return !queue(s).empty();
+        }
+
+        /// true once the value on this side is complete; anything after it is not examined
+        bool
+        is_complete(side_type s) const
+        {
+            return sides_[s].is_complete();
+        }
+
+        bool
+        equal() const
+        {
+            return done() && !difference_ && !error_;
+        }
+
+        /// JSON pointer to the first point of difference
+        std::optional< std::string > const &
+        difference() const
+        {
+            return difference_;
+        }
+
+        /// syntax error in either document, or error::duplicate_key
+        system::error_code const &
+        error() const
+        {
+            return error_;
+        }
+
+      private:
+        struct event
+        {
+            enum kind_type
+            {
+                object_begin,
+                object_end,
+                array_begin,
+                array_end,
+                key,
+                string,
+                number,
+                boolean,
+                null,
+            };
+
+            kind_type   kind;
+            std::string text;
+            decimal     num;
+            bool        flag = false;
+
+            bool
+            starts_value() const
+            {
+                return kind != object_end && kind != array_end && kind != key;
+            }
+
+            friend bool
+            operator==(event const &l, event const &r)
+            {
+                if (l.kind != r.kind)
+                    return false;
+                switch (l.kind)
+                {
+                case key:
+                case string:
+                    return l.text == r.text;
+                case number:
+                    return l.num == r.num;
+                case boolean:
+                    return l.flag == r.flag;
+                default:
+                    return true;
+                }
+            }
+        };
+
+        /// records the events of one document and lets the comparator consume them as they pair up
+        struct recorder
+        {
+            stream_comparator *owner;
+            side_type          s;
+
+            void
+            on_object_begin(system::error_code &ec)
+            {
+                push({ event::object_begin, {}, {} }, ec);
+            }
+            void
+            on_object_end(system::error_code &ec)
+            {
+                push({ event::object_end, {}, {} }, ec);
+            }
+            void
+            on_array_begin(system::error_code &ec)
+            {
+                push({ event::array_begin, {}, {} }, ec);
+            }
+            void
+            on_array_end(system::error_code &ec)
+            {
+                push({ event::array_end, {}, {} }, ec);
+            }
+            void
+            on_key(std::string_view key, system::error_code &ec)
+            {
+                push({ event::key, std::string(key), {} }, ec);
+            }
+            void
+            on_string(std::string_view str, system::error_code &ec)
+            {
+                push({ event::string, std::string(str), {} }, ec);
+            }
+            number_range const *
+            on_number_begin(system::error_code &)
+            {
+                return nullptr;
+            }
+            void
+            on_number(number const &n, system::error_code &ec)
+            {
+                push({ event::number, {}, to_decimal(n) }, ec);
+            }
+            void
+            on_bool(bool b, system::error_code &ec)
+            {
+                push({ event::boolean, {}, {}, b }, ec);
+            }
+            void
+            on_null(system::error_code &ec)
+            {
+                push({ event::null, {}, {} }, ec);
+            }
+
+            void
+            push(event e, system::error_code &ec)
+            {
+                owner->queues_[s].push_back(std::move(e));
+                if (!owner->drain())
+                    ec = error::documents_differ;
+            }
+        };
+
+        using side = basic_tokenizer< recorder >;
+
+        std::deque< event > &
+        queue(side_type s)
+        {
+            return queues_[s];
+        }
+
+        std::deque< event > const &
+        queue(side_type s) const
+        {
+            return queues_[s];
+        }
+
+        void
+        check_side(side_type s)
+        {
+            auto &ec = sides_[s].error();
+            if (ec && ec != error::documents_differ && !difference_)
+                error_ = ec;
+        }
+
+        /// consume matching pairs of events. Returns false on the first mismatch.
+        bool
+        drain()
+        {
+            auto &l = queues_[left];
+            auto &r = queues_[right];
+            for (;;)
+            {
+                if (unordered_)
+                {
+                    if (!drain_unordered())
+                        return false;
+                    if (unordered_)
+                        return true;
+                }
+                if (l.empty() || r.empty())
+                    return true;
+                auto &e = l.front();
+                auto &o = r.front();
+                if ((e.starts_value() || o.starts_value()) && !path_.empty() && !path_.back().is_object)
+                    ++path_.back().index;
+                if (!(e == o) && !member_order_matters_ && (e.kind == event::key || o.kind == event::key))
+                {
+                    unordered_.emplace();
+                    continue;
+                }
+                if (e.kind == event::key || o.kind == event::key)
+                    path_.back().key = e.kind == event::key ? e.text : o.text;
+                if (!(e == o))
+                {
+                    differ();
+                    return false;
+                }
+                if (e.kind == event::object_begin)
+                    path_.push_back({ true, {} });
+                else if (e.kind == event::array_begin)
+                    path_.push_back({ false, {} });
+                else if (e.kind == event::object_end || e.kind == event::array_end)
+                    path_.pop_back();
+                l.pop_front();
+                r.pop_front();
+            }
+        }
+
+        /// a value under construction in canonical form: scalars are tagged and length prefixed, and the
+        /// members of objects are sorted by key
+        struct canonical_container
+        {
+            bool                                                 is_object;
+            std::string                                          text;
+            std::vector< std::pair< std::string, std::string > > members;
+            std::string                                          key;
+        };
+
+        /// the rest of the members of an object, from the first key which differs between the sides.
+        /// Members of one side wait, in canonical form, until the other side produces the same key.
+        struct unordered_members
+        {
+            struct side_state
+            {
+                std::map< std::string, std::string > waiting;
+                std::vector< canonical_container >   stack;
+                std::string                          key;
+                bool                                 ended = false;
+            };
+
+            side_state              sides[2];
+            std::set< std::string > matched;   // keys which have been on both sides
+        };
+
+        static void
+        append_token(std::string &out, char kind, std::string_view text)
+        {
+            out += kind;
+            out += std::to_string(text.size());
+            out += ':';
+            out.append(text.begin(), text.end());
+        }
+
+        static std::string
+        canonical(event const &e)
+        {
+            std::string result;
+            switch (e.kind)
+            {
+            case event::string:
+                append_token(result, 's', e.text);
+                break;
+            case event::number:
+            {
+                std::ostringstream ss;
+                ss << e.num;
+                append_token(result, 'n', ss.str());
+                break;
+            }
+            case event::boolean:
+                result = e.flag ? "t" : "f";
+                break;
+            default:
+                result = "z";
+                break;
+            }
+            return result;
+        }
+
+        /// consume the events of both sides member by member. Returns false on the first mismatch.
+        bool
+        drain_unordered()
+        {
+            for (auto s : { left, right })
+            {
+                auto &state = unordered_->sides[s];
+                auto &q     = queues_[s];
+                while (!state.ended && !q.empty())
+                {
+                    auto e = std::move(q.front());
+                    q.pop_front();
+                    if (!consume_unordered(s, std::move(e)))
+                        return false;
+                }
+            }
+
+            auto &sides = unordered_->sides;
+            if (!sides[left].ended || !sides[right].ended)
+                return true;
+            for (auto s : { left, right })
+                if (!sides[s].waiting.empty())
+                {
+                    path_.back().key = sides[s].waiting.begin()->first;
+                    differ();
+                    return false;
+                }
+            unordered_.reset();
+            path_.pop_back();
+            return true;
+        }
+
+        bool
+        consume_unordered(side_type s, event e)
+        {
+            auto &state = unordered_->sides[s];
+            auto &stack = state.stack;
+            std::string value;
+            switch (e.kind)
+            {
+            case event::key:
+                (stack.empty() ? state.key : stack.back().key) = std::move(e.text);
+                return true;
+            case event::object_begin:
+            case event::array_begin:
+                stack.push_back({ e.kind == event::object_begin, {}, {}, {} });
+                return true;
+            case event::object_end:
+                if (stack.empty())
+                {
+                    state.ended = true;
+                    return true;
+                }
+                std::sort(stack.back().members.begin(), stack.back().members.end());
+                if (std::adjacent_find(stack.back().members.begin(),
+                                       stack.back().members.end(),
+                                       [](auto const &l, auto const &r) { return l.first == r.first; }) !=
+                    stack.back().members.end())
+                {
+                    error_ = error::duplicate_key;
+                    return false;
+                }
+                value = "{";
+                for (auto &m : stack.back().members)
+                {
+                    append_token(value, 'k', m.first);
+                    value += m.second;
+                }
+                value += '}';
+                stack.pop_back();
+                break;
+            case event::array_end:
+                value = '[' + stack.back().text + ']';
+                stack.pop_back();
+                break;
+            default:
+                value = canonical(e);
+                break;
+            }
+
+            if (!stack.empty())
+            {
+                auto &top = stack.back();
+                if (top.is_object)
+                    top.members.emplace_back(std::move(top.key), std::move(value));
+                else
+                    top.text += value;
+                return true;
+            }
+
+            if (state.waiting.count(state.key) || unordered_->matched.count(state.key))
+            {
+                error_ = error::duplicate_key;
+                return false;
+            }
+            auto &other = unordered_->sides[1 - s].waiting;
+            auto  match = other.find(state.key);
+            if (match == other.end())
+            {
+                state.waiting.emplace(std::move(state.key), std::move(value));
+                return true;
+            }
+            if (match->second != value)
+            {
+                path_.back().key = state.key;
+                descend(match->second, value);
+                differ();
+                return false;
+            }
+            other.erase(match);
+            unordered_->matched.insert(std::move(state.key));
+            return true;
+        }
+
+        /// the text of the length prefixed token at the front of s, which is removed
+        static std::string_view
+        take_token(std::string_view &s)
+        {
+            auto colon = s.find(':');
+            auto size  = std::size_t(std::stoull(std::string(s.substr(1, colon - 1))));
+            auto text  = s.substr(colon + 1, size);
+            s.remove_prefix(colon + 1 + size);
+            return text;
+        }
+
+        /// the canonical value at the front of s, which is removed
+        static std::string_view
+        take_value(std::string_view &s)
+        {
+            auto start = s;
+            switch (s.front())
+            {
+            case 's':
+            case 'n':
+                take_token(s);
+                break;
+            case '{':
+                for (s.remove_prefix(1); s.front() != '}';)
+                {
+                    take_token(s);
+                    take_value(s);
+                }
+                s.remove_prefix(1);
+                break;
+            case '[':
+                for (s.remove_prefix(1); s.front() != ']';)
+                    take_value(s);
+                s.remove_prefix(1);
+                break;
+            default:
+                s.remove_prefix(1);
+                break;
+            }
+            return start.substr(0, start.size() - s.size());
+        }
+
+        /// extend path_ from a member whose canonical values l and r differ to where they first differ: the
+        /// first element of arrays which differs, or is on one side only, and likewise the first key of objects
+        /// in key order
+        void
+        descend(std::string_view l, std::string_view r)
+        {
+            while (l.front() == r.front() && (l.front() == '{' || l.front() == '['))
+            {
+                path_segment segment { l.front() == '{', {}, 0 };
+                auto         close = segment.is_object ? '}' : ']';
+                l.remove_prefix(1);
+                r.remove_prefix(1);
+                for (;; ++segment.index)
+                {
+                    if (l.front() == close || r.front() == close)
+                    {
+                        if (segment.is_object)
+                            segment.key = take_token(l.front() == close ? r : l);
+                        path_.push_back(std::move(segment));
+                        return;
+                    }
+                    if (segment.is_object)
+                    {
+                        auto lk = take_token(l), rk = take_token(r);
+                        segment.key = std::min(lk, rk);
+                        if (lk != rk)
+                        {
+                            // the smaller key is the one the other side lacks
+                            path_.push_back(std::move(segment));
+                            return;
+                        }
+                    }
+                    auto lv = take_value(l), rv = take_value(r);
+                    if (lv != rv)
+                    {
+                        path_.push_back(std::move(segment));
+                        l = lv;
+                        r = rv;
+                        break;
+                    }
+                }
+            }
+        }
+
+        void
+        differ()
+        {
+            difference_ = to_pointer(path_);
+        }
+
+        side                               sides_[2];
+        std::deque< event >                queues_[2];
+        bool                               member_order_matters_;
+        std::optional< unordered_members > unordered_;
+        std::vector< path_segment >        path_;
+        std::optional< std::string > difference_;
+        system::error_code           error_;
+    };
+
+    /// compare the first value of two streams chunk by chunk. Returns the JSON pointer of the first difference,
+    /// or nothing if the values are equal. Throws system_error if either stream is not valid JSON, or repeats a
+    /// key where stream_comparator cannot tell which member to compare.
+    inline std::optional< std::string >
+    compare_streams(std::istream &left,
+                    std::istream &right,
+                    std::size_t   chunk_size          = 65536,
+                    bool          member_order_matters = false)
+    {
+        stream_comparator sc(member_order_matters);
+        std::string       buffer(chunk_size, '\0');
+        std::istream *    streams[2] = { &left, &right };
+
+        while (!sc.done())
+        {
+            auto s = stream_comparator::left;
+            if (sc.has_pending(s) || sc.is_complete(s))
+                s = stream_comparator::right;
+            if (sc.is_complete(s))
+                break;
+            streams[s]->read(&buffer[0], std::streamsize(chunk_size));
+            auto n = std::size_t(streams[s]->gcount());
+            if (n)
+                sc.feed(s, buffer.data(), buffer.data() + n);
+            else
+                sc.finalise(s);
+        }
+        sc.finalise();
+        if (sc.error())
+            throw system::system_error(sc.error(), "compare_streams");
+        return sc.difference();
+    }
+}   // namespace program
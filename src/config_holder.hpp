@@ -0,0 +1,261 @@
+#pragma once
+
+#include "config.hpp"
+#include "persistent.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace program
+{
+    /// epoch based reclamation shared by every config_holder in the process.
+    /// Each thread which reads owns a record, found through a thread_local pointer, in which it announces the
+    /// global epoch it entered in, or zero while it is outside any read. A writer unlinks an object, then
+    /// advances the global epoch and tags the object with the new value; the object may be deleted once every
+    /// active record shows an epoch at least as recent as its tag, since any reader which entered before the
+    /// unlink announced an older one. Readers only store to their own cache line.
+    struct epoch_domain
+    {
+        static epoch_domain &
+        instance()
+        {
+            static epoch_domain domain;
+            return domain;
+        }
+
+        /// enter a read on the calling thread. Reads may nest.
+        void
+        enter()
+        {
+            auto &r = local();
+            if (r.depth++ == 0)
+                r.epoch.store(epoch_.load(std::memory_order_acquire), std::memory_order_seq_cst);
+        }
+
+        void
+        leave()
+        {
+            auto &r = local();
+            if (--r.depth == 0)
+                r.epoch.store(0, std::memory_order_release);
+        }
+
+        /// advance the global epoch, returning the new one. Called after unlinking.
+        std::uint64_t
+        advance()
+        {
+            return epoch_.fetch_add(1, std::memory_order_seq_cst) + 1;
+        }
+
+        /// the oldest epoch any thread is reading in, or the current one if none is reading
+        std::uint64_t
+        oldest_active() const
+        {
+            auto oldest = epoch_.load(std::memory_order_seq_cst);
+            for (auto r = head_.load(std::memory_order_acquire); r; r = r->next)
+            {
+                auto e = r->epoch.load(std::memory_order_seq_cst);
+                if (e && e < oldest)
+                    oldest = e;
+            }
+            return oldest;
+        }
+
+      private:
+        struct alignas(64) record
+        {
+            std::atomic< std::uint64_t > epoch { 0 };
+            std::atomic< bool >          in_use { true };
+            unsigned                     depth = 0;
+            record *                     next  = nullptr;
+        };
+
+        /// gives the thread's record back for reuse when the thread exits
+        struct lease
+        {
+            record *r = nullptr;
+
+            ~lease()
+            {
+                if (r)
+                    r->in_use.store(false, std::memory_order_release);
+            }
+        };
+
+        epoch_domain() = default;
+
+        // records are never freed, since a scanning writer may be reading one; a thread reuses a released
+        // record if there is one
+        record &
+        local()
+        {
+            thread_local lease l;
+            if (!l.r)
+                l.r = acquire();
+            return *l.r;
+        }
+
+        record *
+        acquire()
+        {
+            for (auto r = head_.load(std::memory_order_acquire); r; r = r->next)
+            {
+                bool expected = false;
+                if (!r->in_use.load(std::memory_order_relaxed) &&
+                    r->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire))
+                    return r;
+            }
+            auto r  = new record;
+            r->next = head_.load(std::memory_order_relaxed);
+            while (!head_.compare_exchange_weak(r->next, r, std::memory_order_release, std::memory_order_relaxed))
+                ;
+            return r;
+        }
+
+        std::atomic< std::uint64_t > epoch_ { 1 };
+        std::atomic< record * >      head_ { nullptr };
+    };
+
+    /// a persistent document which is read by many threads and replaced as a whole, read-copy-update style.
+    /// A reader pins the current version with read(), which neither locks nor touches a reference count,
+    /// and may hold references into it for as long as the guard lives. A writer parses a new version outside
+    /// any lock and publishes it with one atomic exchange; versions replaced are deleted by whichever writer
+    /// next finds that no reader can still see them. Writers serialise among themselves only while retiring.
+    struct config_holder
+    {
+        /// pins the version current when it was made. Not to be kept across blocking operations, since no
+        /// version retired after it was made can be reclaimed until it is destroyed.
+        struct reader
+        {
+            explicit reader(config_holder const &h)
+            : domain_(h.domain_)
+            {
+                domain_.enter();
+                current_ = h.current_.load(std::memory_order_seq_cst);
+            }
+
+            reader(reader const &) = delete;
+            reader &
+            operator=(reader const &) = delete;
+
+            ~reader()
+            {
+                domain_.leave();
+            }
+
+            pvalue const &
+            operator*() const
+            {
+                return *current_;
+            }
+
+            pvalue const *
+            operator->() const
+            {
+                return current_;
+            }
+
+            /// the value at a JSON pointer in the pinned version, or nullptr
+            pvalue const *
+            find(std::string_view pointer) const
+            {
+                return find_pointer(*current_, pointer);
+            }
+
+          private:
+            epoch_domain &domain_;
+            pvalue const *current_;
+        };
+
+        explicit config_holder(pvalue initial = {})
+        : current_(new pvalue(std::move(initial)))
+        {
+        }
+
+        config_holder(config_holder const &) = delete;
+        config_holder &
+        operator=(config_holder const &) = delete;
+
+        /// there must be no readers left
+        ~config_holder()
+        {
+            delete current_.load(std::memory_order_relaxed);
+            for (auto &r : retired_)
+                delete r.version;
+        }
+
+        reader
+        read() const
+        {
+            return reader(*this);
+        }
+
+        /// a reference counted handle on the current version, for holding it across blocking operations
+        pvalue
+        snapshot() const
+        {
+            return *read();
+        }
+
+        /// make v the current version
+        void
+        publish(pvalue v)
+        {
+            auto next     = new pvalue(std::move(v));
+            auto previous = current_.exchange(next, std::memory_order_seq_cst);
+            auto tag      = domain_.advance();
+
+            std::lock_guard< std::mutex > lock(mutex_);
+            retired_.push_back({ previous, tag });
+            collect_locked();
+        }
+
+        /// parse text and publish it. On error nothing is published.
+        void
+        reload(std::string_view text, system::error_code &ec)
+        {
+            auto v = parse_persistent(text, ec);
+            if (!ec)
+                publish(std::move(v));
+        }
+
+        /// delete retired versions no reader can see. Returns how many remain.
+        std::size_t
+        collect()
+        {
+            std::lock_guard< std::mutex > lock(mutex_);
+            collect_locked();
+            return retired_.size();
+        }
+
+      private:
+        struct retired
+        {
+            pvalue const *version;
+            std::uint64_t tag;
+        };
+
+        void
+        collect_locked()
+        {
+            auto oldest = domain_.oldest_active();
+            auto keep   = retired_.begin();
+            for (auto &r : retired_)
+                if (r.tag <= oldest)
+                    delete r.version;
+                else
+                    *keep++ = r;
+            retired_.erase(keep, retired_.end());
+        }
+
+        epoch_domain &                domain_ = epoch_domain::instance();
+        std::atomic< pvalue const * > current_;
+        std::mutex                    mutex_;
+        std::vector< retired >        retired_;
+    };
+}   // namespace program
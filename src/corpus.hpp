@@ -0,0 +1,540 @@
+#pragma once
+
+#include "config.hpp"
+#include "value.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace program
+{
+    /// the shape of a synthetic corpus. Every field has a default, and any may be given in a JSON description:
+    ///
+    ///   { "format": "ndjson", "depth": 3, "width": [2, 12], "array_length": [0, 8], "string_length": [0, 32],
+    ///     "key_length": [3, 12], "keys": 64, "escape_density": 0.01,
+    ///     "types": { "object": 1, "array": 1, "string": 4, "number": 4, "bool": 1, "null": 1 },
+    ///     "numbers": { "integer": 6, "decimal": 3, "scientific": 1, "digits": [1, 17] } }
+    ///
+    /// Ranges are inclusive. Weights are relative. Records are objects at depth 0; values at depth are scalars.
+    struct corpus_shape
+    {
+        struct range
+        {
+            std::uint64_t min, max;
+        };
+
+        bool   ndjson         = true;   // or one top level array
+        int    depth          = 3;
+        range  width          = { 2, 12 };
+        range  array_length   = { 0, 8 };
+        range  string_length  = { 0, 32 };
+        range  key_length     = { 3, 12 };
+        range  digits         = { 1, 17 };
+        int    keys           = 64;   // distinct keys
+        double escape_density = 0.01;   // fraction of string characters written as escapes
+
+        // object, array, string, number, bool, null
+        double types[6] = { 1, 1, 4, 4, 1, 1 };
+        // integer, decimal, scientific
+        double numbers[3] = { 6, 3, 1 };
+
+        /// Throws system_error(asio::error::invalid_argument) if the description is malformed
+        static corpus_shape
+        parse(std::string_view description)
+        {
+            system::error_code ec;
+            auto               v = program::parse(description, ec);
+            if (ec)
+                throw system::system_error(ec, "corpus_shape::parse");
+            auto obj = v.if_is< object >();
+            if (!obj)
+                invalid("shape must be an object");
+
+            corpus_shape s;
+            if (auto f = obj->find("format"))
+            {
+                auto t = f->if_is< std::string >();
+                if (!t || (*t != "ndjson" && *t != "array"))
+                    invalid("format must be \"ndjson\" or \"array\"");
+                s.ndjson = *t == "ndjson";
+            }
+            if (auto f = obj->find("depth"))
+                s.depth = int(to_double(*f));
+            read_range(*obj, "width", s.width);
+            read_range(*obj, "array_length", s.array_length);
+            read_range(*obj, "string_length", s.string_length);
+            read_range(*obj, "key_length", s.key_length);
+            if (auto f = obj->find("keys"))
+                s.keys = std::max(1, int(to_double(*f)));
+            if (auto f = obj->find("escape_density"))
+                s.escape_density = std::clamp(to_double(*f), 0.0, 1.0);
+            if (auto f = obj->find("types"))
+                read_weights(*f, { "object", "array", "string", "number", "bool", "null" }, s.types);
+            if (auto f = obj->find("numbers"))
+            {
+                read_weights(*f, { "integer", "decimal", "scientific" }, s.numbers);
+                read_range(*f->if_is< object >(), "digits", s.digits);
+                s.digits.min = std::max< std::uint64_t >(1, s.digits.min);
+            }
+            return s;
+        }
+
+      private:
+        [[noreturn]] static void
+        invalid(const char *what)
+        {
+            throw system::system_error(asio::error::invalid_argument, std::string("corpus_shape: ") + what);
+        }
+
+        static double
+        to_double(value const &v)
+        {
+            auto n = v.if_is< number >();
+            if (!n)
+                invalid("expected a number");
+            auto text = n->mantissa.buffer + n->exponent.buffer;
+            auto d    = std::strtod(text.c_str(), nullptr);
+            if (d < 0)
+                invalid("expected a non-negative number");
+            return d;
+        }
+
+        static void
+        read_range(object const &obj, const char *key, range &r)
+        {
+            auto f = obj.find(key);
+            if (!f)
+                return;
+            auto a = f->if_is< array >();
+            if (!a || a->size() != 2)
+                invalid("ranges are [min, max]");
+            r.min = std::uint64_t(to_double((*a)[0]));
+            r.max = std::uint64_t(to_double((*a)[1]));
+            if (r.max < r.min)
+                invalid("range has max below min");
+        }
+
+        template < std::size_t N >
+        static void
+        read_weights(value const &v, std::initializer_list< const char * > names, double (&weights)[N])
+        {
+            auto obj = v.if_is< object >();
+            if (!obj)
+                invalid("weights must be an object");
+            bool any = false;
+            for (auto &m : obj->members())
+                any = any || std::find_if(names.begin(), names.end(), [&](const char *n) { return m.first == n; }) !=
+                                 names.end();
+            if (!any)
+                return;
+            // naming any weight sets the others to zero, so a description lists only what it wants
+            std::size_t i = 0;
+            for (auto name : names)
+            {
+                auto w       = obj->find(name);
+                weights[i++] = w ? to_double(*w) : 0;
+            }
+        }
+    };
+
+    /// deterministic generator of JSON text with a given shape. The same shape and seed produce the same bytes
+    /// on every platform: randomness comes from a fixed xoshiro256** stream rather than the standard library's
+    /// distributions, whose results are implementation defined.
+    ///
+    /// Output is written into an internal buffer a record at a time. Strings are cut from a pregenerated pool of
+    /// text and keys from a pool of their own, and both are copied in fixed 16 byte strides which the pools and
+    /// the buffer are padded to allow, so small writes never become library calls.
+    struct corpus_generator
+    {
+        corpus_generator(corpus_shape shape, std::uint64_t seed)
+        : shape_(std::move(shape))
+        , seed_(seed)
+        {
+            reseed(seed_);
+
+            static const char alphabet[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 _-.:/";
+            text_.resize(text_pool + stride);
+            for (std::size_t i = 0; i < text_pool; ++i)
+                text_[i] = alphabet[below(sizeof(alphabet) - 1)];
+
+            for (int i = 0; i < shape_.keys; ++i)
+            {
+                auto len = std::min< std::size_t >(std::size_t(pick(shape_.key_length)), text_pool);
+                keys_.push_back({ key_text_.size(), len + 3 });
+                key_text_ += '"';
+                key_text_.append(text_, std::size_t(below(text_pool - len + 1)), len);
+                key_text_ += "\":";
+            }
+            key_text_.append(stride, '\0');
+
+            cumulate(shape_.types, type_weights_);
+            double scalars[6] = { 0, 0, shape_.types[2], shape_.types[3], shape_.types[4], shape_.types[5] };
+            if (!(scalars[2] + scalars[3] + scalars[4] + scalars[5] > 0))
+                scalars[k_null] = 1;
+            cumulate(scalars, scalar_weights_);
+            cumulate(shape_.numbers, number_weights_);
+            escape_threshold_ = unsigned(shape_.escape_density * 65536);
+        }
+
+        /// block index of the corpus: whole records amounting to at least bytes, as lines of NDJSON or as
+        /// elements of the top level array with their separators. Each block draws from its own stream, seeded
+        /// from the seed and index, so blocks may be generated in any order and on any thread, by generators
+        /// constructed alike, and the corpus is still the same. The view is valid until the next call.
+        std::string_view
+        block(std::uint64_t index, std::size_t bytes)
+        {
+            reseed(seed_ ^ (index + 1) * 0xD1B54A32D192ED03ull);
+            p_ = buffer_.get();
+            ensure(bytes);
+            if (!shape_.ndjson && index == 0)
+                put('[');
+            for (bool first = index == 0; std::size_t(p_ - buffer_.get()) < bytes; first = false)
+            {
+                if (!shape_.ndjson && !first)
+                    put(',');
+                write_object(0);
+                if (shape_.ndjson)
+                    put('\n');
+            }
+            return std::string_view(buffer_.get(), std::size_t(p_ - buffer_.get()));
+        }
+
+        /// what completes the corpus after its last block
+        std::string_view
+        finish() const
+        {
+            return shape_.ndjson ? std::string_view() : "]";
+        }
+
+        /// a whole corpus of one block
+        std::string
+        generate(std::size_t bytes)
+        {
+            std::string result(block(0, bytes));
+            result += finish();
+            return result;
+        }
+
+      private:
+        static constexpr std::size_t stride    = 16;
+        static constexpr std::size_t text_pool = 65536;
+
+        enum kind
+        {
+            k_object,
+            k_array,
+            k_string,
+            k_number,
+            k_bool,
+            k_null
+        };
+
+        struct key
+        {
+            std::size_t offset, length;
+        };
+
+        /// room for n more bytes plus a stride of padding
+        void
+        ensure(std::size_t n)
+        {
+            if (std::size_t(end_ - p_) >= n + stride)
+                return;
+            auto used     = std::size_t(p_ - buffer_.get());
+            auto capacity = std::max(2 * std::size_t(end_ - buffer_.get()), used + n + stride + 4096);
+            std::unique_ptr< char[] > bigger(new char[capacity]);
+            if (used)
+                std::memcpy(bigger.get(), buffer_.get(), used);
+            buffer_ = std::move(bigger);
+            p_      = buffer_.get() + used;
+            end_    = buffer_.get() + capacity;
+        }
+
+        void
+        put(char c)
+        {
+            ensure(1);
+            *p_++ = c;
+        }
+
+        template < std::size_t N >
+        void
+        put(const char (&literal)[N])
+        {
+            ensure(N - 1);
+            std::memcpy(p_, literal, N - 1);
+            p_ += N - 1;
+        }
+
+        /// copy n bytes from src, which must be readable to the next multiple of the stride
+        void
+        copy(const char *src, std::size_t n)
+        {
+            ensure(n);
+            for (std::size_t i = 0; i < n; i += stride)
+                std::memcpy(p_ + i, src + i, stride);
+            p_ += n;
+        }
+
+        /// seed the state with splitmix64, as the xoshiro authors recommend
+        void
+        reseed(std::uint64_t seed)
+        {
+            for (auto &s : state_)
+            {
+                seed += 0x9E3779B97F4A7C15ull;
+                auto z = seed;
+                z      = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+                z      = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+                s      = z ^ (z >> 31);
+            }
+        }
+
+        std::uint64_t
+        next()
+        {
+            auto rotl   = [](std::uint64_t x, int k) { return (x << k) | (x >> (64 - k)); };
+            auto result = rotl(state_[1] * 5, 7) * 9;
+            auto t      = state_[1] << 17;
+            state_[2] ^= state_[0];
+            state_[3] ^= state_[1];
+            state_[1] ^= state_[2];
+            state_[0] ^= state_[3];
+            state_[2] ^= t;
+            state_[3] = rotl(state_[3], 45);
+            return result;
+        }
+
+        /// uniform below n, by multiplying rather than dividing where n allows
+        std::uint64_t
+        below(std::uint64_t n)
+        {
+            if (n <= std::uint64_t(1) << 32)
+                return ((next() >> 32) * n) >> 32;
+            return next() % n;
+        }
+
+        std::uint64_t
+        pick(corpus_shape::range r)
+        {
+            return r.min + below(r.max - r.min + 1);
+        }
+
+        template < std::size_t N >
+        static void
+        cumulate(double const (&weights)[N], std::uint64_t (&thresholds)[N])
+        {
+            double total = 0;
+            for (auto w : weights)
+                total += w;
+            double sum = 0;
+            for (std::size_t i = 0; i < N; ++i)
+            {
+                sum += weights[i];
+                thresholds[i] = total > 0 ? std::uint64_t(sum / total * 18446744073709549568.0) : ~std::uint64_t(0);
+            }
+            thresholds[N - 1] = ~std::uint64_t(0);
+        }
+
+        template < std::size_t N >
+        std::size_t
+        choose(std::uint64_t const (&thresholds)[N])
+        {
+            auto        x = next();
+            std::size_t i = 0;
+            while (i + 1 < N && x >= thresholds[i])
+                ++i;
+            return i;
+        }
+
+        void
+        write_value(int depth)
+        {
+            // at the deepest level only scalars are written
+            switch (kind(depth >= shape_.depth ? choose(scalar_weights_) : choose(type_weights_)))
+            {
+            case k_object:
+                write_object(depth);
+                break;
+            case k_array:
+            {
+                auto n = pick(shape_.array_length);
+                put('[');
+                for (std::uint64_t i = 0; i < n; ++i)
+                {
+                    if (i)
+                        put(',');
+                    write_value(depth + 1);
+                }
+                put(']');
+                break;
+            }
+            case k_string:
+                write_string();
+                break;
+            case k_number:
+                write_number();
+                break;
+            case k_bool:
+                if (next() & 1)
+                    put("true");
+                else
+                    put("false");
+                break;
+            case k_null:
+                put("null");
+                break;
+            }
+        }
+
+        void
+        write_object(int depth)
+        {
+            auto n = pick(shape_.width);
+            put('{');
+            for (std::uint64_t i = 0; i < n; ++i)
+            {
+                if (i)
+                    put(',');
+                // keys may repeat within an object when the pool is small; JSON permits it
+                auto &k = keys_[below(keys_.size())];
+                copy(key_text_.data() + k.offset, k.length);
+                write_value(depth + 1);
+            }
+            put('}');
+        }
+
+        void
+        write_string()
+        {
+            struct escape
+            {
+                char        text[stride];
+                std::size_t length;
+            };
+            static const escape escapes[] = {
+                { "\\n", 2 },     { "\\t", 2 },      { "\\\"", 2 },     { "\\\\", 2 },
+                { "\\/", 2 },     { "\\u00e9", 6 }, { "\\u20ac", 6 }, { "\\ud83d\\ude00", 12 },
+            };
+
+            auto len = std::size_t(pick(shape_.string_length));
+            put('"');
+            while (len)
+            {
+                // each character is escaped with probability escape_threshold_ / 65536, taking four decisions
+                // from each random word
+                std::size_t run = len;
+                if (escape_threshold_)
+                {
+                    run = 0;
+                    for (;;)
+                    {
+                        auto x = next();
+                        int  i = 0;
+                        for (; i < 4 && run < len && (x & 0xFFFF) >= escape_threshold_; ++i, x >>= 16)
+                            ++run;
+                        if (i < 4 || run == len)
+                            break;
+                    }
+                }
+                append_text(run);
+                len -= run;
+                if (len)
+                {
+                    auto &e = escapes[below(sizeof(escapes) / sizeof(escapes[0]))];
+                    copy(e.text, e.length);
+                    --len;
+                }
+            }
+            put('"');
+        }
+
+        /// append n characters of plain text, cut from the pool at random
+        void
+        append_text(std::size_t n)
+        {
+            while (n)
+            {
+                auto run = std::min< std::size_t >(n, 4096);
+                copy(text_.data() + below(text_pool - run + 1), run);
+                n -= run;
+            }
+        }
+
+        /// n random digits, eight from each random word; a leading digit is never a zero unless it is alone
+        void
+        append_digits(std::uint64_t n, bool leading)
+        {
+            std::uint64_t x = 0;
+            for (std::uint64_t i = 0; i < n;)
+            {
+                auto m = std::min< std::uint64_t >(n - i, 4096);
+                ensure(std::size_t(m));
+                for (std::uint64_t j = 0; j < m; ++j, ++i)
+                {
+                    if (i % 8 == 0)
+                        x = next();
+                    p_[j] = char('0' + (x & 0xFF) * 10 / 256);
+                    x >>= 8;
+                }
+                if (leading && i == m && p_[0] == '0' && n > 1)
+                    p_[0] = '1';
+                p_ += m;
+            }
+        }
+
+        void
+        write_number()
+        {
+            auto form = choose(number_weights_);
+            if (next() & 1)
+                put('-');
+            auto digits = pick(shape_.digits);
+            switch (form)
+            {
+            case 0:
+                append_digits(digits, true);
+                break;
+            case 1:
+            {
+                auto integral = 1 + below(digits);
+                append_digits(integral, true);
+                put('.');
+                append_digits(std::max< std::uint64_t >(1, digits - integral), false);
+                break;
+            }
+            default:
+                append_digits(1, true);
+                put('.');
+                append_digits(std::max< std::uint64_t >(1, digits - 1), false);
+                if (next() & 1)
+                    put("e-");
+                else
+                    put("e+");
+                append_digits(1 + below(3), true);
+                break;
+            }
+        }
+
+        corpus_shape               shape_;
+        std::uint64_t              seed_;
+        std::uint64_t              state_[4];
+        std::string                text_;
+        std::string                key_text_;
+        std::vector< key >         keys_;
+        std::uint64_t              type_weights_[6];
+        std::uint64_t              scalar_weights_[6];
+        std::uint64_t              number_weights_[3];
+        unsigned                   escape_threshold_ = 0;
+        std::unique_ptr< char[] >  buffer_;
+        char *                     p_   = nullptr;
+        char *                     end_ = nullptr;
+    };
+}   // namespace program
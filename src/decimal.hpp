@@ -0,0 +1,145 @@
+#pragma once
+
+#include "config.hpp"
+
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace program
+{
+    /// canonical form of a parsed number, suitable for exact comparison without conversion to double.
+    /// value = (negative ? -1 : 1) * 0.digits * 10^exponent
+    /// digits carries no leading or trailing zeros, so zero is represented by empty digits.
+    struct decimal
+    {
+        bool        negative = false;
+        std::string digits;
+        long long   exponent = 0;
+
+        bool
+        is_zero() const
+        {
+            return digits.empty();
+        }
+
+        friend std::ostream &
+        operator<<(std::ostream &os, decimal const &d)
+        {
+            if (d.is_zero())
+                return os << "0";
+            if (d.negative)
+                os << '-';
+            return os << "0." << d.digits << 'e' << d.exponent;
+        }
+    };
+
+    /// exponents beyond this are clamped; the value is already far outside anything representable
+    constexpr long long decimal_exponent_limit = 1000000000000LL;
+
+    /// accumulate an exponent digit, saturating at decimal_exponent_limit
+    inline long long
+    accumulate_exponent(long long acc, char c)
+    {
+        if (acc < decimal_exponent_limit)
+            acc = acc * 10 + (c - '0');
+        return acc;
+    }
+
+    /// build the canonical form from the text produced by the mantissa and exponent builders
+    inline decimal
+    to_decimal(std::string_view mantissa, std::string_view exponent)
+    {
+        decimal result;
+
+        long long exp10   = 0;
+        bool      exp_neg = false;
+        for (auto c : exponent)
+        {
+            if (c == '-')
+                exp_neg = true;
+            else if (c >= '0' && c <= '9')
+                exp10 = accumulate_exponent(exp10, c);
+        }
+        if (exp_neg)
+            exp10 = -exp10;
+
+        long long point      = 0;
+        bool      seen_point = false;
+        for (auto c : mantissa)
+        {
+            if (c == '-')
+                result.negative = true;
+            else if (c == '.')
+                seen_point = true;
+            else if (c >= '0' && c <= '9')
+            {
+                if (result.digits.empty() && c == '0')
+                {
+                    // leading zeros after the point push the first significant digit further right
+                    if (seen_point)
+                        --point;
+                    continue;
+                }
+                result.digits += c;
+                if (!seen_point)
+                    ++point;
+            }
+        }
+
+        auto last = result.digits.find_last_not_of('0');
+        result.digits.erase(last == std::string::npos ? 0 : last + 1);
+
+        if (result.digits.empty())
+        {
+            result.negative = false;
+            result.exponent = 0;
+        }
+        else
+            result.exponent = point + exp10;
+
+        return result;
+    }
+
+    /// three-way comparison of the values represented
+    inline int
+    compare(decimal const &l, decimal const &r)
+    {
+        auto sign = [](decimal const &d) { return d.is_zero() ? 0 : d.negative ? -1 : 1; };
+
+        auto ls = sign(l);
+        auto rs = sign(r);
+        if (ls != rs)
+            return ls < rs ? -1 : 1;
+        if (ls == 0)
+            return 0;
+
+        int magnitude = 0;
+        if (l.exponent != r.exponent)
+            magnitude = l.exponent < r.exponent ? -1 : 1;
+        else
+        {
+            auto c    = l.digits.compare(r.digits);
+            magnitude = c < 0 ? -1 : c > 0 ? 1 : 0;
+        }
+        return ls < 0 ? -magnitude : magnitude;
+    }
+
+    inline bool
+    operator==(decimal const &l, decimal const &r)
+    {
+        return compare(l, r) == 0;
+    }
+
+    inline bool
+    operator!=(decimal const &l, decimal const &r)
+    {
+        return compare(l, r) != 0;
+    }
+
+    inline bool
+    operator<(decimal const &l, decimal const &r)
+    {
+        return compare(l, r) < 0;
+    }
+}   // namespace program
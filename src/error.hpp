@@ -0,0 +1,102 @@
+#pragma once
+
+#include "config.hpp"
+
+#include <string>
+#include <type_traits>
+
+namespace program
+{
+    /// semantic errors reported by handlers, validators and tools.
+    /// Malformed input is reported by the parsers themselves as asio::error::invalid_argument.
+    enum class error
+    {
+        invalid_schema = 1,
+        type_mismatch,
+        missing_required_key,
+        out_of_range,
+        bad_string_length,
+        not_in_enum,
+        documents_differ,
+        duplicate_key,
+        invalid_pointer,
+        no_such_path,
+        need_more,
+        out_of_order,
+        invalid_patch,
+        bad_index,
+        too_deep,
+    };
+
+    struct error_category_impl : system::error_category
+    {
+        const char *
+        name() const noexcept override
+        {
+            return "program";
+        }
+
+        std::string
+        message(int ev) const override
+        {
+            switch (static_cast< error >(ev))
+            {
+            case error::invalid_schema:
+                return "invalid schema";
+            case error::type_mismatch:
+                return "value has the wrong type";
+            case error::missing_required_key:
+                return "required key is missing";
+            case error::out_of_range:
+                return "number is out of range";
+            case error::bad_string_length:
+                return "string length is out of range";
+            case error::not_in_enum:
+                return "value is not one of the permitted values";
+            case error::documents_differ:
+                return "documents differ";
+            case error::duplicate_key:
+                return "object contains a duplicate key";
+            case error::invalid_pointer:
+                return "invalid JSON pointer";
+            case error::no_such_path:
+                return "path does not exist in the document";
+            case error::need_more:
+                return "more input is needed";
+            case error::out_of_order:
+                return "value has already been passed";
+            case error::invalid_patch:
+                return "invalid patch";
+            case error::bad_index:
+                return "index is malformed or does not match the document";
+            case error::too_deep:
+                return "containers are nested too deeply";
+            }
+            return "unknown error";
+        }
+    };
+
+    inline system::error_category const &
+    error_category()
+    {
+        static error_category_impl const cat;
+        return cat;
+    }
+
+    inline system::error_code
+    make_error_code(error e)
+    {
+        return system::error_code(static_cast< int >(e), error_category());
+    }
+}   // namespace program
+
+namespace boost
+{
+    namespace system
+    {
+        template <>
+        struct is_error_code_enum< program::error > : std::true_type
+        {
+        };
+    }   // namespace system
+}   // namespace boost
@@ -0,0 +1,271 @@
+#pragma once
+
+#include "config.hpp"
+#include "pointer.hpp"
+#include "projection.hpp"
+#include "tokenizer.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace program
+{
+    struct external_sort_options
+    {
+        /// bytes of keys and entries held in memory before a run is written out
+        std::size_t memory = std::size_t(256) << 20;
+        /// threads sorting each run
+        unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    };
+
+    struct external_sort_stats
+    {
+        std::uint64_t records = 0;
+        std::uint64_t runs    = 0;
+    };
+
+    namespace detail
+    {
+        /// fixed size sort entry. The first 16 bytes of the encoded key are held big endian in prefix, so most
+        /// comparisons are two integer compares; only keys which agree on all 16 bytes look at the key arena.
+        struct sort_entry
+        {
+            std::uint64_t prefix[2];
+            std::uint64_t offset;
+            std::uint32_t length;
+            std::uint32_t key_length;
+            std::size_t   key_at;
+        };
+
+        inline sort_entry
+        make_sort_entry(std::string_view key, std::size_t key_at, std::uint64_t offset, std::size_t length)
+        {
+            unsigned char bytes[16] = {};
+            std::memcpy(bytes, key.data(), std::min< std::size_t >(key.size(), sizeof(bytes)));
+            sort_entry e {};
+            for (int i = 0; i < 16; ++i)
+                e.prefix[i / 8] = e.prefix[i / 8] << 8 | bytes[i];
+            e.offset     = offset;
+            e.length     = std::uint32_t(length);
+            e.key_length = std::uint32_t(key.size());
+            e.key_at     = key_at;
+            return e;
+        }
+
+        /// orders by key, then by position in the input, so the sort is stable
+        struct sort_entry_less
+        {
+            std::string const *keys;
+
+            bool
+            operator()(sort_entry const &l, sort_entry const &r) const
+            {
+                if (l.prefix[0] != r.prefix[0])
+                    return l.prefix[0] < r.prefix[0];
+                if (l.prefix[1] != r.prefix[1])
+                    return l.prefix[1] < r.prefix[1];
+                if (l.key_length > 16 || r.key_length > 16)
+                {
+                    auto c = std::string_view(keys->data() + l.key_at, l.key_length)
+                                 .compare(std::string_view(keys->data() + r.key_at, r.key_length));
+                    if (c)
+                        return c < 0;
+                }
+                else if (l.key_length != r.key_length)
+                    return l.key_length < r.key_length;
+                return l.offset < r.offset;
+            }
+        };
+
+        /// sort in threads slices, then merge the slices pairwise
+        inline void
+        parallel_sort(std::vector< sort_entry > &entries, sort_entry_less less, unsigned threads)
+        {
+            threads = std::max(1u, std::min< unsigned >(threads, unsigned(entries.size() / 4096 + 1)));
+            std::vector< std::size_t > bounds;
+            for (unsigned i = 0; i <= threads; ++i)
+                bounds.push_back(entries.size() / threads * i);
+            bounds.back() = entries.size();
+
+            auto sort_slice = [&](unsigned i) {
+                std::sort(entries.begin() + bounds[i], entries.begin() + bounds[i + 1], less);
+            };
+            std::vector< std::thread > pool;
+            for (unsigned i = 1; i < threads; ++i)
+                pool.emplace_back(sort_slice, i);
+            sort_slice(0);
+            for (auto &t : pool)
+                t.join();
+
+            for (std::size_t width = 1; width < threads; width *= 2)
+            {
+                pool.clear();
+                for (std::size_t i = 0; i + width < threads; i += 2 * width)
+                {
+                    auto first  = entries.begin() + bounds[i];
+                    auto middle = entries.begin() + bounds[i + width];
+                    auto last   = entries.begin() + bounds[std::min< std::size_t >(i + 2 * width, threads)];
+                    pool.emplace_back([=] { std::inplace_merge(first, middle, last, less); });
+                }
+                for (auto &t : pool)
+                    t.join();
+            }
+        }
+
+        struct file_closer
+        {
+            void
+            operator()(std::FILE *f) const
+            {
+                std::fclose(f);
+            }
+        };
+        using file_ptr = std::unique_ptr< std::FILE, file_closer >;
+
+        [[noreturn]] inline void
+        throw_errno(const char *what)
+        {
+            throw system::system_error(system::error_code(errno, system::system_category()), what);
+        }
+
+        /// a sorted run on disk: each entry is the key length, the key, the record offset and the record length
+        struct sort_run
+        {
+            file_ptr      file;
+            std::string   key;
+            std::uint64_t offset = 0;
+            std::uint32_t length = 0;
+
+            template < class T >
+            bool
+            read(T &x)
+            {
+                return std::fread(&x, sizeof(x), 1, file.get()) == 1;
+            }
+
+            /// advance to the next entry; false at the end of the run
+            bool
+            next()
+            {
+                std::uint32_t key_length;
+                if (!read(key_length))
+                    return false;
+                key.resize(key_length);
+                if ((key_length && std::fread(&key[0], key_length, 1, file.get()) != 1) || !read(offset) ||
+                    !read(length))
+                    throw_errno("external sort: read run");
+                return true;
+            }
+        };
+
+        inline file_ptr
+        write_run(std::vector< sort_entry > const &entries, std::string const &keys)
+        {
+            file_ptr f(std::tmpfile());
+            if (!f)
+                throw_errno("external sort: create run");
+            for (auto &e : entries)
+            {
+                bool ok = std::fwrite(&e.key_length, sizeof(e.key_length), 1, f.get()) == 1 &&
+                          (!e.key_length || std::fwrite(keys.data() + e.key_at, e.key_length, 1, f.get()) == 1) &&
+                          std::fwrite(&e.offset, sizeof(e.offset), 1, f.get()) == 1 &&
+                          std::fwrite(&e.length, sizeof(e.length), 1, f.get()) == 1;
+                if (!ok)
+                    throw_errno("external sort: write run");
+            }
+            if (std::fflush(f.get()) != 0)
+                throw_errno("external sort: write run");
+            std::rewind(f.get());
+            return f;
+        }
+    }   // namespace detail
+
+    /// write the records of an NDJSON document to os ordered by the value at pointer, using the encoded key
+    /// order of sort_key.hpp: numbers by value, then strings bytewise. Records without a key come first.
+    /// Records with equal keys keep their input order.
+    ///
+    /// Each key is projected once. The keys and record offsets are sorted in runs bounded by options.memory,
+    /// and the runs are spilled to temporary files and merged. The records themselves are only ever copied from
+    /// data, never parsed again. Throws system_error if pointer or a record is malformed or on I/O failure.
+    inline external_sort_stats
+    sort_ndjson(std::string_view data, std::string const &pointer, std::ostream &os, external_sort_options const &options = {})
+    {
+        system::error_code ec;
+        auto               path = parse_pointer(pointer, ec);
+        if (ec)
+            throw system::system_error(ec, "sort_ndjson: " + pointer);
+
+        external_sort_stats                stats;
+        std::vector< detail::sort_entry > entries;
+        std::string                        keys;
+        std::vector< detail::sort_run >    runs;
+        basic_tokenizer< key_projection >  tk(key_projection { path });
+
+        auto emit = [&](std::uint64_t offset, std::uint32_t length) {
+            os.write(data.data() + offset, std::streamsize(length));
+            os.put('\n');
+        };
+
+        auto spill = [&] {
+            detail::parallel_sort(entries, { &keys }, options.threads);
+            runs.push_back({ detail::write_run(entries, keys), {}, 0, 0 });
+            entries.clear();
+            keys.clear();
+        };
+
+        for_each_record(data, 0, data.size(), [&](std::string_view record, std::size_t offset) {
+            ++stats.records;
+            if (!project_key(tk, record, ec) && ec)
+                throw system::system_error(ec, "sort_ndjson: record at " + std::to_string(offset));
+            auto key = tk.handler().found() ? std::string_view(tk.handler().key()) : std::string_view();
+            entries.push_back(detail::make_sort_entry(key, keys.size(), offset, record.size()));
+            keys.append(key.data(), key.size());
+            if (entries.size() * sizeof(detail::sort_entry) + keys.size() >= options.memory)
+                spill();
+        });
+
+        if (runs.empty())
+        {
+            // everything fitted in memory
+            detail::parallel_sort(entries, { &keys }, options.threads);
+            for (auto &e : entries)
+                emit(e.offset, e.length);
+        }
+        else
+        {
+            if (!entries.empty())
+                spill();
+            auto later = [&](std::size_t l, std::size_t r) {
+                auto c = runs[l].key.compare(runs[r].key);
+                return c ? c > 0 : runs[l].offset > runs[r].offset;
+            };
+            std::priority_queue< std::size_t, std::vector< std::size_t >, decltype(later) > heap(later);
+            for (std::size_t i = 0; i < runs.size(); ++i)
+                if (runs[i].next())
+                    heap.push(i);
+            while (!heap.empty())
+            {
+                auto i = heap.top();
+                heap.pop();
+                emit(runs[i].offset, runs[i].length);
+                if (runs[i].next())
+                    heap.push(i);
+            }
+        }
+        stats.runs = runs.size();
+
+        if (!os)
+            throw system::system_error(system::error_code(EIO, system::system_category()), "sort_ndjson: write");
+        return stats;
+    }
+}   // namespace program
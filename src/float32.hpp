@@ -0,0 +1,197 @@
+#pragma once
+
+#include "config.hpp"
+#include "error.hpp"
+#include "number_parser.hpp"
+#include "tokenizer.hpp"
+
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace program
+{
+    namespace detail
+    {
+        /// the significant digits of a number, as many as fit in 64 bits, and the power of ten to scale them by
+        struct float_digits
+        {
+            std::uint64_t significand = 0;
+            long long     power       = 0;
+            bool          negative    = false;
+            bool          truncated   = false;   // nonzero digits beyond the 19 held were dropped
+        };
+
+        inline float_digits
+        read_float_digits(std::string_view mantissa, std::string_view exponent)
+        {
+            float_digits d;
+            int          digits = 0;
+            bool         point  = false;
+            for (auto c : mantissa)
+            {
+                if (c == '-')
+                    d.negative = true;
+                else if (c == '.')
+                    point = true;
+                else if (digits == 0 && c == '0')
+                    d.power -= point;
+                else if (digits < 19)
+                {
+                    d.significand = d.significand * 10 + std::uint64_t(c - '0');
+                    ++digits;
+                    d.power -= point;
+                }
+                else
+                {
+                    d.truncated = d.truncated || c != '0';
+                    d.power += !point;
+                }
+            }
+
+            long long e   = 0;
+            bool      neg = false;
+            for (auto c : exponent)
+            {
+                if (c == '-')
+                    neg = true;
+                else if (c >= '0' && c <= '9')
+                    e = accumulate_exponent(e, c);
+            }
+            d.power += neg ? -e : e;
+            return d;
+        }
+
+        /// powers of ten exact in float, and in double
+        constexpr float float_powers[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+
+        constexpr double double_powers[] = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                             1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+#if LDBL_MANT_DIG == 64 && (defined(__x86_64__) || defined(__i386__))
+        constexpr bool has_extended_path = true;
+#else
+        constexpr bool has_extended_path = false;
+#endif
+
+        /// significand * 10^power rounded to float through the 64 bit significand of the x87 long double, in
+        /// which any significand we hold and powers of ten up to 10^27 are exact. False if the long double
+        /// landed exactly halfway between two floats.
+        inline bool
+        extended_float(std::uint64_t significand, long long power, float &result)
+        {
+#if LDBL_MANT_DIG == 64 && (defined(__x86_64__) || defined(__i386__))
+            static const long double powers[] = { 1e0L,  1e1L,  1e2L,  1e3L,  1e4L,  1e5L,  1e6L,
+                                                  1e7L,  1e8L,  1e9L,  1e10L, 1e11L, 1e12L, 1e13L,
+                                                  1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L, 1e20L,
+                                                  1e21L, 1e22L, 1e23L, 1e24L, 1e25L, 1e26L, 1e27L };
+            auto x = static_cast< long double >(significand);
+            x      = power < 0 ? x / powers[-power] : x * powers[power];
+            std::uint64_t bits;
+            std::memcpy(&bits, &x, sizeof(bits));   // the explicit significand comes first
+            if ((bits & 0xFFFFFFFFFFull) == 0x8000000000ull)
+                return false;
+            result = static_cast< float >(x);
+            return true;
+#else
+            (void)significand;
+            (void)power;
+            (void)result;
+            return false;
+#endif
+        }
+
+        /// the correctly rounded float, if one of the fast paths can produce it
+        inline bool
+        fast_float(float_digits const &d, float &result)
+        {
+            if (d.significand == 0 && !d.truncated)
+            {
+                result = d.negative ? -0.0f : 0.0f;
+                return true;
+            }
+
+            // both operands exact in float, so the one operation rounds once
+            if (!d.truncated && d.significand <= (std::uint64_t(1) << 24) && d.power >= -10 && d.power <= 10)
+            {
+                auto f = float(d.significand);
+                f      = d.power < 0 ? f / float_powers[-d.power] : f * float_powers[d.power];
+                result = d.negative ? -f : f;
+                return true;
+            }
+
+            // both operands exact in double, so the double is correctly rounded. Narrowing it rounds correctly
+            // too unless it landed exactly halfway between two floats, which the exact value need not have.
+            // Every result here is a normal float, so halfway means the 29 bits narrowing drops are 1 followed
+            // by zeros.
+            if (!d.truncated && d.significand <= (std::uint64_t(1) << 53) && d.power >= -22 && d.power <= 22)
+            {
+                auto x = double(d.significand);
+                x      = d.power < 0 ? x / double_powers[-d.power] : x * double_powers[d.power];
+                std::uint64_t bits;
+                std::memcpy(&bits, &x, sizeof(bits));
+                if ((bits & 0x1FFFFFFF) == 0x10000000)
+                    return false;
+                auto f = float(x);
+                result = d.negative ? -f : f;
+                return true;
+            }
+
+            // the same argument with 64 bit significands. Where digits were dropped the value lies between
+            // significand and significand + 1 scaled, and if both round to the same float so does it.
+            if (has_extended_path && d.power >= -27 && d.power <= 27 && d.significand < ~std::uint64_t(0))
+            {
+                float f;
+                if (!extended_float(d.significand, d.power, f))
+                    return false;
+                if (d.truncated)
+                {
+                    float g;
+                    if (!extended_float(d.significand + 1, d.power, g) || g != f)
+                        return false;
+                }
+                result = d.negative ? -f : f;
+                return true;
+            }
+            return false;
+        }
+    }   // namespace detail
+
+    /// the float nearest the value of n, rounding ties to even, without going through double. Numbers beyond
+    /// the range of float give infinity and set ec to error::out_of_range; numbers too small give zero or a
+    /// subnormal, as strtof does. Numbers the fast paths cannot round go to strtof, which takes its decimal
+    /// point from LC_NUMERIC: a program which sets a locale whose point is not '.' gets wrong results for them.
+    inline float
+    to_float(number const &n, system::error_code &ec)
+    {
+        auto  d = detail::read_float_digits(n.mantissa.buffer, n.exponent.buffer);
+        float result;
+        if (!detail::fast_float(d, result))
+        {
+            // the rest are left to the C library, whose strtof rounds correctly on glibc and the BSDs
+            auto text = n.mantissa.buffer + n.exponent.buffer;
+            result    = std::strtof(text.c_str(), nullptr);
+        }
+        if (std::isinf(result))
+            ec = error::out_of_range;
+        return result;
+    }
+
+    /// tokenizer handler which collects every number in a document as a float, in document order
+    struct float_collector : null_handler
+    {
+        std::vector< float > values;
+
+        void
+        on_number(number const &n, system::error_code &ec)
+        {
+            values.push_back(to_float(n, ec));
+        }
+    };
+}   // namespace program
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace program
+{
+    /// fast non-cryptographic 64 bit hash of a byte string, consuming 8 bytes per step
+    inline std::uint64_t
+    hash_bytes(std::string_view s, std::uint64_t seed = 0)
+    {
+        auto mix = [](std::uint64_t h, std::uint64_t w) {
+            h = (h ^ w) * 0xff51afd7ed558ccdULL;
+            return h ^ (h >> 32);
+        };
+
+        auto load64 = [](const char *p) {
+            std::uint64_t w;
+            std::memcpy(&w, p, 8);
+            return w;
+        };
+        auto load32 = [](const char *p) {
+            std::uint32_t w;
+            std::memcpy(&w, p, 4);
+            return std::uint64_t(w);
+        };
+
+        std::uint64_t h = seed ^ 0x9e3779b97f4a7c15ULL ^ s.size();
+        auto          p = s.data();
+        auto          n = s.size();
+        for (; n > 8; p += 8, n -= 8)
+            h = mix(h, load64(p));
+
+        // the tail is read with fixed size loads, overlapping bytes already hashed where necessary
+        std::uint64_t w;
+        if (s.size() >= 8)
+            w = load64(p + n - 8);
+        else if (n >= 4)
+            w = load32(p) | (load32(p + n - 4) << 32);
+        else
+        {
+            w = 0;
+            for (std::size_t i = 0; i < n; ++i)
+                w = (w << 8) | static_cast< unsigned char >(p[i]);
+        }
+        h = mix(h, w) * 0xc4ceb9fe1a85ec53ULL;
+        return h ^ (h >> 29);
+    }
+
+    /// combine a hash into an accumulated hash
+    inline std::uint64_t
+    hash_combine(std::uint64_t seed, std::uint64_t h)
+    {
+        seed ^= h + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+        return seed;
+    }
+}   // namespace program
@@ -0,0 +1,539 @@
+#pragma once
+
+#include "config.hpp"
+#include "decimal.hpp"
+#include "number_parser.hpp"
+#include "projection.hpp"
+#include "schema.hpp"
+#include "serializer.hpp"
+#include "tokenizer.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace program
+{
+    /// string formats recognised during inference, as JSON Schema format names
+    enum string_format : unsigned
+    {
+        format_date_time = 1,
+        format_date      = 2,
+        format_time      = 4,
+        format_uuid      = 8,
+        format_email     = 16,
+        format_ipv4      = 32,
+        format_all       = 63,
+    };
+
+    namespace detail
+    {
+        inline bool
+        digits_at(std::string_view s, std::size_t at, std::size_t n)
+        {
+            if (at + n > s.size())
+                return false;
+            return std::all_of(s.begin() + at, s.begin() + at + n, [](char c) { return c >= '0' && c <= '9'; });
+        }
+
+        /// hh:mm:ss[.fff](Z|±hh:mm)
+        inline bool
+        is_time(std::string_view s)
+        {
+            if (!digits_at(s, 0, 2) || s.size() < 9 || s[2] != ':' || !digits_at(s, 3, 2) || s[5] != ':' ||
+                !digits_at(s, 6, 2))
+                return false;
+            std::size_t i = 8;
+            if (i < s.size() && s[i] == '.')
+            {
+                auto first = ++i;
+                while (i < s.size() && s[i] >= '0' && s[i] <= '9')
+                    ++i;
+                if (i == first)
+                    return false;
+            }
+            if (i + 1 == s.size() && (s[i] == 'Z' || s[i] == 'z'))
+                return true;
+            return i + 6 == s.size() && (s[i] == '+' || s[i] == '-') && digits_at(s, i + 1, 2) && s[i + 3] == ':' &&
+                   digits_at(s, i + 4, 2);
+        }
+
+        inline bool
+        is_date(std::string_view s)
+        {
+            return s.size() == 10 && digits_at(s, 0, 4) && s[4] == '-' && digits_at(s, 5, 2) && s[7] == '-' &&
+                   digits_at(s, 8, 2);
+        }
+
+        inline bool
+        is_uuid(std::string_view s)
+        {
+            if (s.size() != 36)
+                return false;
+            for (std::size_t i = 0; i < s.size(); ++i)
+            {
+                auto c = s[i];
+                if (i == 8 || i == 13 || i == 18 || i == 23)
+                {
+                    if (c != '-')
+                        return false;
+                }
+                else if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F')))
+                    return false;
+            }
+            return true;
+        }
+
+        inline bool
+        is_email(std::string_view s)
+        {
+            auto at = s.find('@');
+            return at != 0 && at != std::string_view::npos && s.find('@', at + 1) == std::string_view::npos &&
+                   s.find('.', at + 2) < s.size() - 1 && s.find_first_of(" \t\r\n") == std::string_view::npos;
+        }
+
+        inline bool
+        is_ipv4(std::string_view s)
+        {
+            for (int part = 0; part < 4; ++part)
+            {
+                std::size_t n = 0;
+                unsigned    x = 0;
+                while (n < s.size() && n < 4 && s[n] >= '0' && s[n] <= '9')
+                    x = x * 10 + unsigned(s[n++] - '0');
+                if (n == 0 || n > 3 || x > 255 || (n > 1 && s[0] == '0'))
+                    return false;
+                s.remove_prefix(n);
+                if (part < 3)
+                {
+                    if (s.empty() || s[0] != '.')
+                        return false;
+                    s.remove_prefix(1);
+                }
+            }
+            return s.empty();
+        }
+
+        inline unsigned
+        string_formats(std::string_view s)
+        {
+            unsigned result = 0;
+            if (s.size() > 10 && (s[10] == 'T' || s[10] == 't') && is_date(s.substr(0, 10)) && is_time(s.substr(11)))
+                result |= format_date_time;
+            if (is_date(s))
+                result |= format_date;
+            if (is_time(s))
+                result |= format_time;
+            if (is_uuid(s))
+                result |= format_uuid;
+            if (is_email(s))
+                result |= format_email;
+            if (is_ipv4(s))
+                result |= format_ipv4;
+            return result;
+        }
+    }   // namespace detail
+
+    /// what has been seen of the values at one place in a corpus
+    struct inferred_node
+    {
+        static constexpr std::size_t none = std::size_t(-1);
+
+        struct property
+        {
+            std::size_t   node    = none;
+            std::uint64_t present = 0;   // objects in which the key appeared
+            /// the owner's objects count when the key was last counted, so a repeated key counts once per object
+            std::uint64_t counted_in = 0;
+        };
+
+        unsigned      types   = 0;   // schema_type bits seen; schema_number only for non-integers
+        std::uint64_t count   = 0;   // values seen
+        std::uint64_t objects = 0;   // of which objects
+
+        std::map< std::string, property > properties;
+        std::size_t                       items = none;
+
+        std::optional< decimal > minimum, maximum;
+        std::string              minimum_text, maximum_text;
+
+        std::size_t min_length = std::size_t(-1);
+        std::size_t max_length = 0;
+        unsigned    formats    = format_all;   // formats every string seen satisfies
+    };
+
+    /// a schema inferred from examples. Partial schemas inferred from parts of a corpus merge into the schema of
+    /// the whole, so inference parallelises over any split of the records.
+    struct inferred_schema
+    {
+        std::vector< inferred_node > nodes;   // nodes[0] is the root, once a value has been seen
+        std::uint64_t                records = 0;
+
+        void
+        merge(inferred_schema const &other)
+        {
+            records += other.records;
+            if (!other.nodes.empty())
+                merge(root(), other, 0);
+        }
+
+        /// the schema as JSON Schema text, in the dialect compiled_schema understands plus "format"
+        std::string
+        to_json() const
+        {
+            json_writer w;
+            if (nodes.empty())
+                w.raw("{}");
+            else
+                write(w, 0);
+            return std::move(w.output());
+        }
+
+        std::size_t
+        root()
+        {
+            if (nodes.empty())
+                nodes.emplace_back();
+            return 0;
+        }
+
+        std::size_t
+        child(std::size_t &slot)
+        {
+            if (slot == inferred_node::none)
+            {
+                slot = nodes.size();
+                nodes.emplace_back();
+            }
+            return slot;
+        }
+
+      private:
+        void
+        merge(std::size_t into, inferred_schema const &other, std::size_t from)
+        {
+            auto &src = other.nodes[from];
+            {
+                auto &dst = nodes[into];
+                dst.types |= src.types;
+                dst.count += src.count;
+                dst.objects += src.objects;
+                if (src.minimum && (!dst.minimum || compare(*src.minimum, *dst.minimum) < 0))
+                {
+                    dst.minimum      = src.minimum;
+                    dst.minimum_text = src.minimum_text;
+                }
+                if (src.maximum && (!dst.maximum || compare(*src.maximum, *dst.maximum) > 0))
+                {
+                    dst.maximum      = src.maximum;
+                    dst.maximum_text = src.maximum_text;
+                }
+                dst.min_length = std::min(dst.min_length, src.min_length);
+                dst.max_length = std::max(dst.max_length, src.max_length);
+                dst.formats &= src.formats;
+            }
+
+            // nodes may reallocate as children are added, so index rather than hold references
+            for (auto &p : src.properties)
+            {
+                auto &prop = nodes[into].properties[p.first];
+                prop.present += p.second.present;
+                auto slot = prop.node;
+                auto c    = child(slot);
+                nodes[into].properties[p.first].node = c;
+                merge(c, other, p.second.node);
+            }
+            if (src.items != inferred_node::none)
+            {
+                auto slot = nodes[into].items;
+                auto c    = child(slot);
+                nodes[into].items = c;
+                merge(c, other, src.items);
+            }
+        }
+
+        void
+        write(json_writer &w, std::size_t index) const
+        {
+            system::error_code ec;
+            auto &             n = nodes[index];
+            w.on_object_begin(ec);
+
+            static const std::pair< unsigned, const char * > type_names[] = {
+                { schema_null, "null" },     { schema_boolean, "boolean" }, { schema_number, "number" },
+                { schema_string, "string" }, { schema_array, "array" },     { schema_object, "object" },
+            };
+            auto types = n.types;
+            if (types & schema_number)
+                types &= ~unsigned(schema_integer);
+            std::vector< const char * > names;
+            if (types & schema_integer)
+                names.push_back("integer");
+            for (auto &t : type_names)
+                if (types & t.first)
+                    names.push_back(t.second);
+            if (!names.empty())
+            {
+                w.key("type");
+                if (names.size() == 1)
+                    w.on_string(names[0], ec);
+                else
+                {
+                    w.on_array_begin(ec);
+                    for (auto name : names)
+                        w.on_string(name, ec);
+                    w.on_array_end(ec);
+                }
+            }
+
+            if (n.minimum)
+            {
+                w.key("minimum");
+                w.raw(n.minimum_text);
+                w.key("maximum");
+                w.raw(n.maximum_text);
+            }
+
+            if (n.types & schema_string)
+            {
+                w.key("minLength");
+                w.raw(std::to_string(n.min_length));
+                w.key("maxLength");
+                w.raw(std::to_string(n.max_length));
+                static const std::pair< unsigned, const char * > format_names[] = {
+                    { format_date_time, "date-time" }, { format_date, "date" },   { format_time, "time" },
+                    { format_uuid, "uuid" },           { format_email, "email" }, { format_ipv4, "ipv4" },
+                };
+                for (auto &f : format_names)
+                    if (n.formats & f.first)
+                    {
+                        w.key("format");
+                        w.on_string(f.second, ec);
+                        break;
+                    }
+            }
+
+            if (!n.properties.empty())
+            {
+                w.key("properties");
+                w.on_object_begin(ec);
+                for (auto &p : n.properties)
+                {
+                    w.key(p.first);
+                    write(w, p.second.node);
+                }
+                w.on_object_end(ec);
+
+                bool any = false;
+                for (auto &p : n.properties)
+                    if (p.second.present == n.objects)
+                    {
+                        if (!any)
+                        {
+                            w.key("required");
+                            w.on_array_begin(ec);
+                            any = true;
+                        }
+                        w.on_string(p.first, ec);
+                    }
+                if (any)
+                    w.on_array_end(ec);
+            }
+
+            if (n.items != inferred_node::none)
+            {
+                w.key("items");
+                write(w, n.items);
+            }
+            w.on_object_end(ec);
+        }
+    };
+
+    /// tokenizer handler which accumulates an inferred schema from a stream of documents without building them
+    struct schema_inferrer
+    {
+        inferred_schema &
+        schema()
+        {
+            return schema_;
+        }
+
+        /// call after each complete document
+        void
+        end_document()
+        {
+            ++schema_.records;
+            stack_.clear();
+        }
+
+        void
+        on_object_begin(system::error_code &)
+        {
+            auto n = begin(schema_object);
+            ++schema_.nodes[n].objects;
+            stack_.push_back({ n, false });
+        }
+        void
+        on_object_end(system::error_code &)
+        {
+            stack_.pop_back();
+        }
+        void
+        on_array_begin(system::error_code &)
+        {
+            stack_.push_back({ begin(schema_array), true });
+        }
+        void
+        on_array_end(system::error_code &)
+        {
+            stack_.pop_back();
+        }
+        void
+        on_key(std::string_view key, system::error_code &)
+        {
+            auto &node = schema_.nodes[stack_.back().node];
+            auto &prop = node.properties[std::string(key)];
+            if (prop.counted_in != node.objects)
+            {
+                prop.counted_in = node.objects;
+                ++prop.present;
+            }
+            auto slot = prop.node;
+            key_node_ = schema_.child(slot);
+            schema_.nodes[stack_.back().node].properties[std::string(key)].node = key_node_;
+        }
+        void
+        on_string(std::string_view s, system::error_code &)
+        {
+            auto &n   = schema_.nodes[begin(schema_string)];
+            auto  len = std::size_t(std::count_if(
+                s.begin(), s.end(), [](char c) { return (static_cast< unsigned char >(c) & 0xC0) != 0x80; }));
+            n.min_length = std::min(n.min_length, len);
+            n.max_length = std::max(n.max_length, len);
+            if (n.formats)
+                n.formats &= detail::string_formats(s);
+        }
+        number_range const *
+        on_number_begin(system::error_code &)
+        {
+            return nullptr;
+        }
+        void
+        on_number(number const &num, system::error_code &)
+        {
+            auto d = to_decimal(num);
+            auto is_integer =
+                d.is_zero() || (d.exponent >= 0 && std::ptrdiff_t(d.digits.size()) <= d.exponent);
+            auto &n = schema_.nodes[begin(is_integer ? schema_integer : schema_number)];
+            if (!n.minimum || compare(d, *n.minimum) < 0)
+            {
+                n.minimum_text.clear();
+                append_number(n.minimum_text, num);
+                n.minimum = d;
+            }
+            if (!n.maximum || compare(d, *n.maximum) > 0)
+            {
+                n.maximum_text.clear();
+                append_number(n.maximum_text, num);
+                n.maximum = std::move(d);
+            }
+        }
+        void
+        on_bool(bool, system::error_code &)
+        {
+            begin(schema_boolean);
+        }
+        void
+        on_null(system::error_code &)
+        {
+            begin(schema_null);
+        }
+
+      private:
+        /// the node of the value starting now, with the value counted
+        std::size_t
+        begin(unsigned type)
+        {
+            std::size_t n;
+            if (stack_.empty())
+                n = schema_.root();
+            else if (stack_.back().is_array)
+            {
+                auto slot = schema_.nodes[stack_.back().node].items;
+                n         = schema_.child(slot);
+                schema_.nodes[stack_.back().node].items = n;
+            }
+            else
+                n = key_node_;
+            auto &node = schema_.nodes[n];
+            node.types |= type;
+            ++node.count;
+            return n;
+        }
+
+        struct frame
+        {
+            std::size_t node;
+            bool        is_array;
+        };
+
+        inferred_schema      schema_;
+        std::vector< frame > stack_;
+        std::size_t          key_node_ = inferred_node::none;
+    };
+
+    /// infer the schema of the records of an NDJSON document, one partial schema per thread over line aligned
+    /// ranges, merged at the end. Throws system_error if a record is not valid JSON.
+    inline inferred_schema
+    infer_ndjson_schema(std::string_view data, unsigned threads = std::max(1u, std::thread::hardware_concurrency()))
+    {
+        threads = std::max(1u, threads);
+        std::vector< std::size_t > bounds;
+        for (unsigned i = 0; i <= threads; ++i)
+            bounds.push_back(line_start(data, data.size() / threads * i));
+        bounds.back() = data.size();
+
+        std::vector< inferred_schema >    parts(threads);
+        std::vector< std::exception_ptr > failures(threads);
+        auto                              work = [&](unsigned i) {
+            try
+            {
+                basic_tokenizer< schema_inferrer > tk;
+                for_each_record(data, bounds[i], bounds[i + 1], [&](std::string_view record, std::size_t offset) {
+                    tk.reset();
+                    if (auto ec = tokenize(tk, record))
+                        throw system::system_error(ec, "infer_ndjson_schema: record at " + std::to_string(offset));
+                    tk.handler().end_document();
+                });
+                parts[i] = std::move(tk.handler().schema());
+            }
+            catch (...)
+            {
+                failures[i] = std::current_exception();
+            }
+        };
+
+        std::vector< std::thread > pool;
+        for (unsigned i = 1; i < threads; ++i)
+            pool.emplace_back(work, i);
+        work(0);
+        for (auto &t : pool)
+            t.join();
+
+        inferred_schema result;
+        for (unsigned i = 0; i < threads; ++i)
+        {
+            if (failures[i])
+                std::rethrow_exception(failures[i]);
+            result.merge(parts[i]);
+        }
+        return result;
+    }
+}   // namespace program
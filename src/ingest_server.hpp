@@ -0,0 +1,458 @@
+#pragma once
+
+#include "config.hpp"
+#include "pmr_value.hpp"
+#include "tokenizer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/strand.hpp>
+
+#include <sys/socket.h>
+
+namespace program
+{
+    // Server accepting NDJSON over TCP, one record per line, which parses every record into a pmr_value and
+    // hands it to a sink.
+    //
+    // Sharded, the default, runs one io_context per thread, each thread pinned to a core and listening on its
+    // own SO_REUSEPORT socket, so the kernel spreads connections across threads and a connection stays on the
+    // thread which accepted it. Each shard has its own session pool, its own parse arena, which is released
+    // after every read, its own tokenizer, sink and statistics, so nothing is written by more than one thread
+    // on the path of a record.
+    //
+    // Shared runs one io_context on all the threads, with one listening socket, sessions and documents on the
+    // global heap and statistics updated atomically by every thread. It is kept for comparison.
+
+    struct ingest_options
+    {
+        unsigned    threads    = std::max(1u, std::thread::hardware_concurrency());
+        bool        sharded    = true;
+        bool        pin        = true;           // pin each sharded thread to a core
+        std::size_t read_size  = 64 << 10;       // bytes per read
+        std::size_t max_record = 1 << 20;        // longer records are skipped and counted malformed
+        int         backlog    = asio::socket_base::max_listen_connections;
+    };
+
+    struct ingest_stats
+    {
+        std::uint64_t connections = 0;
+        std::uint64_t records     = 0;
+        std::uint64_t bytes       = 0;
+        std::uint64_t malformed   = 0;
+    };
+
+    /// sink which drops every record
+    struct discard_records
+    {
+        void
+        operator()(pmr_value const &)
+        {
+        }
+    };
+
+    namespace detail
+    {
+        using reuse_port = asio::detail::socket_option::boolean< SOL_SOCKET, SO_REUSEPORT >;
+
+        /// pin the calling thread to one core. Pinning is advisory, so failure is ignored.
+        inline void
+        pin_to_core(unsigned core)
+        {
+#if defined(__linux__)
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(core % CPU_SETSIZE, &set);
+            ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+#else
+            (void)core;
+#endif
+        }
+
+        /// ingest_stats which one thread writes and any thread may read
+        struct alignas(64) ingest_counters
+        {
+            std::atomic< std::uint64_t > connections { 0 };
+            std::atomic< std::uint64_t > records { 0 };
+            std::atomic< std::uint64_t > bytes { 0 };
+            std::atomic< std::uint64_t > malformed { 0 };
+
+            /// add n, as the only writer unless shared
+            static void
+            add(std::atomic< std::uint64_t > &c, std::uint64_t n, bool shared)
+            {
+                if (shared)
+                    c.fetch_add(n, std::memory_order_relaxed);
+                else
+                    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+            }
+
+            void
+            add_to(ingest_stats &s) const
+            {
+                s.connections += connections.load(std::memory_order_relaxed);
+                s.records += records.load(std::memory_order_relaxed);
+                s.bytes += bytes.load(std::memory_order_relaxed);
+                s.malformed += malformed.load(std::memory_order_relaxed);
+            }
+        };
+
+        /// everything one io_context uses. Sharded, only its own thread touches it besides the counters.
+        template < class Sink >
+        struct ingest_shard
+        {
+            using tokenizer = basic_tokenizer< pmr_value_builder >;
+
+            ingest_shard(unsigned concurrency, bool shared, Sink sink)
+            : shared(shared)
+            , pool(shared ? std::pmr::new_delete_resource() : &local_pool)
+            , arena(64 << 10, &local_pool)
+            , parser(pmr_value_builder(&arena), &local_pool)
+            , sink(std::move(sink))
+            , ioc(int(concurrency))
+            , acceptor(ioc)
+            {
+            }
+
+            // the io_context goes first, destroying the sessions its handlers hold while their pool is alive
+            bool                                   shared;
+            std::pmr::unsynchronized_pool_resource local_pool;
+            std::pmr::memory_resource *            pool;     // sessions and their buffers
+            std::pmr::monotonic_buffer_resource    arena;    // documents, sharded only
+            tokenizer                              parser;   // sharded only
+            Sink                                   sink;
+            ingest_counters                        counters;
+            asio::io_context                       ioc;
+            asio::ip::tcp::acceptor                acceptor;
+        };
+
+        /// one connection, reading until the peer closes
+        template < class Sink >
+        struct ingest_session
+        : asio::coroutine
+        , std::enable_shared_from_this< ingest_session< Sink > >
+        {
+            using shard_type = ingest_shard< Sink >;
+
+            ingest_session(shard_type &shard, asio::ip::tcp::socket socket, ingest_options const &options)
+            : shard_(shard)
+            , options_(options)
+            , socket_(std::move(socket))
+            , read_(options.read_size, shard.pool)
+            , carry_(shard.pool)
+            {
+                if (shard.shared)
+                    own_parser_ = std::make_unique< typename shard_type::tokenizer >(
+                        pmr_value_builder(std::pmr::new_delete_resource()), std::pmr::new_delete_resource());
+            }
+
+            /// begin reading, within the socket's strand if it has one
+            void
+            start()
+            {
+                asio::dispatch(socket_.get_executor(), [self = this->shared_from_this()] { (*self)(); });
+            }
+
+#include <boost/asio/yield.hpp>
+            void
+            operator()(system::error_code ec = {}, std::size_t n = 0)
+            {
+                reenter(this)
+                {
+                    for (;;)
+                    {
+                        yield socket_.async_read_some(
+                            asio::buffer(read_),
+                            [self = this->shared_from_this()](system::error_code e, std::size_t m) { (*self)(e, m); });
+                        if (ec)
+                        {
+                            yield break;
+                        }
+                        consume(std::string_view(read_.data(), n));
+                    }
+                }
+            }
+#include <boost/asio/unyield.hpp>
+
+          private:
+            void
+            consume(std::string_view in)
+            {
+                ingest_counters::add(shard_.counters.bytes, in.size(), shard_.shared);
+                std::uint64_t records = 0, malformed = 0;
+                while (!in.empty())
+                {
+                    auto eol = in.find('\n');
+                    if (eol == std::string_view::npos)
+                    {
+                        if (!skipping_ && carry_.size() + in.size() > options_.max_record)
+                        {
+                            skipping_ = true;
+                            carry_.clear();
+                        }
+                        if (!skipping_)
+                            carry_.append(in.data(), in.size());
+                        break;
+                    }
+                    auto line = in.substr(0, eol);
+                    in.remove_prefix(eol + 1);
+                    if (skipping_)
+                    {
+                        skipping_ = false;
+                        ++malformed;
+                        continue;
+                    }
+                    if (carry_.size() + line.size() > options_.max_record)
+                    {
+                        carry_.clear();
+                        ++malformed;
+                        continue;
+                    }
+                    if (!carry_.empty())
+                    {
+                        carry_.append(line.data(), line.size());
+                        line = carry_;
+                    }
+                    if (line.find_first_not_of(" \t\r") != std::string_view::npos)
+                    {
+                        if (record(line))
+                            ++records;
+                        else
+                            ++malformed;
+                    }
+                    carry_.clear();
+                }
+                ingest_counters::add(shard_.counters.records, records, shard_.shared);
+                if (malformed)
+                    ingest_counters::add(shard_.counters.malformed, malformed, shard_.shared);
+
+                // the documents of this read are gone, so the arena can start again
+                if (!shard_.shared)
+                {
+                    shard_.parser.handler() = pmr_value_builder(&shard_.arena);
+                    shard_.arena.release();
+                }
+            }
+
+            bool
+            record(std::string_view line)
+            {
+                auto &tk = own_parser_ ? *own_parser_ : shard_.parser;
+                auto  resource =
+                    own_parser_ ? std::pmr::new_delete_resource() : static_cast< std::pmr::memory_resource * >(&shard_.arena);
+                tk.reset();
+                tk.handler() = pmr_value_builder(resource);
+                if (tokenize(tk, line))
+                    return false;
+                shard_.sink(tk.handler().get());
+                return true;
+            }
+
+            shard_type &                                          shard_;
+            ingest_options const &                                options_;
+            asio::ip::tcp::socket                                 socket_;
+            std::pmr::vector< char >                              read_;
+            std::pmr::string                                      carry_;   // a record split across reads
+            bool                                                  skipping_ = false;
+            std::unique_ptr< typename shard_type::tokenizer >     own_parser_;   // shared only
+        };
+    }   // namespace detail
+
+    template < class Sink = discard_records >
+    struct basic_ingest_server
+    {
+        /// listen on endpoint, port 0 choosing a free one. Sharded, every shard gets a copy of sink; shared, all
+        /// the threads call the one sink concurrently. Throws system_error if the endpoint cannot be bound.
+        basic_ingest_server(asio::ip::tcp::endpoint endpoint, ingest_options options = {}, Sink sink = {})
+        : options_(options)
+        {
+            options_.threads = std::max(1u, options_.threads);
+            auto shards      = options_.sharded ? options_.threads : 1u;
+            for (unsigned i = 0; i < shards; ++i)
+            {
+                shards_.push_back(std::make_unique< shard_type >(
+                    options_.sharded ? 1u : options_.threads, !options_.sharded, sink));
+                auto &a = shards_.back()->acceptor;
+                a.open(endpoint.protocol());
+                a.set_option(asio::socket_base::reuse_address(true));
+                if (options_.sharded)
+                    a.set_option(detail::reuse_port(true));
+                a.bind(endpoint);
+                a.listen(options_.backlog);
+                // the rest of the shards listen on the port the first one was given
+                endpoint = a.local_endpoint();
+            }
+            endpoint_ = endpoint;
+        }
+
+        basic_ingest_server(basic_ingest_server const &) = delete;
+        basic_ingest_server &
+        operator=(basic_ingest_server const &) = delete;
+
+        asio::ip::tcp::endpoint
+        local_endpoint() const
+        {
+            return endpoint_;
+        }
+
+        /// serve on options.threads threads, the calling thread among them, until stop is called
+        void
+        run()
+        {
+            for (auto &s : shards_)
+                accept(*s);
+
+            auto work = [this](unsigned i) {
+                if (options_.sharded)
+                {
+                    if (options_.pin)
+                        detail::pin_to_core(i % std::max(1u, std::thread::hardware_concurrency()));
+                    shards_[i]->ioc.run();
+                }
+                else
+                    shards_[0]->ioc.run();
+            };
+            std::vector< std::thread > pool;
+            for (unsigned i = 1; i < options_.threads; ++i)
+                pool.emplace_back(work, i);
+            work(0);
+            for (auto &t : pool)
+                t.join();
+        }
+
+        /// make run return. Safe from any thread.
+        void
+        stop()
+        {
+            for (auto &s : shards_)
+                s->ioc.stop();
+        }
+
+        /// totals over all shards so far. Safe from any thread.
+        ingest_stats
+        stats() const
+        {
+            ingest_stats s;
+            for (auto &shard : shards_)
+                shard->counters.add_to(s);
+            return s;
+        }
+
+        /// statistics of each shard
+        std::vector< ingest_stats >
+        shard_stats() const
+        {
+            std::vector< ingest_stats > result(shards_.size());
+            for (std::size_t i = 0; i < shards_.size(); ++i)
+                shards_[i]->counters.add_to(result[i]);
+            return result;
+        }
+
+      private:
+        using shard_type   = detail::ingest_shard< Sink >;
+        using session_type = detail::ingest_session< Sink >;
+
+        void
+        accept(shard_type &s)
+        {
+            auto on_accept = [this, &s](system::error_code ec, asio::ip::tcp::socket socket) {
+                if (ec == asio::error::operation_aborted)
+                    return;
+                if (!ec)
+                {
+                    detail::ingest_counters::add(s.counters.connections, 1, s.shared);
+                    socket.set_option(asio::ip::tcp::no_delay(true), ec);
+                    std::allocate_shared< session_type >(std::pmr::polymorphic_allocator< session_type >(s.pool), s,
+                                                         std::move(socket), options_)
+                        ->start();
+                }
+                accept(s);
+            };
+            // with many threads on one io_context each session needs a strand, since a read may complete on
+            // another thread before the call which started it has returned
+            if (s.shared)
+                s.acceptor.async_accept(asio::make_strand(s.ioc), std::move(on_accept));
+            else
+                s.acceptor.async_accept(std::move(on_accept));
+        }
+
+        ingest_options                              options_;
+        asio::ip::tcp::endpoint                     endpoint_;
+        std::vector< std::unique_ptr< shard_type > > shards_;
+    };
+
+    using ingest_server = basic_ingest_server<>;
+
+    /// what a load generator achieved
+    struct ingest_load_result
+    {
+        std::uint64_t bytes   = 0;
+        double        seconds = 0;
+    };
+
+    /// send payload, which should be whole NDJSON records, over and over on each of connections connections
+    /// to endpoint for duration, one thread per connection. Throws system_error if a connection fails.
+    inline ingest_load_result
+    ingest_load(asio::ip::tcp::endpoint endpoint, unsigned connections, std::string_view payload,
+                std::chrono::duration< double > duration)
+    {
+        using clock = std::chrono::steady_clock;
+
+        asio::io_context                      ioc;
+        std::vector< asio::ip::tcp::socket >  sockets;
+        for (unsigned i = 0; i < std::max(1u, connections); ++i)
+        {
+            sockets.emplace_back(ioc);
+            sockets.back().connect(endpoint);
+            sockets.back().set_option(asio::ip::tcp::no_delay(true));
+        }
+
+        std::vector< std::uint64_t >      sent(sockets.size());
+        std::vector< std::exception_ptr > failures(sockets.size());
+        auto                              start    = clock::now();
+        auto                              deadline = start + std::chrono::duration_cast< clock::duration >(duration);
+        auto                              work     = [&](std::size_t i) {
+            try
+            {
+                while (clock::now() < deadline)
+                    sent[i] += asio::write(sockets[i], asio::buffer(payload.data(), payload.size()));
+                sockets[i].shutdown(asio::ip::tcp::socket::shutdown_send);
+            }
+            catch (...)
+            {
+                failures[i] = std::current_exception();
+            }
+        };
+        std::vector< std::thread > pool;
+        for (std::size_t i = 1; i < sockets.size(); ++i)
+            pool.emplace_back(work, i);
+        work(0);
+        for (auto &t : pool)
+            t.join();
+
+        ingest_load_result result;
+        result.seconds = std::chrono::duration< double >(clock::now() - start).count();
+        for (std::size_t i = 0; i < sockets.size(); ++i)
+        {
+            if (failures[i])
+                std::rethrow_exception(failures[i]);
+            result.bytes += sent[i];
+        }
+        return result;
+    }
+}   // namespace program
@@ -1,394 +1,1928 @@
+#include "checkpoint.hpp"
+#include "codegen.hpp"
+#include "codegen_check.hpp"
+#include "compare.hpp"
 #include "config.hpp"
+#include "config_holder.hpp"
+#include "corpus.hpp"
 #include "explain.hpp"
+#include "external_sort.hpp"
+#include "float32.hpp"
+#include "infer_schema.hpp"
+#include "ingest_server.hpp"
+#include "ndjson_index.hpp"
+#include "number_parser.hpp"
+#include "on_demand.hpp"
+#include "patch.hpp"
+#include "persistent.hpp"
+#include "pmr_value.hpp"
+#include "prefilter.hpp"
+#include "rewrite.hpp"
+#include "schema.hpp"
+#include "serializer.hpp"
+#include "unique_keys.hpp"
+#include "value.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <memory_resource>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 namespace program
 {
-    struct mantissa_builder
+    struct result
+    {
+        system::error_code ec;
+        number             n;
+
+        result(number_parser const& np)
+        : ec(np.error())
+        , n(np.get_number())
+        {}
+
+        auto
+        as_tuple() const
+        {
+            return std::tie(ec, n);
+        }
+
+        friend std::ostream &
+        operator<<(std::ostream &os, result const &r)
+        {
+            if (r.ec)
+            {
+                os << r.ec.category().name()<< " : " << r.ec.value() << " : " << r.ec.message();
+            }
+            else
+            {
+                os << r.n;
+            }
+            return os;
+        }
+    };
+
+    bool
+    operator==(result const &l, result const &r)
+    {
+        return l.as_tuple() == r.as_tuple();
+    }
+
+    bool
+    operator!=(result const &l, result const &r)
+    {
+        return l.as_tuple() != r.as_tuple();
+    }
+
+    using namespace std::literals;
+
+    struct grind_failure : std::runtime_error
+    {
+        using std::runtime_error::runtime_error;
+    };
+
+    result grind(std::string_view input)
+    {
+        number_parser np_base;
+        auto next = np_base(input.begin(), input.end());
+        if (!np_base.is_complete())
+            np_base.finalise();
+        auto consumed_base = std::distance(input.begin(), next);
+        auto result_base = result(np_base);
+
+        for (std::size_t i = 1 ; i < input.size() ; ++i)
+        {
+            number_parser np;
+            next = np(input.data(), input.data() + i);
+            if (!np.is_complete() && !np.error())
+                next = np(next, input.data() + input.size());
+           if (!np.is_complete())
+               np.finalise();
+            auto consumed = std::distance(input.begin(), next);
+            auto res = result(np);
+
+            if (res != result_base || consumed != consumed_base)
+            {
+                std::ostringstream ss;
+                ss << "gind failure: "
+                      "expected " << result_base << "," << consumed_base
+                      << " but got " << res << "," << consumed;
+                throw grind_failure(ss.str());
+            }
+        }
+        return result_base;
+    }
+
+    /// a check which did not hold
+    struct check_failure : std::runtime_error
+    {
+        using std::runtime_error::runtime_error;
+    };
+
+    void
+    expect(bool condition, std::string_view what)
+    {
+        if (!condition)
+            throw check_failure("check failed: " + std::string(what));
+    }
+
+    void
+    check_number_grammar()
+    {
+        for (auto text : { "0"sv, "-0"sv, "1.5"sv, "-0.25e-3"sv, "1E+2"sv, "10"sv, "0e0"sv })
+            expect(!grind(text).ec, text);
+
+        // a sign, a point and an exponent must each be followed by a digit
+        for (auto text : { "-"sv, "1."sv, "1e"sv, "1e+"sv, "1E-"sv, "-.5"sv, ".5"sv, "-a"sv, "1.e5"sv, "01"sv })
+            expect(grind(text).ec == asio::error::invalid_argument, text);
+
+        for (auto doc : { "[-]"sv, "[1.]"sv, "[1e]"sv, "[1e+]"sv, "[-.5]"sv, "-"sv, "1."sv, "{\"a\":1e}"sv })
+        {
+            system::error_code ec;
+            parse(doc, ec);
+            expect(ec == asio::error::invalid_argument, doc);
+        }
+    }
+
+    void
+    check_depth_limit()
+    {
+        auto nested = [](std::size_t depth) { return std::string(depth, '[') + std::string(depth, ']'); };
+        using tokenizer = basic_tokenizer< value_builder >;
+
+        system::error_code ec;
+        parse(nested(tokenizer::default_max_depth), ec);
+        expect(!ec, "nesting at the maximum depth parses");
+        // deep enough to overflow the stack when the value is destroyed, had it been built
+        parse(nested(1 << 20), ec);
+        expect(ec == error::too_deep, "nesting beyond the maximum depth fails");
+
+        tokenizer tk;
+        tk.set_max_depth(2);
+        expect(!tokenize(tk, "[{\"a\":1}]"), "nesting within a lowered maximum parses");
+        tk.reset();
+        expect(tokenize(tk, "[{\"a\":[]}]") == error::too_deep, "nesting beyond a lowered maximum fails");
+    }
+
+    void
+    check_schema_enum()
+    {
+        auto schema = compiled_schema::parse(R"({"enum":["a","b"]})");
+        auto validate = [&](std::string_view doc) {
+            basic_tokenizer< validating_handler<> > tk { validating_handler<>(schema) };
+            return tokenize(tk, doc);
+        };
+        expect(!validate(R"("a")"), "a listed string is in the enum");
+        expect(validate(R"("c")") == error::not_in_enum, "an unlisted string is not in the enum");
+        expect(validate("{}") == error::not_in_enum, "an object is not in an enum of scalars");
+        expect(validate("[]") == error::not_in_enum, "an array is not in an enum of scalars");
+    }
+
+    /// counts the events a validating_handler passes on
+    struct counting_handler : null_handler
+    {
+        std::size_t events = 0;
+
+        void
+        on_array_begin(system::error_code &)
+        {
+            ++events;
+        }
+        void
+        on_number(number const &, system::error_code &)
+        {
+            ++events;
+        }
+        void
+        on_string(std::string_view, system::error_code &)
+        {
+            ++events;
+        }
+    };
+
+    void
+    check_schema_keywords()
+    {
+        auto validate = [](std::string_view schema_text, std::string_view doc) {
+            auto                                    schema = compiled_schema::parse(schema_text);
+            basic_tokenizer< validating_handler<> > tk { validating_handler<>(schema) };
+            return tokenize(tk, doc);
+        };
+        struct expectation
+        {
+            std::string_view   schema, doc;
+            system::error_code ec;
+        };
+        system::error_code const valid;
+        std::initializer_list< expectation > const expectations = {
+            { R"({"type":"integer"})", "3", valid },
+            { R"({"type":"integer"})", "3.0", valid },
+            { R"({"type":"integer"})", "-30e-1", valid },
+            { R"({"type":"integer"})", "3.5", error::type_mismatch },
+            { R"({"type":"integer"})", R"("3")", error::type_mismatch },
+            { R"({"type":"number"})", "3", valid },
+            { R"({"type":"number"})", "null", error::type_mismatch },
+            { R"({"type":["string","null"]})", "null", valid },
+            { R"({"type":["string","null"]})", R"("s")", valid },
+            { R"({"type":["string","null"]})", "true", error::type_mismatch },
+            { R"({"type":"object"})", "[]", error::type_mismatch },
+            { R"({"items":{"type":"boolean"}})", "[true,false]", valid },
+            { R"({"items":{"type":"boolean"}})", "[true,0]", error::type_mismatch },
+
+            { R"({"properties":{"a":{}},"required":["a","b"]})", R"({"b":2,"a":1})", valid },
+            { R"({"properties":{"a":{}},"required":["a","b"]})", R"({"a":1,"c":2})", error::missing_required_key },
+            { R"({"properties":{"a":{}},"required":["a","b"]})", "{}", error::missing_required_key },
+            { R"({"required":["a","a"]})", R"({"a":1})", valid },
+            { R"({"properties":{"o":{"required":["x"]}},"required":["o"]})", R"({"o":{"x":1}})", valid },
+            { R"({"properties":{"o":{"required":["x"]}},"required":["o"]})",
+              R"({"o":{"y":{"x":1}}})",
+              error::missing_required_key },
+            { R"({"items":{"required":["x"]}})", R"([{"x":1},{"x":2}])", valid },
+            { R"({"items":{"required":["x"]}})", R"([{"x":1},{}])", error::missing_required_key },
+
+            { R"({"minimum":1,"maximum":10})", "1", valid },
+            { R"({"minimum":1,"maximum":10})", "10", valid },
+            { R"({"minimum":1,"maximum":10})", "1e1", valid },
+            { R"({"minimum":1,"maximum":10})", "0.999", error::out_of_range },
+            { R"({"minimum":1,"maximum":10})", "10.0001", error::out_of_range },
+            { R"({"minimum":1,"maximum":10})", "-5", error::out_of_range },
+            { R"({"minimum":-1e-5})", "-0.00001", valid },
+            { R"({"minimum":-1e-5})", "-0.000010000000000000000001", error::out_of_range },
+            { R"({"maximum":1e300})", "1e300", valid },
+            { R"({"maximum":1e300})", "1e400", error::out_of_range },
+            { R"({"exclusiveMinimum":1,"exclusiveMaximum":10})", "1", error::out_of_range },
+            { R"({"exclusiveMinimum":1,"exclusiveMaximum":10})", "1.0000001", valid },
+            { R"({"exclusiveMinimum":1,"exclusiveMaximum":10})", "9.99", valid },
+            { R"({"exclusiveMinimum":1,"exclusiveMaximum":10})", "10", error::out_of_range },
+            { R"({"exclusiveMinimum":1,"exclusiveMaximum":10})", "0.1e2", error::out_of_range },
+            { R"({"exclusiveMinimum":0})", "0", error::out_of_range },
+            { R"({"exclusiveMinimum":0})", "-0", error::out_of_range },
+            { R"({"exclusiveMinimum":0})", "1e-400", valid },
+
+            { R"({"minLength":2,"maxLength":3})", R"("a")", error::bad_string_length },
+            { R"({"minLength":2,"maxLength":3})", R"("ab")", valid },
+            { R"({"minLength":2,"maxLength":3})", R"("abc")", valid },
+            { R"({"minLength":2,"maxLength":3})", R"("abcd")", error::bad_string_length },
+            { R"({"minLength":1})", R"("")", error::bad_string_length },
+            { R"({"maxLength":0})", R"("")", valid },
+            // lengths count code points, not bytes
+            { R"({"minLength":2,"maxLength":3})", "\"\xc3\xa9\"", error::bad_string_length },
+            { R"({"minLength":2,"maxLength":3})", "\"\xc3\xa9\xc3\xa9\xc3\xa9\"", valid },
+            { R"({"minLength":2,"maxLength":3})", R"("éééé")", error::bad_string_length },
+            { R"({"minLength":2,"maxLength":3})", R"("😀")", error::bad_string_length },
+            { R"({"minLength":2,"maxLength":3})", R"("😀x")", valid },
+            { R"({"minLength":2,"maxLength":3})", R"("😀")", error::bad_string_length },
+            { R"({"minLength":2,"maxLength":3})", R"("😀é")", valid },
+            { R"({"minLength":2,"maxLength":3})", "\"\xf0\x9f\x98\x80\xf0\x9f\x98\x80\xf0\x9f\x98\x80\"", valid },
+        };
+        for (auto &e : expectations)
+            expect(validate(e.schema, e.doc) == e.ec, std::string(e.schema) + " against " + std::string(e.doc));
+
+        // the first violation stops the parse: nothing after it reaches the next handler
+        auto schema = compiled_schema::parse(R"({"items":{"type":"integer","maximum":5}})");
+        struct stop
+        {
+            std::string_view   doc;
+            system::error_code ec;
+            std::size_t        events;
+        };
+        for (auto &e : { stop { "[1,2,\"x\",3]", error::type_mismatch, 3 },
+                         stop { "[1,9,\"x\",3]", error::out_of_range, 2 },
+                         stop { "[1,2,3]", valid, 4 } })
+        {
+            basic_tokenizer< validating_handler< counting_handler > > tk {
+                validating_handler< counting_handler >(schema)
+            };
+            expect(tokenize(tk, e.doc) == e.ec, e.doc);
+            expect(tk.handler().next().events == e.events, "events stop at the first violation");
+        }
+    }
+
+    void
+    check_digit_budget()
+    {
+        auto validate = [](compiled_schema const &schema, std::string const &doc) {
+            basic_tokenizer< validating_handler<> > tk { validating_handler<>(schema) };
+            return tokenize(tk, doc);
+        };
+        auto bounded = compiled_schema::parse(R"({"maximum":1e9})");
+        auto long_fraction = "0." + std::string(900, '1');
+        expect(!validate(bounded, long_fraction), "a long number within the digit budget is checked");
+        expect(validate(bounded, std::string(100000, '1')) == error::out_of_range,
+               "a run of digits beyond the budget of a bounded number is out of range");
+        expect(!validate(compiled_schema::parse("{}"), std::string(100000, '1')),
+               "an unbounded number has no digit budget");
+
+        auto wide = compiled_schema::parse(R"({"minimum":0,"maximum":1e2000})");
+        expect(!validate(wide, "1" + std::string(1999, '0')), "the budget fits the bounds written out");
+        auto narrow = compiled_schema::parse(R"({"maximum":1e9})", 8);
+        expect(validate(narrow, "0." + std::string(20, '1')) == error::out_of_range, "the budget can be lowered");
+    }
+
+    void
+    check_compare()
+    {
+        auto compare = [](std::string const &l, std::string const &r, bool member_order_matters = false) {
+            std::istringstream ls(l), rs(r);
+            return compare_streams(ls, rs, 3, member_order_matters);
+        };
+        expect(!compare("[1.0,{\"a\":null}]", "[1,{\"a\":null}]"), "1.0 == 1");
+        expect(compare("[1,2]", "[1,3]") == "/1"s, "the first difference in an array");
+        expect(compare("{\"a\":{\"b\":[true]}}", "{\"a\":{\"b\":[false]}}") == "/a/b/0"s,
+               "the first difference in nested containers");
+
+        auto l = R"({"a":1,"b":{"x":[1,2],"y":"s"},"c":null})"s;
+        auto r = R"({"c":null,"b":{"y":"s","x":[1.0,2]},"a":1e0})"s;
+        expect(!compare(l, r), "members match by key in any order");
+        expect(compare(l, r, true) == "/a"s, "members in order when order matters");
+        expect(compare(l, R"({"c":null,"b":{"y":"s","x":[1,3]},"a":1})") == "/b/x/1"s,
+               "a reordered member which differs, down to the value within it");
+        expect(compare(R"({"a":1,"b":{"x":[1,{"p":2}]}})", R"({"b":{"x":[1,{"p":3}]},"a":1})") == "/b/x/1/p"s,
+               "a difference deep in a reordered member");
+        expect(compare(R"({"a":[1,2],"b":0})", R"({"b":0,"a":[1,2,3]})") == "/a/2"s,
+               "an element on one side only of a reordered member");
+        expect(compare(R"({"a":{"p":1,"q":2},"b":0})", R"({"b":0,"a":{"q":2,"p":1,"r":3}})") == "/a/r"s,
+               "a key on one side only of a reordered member");
+        expect(compare(R"({"a":[1],"b":0})", R"({"b":0,"a":{"0":1}})") == "/a"s,
+               "reordered members of different types");
+        expect(compare(l, R"({"a":1,"c":null})") == "/b"s, "a member missing from one side");
+        expect(compare(R"({"a":1})", R"({"a":1,"b":2})") == "/b"s, "a member added on one side");
+        expect(compare(R"([{"a":1,"b":2},3])", R"([{"b":2,"a":1},4])") == "/1"s,
+               "comparison resumes in order after a reordered object");
+
+        auto duplicate = [&](std::string const &l, std::string const &r) {
+            try
+            {
+                compare(l, r);
+            }
+            catch (system::system_error const &e)
+            {
+                return e.code() == error::duplicate_key;
+            }
+            return false;
+        };
+        expect(duplicate(R"({"a":1,"b":2,"b":3})", R"({"b":2,"a":1})"), "a key repeated among reordered members");
+        expect(duplicate(R"({"b":2,"a":1})", R"({"a":1,"b":2,"a":1})"), "a repeat of a key already matched");
+        expect(duplicate(R"({"x":{"p":1,"p":1},"a":0})", R"({"a":0,"x":{"p":1,"p":1}})"),
+               "a key repeated in an object within a reordered member");
+        expect(!compare(R"({"a":1,"a":1})", R"({"a":1,"a":1})"), "documents which agree in order may repeat keys");
+    }
+
+    void
+    check_unique_keys()
+    {
+        auto check = [](std::string_view doc) {
+            basic_tokenizer< unique_keys<> > tk;
+            return tokenize(tk, doc);
+        };
+        auto long_a = std::string(20, 'a'), long_b = std::string(19, 'a') + 'b';
+        auto member = [](std::string const &key) { return "\"" + key + "\":0"; };
+
+        expect(!check(R"([{"a":1,"b":2},{"a":1,"b":2},{"b":2,"a":1},{"a":1}])"), "distinct keys in every object");
+        expect(check(R"({"a":1,"a":2})") == error::duplicate_key, "a duplicate in the first object");
+        expect(check(R"([{"a":1,"b":2},{"a":1,"b":2,"a":3}])") == error::duplicate_key,
+               "a duplicate after the keys of the previous object");
+        expect(check(R"([{"a":1,"b":2},{"b":2,"c":3,"b":1}])") == error::duplicate_key,
+               "a duplicate after the keys part from the previous object");
+        expect(check(R"([{"a":1,"b":2,"c":3},{"a":1,"c":3,"b":2,"a":0}])") == error::duplicate_key,
+               "a duplicate of a key matched by position");
+        expect(!check(R"({"a":{"a":1,"b":{"a":2}},"b":[{"a":1}]})"), "keys are distinct per object, not per document");
+        expect(!check("[{" + member(long_a) + "," + member(long_b) + "},{" + member(long_b) + "," + member(long_a) +
+                      "}]"),
+               "distinct long keys");
+        expect(check("[{" + member(long_a) + "},{" + member(long_b) + "," + member(long_a) + "," + member(long_b) +
+                     "}]") == error::duplicate_key,
+               "a duplicate long key");
+
+        std::string wide = "{";
+        for (int k = 0; k < 100; ++k)
+            wide += (k ? "," : "") + member("k" + std::to_string(k));
+        expect(!check(wide + "}"), "distinct keys in a wide object");
+        expect(check(wide + "," + member("k57") + "}") == error::duplicate_key, "a duplicate in a wide object");
+    }
+
+    void
+    check_persistent_sharing()
+    {
+        system::error_code ec;
+        auto before = parse_persistent(R"({"a":{"x":1},"b":[1,2,3],"c":{"y":{"z":2},"w":[4]}})", ec);
+        expect(!ec, "a persistent document parses");
+        auto after = set_pointer(before, "/c/y/z", pvalue(std::string("new")), ec);
+        expect(!ec, "set a value by pointer");
+
+        auto same = [&](std::string_view pointer) {
+            auto l = find_pointer(before, pointer), r = find_pointer(after, pointer);
+            if (auto o = l->if_object())
+                return o->identity() == r->if_object()->identity();
+            return l->if_array()->identity() == r->if_array()->identity();
+        };
+        expect(same("/a") && same("/b") && same("/c/w"), "set shares the values off its path");
+        expect(!same("/c") && !same("/c/y"), "set copies the values on its path");
+        expect(*find_pointer(after, "/c/y/z")->if_string() == "new", "set replaces the value");
+        expect(find_pointer(before, "/c/y/z")->if_number(), "set leaves the original unchanged");
+
+        auto root = *before.if_object();
+        auto added = root.set("d", pvalue(true));
+        expect(added.size() == root.size() + 1 && root.find("d") == nullptr, "pobject::set adds to a copy");
+        expect(added.find("a")->if_object()->identity() == root.find("a")->if_object()->identity(),
+               "pobject::set shares the other members");
+    }
+
+    void
+    check_on_demand()
+    {
+        system::error_code ec;
+        {
+            on_demand_document doc(
+                R"({"skipped":{"deep":[1,{"x":"}"}],"s":"]"},"i":-42,"d":0.25,"s":"a\"b","t":true,"n":null,)"
+                R"("big":1e30,"frac":1.5,"arr":[1,2,3],"last":"end"})");
+            expect(doc.find_field("i").get_int64(ec) == -42 && !ec, "get_int64 after skipping a nested value");
+            expect(doc.find_field("d").get_double(ec) == 0.25 && !ec, "get_double");
+            expect(doc.find_field("s").get_string(ec) == "a\"b" && !ec, "get_string unescapes");
+            expect(doc.find_field("t").get_bool(ec) && !ec, "get_bool");
+            expect(doc.find_field("n").is_null(ec) && !ec, "is_null");
+
+            auto big = doc.find_field("big");
+            big.get_int64(ec);
+            expect(ec == error::out_of_range, "get_int64 of a number too large");
+            ec.clear();
+            expect(big.get_number(ec).exponent.buffer == "e30" && !ec, "get_number gives the number as written");
+
+            auto frac = doc.find_field("frac");
+            frac.get_int64(ec);
+            expect(ec == error::type_mismatch, "get_int64 of a fraction");
+            ec.clear();
+            expect(!frac.get_string(ec).size() && ec == error::type_mismatch, "get_string of a number");
+            ec.clear();
+            expect(!frac.skip(), "skip a value left unconsumed");
+
+            auto            arr = doc.find_field("arr");
+            on_demand_value element;
+            expect(arr.next_element(element, ec) && element.get_int64(ec) == 1, "the first element");
+            expect(!arr.skip(), "skip the rest of an entered array");
+            expect(doc.find_field("last").get_string(ec) == "end" && !ec, "a member after a skipped array");
+            expect(doc.find_field("i").error() == error::no_such_path, "members before the cursor are not found");
+        }
+        {
+            on_demand_document doc;
+            std::string        text = R"({"a":{"b":[true,"x"]},"c":12345})";
+            std::int64_t       c    = 0;
+            for (std::size_t i = 0;; ++i)
+            {
+                if (i < text.size())
+                    doc.append(text.substr(i, 1));
+                else
+                    doc.finish();
+                ec.clear();
+                c = doc.find_field("c").get_int64(ec);
+                if (ec != error::need_more)
+                    break;
+            }
+            expect(!ec && c == 12345, "an access repeated as input arrives a byte at a time");
+        }
+    }
+
+    value
+    parse_or_throw(std::string_view text)
+    {
+        system::error_code ec;
+        auto               v = parse(text, ec);
+        if (ec)
+            throw system::system_error(ec, "parse");
+        return v;
+    }
+
+    void
+    check_serialize_round_trip()
+    {
+        for (auto doc : { "[0.5,-0.5,-0,0,0e0,1.25e-7,-0.0,10,{\"a\":[0.001]}]"sv, "0.5"sv, "-0"sv })
+        {
+            auto once = serialize(parse_or_throw(doc));
+            expect(serialize(parse_or_throw(once)) == once, doc);
+        }
+        expect(serialize(parse_or_throw("[0.5,-0,-0.25,0e0]")) == "[0.5,-0,-0.25,0]", "zeros before the point");
+    }
+
+    /// doc with ops applied to it in memory, as compact JSON, for comparison with the streaming editors
+    std::string
+    apply_in_memory(std::string_view doc, std::vector< patch_operation > const &ops)
+    {
+        std::optional< value > target = parse_or_throw(doc);
+        for (auto &op : ops)
+            if (auto ec = apply_operation(target, op))
+                throw system::system_error(ec, "apply_in_memory");
+        return target ? serialize(*target) : std::string();
+    }
+
+    patch_operation
+    operation(patch_op op, std::string_view pointer, std::string_view json = "null")
+    {
+        system::error_code ec;
+        auto               path = parse_pointer(pointer, ec);
+        if (ec)
+            throw system::system_error(ec, "operation");
+        return { op, std::move(path), parse_or_throw(json) };
+    }
+
+    void
+    check_rewrite()
+    {
+        auto doc = R"({ "id": 7, "user": { "name": "ann", "tags": ["a", "b"] }, "items": [ {"n": 1}, {"n": 2} ],)"
+                   R"( "empty": {} })"s;
+        std::vector< rewrite_rule > rules = {
+            rewrite_rule::replace_value("/user/name", R"("bob")"),
+            rewrite_rule::replace_value("/items/1", R"({"n":20,"x":true})"),
+            rewrite_rule::replace_value("/user/tags/0", "null"),
+            rewrite_rule::insert_member("/user", "age", "42"),
+            rewrite_rule::insert_member("/empty", "k", "[1]"),
+        };
+        auto expected = apply_in_memory(doc,
+                                        { operation(patch_op::replace, "/user/name", R"("bob")"),
+                                          operation(patch_op::replace, "/items/1", R"({"n":20,"x":true})"),
+                                          operation(patch_op::replace, "/user/tags/0"),
+                                          operation(patch_op::add, "/user/age", "42"),
+                                          operation(patch_op::add, "/empty/k", "[1]") });
+
+        expect(serialize(parse_or_throw(rewrite(doc, rules))) == expected, "rewrite matches the edits made in memory");
+        for (std::size_t chunk = 1; chunk < 8; ++chunk)
+        {
+            rewriter    rw(rules);
+            std::string out;
+            auto        append = [&](std::vector< asio::const_buffer > const &bufs) {
+                for (auto &b : bufs)
+                    out.append(static_cast< const char * >(b.data()), b.size());
+            };
+            for (std::size_t i = 0; i < doc.size(); i += chunk)
+                append(rw.feed(asio::buffer(doc.data() + i, std::min(chunk, doc.size() - i))));
+            append(rw.finalise());
+            expect(!rw.error() && serialize(parse_or_throw(out)) == expected, "rewrite in chunks matches in memory");
+        }
+        expect(rewrite(R"({"a":1})", { rewrite_rule::replace_value("", "[]") }) == "[]", "replace the document");
+    }
+
+    void
+    check_patch()
+    {
+        auto doc = R"({"a":[0,1,{"x":2},3,4],"b":{"c":[[1],[2]],"d":0.5},"e":[]})"s;
+        auto patches = {
+            R"([{"op":"add","path":"/a/-","value":5}])"s,
+            R"([{"op":"add","path":"/a/0","value":"first"},{"op":"remove","path":"/a/3"}])"s,
+            R"([{"op":"remove","path":"/a/1"},{"op":"remove","path":"/a/1"},{"op":"add","path":"/a/1","value":[9]}])"s,
+            R"([{"op":"replace","path":"/a/2/x","value":-0},{"op":"add","path":"/a/5","value":null}])"s,
+            R"([{"op":"add","path":"/a/1","value":{"y":1}},{"op":"replace","path":"/a/1/y","value":2},)"
+            R"({"op":"add","path":"/a/-","value":6},{"op":"add","path":"/a/-","value":7}])"s,
+            R"([{"op":"add","path":"/e/0","value":1},{"op":"add","path":"/e/-","value":2}])"s,
+            R"([{"op":"remove","path":"/b/c/0/0"},{"op":"add","path":"/b/c/1/0","value":0},)"
+            R"({"op":"remove","path":"/b/d"}])"s,
+            R"([{"op":"add","path":"/a/-","value":5},{"op":"remove","path":"/a/5"}])"s,
+            R"([{"op":"replace","path":"/b","value":{}},{"op":"add","path":"/b/k","value":[]}])"s,
+        };
+        for (auto &text : patches)
+        {
+            auto patch = compiled_patch::parse(text);
+            auto                           list = parse_or_throw(text);
+            std::vector< patch_operation > ops;
+            for (auto &entry : *list.if_is< array >())
+            {
+                auto &o    = *entry.if_is< object >();
+                auto  name = *o.find("op")->if_is< std::string >();
+                auto  op   = name == "add" ? patch_op::add : name == "remove" ? patch_op::remove : patch_op::replace;
+                ops.push_back(operation(op,
+                                        *o.find("path")->if_is< std::string >(),
+                                        o.find("value") ? serialize(*o.find("value")) : "null"));
+            }
+            auto expected = apply_in_memory(doc, ops);
+            expect(apply_patch(doc, patch) == expected, text);
+            for (std::size_t chunk = 1; chunk < 5; ++chunk)
+            {
+                patcher     pt(patch);
+                std::string out;
+                for (std::size_t i = 0; i < doc.size(); i += chunk)
+                    out += pt.feed(doc.data() + i, doc.data() + std::min(doc.size(), i + chunk));
+                out += pt.finalise();
+                expect(!pt.error() && out == expected, text);
+            }
+        }
+
+        auto spliced = compiled_patch::parse(R"([{"op":"add","path":"/a/0","value":1},{"op":"remove","path":"/a/2"}])");
+        expect(spliced.nodes.size() == 2 && spliced.nodes[1].splice, "array insertions and removals stream");
+        auto held = compiled_patch::parse(R"([{"op":"add","path":"/a/-","value":1},{"op":"remove","path":"/a/2"}])");
+        expect(!held.nodes[1].splice, "an index after an append depends on the length");
+
+        for (auto text : { R"([{"op":"remove","path":"/a/5"}])"sv, R"([{"op":"add","path":"/a/6","value":1}])"sv,
+                           R"([{"op":"replace","path":"/e/0","value":1}])"sv })
+        {
+            auto    patch = compiled_patch::parse(text);
+            patcher pt(patch);
+            pt.feed(doc.data(), doc.data() + doc.size());
+            pt.finalise();
+            expect(pt.error() == error::no_such_path, text);
+        }
+
+        auto merged = apply_patch(doc, compiled_patch::parse_merge(R"({"b":{"c":null,"n":1},"e":{"f":0.5}})"));
+        auto target = parse_or_throw(doc);
+        merge_patch(target, parse_or_throw(R"({"b":{"c":null,"n":1},"e":{"f":0.5}})"));
+        expect(merged == serialize(target), "a merge patch matches one applied in memory");
+    }
+
+    /// records every event with the offset at which the tokenizer delivered it
+    struct event_log
+    {
+        basic_tokenizer< event_log > const *                 tk = nullptr;
+        std::vector< std::pair< std::size_t, std::string > > events;
+
+        void
+        log(std::string e)
+        {
+            events.emplace_back(tk->offset(), std::move(e));
+        }
+
+        void
+        on_object_begin(system::error_code &)
+        {
+            log("{");
+        }
+        void
+        on_object_end(system::error_code &)
+        {
+            log("}");
+        }
+        void
+        on_array_begin(system::error_code &)
+        {
+            log("[");
+        }
+        void
+        on_array_end(system::error_code &)
+        {
+            log("]");
+        }
+        void
+        on_key(std::string_view k, system::error_code &)
+        {
+            log("k" + std::string(k));
+        }
+        void
+        on_string(std::string_view s, system::error_code &)
+        {
+            log("s" + std::string(s));
+        }
+        number_range const *
+        on_number_begin(system::error_code &)
+        {
+            return nullptr;
+        }
+        void
+        on_number(number const &n, system::error_code &)
+        {
+            std::string text;
+            append_number(text, n);
+            log("n" + text);
+        }
+        void
+        on_bool(bool b, system::error_code &)
+        {
+            log(b ? "t" : "f");
+        }
+        void
+        on_null(system::error_code &)
+        {
+            log("z");
+        }
+    };
+
+    void
+    check_checkpoints()
+    {
+        std::string doc = "[";
+        for (int i = 0; i < 200; ++i)
+            doc += (i ? "," : "") + R"({"id":)"s + std::to_string(i) + R"(,"tags":["a",{"b":[1,2.5,null]}],"ok":true})";
+        doc += "]";
+
+        basic_tokenizer< event_log > whole;
+        whole.handler().tk = &whole;
+        expect(!tokenize(whole, doc), "the document tokenizes");
+        auto &all = whole.handler().events;
+
+        auto index = checkpoint_index::build(doc, 64);
+        expect(index.checkpoints.size() > 50, "checkpoints are taken through the document");
+        for (auto &cp : index.checkpoints)
+        {
+            basic_tokenizer< event_log > tk;
+            tk.handler().tk = &tk;
+            resume(tk, cp);
+            auto ec = tokenize(tk, std::string_view(doc).substr(std::size_t(cp.offset)));
+            auto first = std::find_if(all.begin(), all.end(), [&](auto &e) { return e.first > cp.offset; });
+            expect(!ec && std::equal(first, all.end(), tk.handler().events.begin(), tk.handler().events.end()),
+                   "resuming from a checkpoint gives the same events");
+        }
+
+        system::error_code ec;
+        auto element = read_element(doc, index, 123, ec);
+        expect(!ec && serialize(element) == serialize(parse_or_throw(R"({"id":123,"tags":["a",{"b":[1,2.5,null]}],)"
+                                                                     R"("ok":true})")),
+               "read an element from the nearest checkpoint");
+
+        std::stringstream saved;
+        index.save(saved);
+        auto bytes  = saved.str();
+        auto loaded = [](std::string const &b) {
+            std::istringstream is(b);
+            return checkpoint_index::load(is);
+        };
+        auto copy = loaded(bytes);
+        expect(copy.checkpoints.size() == index.checkpoints.size() &&
+                   copy.checkpoints.back().offset == index.checkpoints.back().offset &&
+                   to_pointer(copy.checkpoints.back().path) == to_pointer(index.checkpoints.back().path),
+               "an index loads as saved");
+
+        auto rejected = [&](std::string const &b) {
+            try
+            {
+                loaded(b);
+            }
+            catch (system::system_error &e)
+            {
+                return e.code() == error::bad_index;
+            }
+            return false;
+        };
+        expect(rejected(bytes.substr(0, bytes.size() - 1)), "a truncated index is rejected");
+        auto huge_count = bytes;
+        std::memset(&huge_count[24], 0x7f, 8);
+        expect(rejected(huge_count), "a count larger than the index is rejected");
+        auto huge_key = bytes;
+        // the first checkpoint's outer segment: offset, depth, then is_object, index and key length
+        std::memset(&huge_key[32 + 8 + 4 + 1 + 8], 0xff, 4);
+        expect(rejected(huge_key), "a key longer than the index is rejected");
+    }
+
+    void
+    check_infer_schema()
+    {
+        auto ndjson = "{\"a\":1,\"a\":2,\"n\":{\"k\":1,\"k\":2}}\n{\"b\":1,\"n\":{}}\n{\"a\":3}\n"sv;
+        for (unsigned threads : { 1u, 2u })
+        {
+            auto  schema = infer_ndjson_schema(ndjson, threads);
+            auto &root   = schema.nodes[0];
+            expect(root.objects == 3 && root.properties["a"].present == 2, "a repeated key counts once per object");
+            auto &n = schema.nodes[root.properties["n"].node];
+            expect(n.objects == 2 && n.properties["k"].present == 1, "a repeated nested key counts once per object");
+            expect(schema.to_json().find("\"required\"") == std::string::npos, "no key is in every object");
+        }
+    }
+
+    void
+    check_config_holder()
+    {
+        system::error_code ec;
+        auto               version = [](config_holder::reader const &r) { return *r.find("/v")->if_string(); };
+
+        config_holder holder(parse_persistent(R"({"v":"0","w":"0"})", ec));
+        {
+            auto pinned = holder.read();
+            holder.reload(R"({"v":"1","w":"1"})", ec);
+            expect(!ec && version(holder.read()) == "1", "reload publishes a new version");
+            expect(version(pinned) == "0", "a reader keeps the version it pinned");
+            expect(holder.collect() == 1, "a version a reader can see is not reclaimed");
+            {
+                auto nested = holder.read();
+                expect(version(nested) == "1", "a nested read sees the current version");
+            }
+            expect(holder.collect() == 1, "leaving a nested read does not end the outer one");
+        }
+        expect(holder.collect() == 0, "a version is reclaimed once its readers are gone");
+
+        holder.reload(R"({"v":)", ec);
+        expect(ec && version(holder.read()) == "1", "a document which does not parse is not published");
+        ec.clear();
+
+        auto snapshot = holder.snapshot();
+        holder.publish(parse_persistent(R"({"v":"2","w":"2"})", ec));
+        expect(holder.collect() == 0 && *find_pointer(snapshot, "/v")->if_string() == "1",
+               "a snapshot outlives the version it was taken from");
+
+        // readers race a writer; every version they see must be whole
+        std::atomic< bool >        done { false };
+        std::atomic< unsigned >    torn { 0 };
+        std::vector< std::thread > readers;
+        for (int i = 0; i < 3; ++i)
+            readers.emplace_back([&] {
+                while (!done.load())
+                {
+                    auto r = holder.read();
+                    if (version(r) != *r.find("/w")->if_string())
+                        ++torn;
+                }
+            });
+        for (int i = 3; i < 2000; ++i)
+        {
+            auto n = std::to_string(i);
+            holder.reload(R"({"v":")" + n + R"(","w":")" + n + R"("})", ec);
+        }
+        done = true;
+        for (auto &t : readers)
+            t.join();
+        expect(!ec && torn == 0, "readers see whole versions while a writer publishes");
+        expect(version(holder.read()) == "1999", "the last version published is current");
+        expect(holder.collect() == 0, "every replaced version is reclaimed once the readers stop");
+    }
+
+    void
+    check_object_index()
+    {
+        object o;
+        for (int i = 0; i < 32; ++i)
+            o.emplace_back("k" + std::to_string(i), value(std::string("v" + std::to_string(i))));
+        o.emplace_back("k0", value(nullptr));
+
+        auto found = [&](object const &obj, std::string const &key, std::string_view expected) {
+            auto v = obj.find(key);
+            if (expected.empty())
+                return v == nullptr;
+            return v && v->if_is< std::string >() && *v->if_is< std::string >() == expected;
+        };
+        auto warm = [&](object const &obj) {
+            for (int round = 0; round < 4 && !obj.indexed(); ++round)
+                for (auto &m : obj.members())
+                    obj.find(m.first);
+            return obj.indexed();
+        };
+
+        expect(warm(o), "lookups build an index");
+        expect(found(o, "k0", "v0") && found(o, "k31", "v31") && found(o, "k32", ""),
+               "the index finds the first of duplicate keys, and nothing for absent ones");
+
+        expect(o.erase("k5") && !o.indexed(), "erase drops the index");
+        o.emplace_back("k5", value(std::string("again")));
+        expect(warm(o), "lookups rebuild the index");
+        expect(found(o, "k5", "again") && found(o, "k6", "v6") && found(o, "k31", "v31"),
+               "keys moved by an erase are found at their new positions");
+        expect(o.erase("k0") && o.find("k0") && o.find("k0")->is_null(),
+               "erasing the first of duplicate keys uncovers the second");
+
+        warm(o);
+        auto moved = std::move(o);
+        expect(moved.indexed() && found(moved, "k7", "v7"), "the index moves with the members");
+        auto copy = moved;
+        copy.emplace_back("extra", value(true));
+        expect(!copy.indexed() && copy.find("extra") && !moved.find("extra"), "a copy has its own members");
+    }
+
+    void
+    check_interning()
+    {
+        std::string doc = R"([{"a":1,"b":[1,2,{"x":"s"}]},{"b":[1,2,{"x":"s"}],"a":1},{"a":1,"a":2},{"a":2},)"
+                          R"({"x":"s"},"s",1.0,1,-0,0,[],{},[[]],[{}],{"k":{"a":1,"a":2}},{"k":{"a":2}},null,true)";
+        for (int i = 0; i < 50; ++i)
+            doc += ",{\"id\":" + std::to_string(i % 7) + ",\"tags\":[\"t" + std::to_string(i % 3) + "\"]}";
+        doc += ']';
+
+        system::error_code ec;
+        auto               plain = parse_persistent(doc, ec);
+        expect(!ec, "a document parses without an interner");
+        pvalue_interner interner;
+        auto            interned = parse_persistent(doc, ec, &interner);
+        expect(!ec, "a document parses with an interner");
+        expect(serialize(thaw(plain)) == serialize(thaw(interned)), "interning leaves the document unchanged");
+
+        auto again = parse_persistent(doc, ec, &interner);
+        expect(interned.if_array()->identity() == again.if_array()->identity(), "an equal document is shared whole");
+        auto &a = *interned.if_array();
+        expect(a[0].if_object()->identity() == a[1].if_object()->identity(), "equal objects are shared");
+        expect(interner.stats().hits > 0, "the interner counts values shared");
+    }
+
+    void
+    check_ingest_max_record()
+    {
+        auto record  = [](std::size_t length) { return "{\"k\":\"" + std::string(length - 8, 'x') + "\"}\n"; };
+        auto payload = "{\"a\":1}\n" + record(40) + record(16) + record(17) + "[1]\n";
+
+        // small reads split the long records at every offset, so the newline arrives with pieces of each length
+        for (std::size_t read_size : { 3, 5, 7, 64, 4096 })
+        {
+            ingest_options options;
+            options.threads    = 1;
+            options.pin        = false;
+            options.read_size  = read_size;
+            options.max_record = 16;
+            ingest_server server(asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), 0), options);
+            std::thread   runner([&] { server.run(); });
+            {
+                asio::io_context      ioc;
+                asio::ip::tcp::socket socket(ioc);
+                socket.connect(server.local_endpoint());
+                asio::write(socket, asio::buffer(payload));
+            }
+            auto         deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+            ingest_stats stats;
+            for (stats = server.stats(); stats.records + stats.malformed < 5; stats = server.stats())
+            {
+                if (std::chrono::steady_clock::now() > deadline)
+                    break;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            server.stop();
+            runner.join();
+            expect(stats.records == 3 && stats.malformed == 2,
+                   "records longer than max_record are skipped however the reads split them");
+        }
+    }
+
+    void
+    check_codegen_identifiers()
     {
-        void
-        notify_negative()
+        auto schema = R"({"type":"object","properties":{"\u00fcber":{"type":"string"},"a-b":{"type":"integer"},)"
+                      R"("a--b":{"type":"integer"},"-":{"type":"boolean"},"!!":{"type":"boolean"},)"
+                      R"("class":{"type":"string"},"_id":{"type":"integer"},"1st":{"type":"integer"},)"
+                      R"("a b":{"type":"object","properties":{"-x-":{"type":"integer"},"__":{"type":"integer"}}}}})"s;
+        codegen_options options;
+        options.name = "rec";
+        auto header  = generate_parser(std::string_view(schema), options);
+
+        // keys appear in string literals as they are; identifiers are everything else
+        std::istringstream lines(header);
+        std::string        line;
+        bool               reserved = false;
+        while (std::getline(lines, line))
+            if (line.find('"') == std::string::npos)
+                reserved = reserved || line.find("__") != std::string::npos || line.find(" _") != std::string::npos;
+        expect(!reserved, "generated identifiers have no double or leading _");
+        for (auto name : { " ber ", " a_b ", " a_b_2 ", " field ", " field_2 ", " field_class ", " id ", " field_1st ",
+                           " has_a_b ", "struct rec_a_b_3", " x ", " a_b_3 " })
+            expect(header.find(name) != std::string::npos, "keys are made into the expected identifiers");
+
+        bool rejected = false;
+        try
         {
-            buffer += "-";
+            options.name = "rec_";
+            generate_parser(std::string_view(schema), options);
         }
-        void
-        notify_decimal()
+        catch (system::system_error const &e)
         {
-            buffer += ".";
+            rejected = e.code() == error::invalid_schema;
         }
+        expect(rejected, "a name which would join into a double _ is rejected");
+    }
+
+    /// unsigned integer of any size, for exact references
+    struct big_uint
+    {
+        std::vector< std::uint32_t > limbs;   // least significant first
+
         void
-        notify_digit(char c)
+        multiply_add(std::uint32_t m, std::uint32_t a = 0)
         {
-            buffer += c;
+            std::uint64_t carry = a;
+            for (auto &l : limbs)
+            {
+                auto p = std::uint64_t(l) * m + carry;
+                l      = std::uint32_t(p);
+                carry  = p >> 32;
+            }
+            if (carry)
+                limbs.push_back(std::uint32_t(carry));
         }
+
+        /// multiply by base^n, base at most 10
         void
-        finalise()
+        scale(std::uint32_t base, long long n)
         {
-            if (buffer.empty())
-                buffer = "0";
+            auto chunk = base == 2 ? 16 : 9;
+            for (; n > 0; n -= chunk)
+            {
+                std::uint32_t m = 1;
+                for (long long i = 0; i < std::min< long long >(n, chunk); ++i)
+                    m *= base;
+                multiply_add(m);
+            }
         }
 
-        std::string buffer;
+        friend int
+        compare(big_uint const &l, big_uint const &r)
+        {
+            auto size = [](big_uint const &b) {
+                auto n = b.limbs.size();
+                while (n && !b.limbs[n - 1])
+                    --n;
+                return n;
+            };
+            auto ln = size(l), rn = size(r);
+            if (ln != rn)
+                return ln < rn ? -1 : 1;
+            for (auto i = ln; i-- > 0;)
+                if (l.limbs[i] != r.limbs[i])
+                    return l.limbs[i] < r.limbs[i] ? -1 : 1;
+            return 0;
+        }
     };
 
-    bool
-    operator==(mantissa_builder const &l, mantissa_builder const &r)
+    /// |n| as exact decimal digits times 10^exponent
+    struct exact_decimal
     {
-        return l.buffer == r.buffer;
-    }
+        big_uint  digits;
+        long long count    = 0;   // significant digits
+        long long exponent = 0;
 
-    struct exponent_builder
-    {
-        void
-        notify_digit(char c)
-        {
-            buffer += c;
-        }
-        void
-        notify_negative()
+        explicit exact_decimal(number const &n)
         {
-            buffer += "-";
+            bool point = false;
+            for (auto c : n.mantissa.buffer)
+                if (c == '.')
+                    point = true;
+                else if (c >= '0' && c <= '9')
+                {
+                    exponent -= point;
+                    if (count || c != '0')
+                    {
+                        digits.multiply_add(10, std::uint32_t(c - '0'));
+                        ++count;
+                    }
+                }
+            exponent += std::stoll(n.exponent.buffer.substr(1));
         }
-        void
-        finalise()
+
+        /// compared with a positive finite double
+        int
+        compare_to(double d) const
         {
-            if (buffer.empty())
-                buffer = "0";
-            buffer.insert(buffer.begin(), 'e');
+            int  k;
+            auto m = std::uint64_t(std::ldexp(std::frexp(d, &k), 53));
+            k -= 53;
+            big_uint l = digits, r;
+            r.limbs    = { std::uint32_t(m), std::uint32_t(m >> 32) };
+            l.scale(10, exponent);
+            r.scale(10, -exponent);
+            l.scale(2, -k);
+            r.scale(2, k);
+            return compare(l, r);
         }
-
-        std::string buffer;
     };
 
+    /// whether f is |n| rounded to the nearest float, ties to even
     bool
-    operator==(exponent_builder const &l, exponent_builder const &r)
+    correctly_rounded(number const &n, float f)
     {
-        return l.buffer == r.buffer;
+        exact_decimal x(n);
+        if (x.count == 0)
+            return f == 0;
+        // beyond these the value is certainly above FLT_MAX and its half ulp, or below half the least subnormal
+        if (x.exponent + x.count > 40)
+            return std::isinf(f);
+        if (x.exponent + x.count < -50)
+            return f == 0;
+
+        std::uint32_t bits;
+        std::memcpy(&bits, &f, sizeof(bits));
+        bool even   = !(bits & 1);
+        auto top    = std::ldexp(1.0, 128);   // where the floats would go on after FLT_MAX
+        auto larger = f == std::numeric_limits< float >::max() ? top : double(std::nextafter(f, INFINITY));
+        if (std::isinf(f))
+        {
+            auto c = x.compare_to((double(std::numeric_limits< float >::max()) + top) / 2);
+            return c > 0 || (c == 0 && even);
+        }
+        if (f != 0)
+        {
+            auto c = x.compare_to((double(std::nextafter(f, 0.0f)) + double(f)) / 2);
+            if (c < 0 || (c == 0 && !even))
+                return false;
+        }
+        auto c = x.compare_to((double(f) + larger) / 2);
+        return c < 0 || (c == 0 && even);
     }
 
-    struct number
+    /// every number in a document
+    struct number_log : null_handler
     {
-        mantissa_builder mantissa;
-        exponent_builder exponent;
+        std::vector< number > numbers;
 
-        friend std::ostream &
-        operator<<(std::ostream &os, number const &n)
+        void
+        on_number(number const &n, system::error_code &)
         {
-            os << n.mantissa.buffer << n.exponent.buffer;
-            return os;
+            numbers.push_back(n);
         }
+    };
 
-        auto
-        as_tuple() const
+    void
+    check_float32()
+    {
+        std::vector< std::string > texts = {
+            "0", "-0", "1", "-1.5", "0.1", "16777216", "16777217", "16777219", "33554434", "33554435",
+            "16777217.000000000000000000001", "1.000000059604644775390625", "1.000000059604644775390625000000001",
+            "0.1000000000000000000000000000001", "123456789012345678901234567890", "1e-46", "7e-46", "7.1e-46",
+            "1e-45", "1.4e-45", "1.401298464324817e-45", "1.1754942e-38", "1.17549435e-38", "3.4028234e38",
+            "3.4028235e38", "340282356779733661637539395458142568448", "340282356779733661637539395458142568447",
+            "3.4028236e38", "1e39", "-1e39", "1e400", "1e-400", "0.000000000000000000000000000001234567890123456789",
+        };
+
+        // halfway between neighbouring floats across the whole range, and the doubles either side, written
+        // with every digit; %e prints them exactly with glibc
+        std::uint64_t x    = 0x9E3779B97F4A7C15ull;
+        auto          next = [&] {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            return x;
+        };
+        char buffer[1024];
+        for (int i = 0; i < 2000; ++i)
         {
-            return std::tie(mantissa, exponent);
+            auto  bits = std::uint32_t(next() % 0x7F7FFFFF);
+            float f;
+            std::memcpy(&f, &bits, sizeof(f));
+            auto half = (double(f) + double(std::nextafter(f, INFINITY))) / 2;
+            for (auto d : { half, std::nextafter(half, 0.0), std::nextafter(half, 1.0e300) })
+            {
+                std::snprintf(buffer, sizeof(buffer), "%.800e", d);
+                texts.push_back(buffer);
+            }
         }
-    };
-    bool
-    operator==(number const &l, number const &r)
+        // random decimals of up to 30 digits
+        for (int i = 0; i < 20000; ++i)
+        {
+            std::string t = next() % 2 ? "-" : "";
+            auto        n = 1 + next() % 30;
+            for (std::uint64_t d = 0; d < n; ++d)
+                t += char('0' + (d == 0 && n > 1 ? 1 + next() % 9 : next() % 10));
+            texts.push_back(t + "e" + std::to_string(int(next() % 120) - 60));
+        }
+
+        std::string doc = "[";
+        for (auto &t : texts)
+            doc += t + ",";
+        doc.back() = ']';
+        doc += '\n';
+        corpus_shape shape;
+        shape.numbers[2] = 4;
+        shape.digits     = { 1, 25 };
+        doc += corpus_generator(shape, 7).generate(1 << 20);
+
+        basic_tokenizer< number_log > tk;
+        for_each_record(doc, 0, doc.size(), [&](std::string_view record, std::size_t) {
+            tk.reset();
+            expect(!tokenize(tk, record), "the float32 inputs parse");
+        });
+        auto &numbers = tk.handler().numbers;
+        expect(numbers.size() > texts.size() + 10000, "the corpus adds numbers");
+        for (auto &n : numbers)
+        {
+            system::error_code ec;
+            auto               f = to_float(n, ec);
+            if (!correctly_rounded(n, std::fabs(f)) || (ec == error::out_of_range) != std::isinf(f))
+            {
+                std::string text;
+                append_number(text, n);
+                expect(false, "to_float rounds " + text.substr(0, 60) + " to the nearest float");
+            }
+        }
+    }
+
+    /// feed doc to tk in pieces ending at cuts, as successive reads would deliver it, then finalise. Anything
+    /// but whitespace after the value is an error, as for tokenize.
+    template < class Handler >
+    system::error_code
+    tokenize_pieces(basic_tokenizer< Handler > &tk, std::string_view doc, std::vector< std::size_t > cuts)
     {
-        return l.as_tuple() == r.as_tuple();
+        cuts.push_back(doc.size());
+        std::sort(cuts.begin(), cuts.end());
+        auto        next = doc.data();
+        std::size_t at   = 0;
+        for (auto cut : cuts)
+        {
+            if (cut == at)
+                continue;
+            next = tk(doc.data() + at, doc.data() + cut);
+            at   = cut;
+            if (tk.error() || tk.is_complete())
+                break;
+        }
+        tk.finalise();
+        if (tk.error())
+            return tk.error();
+        for (auto end = doc.data() + doc.size(); next != end; ++next)
+            if (*next != ' ' && *next != '\t' && *next != '\n' && *next != '\r')
+                return asio::error::invalid_argument;
+        return {};
     }
 
-    /// state machine controlling the parsing of a JSON number
-    /// given np is an instance of number_parser:
-    /// while there is input
-    ///   next = np(begin, end);
-    struct number_parser : asio::coroutine
+    void
+    check_number_engines()
     {
-        using iterator       = char *;
-        using const_iterator = const char *;
+        std::uint64_t x    = 0x2545F4914F6CDD1Dull;
+        auto          next = [&](std::uint64_t n) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            return x % n;
+        };
+        auto digits = [&](std::size_t n, bool leading) {
+            std::string d;
+            for (std::size_t i = 0; i < n; ++i)
+                d += char('0' + (leading && i == 0 && n > 1 ? 1 + next(9) : next(10)));
+            return d;
+        };
+        auto number_text = [&]() -> std::string {
+            static const char *const malformed[] = { "1.", "-", "01", "1e", "1.e5", "-.5", "1e+", "--1", "1E-" };
+            if (next(40) == 0)
+                return malformed[next(9)];
+            std::string t = next(3) ? "" : "-";
+            t += digits(1 + next(next(4) ? 4 : 40), true);
+            if (next(2))
+                t += "." + digits(1 + next(next(4) ? 4 : 40), false);
+            if (next(3) == 0)
+            {
+                t += next(2) ? "e" : "E";
+                t += next(3) ? "" : next(2) ? "+" : "-";
+                t += digits(1 + next(4), false);
+            }
+            return t;
+        };
+        std::function< std::string(int) > element = [&](int depth) -> std::string {
+            auto kind = depth ? next(6) : 0;
+            if (kind == 1)
+            {
+                std::string a = "[";
+                for (std::uint64_t i = 0, n = next(6); i < n; ++i)
+                    a += (i ? "," : "") + element(depth - 1);
+                return a + "]";
+            }
+            if (kind == 2)
+            {
+                std::string o = "{";
+                for (std::uint64_t i = 0, n = next(5); i < n; ++i)
+                    o += (i ? ", " : "") + ("\"k" + std::to_string(i) + "\": ") + element(depth - 1);
+                return o + "}";
+            }
+            return kind == 3 ? "\"s\"" : number_text();
+        };
+
+        std::vector< std::string > docs = { "0", "-12", "1.5e3", "123456789012345678901234567890", "1.", "[1,-]" };
+        for (int i = 0; i < 1500; ++i)
+            docs.push_back(next(10) ? "[" + element(3) + "," + element(3) + "]" : element(3));
 
-        system::error_code const &
-        error() const
+        const number_engine engines[] = { number_engine::bytewise, number_engine::swar, number_engine::simd };
+        for (auto &doc : docs)
         {
-            return error_;
+            basic_tokenizer< event_log > reference;
+            reference.handler().tk = &reference;
+            reference.number_engines().pin(number_engine::bytewise);
+            auto expected = tokenize(reference, doc);
+
+            for (int engine = 0; engine < 4; ++engine)
+                for (int split = 0; split < 3; ++split)
+                {
+                    std::vector< std::size_t > cuts;
+                    if (split == 2)
+                        for (std::size_t i = 1; i < doc.size(); ++i)
+                            cuts.push_back(i);
+                    else
+                        for (std::uint64_t i = 0, n = split ? 1 + next(4) : 0; i < n; ++i)
+                            cuts.push_back(next(doc.size() + 1));
+
+                    basic_tokenizer< event_log > tk;
+                    tk.handler().tk = &tk;
+                    if (engine < 3)
+                        tk.number_engines().pin(engines[engine]);
+                    auto ec = tokenize_pieces(tk, doc, cuts);
+                    expect(ec == expected && tk.handler().events == reference.handler().events,
+                           "every number engine gives the events and errors of number_parser, however the input "
+                           "is split: " + doc.substr(0, 80));
+                }
         }
 
-#include <boost/asio/yield.hpp>
-        const_iterator
-        operator()(const_iterator begin, const_iterator end)
+        // each pinned engine takes every number followed by a delimiter within the buffer
+        std::string short_runs = "[", long_runs = "[";
+        for (int i = 0; i < 2000; ++i)
         {
-            auto p = begin;
+            short_runs += (i ? "," : "") + std::to_string(i % 100);
+            long_runs += (i ? "," : "") + digits(24, true) + "." + digits(20, false);
+        }
+        short_runs += "]";
+        long_runs += "]";
+        for (auto engine : engines)
+        {
+            basic_tokenizer< null_handler > tk;
+            tk.number_engines().pin(engine);
+            expect(!tokenize(tk, long_runs), "long runs parse");
+            auto &stats = tk.number_stats();
+            expect(stats.engine == engine && stats.switches == 0 && stats.numbers[unsigned(engine)] == 2000,
+                   std::string("a pinned engine counts every number as its own: ") + to_string(engine));
+        }
 
-            auto exhausted = [&] { return p == end; };
+        // adaptive: long runs move to simd, short ones back to swar, and numbers which always straddle the
+        // ends of buffers to number_parser; every number is counted once
+        basic_tokenizer< null_handler > tk;
+        auto &stats = tk.number_stats();
+        auto  total = [&] { return stats.numbers[0] + stats.numbers[1] + stats.numbers[2]; };
+        expect(stats.engine == number_engine::swar, "the adaptive engine starts with swar");
+        expect(!tokenize(tk, long_runs) && stats.engine == number_engine::simd && stats.switches == 1,
+               "long runs of digits switch to simd");
+        tk.reset();
+        expect(!tokenize(tk, short_runs) && stats.engine == number_engine::swar && stats.switches == 2,
+               "short runs of digits switch back to swar");
+        std::vector< std::size_t > every_byte;
+        for (std::size_t i = 1; i < short_runs.size(); ++i)
+            every_byte.push_back(i);
+        tk.reset();
+        expect(!tokenize_pieces(tk, short_runs, every_byte) && stats.engine == number_engine::bytewise &&
+                   stats.switches == 3,
+               "numbers which straddle buffers switch to number_parser");
+        tk.reset();
+        expect(!tokenize(tk, short_runs) && stats.engine == number_engine::swar && stats.switches == 4,
+               "a stream recovers from number_parser once numbers fit in its buffers");
+        expect(total() == 8000 && stats.numbers[0] > 0 && stats.numbers[1] > 0 && stats.numbers[2] > 0,
+               "every number is counted under the engine which parsed it");
+    }
 
-            auto consume = [&] {
-                ++p;
-                return exhausted();
-            };
+    /// the first difference between two documents, or empty if they are equal as values
+    std::string
+    difference(std::string const &left, std::string const &right)
+    {
+        std::istringstream l(left), r(right);
+        return compare_streams(l, r).value_or("");
+    }
 
-            auto is_digit = [&] {
-                auto c = *p;
-                return c >= '0' && c <= '9';
-            };
+    void
+    check_codegen_parser()
+    {
+        // a parser generated as check is built, from a schema in which the struct for info would be named
+        // order_info, as is a field of order
+        using codegen_check::order;
+        using info = decltype(order::info);
 
-            auto finalising = [&] { return begin == end; };
+        auto full  = R"({"order_info":"first","info":{"a":7,"b":null},"price":12.50,"weight":2.5e-1,"paid":true,)"
+                     R"("tags":["x","yé"],"lines":[{"sku":"s1","qty":2},{"qty":1,"sku":"s2"}],)"
+                     R"("extra":{"k":[1,"2",null]}})"s;
+        auto least = R"({"price":0,"info":{"a":-1},"order_info":""})"s;
+        for (auto &doc : { full, least })
+        {
+            system::error_code ec;
+            auto               o = codegen_check::parse_order(doc, ec);
+            expect(!ec, "a generated parser accepts a valid document");
+            expect(difference(codegen_check::serialize_order(o), doc).empty(),
+                   "a generated parser and serializer round trip the document: " + doc);
 
-            reenter(this)
+            // and in pieces, however the input is split
+            for (std::size_t cut = 0; cut <= doc.size(); ++cut)
             {
-                if (finalising())
-                {
-                    error_ = asio::error::invalid_argument;
-                    yield break;
-                }
-                // [+-]?
-                if (*p == '+')
-                {
-                    if (consume())
-                    {
-                        yield;
-                        if (finalising())
-                        {
-                            error_ = asio::error::invalid_argument;
-                            yield break;
-                        }
-                    }
-                }
-                else if (*p == '-')
-                {
-                    mantissa_.notify_negative();
-                    if (consume())
-                    {
-                        yield;
-                        if (finalising())
-                        {
-                            error_ = asio::error::invalid_argument;
-                            yield break;
-                        }
-                    }
-                }
-                // leading zero must be followed by a . or nothing
-                if (*p == '0')
-                {
-                    if (consume())
-                    {
-                        yield;
-                        if (finalising())
-                        {
-                            yield break;
-                        }
-                    }
-                    if (*p != '.')
-                    {
-                        error_ = asio::error::invalid_argument;
-                        yield break;
-                    }
-                    goto on_mantissa_decimal;
-                }
-                // keep consuming leading digits
-                while (is_digit())
-                {
-                    mantissa_.notify_digit(*p);
-                    if (consume())
-                    {
-                        yield;
-                        if (finalising())
-                        {
-                            yield break;
-                        }
-                    }
-                }
+                codegen_check::order_parser tk;
+                auto ec = tokenize_pieces(tk, doc, { cut, cut + 1, cut + 7 });
+                expect(!ec && codegen_check::serialize_order(tk.handler().get()) == codegen_check::serialize_order(o),
+                       "a generated parser gives the same result from chunks");
+            }
+        }
 
-                if (*p == 'e' || *p == 'E')
-                    goto on_exponent_start;
+        system::error_code ec;
+        auto               o = codegen_check::parse_order(full, ec);
+        expect(o.order_info == "first" && o.info.a == 7 && (o.info.null & info::has_b) && o.lines.size() == 2 &&
+                   o.lines[1].sku == "s2" && o.tags[1] == "y\xc3\xa9" && (o.present & order::has_extra),
+               "a generated parser fills the fields of the struct");
 
-                if (*p != '.')
-                {
-                    // this is the end of the number
-                    yield break;
-                }
+        auto fails = [](std::string_view doc, error e) {
+            system::error_code ec;
+            codegen_check::parse_order(doc, ec);
+            return ec == e;
+        };
+        for (auto doc : { R"({"order_info":"x","price":1})"sv, R"({"order_info":"x","info":{"b":"y"},"price":1})"sv,
+                          R"({"order_info":"x","info":{"a":1},"price":1,"lines":[{"sku":"s"}]})"sv })
+            expect(fails(doc, error::missing_required_key), "a missing required key is reported: " + std::string(doc));
+        for (auto doc :
+             { R"({"order_info":5,"info":{"a":1},"price":1})"sv, R"({"order_info":"x","info":[],"price":1})"sv,
+               R"({"order_info":"x","info":{"a":"1"},"price":1})"sv,
+               R"({"order_info":"x","info":{"a":1},"price":1,"tags":[1]})"sv,
+               R"({"order_info":"x","info":{"a":1},"price":true})"sv })
+            expect(fails(doc, error::type_mismatch), "a value of the wrong type is reported: " + std::string(doc));
+    }
 
-                // fallthrough
+    void
+    check_pmr()
+    {
+        corpus_shape shape;
+        shape.string_length  = { 0, 100 };
+        shape.key_length     = { 3, 40 };
+        shape.escape_density = 0.05;
+        shape.digits         = { 1, 30 };
+        auto text            = corpus_generator(shape, 11).generate(256 << 10);
+        text += "{\"\":[[[]],{},\"\",-0,1e400]}\n[\"\\u00e9\\ud83d\\ude00\"]\n{\"a\":[1,}\n\"unterminated\n";
 
-            on_mantissa_decimal:
-                mantissa_.notify_decimal();
-                if (consume())
-                {
-                    yield;
-                    if (finalising())
-                    {
-                        yield break;
-                    }
-                }
+        // parse's tokenizer takes its memory from the default resource, so find what it gives first
+        std::vector< std::pair< system::error_code, std::string > > expected;
+        for_each_record(text, 0, text.size(), [&](std::string_view record, std::size_t) {
+            system::error_code ec;
+            auto               v = parse(record, ec);
+            expected.emplace_back(ec, serialize(v));
+        });
 
-                while (is_digit())
-                {
-                    mantissa_.notify_digit(*p);
-                    if (consume())
-                    {
-                        yield;
-                        if (finalising())
-                        {
-                            yield break;
-                        }
-                    }
-                }
+        // then nothing may come from the default resource: the document, the builder and the tokenizer all use
+        // the one given, and to_value and serialize use none
+        struct restore
+        {
+            std::pmr::memory_resource *previous;
+            ~restore()
+            {
+                std::pmr::set_default_resource(previous);
+            }
+        } restore_default { std::pmr::set_default_resource(std::pmr::null_memory_resource()) };
 
-                if (*p != 'e' && *p != 'E')
-                {
-                    yield break;
-                }
+        std::uint64_t x       = 0x9E3779B97F4A7C15ull;
+        std::size_t   records = 0;
+        for_each_record(text, 0, text.size(), [&](std::string_view record, std::size_t) {
+            auto &[expected_ec, expected_text] = expected[records++];
 
-            on_exponent_start:
-                if (consume())
-                {
-                    yield;
-                    if (finalising())
-                    {
-                        error_ = asio::error::invalid_argument;
-                        yield break;
-                    }
-                }
-                if (*p == '-')
-                {
-                    exponent_.notify_negative();
-                    if (consume())
-                    {
-                        yield;
-                        if (finalising())
-                        {
-                            error_ = asio::error::invalid_argument;
-                            yield break;
-                        }
-                    }
-                }
-                else if (*p == '+')
-                {
-                    if (consume())
-                    {
-                        yield;
-                        if (finalising())
-                        {
-                            error_ = asio::error::invalid_argument;
-                            yield break;
-                        }
-                    }
-                }
-                while (is_digit())
-                {
-                    exponent_.notify_digit(*p);
-                    if (consume())
-                    {
-                        yield;
-                        if (finalising())
-                        {
-                            yield break;
-                        }
-                    }
-                }
-            }
+            std::pmr::monotonic_buffer_resource whole(std::pmr::new_delete_resource());
+            system::error_code                  ec;
+            auto                                v = parse_pmr(record, &whole, ec);
+            expect(ec == expected_ec, "parse_pmr reports the errors parse does");
+            if (ec)
+                return;
+            expect(serialize(to_value(v)) == expected_text, "parse_pmr builds the document parse does");
 
-            // special case if called with empty range, finalise values
-            if (finalising())
+            // and in pieces, when keys and strings are carried from one to the next in the tokenizer's buffer
+            std::vector< std::size_t > cuts;
+            for (int i = 0; i < 4; ++i)
             {
-                mantissa_.finalise();
-                exponent_.finalise();
+                x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+                cuts.push_back(x % (record.size() + 1));
             }
+            std::pmr::monotonic_buffer_resource  pieces(std::pmr::new_delete_resource());
+            basic_tokenizer< pmr_value_builder > tk(pmr_value_builder(&pieces), &pieces);
+            ec = tokenize_pieces(tk, record, cuts);
+            expect(!ec && serialize(to_value(tk.handler().get())) == expected_text,
+                   "a pmr tokenizer builds the same document from pieces");
+        });
+        expect(records > 100, "the pmr documents were checked");
+    }
 
-            return p;
+    void
+    check_parse_batch()
+    {
+        // failures of every kind, each followed by a document which a builder left inside one would spoil
+        std::vector< std::string_view > inputs = { R"({"a":[1,{"b":2}],"c":"d"})",
+                                                   R"({"a":[1,{"b":2)",
+                                                   "[true]",
+                                                   R"({"a":1,})",
+                                                   R"({"x":null})",
+                                                   "[1,2]x",
+                                                   "3.5",
+                                                   "",
+                                                   R"([[["deep"]],{"k":[)",
+                                                   R"("s")",
+                                                   "  ",
+                                                   "{}",
+                                                   "[1e999999999999999999999]",
+                                                   R"({"e":"é"})" };
+        std::vector< value >              outputs;
+        std::vector< system::error_code > errors;
+        auto                              failed = parse_batch(inputs, outputs, errors);
+
+        std::size_t expected_failed = 0;
+        for (std::size_t i = 0; i < inputs.size(); ++i)
+        {
+            system::error_code ec;
+            auto               v = parse(inputs[i], ec);
+            expected_failed += bool(ec);
+            expect(errors[i] == ec && serialize(outputs[i]) == serialize(v),
+                   "parse_batch gives each document and error parse gives: " + std::string(inputs[i]));
         }
-#include <boost/asio/unyield.hpp>
+        expect(failed == expected_failed && failed >= 5, "parse_batch counts the documents which failed");
+    }
 
-        void
-        finalise()
+    /// the encoded key of a JSON scalar, as ndjson_index find takes it
+    std::string
+    key_of(std::string_view json)
+    {
+        basic_tokenizer< key_projection > tk(key_projection { {} });
+        system::error_code                ec;
+        if (!project_key(tk, json, ec))
+            throw system::system_error(ec, "key_of");
+        return tk.handler().key();
+    }
+
+    void
+    check_ndjson_index()
+    {
+        // 42 in three spellings, spread through the document so that each build thread sees some, among
+        // records with other keys, none, or a key which cannot be indexed
+        std::string                  data;
+        std::vector< std::uint64_t > forty_two, string_42, unkeyed;
+        std::uint64_t                records = 0;
+        for (int i = 0; i < 3000; ++i, ++records)
         {
-            static const char empty[] = "";
-            if (!error_)
+            auto offset = data.size();
+            if (i % 401 == 17)
+            {
+                forty_two.push_back(offset);
+                data += i % 3 == 0 ? R"({"id":42,"n":1})" : i % 3 == 1 ? R"({"n":2,"id":42.0})" : R"({"id":4.2e1})";
+            }
+            else if (i % 997 == 5)
+            {
+                string_42.push_back(offset);
+                data += R"({"id":"42"})";
+            }
+            else if (i % 7 == 3)
+            {
+                unkeyed.push_back(offset);
+                data += i % 2 ? R"({"n":4})" : R"({"id":[42],"x":{"id":42}})";
+            }
+            else if (i % 11 == 0)
             {
-                (*this)(empty, empty);
+                data += "   ";
+                --records;
             }
+            else
+                data += "{\"id\":" + std::to_string(i * 1000) + ",\"s\":\"" + std::string(i % 50, 'z') + "\"}";
+            data += '\n';
         }
 
-        number get_number() const { return number { mantissa_, exponent_ }; }
+        std::string reference;
+        for (unsigned threads : { 1u, 2u, 3u, 8u })
+        {
+            std::ostringstream os;
+            auto               stats = build_ndjson_index(data, "/id", os, threads);
+            expect(stats.records == records && stats.indexed == records - unkeyed.size(),
+                   "the index counts records and indexes those with a key");
+            if (reference.empty())
+                reference = os.str();
+            expect(os.str() == reference, "the index is the same however many threads build it");
+        }
 
-        mantissa_builder   mantissa_;
-        exponent_builder   exponent_;
-        system::error_code error_;
-    };
+        auto stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+        auto name  = "check_ndjson_index_" + std::to_string(stamp);
+        auto path  = (std::filesystem::temp_directory_path() / name).string();
+        auto write = [&](std::string_view bytes) {
+            std::ofstream os(path, std::ios::binary | std::ios::trunc);
+            os.write(bytes.data(), std::streamsize(bytes.size()));
+        };
+        struct remove_file
+        {
+            std::string const &path;
+            ~remove_file()
+            {
+                std::remove(path.c_str());
+            }
+        } remove_at_end { path };
 
-    struct result
-    {
-        system::error_code ec;
-        number             n;
+        write(reference);
+        {
+            ndjson_index       index(path);
+            system::error_code ec;
+            for (auto spelling : { "42", "42.0", "4.2e1", "420e-1" })
+                expect(index.find(data, key_of(spelling), ec) == forty_two && !ec,
+                       "every spelling of a number finds the records with any spelling of it");
+            expect(index.find(data, key_of("\"42\""), ec) == string_42, "a string is not the number it spells");
+            expect(index.find(data, key_of("43"), ec).empty() && !ec, "a key no record has finds nothing");
+            expect(index.size() == records - unkeyed.size(), "the index holds the keyed records");
 
-        result(number_parser const& np)
-        : ec(np.error())
-        , n(np.get_number())
-        {}
+            index.find(data + "\n", key_of("42"), ec);
+            expect(ec == error::bad_index, "an index is rejected for a document of the wrong size");
+        }
 
-        auto
-        as_tuple() const
+        // a record whose key hashes as 42's does, which is only found by projecting it again
         {
-            return std::tie(ec, n);
+            auto pointer = "/id"s;
+            auto h       = hash_bytes(key_of("42"));
+            auto colliding = forty_two;
+            colliding.push_back(string_42[0]);
+            colliding.push_back(unkeyed[0]);
+            std::sort(colliding.begin(), colliding.end());
+            std::string bytes(detail::ndjson_index_magic, sizeof(detail::ndjson_index_magic));
+            auto        put = [&](std::uint64_t x) { bytes.append(reinterpret_cast< const char * >(&x), sizeof(x)); };
+            put(data.size());
+            put(colliding.size());
+            put(pointer.size());
+            bytes += pointer;
+            bytes.resize((bytes.size() + 7) & ~std::size_t(7));
+            for (auto offset : colliding)
+            {
+                put(h);
+                put(offset);
+            }
+            write(bytes);
+            ndjson_index       index(path);
+            system::error_code ec;
+            expect(index.find(data, key_of("42"), ec) == forty_two && !ec,
+                   "a record whose key only shares the hash is not a match");
         }
 
-        friend std::ostream &
-        operator<<(std::ostream &os, result const &r)
-        {
-            if (r.ec)
+        auto rejected = [&](std::string_view bytes) {
+            write(bytes);
+            try
             {
-                os << r.ec.category().name()<< " : " << r.ec.value() << " : " << r.ec.message();
+                ndjson_index index(path);
             }
-            else
+            catch (system::system_error const &e)
             {
-                os << r.n;
+                return e.code() == error::bad_index;
             }
-            return os;
-        }
-    };
+            return false;
+        };
+        expect(rejected(std::string_view(reference).substr(0, reference.size() - 8)), "a truncated index is rejected");
+        expect(rejected(std::string_view(reference).substr(0, 20)), "a truncated header is rejected");
+        expect(rejected("JSONKIX0" + reference.substr(8)), "an index without the magic is rejected");
+    }
 
-    bool
-    operator==(result const &l, result const &r)
+    void
+    check_external_sort()
     {
-        return l.as_tuple() == r.as_tuple();
+        // numbers spelled several ways, strings which agree on far more than the 16 bytes held in a sort entry,
+        // and records without a key, each record numbered in input order
+        struct expected_record
+        {
+            int         kind;   // no key, number, string
+            long long   hundredths;
+            std::string text;
+            std::string line;
+        };
+        std::vector< expected_record > records;
+        std::string                    data;
+        std::uint64_t                  x = 0x853C49E6748FEA9Bull;
+        auto next = [&](std::uint64_t n) {
+            x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+            return x % n;
+        };
+        auto shared = "a key prefix shared well past sixteen bytes/"s;
+        for (int i = 0; i < 2000; ++i)
+        {
+            expected_record r { 0, 0, {}, {} };
+            std::string     key;
+            switch (next(4))
+            {
+            case 0:
+                break;
+            case 1:
+            case 2:
+            {
+                // hundredths, so that 1.5, 150e-2 and 0.015e2 are one value
+                r.kind       = 1;
+                r.hundredths = (long long)next(41) - 20;
+                auto m       = std::to_string(std::llabs(r.hundredths));
+                auto sign    = r.hundredths < 0 || (r.hundredths == 0 && next(2)) ? "-" : "";
+                switch (next(3))
+                {
+                case 0:
+                    key = sign + m + "e-2";
+                    break;
+                case 1:
+                    key = sign + (r.hundredths ? m + "0e-3" : "0.000e5");
+                    break;
+                default:
+                    m.insert(0, 3 - std::min< std::size_t >(m.size(), 3), '0');
+                    key = sign + m.substr(0, m.size() - 2) + "." + m.substr(m.size() - 2);
+                    break;
+                }
+                break;
+            }
+            default:
+                r.kind = 2;
+                r.text = next(3) ? shared + std::string(1, char('a' + next(3))) + (next(2) ? "" : "z") : "b"s;
+                key    = "\"" + r.text + "\"";
+                break;
+            }
+            r.line = key.empty() ? "{\"i\":" + std::to_string(i) + "}"
+                                 : "{\"k\":" + key + ",\"i\":" + std::to_string(i) + "}";
+            data += r.line + "\n";
+            if (next(10) == 0)
+                data += "\n";
+            records.push_back(std::move(r));
+        }
+        std::stable_sort(records.begin(), records.end(), [](expected_record const &l, expected_record const &r) {
+            if (l.kind != r.kind)
+                return l.kind < r.kind;
+            return l.kind == 1 ? l.hundredths < r.hundredths : l.text < r.text;
+        });
+        std::string expected;
+        for (auto &r : records)
+            expected += r.line + "\n";
+
+        for (unsigned threads : { 1u, 3u })
+            for (std::size_t memory : { std::size_t(1) << 20, std::size_t(4096), std::size_t(1) })
+            {
+                external_sort_options options;
+                options.memory  = memory;
+                options.threads = threads;
+                std::ostringstream os;
+                auto               stats = sort_ndjson(data, "/k", os, options);
+                expect(os.str() == expected,
+                       "sort_ndjson puts keyless records first, then numbers by value and strings bytewise, "
+                       "keeping the input order of equal keys");
+                expect(stats.records == 2000 && (memory > 65536 ? stats.runs == 0 : stats.runs > 8),
+                       "small memory merges many runs");
+            }
     }
 
-    bool
-    operator!=(result const &l, result const &r)
+    void
+    check_prefilter()
     {
-        return l.as_tuple() != r.as_tuple();
-    }
+        // find_bytes against std::string_view::find: over a two letter alphabet most positions are partial
+        // matches, and needles of 1, 2, 16 and 17 bytes sit at and across the edge of each 16 byte load
+        std::uint64_t x    = 0xD1B54A32D192ED03ull;
+        auto          next = [&](std::uint64_t n) {
+            x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+            return x % n;
+        };
+        auto random_text = [&](std::size_t n) {
+            std::string t;
+            for (std::size_t i = 0; i < n; ++i)
+                t += "ab"[next(2)];
+            return t;
+        };
+        for (std::size_t size = 0; size <= 70; ++size)
+            for (std::size_t n = 1; n <= 20; ++n)
+                for (int trial = 0; trial < 4; ++trial)
+                {
+                    auto haystack = random_text(size);
+                    auto needle   = random_text(n);
+                    if (n <= size && trial % 2)
+                        haystack.replace(next(size - n + 1), n, needle);
+                    expect(find_bytes(haystack, needle) == std::string_view(haystack).find(needle),
+                           "find_bytes finds what find finds: " + needle + " in " + haystack);
+                }
+        expect(find_bytes("abc", "") == 0 && find_bytes("", "a") == std::string_view::npos,
+               "find_bytes handles empty needles and haystacks");
 
-    using namespace std::literals;
+        // filter_ndjson with and without Bloom filters against the predicate applied to every record
+        std::string data;
+        for (int i = 0; i < 4000; ++i)
+        {
+            // the literals are hidden by escapes in some spellings of the values which match
+            static const char *const users[]  = { "alice", "bob", "\\u0061lice", "alicia" };
+            static const char *const levels[] = { "error", "info", "\\u0065rror", "err\\u006fr", "errors" };
+            data += "{\"user\":\"" + std::string(users[next(4)]) + "\",\"level\":\"" + levels[next(5)] +
+                    "\",\"n\":" + std::to_string(i) + "}\n";
+            if (next(100) == 0)
+                data += "{\"user\":\"alice\",\"level\":\"error\",\n";   // malformed: never matches
+        }
+        auto predicate = [](value const &v) {
+            auto o = v.if_is< object >();
+            if (!o)
+                return false;
+            auto user  = o->find("user");
+            auto level = o->find("level");
+            return user && level && user->if_is< std::string >() && *user->if_is< std::string >() == "alice" &&
+                   level->if_is< std::string >() && *level->if_is< std::string >() == "error";
+        };
+        std::vector< std::size_t > expected;
+        for_each_record(data, 0, data.size(), [&](std::string_view record, std::size_t offset) {
+            system::error_code ec;
+            auto               v = parse(record, ec);
+            if (!ec && predicate(v))
+                expected.push_back(offset);
+        });
+        expect(expected.size() > 100, "the predicate matches records");
 
-    struct grind_failure : std::runtime_error
-    {
-        using std::runtime_error::runtime_error;
-    };
+        prefilter filter { { "alice", "error" } };
+        auto      run = [&](block_bloom const *blooms) {
+            std::vector< std::size_t > found;
+            auto                       stats = filter_ndjson(
+                data,
+                filter,
+                predicate,
+                [&](std::string_view, std::size_t offset) { found.push_back(offset); },
+                blooms);
+            expect(found == expected, "filtering finds exactly the records the predicate accepts");
+            return stats;
+        };
+        expect(run(nullptr).candidates < 4000, "the prefilter rejects records");
+        std::uint64_t skipped = 0;
+        for (std::size_t block : { 1, 64, 300, 4096, 1 << 20 })
+            for (std::size_t bits : { 64, 1024, 32768 })
+            {
+                auto blooms = block_bloom::build(data, block, bits);
+                skipped += run(&blooms).skipped;
+            }
+        expect(skipped > 0, "the Bloom filters skip blocks");
+    }
 
-    result grind(std::string_view input)
+    /// a corpus generated as json_corpus does: fixed size blocks, handed out to threads in turn, each thread with
+    /// a generator of its own
+    std::string
+    corpus_in_blocks(corpus_shape const &shape, std::uint64_t seed, std::size_t bytes, unsigned threads)
     {
-        number_parser np_base;
-        auto next = np_base(input.begin(), input.end());
-        if (!np_base.is_complete())
-            np_base.finalise();
-        auto consumed_base = std::distance(input.begin(), next);
-        auto result_base = result(np_base);
+        constexpr std::size_t           block_size = 4096;
+        auto                            blocks     = (bytes + block_size - 1) / block_size;
+        std::vector< corpus_generator > gens;
+        std::vector< std::string >      texts(blocks);
+        gens.reserve(threads);
+        for (unsigned t = 0; t < threads; ++t)
+            gens.emplace_back(shape, seed);
+        std::vector< std::thread >      pool;
+        for (unsigned t = 0; t < threads; ++t)
+            pool.emplace_back([&, t] {
+                for (auto i = t; i < blocks; i += threads)
+                    texts[i] = std::string(gens[t].block(i, std::min(block_size, bytes - i * block_size)));
+            });
+        for (auto &t : pool)
+            t.join();
+        std::string result;
+        for (auto &text : texts)
+            result += text;
+        return result += gens[0].finish();
+    }
 
-        for (std::size_t i = 1 ; i < input.size() ; ++i)
+    void
+    check_corpus()
+    {
+        corpus_shape ndjson;
+        corpus_shape nested  = corpus_shape::parse(R"({"format":"array","depth":5,"escape_density":0.2})");
+        corpus_shape numbers = corpus_shape::parse(R"({"types":{"object":1,"array":1,"number":20},)"
+                                                   R"("numbers":{"scientific":4,"decimal":1,"digits":[1,40]}})");
+        for (auto *shape : { &ndjson, &nested, &numbers })
         {
-            number_parser np;
-            next = np(input.data(), input.data() + i);
-            if (!np.is_complete() && !np.error())
-                next = np(next, input.data() + input.size());
-           if (!np.is_complete())
-               np.finalise();
-            auto consumed = std::distance(input.begin(), next);
-            auto res = result(np);
+            auto once = corpus_generator(*shape, 42).generate(200000);
+            expect(corpus_generator(*shape, 42).generate(200000) == once,
+                   "a seed and shape give the same corpus every time");
+            expect(corpus_generator(*shape, 43).generate(200000) != once, "another seed gives another corpus");
 
-            if (res != result_base || consumed != consumed_base)
+            auto reference = corpus_in_blocks(*shape, 42, 100000, 1);
+            for (unsigned threads : { 2u, 3u, 7u })
+                expect(corpus_in_blocks(*shape, 42, 100000, threads) == reference,
+                       "a corpus generated in blocks is the same on any number of threads");
+
+            // every record parses
+            std::size_t records = 0;
+            if (shape->ndjson)
+                for_each_record(reference, 0, reference.size(), [&](std::string_view record, std::size_t) {
+                    system::error_code ec;
+                    parse(record, ec);
+                    expect(!ec, "every generated record parses");
+                    ++records;
+                });
+            else
             {
-                std::ostringstream ss;
-                ss << "gind failure: "
-                      "expected " << result_base << "," << consumed_base
-                      << " but got " << res << "," << consumed;
-                throw grind_failure(ss.str());
+                system::error_code ec;
+                auto               v = parse(reference, ec);
+                expect(!ec && v.if_is< array >(), "a generated array parses");
+                records = v.if_is< array >()->size();
             }
+            expect(records > 100, "the corpus holds records");
         }
-        return result_base;
+    }
+
+    void
+    check_persistent_order()
+    {
+        // the keys of the members of an object, in the order it visits them
+        auto keys_of = [](pobject const &o) {
+            std::vector< std::string > keys;
+            o.for_each([&](std::string const &k, pvalue const &) { keys.push_back(k); });
+            return keys;
+        };
+
+        std::string                doc = "{";
+        std::vector< std::string > document_order;
+        for (int i = 0; i < 40; ++i)
+        {
+            document_order.push_back("key" + std::to_string(i));
+            doc += (i ? ",\"" : "\"") + document_order.back() + "\":" + std::to_string(i);
+        }
+        doc += ",\"nested\":{\"z\":1,\"a\":[{\"y\":2,\"b\":3}]}}";
+        document_order.push_back("nested");
+
+        auto v       = parse_or_throw(doc);
+        auto frozen  = freeze(v);
+        auto visited = keys_of(*frozen.if_object());
+        expect(visited == keys_of(*frozen.if_object()), "an object visits its members in the same order every time");
+        expect(visited != document_order, "an object visits its members in hash order, not document order");
+        auto sorted_visited = visited, sorted_document = document_order;
+        std::sort(sorted_visited.begin(), sorted_visited.end());
+        std::sort(sorted_document.begin(), sorted_document.end());
+        expect(sorted_visited == sorted_document, "freeze keeps every member");
+
+        // thaw lists the members in that order, with their values
+        auto thawed = thaw(frozen);
+        std::vector< std::string > thawed_keys;
+        for (auto &m : thawed.if_is< object >()->members())
+            thawed_keys.push_back(m.first);
+        expect(thawed_keys == visited, "thaw lists members in the order the object visits them");
+        expect(difference(serialize(thawed), doc).empty(), "thaw(freeze(v)) holds the members of v");
+        expect(serialize(thaw(freeze(thawed))) == serialize(thawed), "a thawed document round trips as it is");
+
+        // the order depends only on the keys
+        pobject reversed;
+        for (auto i = document_order.size(); i-- > 0;)
+            reversed = reversed.set(document_order[i], pvalue(std::string("x")));
+        expect(keys_of(reversed) == visited, "objects with the same keys visit them alike however they were built");
+
+        auto edited    = frozen.if_object()->erase("key7").set("added", pvalue(true)).set("key3", pvalue(false));
+        auto remaining = keys_of(edited);
+        remaining.erase(std::find(remaining.begin(), remaining.end(), "added"));
+        auto expected = visited;
+        expected.erase(std::find(expected.begin(), expected.end(), "key7"));
+        expect(remaining == expected, "set and erase leave the order of the other members as it was");
     }
 
     int
@@ -402,6 +1936,35 @@ namespace program
 
         assert(!res.ec);
 
+        check_number_grammar();
+        check_depth_limit();
+        check_schema_enum();
+        check_schema_keywords();
+        check_digit_budget();
+        check_compare();
+        check_unique_keys();
+        check_persistent_sharing();
+        check_on_demand();
+        check_rewrite();
+        check_serialize_round_trip();
+        check_patch();
+        check_checkpoints();
+        check_infer_schema();
+        check_config_holder();
+        check_object_index();
+        check_interning();
+        check_ingest_max_record();
+        check_codegen_identifiers();
+        check_float32();
+        check_number_engines();
+        check_codegen_parser();
+        check_pmr();
+        check_parse_batch();
+        check_ndjson_index();
+        check_external_sort();
+        check_prefilter();
+        check_corpus();
+        check_persistent_order();
         return 0;
     }
 }   // namespace program
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "config.hpp"
+
+#include <cerrno>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace program
+{
+    /// a whole file mapped read-only into memory. Throws system_error if the file cannot be opened or mapped.
+    struct mapped_file
+    {
+        mapped_file() = default;
+
+        explicit mapped_file(std::string const &path)
+        {
+            auto fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                fail("open " + path);
+            struct stat st;
+            if (::fstat(fd, &st) < 0)
+            {
+                auto e = errno;
+                ::close(fd);
+                errno = e;
+                fail("stat " + path);
+            }
+            size_ = std::size_t(st.st_size);
+            if (size_)
+            {
+                auto p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p == MAP_FAILED)
+                {
+                    auto e = errno;
+                    ::close(fd);
+                    errno = e;
+                    fail("mmap " + path);
+                }
+                data_ = static_cast< const char * >(p);
+            }
+            ::close(fd);
+        }
+
+        mapped_file(mapped_file &&other) noexcept
+        : data_(std::exchange(other.data_, nullptr))
+        , size_(std::exchange(other.size_, 0))
+        {
+        }
+
+        mapped_file &
+        operator=(mapped_file &&other) noexcept
+        {
+            if (this != &other)
+            {
+                unmap();
+                data_ = std::exchange(other.data_, nullptr);
+                size_ = std::exchange(other.size_, 0);
+            }
+            return *this;
+        }
+
+        ~mapped_file()
+        {
+            unmap();
+        }
+
+        /// tell the kernel the file will be read in no particular order, so it does not read ahead
+        void
+        advise_random() const
+        {
+            if (data_)
+                ::madvise(const_cast< char * >(data_), size_, MADV_RANDOM);
+        }
+
+        std::string_view
+        view() const
+        {
+            return std::string_view(data_, size_);
+        }
+
+        const char *
+        data() const
+        {
+            return data_;
+        }
+
+        std::size_t
+        size() const
+        {
+            return size_;
+        }
+
+      private:
+        [[noreturn]] static void
+        fail(std::string const &what)
+        {
+            throw system::system_error(system::error_code(errno, system::system_category()), what);
+        }
+
+        void
+        unmap()
+        {
+            if (data_)
+                ::munmap(const_cast< char * >(data_), size_);
+            data_ = nullptr;
+            size_ = 0;
+        }
+
+        const char *data_ = nullptr;
+        std::size_t size_ = 0;
+    };
+}   // namespace program
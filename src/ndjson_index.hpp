@@ -0,0 +1,234 @@
+#pragma once
+
+#include "config.hpp"
+#include "error.hpp"
+#include "hash.hpp"
+#include "mapped_file.hpp"
+#include "pointer.hpp"
+#include "projection.hpp"
+#include "tokenizer.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace program
+{
+    namespace detail
+    {
+        inline constexpr char ndjson_index_magic[8] = { 'J', 'S', 'O', 'N', 'K', 'I', 'X', '1' };
+        inline constexpr std::size_t ndjson_index_header = 32;   // magic, document size, count, pointer length
+    }   // namespace detail
+
+    /// one indexed record: the hash of its encoded key and the byte offset of its line
+    struct ndjson_index_entry
+    {
+        std::uint64_t hash;
+        std::uint64_t offset;
+
+        friend bool
+        operator<(ndjson_index_entry const &l, ndjson_index_entry const &r)
+        {
+            return l.hash != r.hash ? l.hash < r.hash : l.offset < r.offset;
+        }
+    };
+
+    struct ndjson_index_stats
+    {
+        std::uint64_t records = 0;   // non-blank lines
+        std::uint64_t indexed = 0;   // records which had a key
+    };
+
+    /// build the sidecar index of an NDJSON document keyed on the value at pointer, writing it to os.
+    /// The document is split at line boundaries into one range per thread; each thread projects and sorts its
+    /// own entries, and the sorted runs are merged. Records without a string or number at pointer are not
+    /// indexed. Throws system_error if pointer or any record is malformed, or if os cannot be written.
+    inline ndjson_index_stats
+    build_ndjson_index(std::string_view data, std::string const &pointer, std::ostream &os, unsigned threads)
+    {
+        system::error_code ec;
+        auto               path = parse_pointer(pointer, ec);
+        if (ec)
+            throw system::system_error(ec, "build_ndjson_index: " + pointer);
+
+        threads = std::max(1u, threads);
+        std::vector< std::size_t > bounds;
+        for (unsigned i = 0; i <= threads; ++i)
+            bounds.push_back(line_start(data, data.size() / threads * i));
+        bounds.back() = data.size();
+
+        struct part
+        {
+            std::vector< ndjson_index_entry > entries;
+            std::uint64_t                     records = 0;
+            std::exception_ptr                failure;
+        };
+        std::vector< part > parts(threads);
+
+        auto work = [&](unsigned i) {
+            try
+            {
+                basic_tokenizer< key_projection > tk(key_projection { path });
+                auto &                            out = parts[i];
+                for_each_record(data, bounds[i], bounds[i + 1], [&](std::string_view record, std::size_t offset) {
+                    ++out.records;
+                    system::error_code ec;
+                    if (project_key(tk, record, ec))
+                        out.entries.push_back({ hash_bytes(tk.handler().key()), offset });
+                    else if (ec)
+                        throw system::system_error(ec, "build_ndjson_index: record at " + std::to_string(offset));
+                });
+                std::sort(out.entries.begin(), out.entries.end());
+            }
+            catch (...)
+            {
+                parts[i].failure = std::current_exception();
+            }
+        };
+
+        std::vector< std::thread > pool;
+        for (unsigned i = 1; i < threads; ++i)
+            pool.emplace_back(work, i);
+        work(0);
+        for (auto &t : pool)
+            t.join();
+
+        ndjson_index_stats                stats;
+        std::vector< ndjson_index_entry > entries;
+        for (auto &p : parts)
+        {
+            if (p.failure)
+                std::rethrow_exception(p.failure);
+            stats.records += p.records;
+            auto middle = entries.insert(entries.end(), p.entries.begin(), p.entries.end());
+            std::inplace_merge(entries.begin(), middle, entries.end());
+        }
+        stats.indexed = entries.size();
+
+        auto put = [&](std::uint64_t x) { os.write(reinterpret_cast< const char * >(&x), sizeof(x)); };
+        os.write(detail::ndjson_index_magic, sizeof(detail::ndjson_index_magic));
+        put(data.size());
+        put(entries.size());
+        put(pointer.size());
+        os.write(pointer.data(), std::streamsize(pointer.size()));
+        os.write("\0\0\0\0\0\0\0", std::streamsize(-pointer.size() & 7));   // keep the entries aligned
+        os.write(reinterpret_cast< const char * >(entries.data()),
+                 std::streamsize(entries.size() * sizeof(ndjson_index_entry)));
+        if (!os)
+            throw system::system_error(make_error_code(error::bad_index), "build_ndjson_index");
+        return stats;
+    }
+
+    /// a sidecar index mapped into memory. Lookups binary search the sorted entries for the key's hash and
+    /// confirm each candidate by projecting the key of its record, so hash collisions never produce false
+    /// matches and a lookup costs one search plus one small parse per match.
+    struct ndjson_index
+    {
+        /// Throws system_error if the file cannot be mapped, or with error::bad_index if it is malformed
+        explicit ndjson_index(std::string const &path)
+        : file_(path)
+        {
+            auto v = file_.view();
+            auto magic = std::string_view(detail::ndjson_index_magic, sizeof(detail::ndjson_index_magic));
+            if (v.size() < header_size || v.substr(0, magic.size()) != magic)
+                bad();
+            data_size_       = get(8);
+            count_           = get(16);
+            auto pointer_len = get(24);
+            if (pointer_len > v.size() - header_size)
+                bad();
+            pointer_.assign(v.data() + header_size, std::size_t(pointer_len));
+            auto first = header_size + ((pointer_len + 7) & ~std::uint64_t(7));
+            if (first > v.size() || (v.size() - first) / sizeof(ndjson_index_entry) < count_)
+                bad();
+            entries_ = reinterpret_cast< ndjson_index_entry const * >(v.data() + first);
+
+            system::error_code ec;
+            path_ = parse_pointer(pointer_, ec);
+            if (ec)
+                bad();
+            file_.advise_random();
+        }
+
+        /// the pointer the index is keyed on
+        std::string const &
+        pointer() const
+        {
+            return pointer_;
+        }
+
+        std::uint64_t
+        size() const
+        {
+            return count_;
+        }
+
+        /// byte offsets of the records of data whose encoded key (see sort_key.hpp) is key, in file order.
+        /// Sets ec to error::bad_index if data is not the document indexed.
+        std::vector< std::uint64_t >
+        find(std::string_view data, std::string_view key, system::error_code &ec) const
+        {
+            std::vector< std::uint64_t > result;
+            if (data.size() != data_size_)
+            {
+                ec = error::bad_index;
+                return result;
+            }
+
+            auto h     = hash_bytes(key);
+            auto range = std::equal_range(entries_,
+                                          entries_ + count_,
+                                          ndjson_index_entry { h, 0 },
+                                          [](ndjson_index_entry const &l, ndjson_index_entry const &r) {
+                                              return l.hash < r.hash;
+                                          });
+            basic_tokenizer< key_projection > tk(key_projection { path_ });
+            for (auto e = range.first; e != range.second; ++e)
+            {
+                if (e->offset >= data.size())
+                {
+                    ec = error::bad_index;
+                    return {};
+                }
+                auto start  = std::size_t(e->offset);
+                auto eol    = data.find('\n', start);
+                auto record = data.substr(start, eol == std::string_view::npos ? eol : eol - start);
+                if (project_key(tk, record, ec) && tk.handler().key() == key)
+                    result.push_back(e->offset);
+                else if (ec)
+                    return {};
+            }
+            return result;
+        }
+
+      private:
+        static constexpr std::size_t header_size = detail::ndjson_index_header;
+
+        [[noreturn]] static void
+        bad()
+        {
+            throw system::system_error(make_error_code(error::bad_index), "ndjson_index");
+        }
+
+        std::uint64_t
+        get(std::size_t at) const
+        {
+            std::uint64_t x;
+            std::memcpy(&x, file_.data() + at, sizeof(x));
+            return x;
+        }
+
+        mapped_file                 file_;
+        std::uint64_t               data_size_ = 0;
+        std::uint64_t               count_     = 0;
+        std::string                 pointer_;
+        std::vector< std::string >  path_;
+        ndjson_index_entry const *  entries_ = nullptr;
+    };
+}   // namespace program
@@ -0,0 +1,287 @@
+#pragma once
+
+#include "config.hpp"
+#include "number_parser.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace program
+{
+    /// ways of finding the runs of digits in a number
+    enum class number_engine : unsigned char
+    {
+        bytewise,   // number_parser, one character at a time, resumable across buffers
+        swar,       // 8 characters at a time in a 64 bit register
+        simd,       // 16 characters at a time with SSE2
+    };
+
+    inline const char *
+    to_string(number_engine e)
+    {
+        switch (e)
+        {
+        case number_engine::bytewise:
+            return "bytewise";
+        case number_engine::swar:
+            return "swar";
+        case number_engine::simd:
+            return "simd";
+        }
+        return "unknown";
+    }
+
+    namespace detail
+    {
+        inline bool
+        is_digit(char c)
+        {
+            return c >= '0' && c <= '9';
+        }
+
+        /// the end of the run of digits starting at p
+        inline const char *
+        digit_run_bytewise(const char *p, const char *end)
+        {
+            while (p != end && is_digit(*p))
+                ++p;
+            return p;
+        }
+
+        inline const char *
+        digit_run_swar(const char *p, const char *end)
+        {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            constexpr std::uint64_t high = 0xF0F0F0F0F0F0F0F0ull;
+            constexpr std::uint64_t zero = 0x3030303030303030ull;
+            constexpr std::uint64_t six  = 0x0606060606060606ull;
+            while (end - p >= 8)
+            {
+                std::uint64_t x;
+                std::memcpy(&x, p, sizeof(x));
+                // a digit has a high nibble of 3, and still does after adding 6 to its low nibble. A carry out of
+                // a non-digit byte can only disturb the bytes after it, which no longer matter.
+                auto not_digit = ((x & high) ^ zero) | (((x + six) & high) ^ zero);
+                if (not_digit)
+                    return p + __builtin_ctzll(not_digit) / 8;
+                p += 8;
+            }
+#endif
+            return digit_run_bytewise(p, end);
+        }
+
+        inline const char *
+        digit_run_simd(const char *p, const char *end)
+        {
+#if defined(__SSE2__)
+            auto below = _mm_set1_epi8('0');
+            auto above = _mm_set1_epi8('9');
+            while (end - p >= 16)
+            {
+                auto x    = _mm_loadu_si128(reinterpret_cast< const __m128i * >(p));
+                auto mask = unsigned(
+                    _mm_movemask_epi8(_mm_or_si128(_mm_cmplt_epi8(x, below), _mm_cmpgt_epi8(x, above))));
+                if (mask)
+                    return p + __builtin_ctz(mask);
+                p += 16;
+            }
+#endif
+            return digit_run_swar(p, end);
+        }
+
+        /// parse a well formed number lying wholly within [p, end), followed by a character which is not part
+        /// of it, into np's builders exactly as number_parser would. Returns nullptr without touching np for
+        /// anything else: a number which may continue in the next buffer, a malformed one, or one with a
+        /// range attached, all of which are left to number_parser.
+        template < class Run >
+        const char *
+        scan_number(const char *p, const char *end, Run run, number_parser &np)
+        {
+            if (np.has_range())
+                return nullptr;
+
+            auto q        = p;
+            bool negative = *q == '-';
+            if (negative && ++q == end)
+                return nullptr;
+
+            auto int_first = q;
+            auto int_last  = *q == '0' ? q + 1 : run(q, end);
+            if (int_last == int_first || int_last == end || (*int_first == '0' && is_digit(*int_last)))
+                return nullptr;
+            q = int_last;
+
+            const char *frac_first = nullptr, *frac_last = nullptr;
+            if (*q == '.')
+            {
+                frac_first = ++q;
+                frac_last  = run(q, end);
+                if (frac_last == frac_first || frac_last == end)
+                    return nullptr;
+                q = frac_last;
+            }
+
+            const char *exp_first = nullptr, *exp_last = nullptr;
+            bool        exp_negative = false;
+            if (*q == 'e' || *q == 'E')
+            {
+                if (++q == end)
+                    return nullptr;
+                if (*q == '-' || *q == '+')
+                {
+                    exp_negative = *q == '-';
+                    if (++q == end)
+                        return nullptr;
+                }
+                exp_first = q;
+                exp_last  = run(q, end);
+                if (exp_last == exp_first || exp_last == end)
+                    return nullptr;
+                q = exp_last;
+            }
+
+            // number_parser drops a lone leading zero, leaving finalise to restore it
+            auto &m = np.mantissa_.buffer;
+            if (negative)
+                m += '-';
+            if (*int_first != '0')
+                m.append(int_first, int_last);
+            if (frac_first)
+            {
+                m += '.';
+                m.append(frac_first, frac_last);
+            }
+            auto &e = np.exponent_.buffer;
+            if (exp_negative)
+                e += '-';
+            if (exp_first)
+                e.append(exp_first, exp_last);
+            np.mantissa_.finalise();
+            np.exponent_.finalise();
+            return q;
+        }
+    }   // namespace detail
+
+    struct number_engine_stats
+    {
+        number_engine engine   = number_engine::bytewise;   // in use now
+        std::uint64_t switches = 0;
+        /// numbers parsed by each engine, indexed by number_engine. Numbers an engine handed back to
+        /// number_parser count as bytewise.
+        std::uint64_t numbers[3] = {};
+    };
+
+    /// picks the number engine for one stream. Numbers are sampled in windows of sample_every numbers, and
+    /// a verdict is reached at the end of each window:
+    /// - if most sampled numbers could not be taken by a fast engine, because they kept straddling the ends of
+    ///   buffers, number_parser is used directly rather than paying for the attempt;
+    /// - otherwise the engine follows the average length of the runs of digits, since only long runs repay
+    ///   16 byte loads.
+    /// While number_parser is in use the sampled numbers still probe the SWAR engine, so a stream can recover.
+    /// A switch needs the same verdict from two windows in a row, and the run length thresholds overlap, so a
+    /// stream near a boundary does not flap between engines.
+    struct adaptive_number_engine
+    {
+        static constexpr unsigned    sample_every = 8;    // numbers, a power of two
+        static constexpr unsigned    window       = 32;   // samples
+        static constexpr std::size_t simd_above   = 12;   // average digits per run
+        static constexpr std::size_t simd_below   = 8;
+
+        adaptive_number_engine()
+        {
+            stats_.engine = number_engine::swar;
+        }
+
+        /// use one engine regardless of the numbers seen
+        void
+        pin(number_engine e)
+        {
+            pinned_       = true;
+            stats_.engine = e;
+        }
+
+        void
+        unpin()
+        {
+            pinned_ = false;
+        }
+
+        number_engine_stats const &
+        stats() const
+        {
+            return stats_;
+        }
+
+        /// parse the number at p with the current engine. Returns nullptr if it must be left to number_parser.
+        const char *
+        scan(const char *p, const char *end, number_parser &np)
+        {
+            sampling_ = !pinned_ && (++tick_ & (sample_every - 1)) == 0;
+            attempt_  = stats_.engine;
+            if (attempt_ == number_engine::bytewise && sampling_)
+                attempt_ = number_engine::swar;
+            switch (attempt_)
+            {
+            case number_engine::swar:
+                return detail::scan_number(p, end, detail::digit_run_swar, np);
+            case number_engine::simd:
+                return detail::scan_number(p, end, detail::digit_run_simd, np);
+            default:
+                return nullptr;
+            }
+        }
+
+        /// account for the number just completed; taken is true if scan parsed it
+        void
+        observe(number_parser const &np, bool taken)
+        {
+            ++stats_.numbers[unsigned(taken ? attempt_ : number_engine::bytewise)];
+            if (!sampling_)
+                return;
+
+            auto &m        = np.mantissa_.buffer;
+            auto &e        = np.exponent_.buffer;
+            auto  fraction = m.find('.') != std::string::npos;
+            digits_ += m.size() - (m[0] == '-') - fraction + e.size() - 1 - (e[1] == '-');
+            runs_ += 1 + fraction + (e != "e0");
+            declined_ += !taken;
+            if (++count_ < window)
+                return;
+
+            auto average = digits_ / runs_;
+            auto verdict = number_engine::swar;
+            if (declined_ * 2 > count_)
+                verdict = number_engine::bytewise;
+            else if (average >= simd_above || (stats_.engine == number_engine::simd && average >= simd_below))
+                verdict = number_engine::simd;
+
+            if (verdict != stats_.engine && verdict == pending_)
+            {
+                stats_.engine = verdict;
+                ++stats_.switches;
+            }
+            pending_  = verdict;
+            count_    = 0;
+            digits_   = 0;
+            runs_     = 0;
+            declined_ = 0;
+        }
+
+      private:
+        number_engine_stats stats_;
+        number_engine       pending_  = number_engine::swar;
+        number_engine       attempt_  = number_engine::bytewise;
+        bool                pinned_   = false;
+        bool                sampling_ = false;
+        unsigned            tick_     = 0;
+        unsigned            count_    = 0;
+        unsigned            declined_ = 0;
+        std::size_t         digits_   = 0;
+        std::size_t         runs_     = 0;
+    };
+}   // namespace program
@@ -0,0 +1,438 @@
+#pragma once
+
+#include "config.hpp"
+#include "decimal.hpp"
+#include "error.hpp"
+#include "number_range.hpp"
+
+#include <ostream>
+#include <string>
+#include <tuple>
+
+namespace program
+{
+    struct mantissa_builder
+    {
+        void
+        notify_negative()
+        {
+            buffer += "-";
+        }
+        void
+        notify_decimal()
+        {
+            buffer += ".";
+        }
+        void
+        notify_digit(char c)
+        {
+            buffer += c;
+        }
+        void
+        finalise()
+        {
+            if (buffer.empty())
+                buffer = "0";
+        }
+
+        std::string buffer;
+    };
+
+    inline bool
+    operator==(mantissa_builder const &l, mantissa_builder const &r)
+    {
+        return l.buffer == r.buffer;
+    }
+
+    struct exponent_builder
+    {
+        void
+        notify_digit(char c)
+        {
+            buffer += c;
+        }
+        void
+        notify_negative()
+        {
+            buffer += "-";
+        }
+        void
+        finalise()
+        {
+            if (buffer.empty())
+                buffer = "0";
+            buffer.insert(buffer.begin(), 'e');
+        }
+
+        std::string buffer;
+    };
+
+    inline bool
+    operator==(exponent_builder const &l, exponent_builder const &r)
+    {
+        return l.buffer == r.buffer;
+    }
+
+    struct number
+    {
+        mantissa_builder mantissa;
+        exponent_builder exponent;
+
+        friend std::ostream &
+        operator<<(std::ostream &os, number const &n)
+        {
+            os << n.mantissa.buffer << n.exponent.buffer;
+            return os;
+        }
+
+        auto
+        as_tuple() const
+        {
+            return std::tie(mantissa, exponent);
+        }
+    };
+    inline bool
+    operator==(number const &l, number const &r)
+    {
+        return l.as_tuple() == r.as_tuple();
+    }
+
+    inline decimal
+    to_decimal(number const &n)
+    {
+        return to_decimal(n.mantissa.buffer, n.exponent.buffer);
+    }
+
+    /// state machine controlling the parsing of a JSON number
+    /// given np is an instance of number_parser:
+    /// while there is input
+    ///   next = np(begin, end);
+    /// If a number_range is attached, the parse fails with error::out_of_range as soon as the digits seen
+    /// so far prove the number cannot satisfy it. The exact bounds are checked on finalise().
+    struct number_parser : asio::coroutine
+    {
+        using iterator       = char *;
+        using const_iterator = const char *;
+
+        system::error_code const &
+        error() const
+        {
+            return error_;
+        }
+
+        /// attach bounds to the next number parsed, or detach them with nullptr.
+        /// The range must outlive the parse.
+        void
+        set_range(number_range const *range)
+        {
+            range_ = range;
+        }
+
+        bool
+        has_range() const
+        {
+            return range_ != nullptr;
+        }
+
+#include <boost/asio/yield.hpp>
+        const_iterator
+        operator()(const_iterator begin, const_iterator end)
+        {
+            auto p = begin;
+
+            auto exhausted = [&] { return p == end; };
+
+            auto consume = [&] {
+                ++p;
+                return exhausted();
+            };
+
+            auto is_digit = [&] {
+                auto c = *p;
+                return c >= '0' && c <= '9';
+            };
+
+            auto finalising = [&] { return begin == end; };
+
+            reenter(this)
+            {
+                if (finalising())
+                {
+                    error_ = asio::error::invalid_argument;
+                    yield break;
+                }
+                // [+-]?
+                if (*p == '+')
+                {
+                    if (consume())
+                    {
+                        yield;
+                        if (finalising())
+                        {
+                            error_ = asio::error::invalid_argument;
+                            yield break;
+                        }
+                    }
+                }
+                else if (*p == '-')
+                {
+                    mantissa_.notify_negative();
+                    negative_ = true;
+                    if (consume())
+                    {
+                        yield;
+                        if (finalising())
+                        {
+                            error_ = asio::error::invalid_argument;
+                            yield break;
+                        }
+                    }
+                }
+                // a sign must be followed by a digit
+                if (!is_digit())
+                {
+                    error_ = asio::error::invalid_argument;
+                    yield break;
+                }
+                // leading zero must be followed by a ., an exponent or the end of the number
+                if (*p == '0')
+                {
+                    if (consume())
+                    {
+                        yield;
+                        if (finalising())
+                        {
+                            yield break;
+                        }
+                    }
+                    if (*p == '.')
+                        goto on_mantissa_decimal;
+                    if (*p == 'e' || *p == 'E')
+                        goto on_exponent_start;
+                    if (is_digit())
+                        error_ = asio::error::invalid_argument;
+                    yield break;
+                }
+                // keep consuming leading digits
+                while (is_digit())
+                {
+                    mantissa_.notify_digit(*p);
+                    if (range_ && !check_mantissa_digit(*p, false))
+                    {
+                        error_ = error::out_of_range;
+                        yield break;
+                    }
+                    if (consume())
+                    {
+                        yield;
+                        if (finalising())
+                        {
+                            yield break;
+                        }
+                    }
+                }
+
+                if (*p == 'e' || *p == 'E')
+                    goto on_exponent_start;
+
+                if (*p != '.')
+                {
+                    // this is the end of the number
+                    yield break;
+                }
+
+                // fallthrough
+
+            on_mantissa_decimal:
+                mantissa_.notify_decimal();
+                if (consume())
+                {
+                    yield;
+                    if (finalising())
+                    {
+                        error_ = asio::error::invalid_argument;
+                        yield break;
+                    }
+                }
+                // the point must be followed by a digit
+                if (!is_digit())
+                {
+                    error_ = asio::error::invalid_argument;
+                    yield break;
+                }
+
+                while (is_digit())
+                {
+                    mantissa_.notify_digit(*p);
+                    if (range_ && !check_mantissa_digit(*p, true))
+                    {
+                        error_ = error::out_of_range;
+                        yield break;
+                    }
+                    if (consume())
+                    {
+                        yield;
+                        if (finalising())
+                        {
+                            yield break;
+                        }
+                    }
+                }
+
+                if (*p != 'e' && *p != 'E')
+                {
+                    yield break;
+                }
+
+            on_exponent_start:
+                if (consume())
+                {
+                    yield;
+                    if (finalising())
+                    {
+                        error_ = asio::error::invalid_argument;
+                        yield break;
+                    }
+                }
+                if (*p == '-')
+                {
+                    exponent_.notify_negative();
+                    exponent_negative_ = true;
+                    if (consume())
+                    {
+                        yield;
+                        if (finalising())
+                        {
+                            error_ = asio::error::invalid_argument;
+                            yield break;
+                        }
+                    }
+                }
+                else if (*p == '+')
+                {
+                    if (consume())
+                    {
+                        yield;
+                        if (finalising())
+                        {
+                            error_ = asio::error::invalid_argument;
+                            yield break;
+                        }
+                    }
+                }
+                // the exponent, after any sign, must have a digit
+                if (!is_digit())
+                {
+                    error_ = asio::error::invalid_argument;
+                    yield break;
+                }
+                while (is_digit())
+                {
+                    exponent_.notify_digit(*p);
+                    if (range_ && !check_exponent_digit(*p))
+                    {
+                        error_ = error::out_of_range;
+                        yield break;
+                    }
+                    if (consume())
+                    {
+                        yield;
+                        if (finalising())
+                        {
+                            yield break;
+                        }
+                    }
+                }
+            }
+
+            // special case if called with empty range, finalise values
+            if (finalising())
+            {
+                mantissa_.finalise();
+                exponent_.finalise();
+                if (range_ && !error_ && !range_->contains(to_decimal(mantissa_.buffer, exponent_.buffer)))
+                    error_ = error::out_of_range;
+            }
+
+            return p;
+        }
+#include <boost/asio/unyield.hpp>
+
+        void
+        finalise()
+        {
+            static const char empty[] = "";
+            if (!error_)
+            {
+                (*this)(empty, empty);
+            }
+        }
+
+        /// prepare the parser for another number, retaining the capacity of the builders
+        void
+        reset()
+        {
+            static_cast< asio::coroutine & >(*this) = asio::coroutine();
+            mantissa_.buffer.clear();
+            exponent_.buffer.clear();
+            error_.clear();
+            negative_          = false;
+            exponent_negative_ = false;
+            significant_       = false;
+            digits_            = 0;
+            magnitude_         = 0;
+            exponent_value_    = 0;
+        }
+
+        number get_number() const { return number { mantissa_, exponent_ }; }
+
+        mantissa_builder   mantissa_;
+        exponent_builder   exponent_;
+        system::error_code error_;
+
+      private:
+        /// track the magnitude of the mantissa and test it against the range
+        bool
+        check_mantissa_digit(char c, bool fraction)
+        {
+            if (++digits_ > range_->max_digits)
+                return false;
+            if (!significant_)
+            {
+                if (c == '0')
+                {
+                    // zeros between the point and the first significant digit shrink the magnitude
+                    if (fraction)
+                        --magnitude_;
+                    return true;
+                }
+                significant_ = true;
+                if (range_->excludes_sign(negative_))
+                    return false;
+            }
+            if (!fraction)
+                ++magnitude_;
+            return true;
+        }
+
+        /// the mantissa is complete, so each exponent digit tightens the bound on the final magnitude
+        bool
+        check_exponent_digit(char c)
+        {
+            exponent_value_ = accumulate_exponent(exponent_value_, c);
+            if (!significant_)
+                return true;
+            if (exponent_negative_)
+                return !range_->excludes_magnitude_below(negative_, magnitude_ - exponent_value_);
+            return !range_->excludes_magnitude_at_least(negative_, magnitude_ + exponent_value_ - 1);
+        }
+
+        number_range const *range_             = nullptr;
+        bool                negative_          = false;
+        bool                exponent_negative_ = false;
+        bool                significant_       = false;
+        std::size_t         digits_            = 0;
+        long long           magnitude_         = 0;
+        long long           exponent_value_    = 0;
+    };
+}   // namespace program
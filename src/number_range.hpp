@@ -0,0 +1,68 @@
+#pragma once
+
+#include "decimal.hpp"
+
+#include <cstddef>
+#include <optional>
+
+namespace program
+{
+    /// bounds on a number which number_parser can test while the number is still arriving.
+    /// A number satisfies the range if it lies within [minimum, maximum] (or the exclusive equivalents)
+    /// and is written with no more than max_digits mantissa digits.
+    struct number_range
+    {
+        std::optional< decimal > minimum, maximum;
+        bool                     exclusive_minimum = false, exclusive_maximum = false;
+        std::size_t              max_digits        = std::size_t(-1);
+
+        bool
+        bounded() const
+        {
+            return minimum || maximum || max_digits != std::size_t(-1);
+        }
+
+        bool
+        contains(decimal const &d) const
+        {
+            if (minimum)
+            {
+                auto c = compare(d, *minimum);
+                if (c < 0 || (c == 0 && exclusive_minimum))
+                    return false;
+            }
+            if (maximum)
+            {
+                auto c = compare(d, *maximum);
+                if (c > 0 || (c == 0 && exclusive_maximum))
+                    return false;
+            }
+            return true;
+        }
+
+        /// true if every non-zero value of this sign is out of range
+        bool
+        excludes_sign(bool negative) const
+        {
+            if (negative)
+                return minimum && !minimum->negative;
+            return maximum && (maximum->negative || maximum->is_zero());
+        }
+
+        /// true if every value of this sign with |value| >= 10^m is out of range
+        bool
+        excludes_magnitude_at_least(bool negative, long long m) const
+        {
+            auto &bound = negative ? minimum : maximum;
+            return bound && !bound->is_zero() && bound->negative == negative && bound->exponent <= m;
+        }
+
+        /// true if every value of this sign with |value| < 10^m is out of range
+        bool
+        excludes_magnitude_below(bool negative, long long m) const
+        {
+            auto &bound = negative ? maximum : minimum;
+            return bound && !bound->is_zero() && bound->negative == negative && m <= bound->exponent - 1;
+        }
+    };
+}   // namespace program
@@ -0,0 +1,698 @@
+#pragma once
+
+#include "config.hpp"
+#include "decimal.hpp"
+#include "error.hpp"
+#include "number_parser.hpp"
+#include "tokenizer.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace program
+{
+    struct on_demand_document;
+
+    /// handle on one value of an on_demand_document. Handles are cheap to copy and remain valid until the
+    /// cursor moves past the value they refer to. An error met while locating the value is carried by the
+    /// handle and reported by whatever is asked of it next, so accesses may be chained:
+    ///   auto price = doc.find_field("order").find_field("price").get_double(ec);
+    struct on_demand_value
+    {
+        on_demand_value() = default;
+
+        system::error_code const &
+        error() const
+        {
+            return ec_;
+        }
+
+        /// the value of the member key, searching forward from the cursor. Members before the cursor are not
+        /// found and members passed over are skipped unparsed.
+        on_demand_value
+        find_field(std::string_view key) const;
+
+        /// the next member of an object. Returns false at the end of the object or on error.
+        bool
+        next_field(std::string &key, on_demand_value &v, system::error_code &ec) const;
+
+        /// the next element of an array. Returns false at the end of the array or on error.
+        bool
+        next_element(on_demand_value &element, system::error_code &ec) const;
+
+        double
+        get_double(system::error_code &ec) const;
+
+        /// fails with error::type_mismatch if the value is not integral and error::out_of_range if it does not
+        /// fit. A value of the wrong type is left unconsumed, as it is by the other accessors.
+        std::int64_t
+        get_int64(system::error_code &ec) const;
+
+        std::string
+        get_string(system::error_code &ec) const;
+
+        bool
+        get_bool(system::error_code &ec) const;
+
+        /// the number exactly as written
+        number
+        get_number(system::error_code &ec) const;
+
+        /// true if the value is null. Does not consume any other kind of value.
+        bool
+        is_null(system::error_code &ec) const;
+
+        /// pass over the value, and the remainder of it if it has been entered
+        system::error_code
+        skip() const;
+
+      private:
+        friend on_demand_document;
+
+        on_demand_value(on_demand_document *doc, std::size_t depth, system::error_code ec = {})
+        : doc_(doc)
+        , depth_(depth)
+        , ec_(ec)
+        {
+        }
+
+        on_demand_document *doc_   = nullptr;
+        std::size_t         depth_ = 0;
+        system::error_code  ec_;
+    };
+
+    /// forward-only pull parser over a document which may arrive in pieces.
+    /// Values are parsed only as they are accessed; anything the caller does not ask for is skipped with
+    /// a scan that checks only the nesting of brackets and strings.
+    /// When the input held so far ends before an access can complete, it fails with error::need_more having
+    /// kept whatever progress it made. Append more input and repeat the same access (or the same chain of
+    /// accesses, since steps already taken are recognised and not repeated). Call finish() once the input
+    /// is exhausted.
+    struct on_demand_document
+    {
+        on_demand_document() = default;
+
+        explicit on_demand_document(std::string_view input)
+        {
+            append(input);
+            finish();
+        }
+
+        on_demand_document(on_demand_document const &) = delete;
+        on_demand_document &
+        operator=(on_demand_document const &) = delete;
+
+        /// add input. Input already consumed is discarded from time to time.
+        void
+        append(std::string_view data)
+        {
+            if (pos_ > 0 && pos_ >= buffer_.size() / 2)
+            {
+                buffer_.erase(0, pos_);
+                pos_ = 0;
+            }
+            buffer_.append(data.data(), data.size());
+        }
+
+        /// signal that no more input will be appended
+        void
+        finish()
+        {
+            finished_ = true;
+        }
+
+        /// prepare for another document, retaining the capacity of the buffers
+        void
+        reset()
+        {
+            buffer_.clear();
+            frames_.clear();
+            pos_      = 0;
+            pending_  = true;
+            finished_ = false;
+            skip_     = skip_state();
+            error_.clear();
+        }
+
+        /// the first syntax error found, after which every access fails
+        system::error_code const &
+        error() const
+        {
+            return error_;
+        }
+
+        /// true once the top level value has been consumed
+        bool
+        done() const
+        {
+            return frames_.empty() && !pending_;
+        }
+
+        on_demand_value
+        root()
+        {
+            return on_demand_value(this, 0);
+        }
+
+        on_demand_value
+        find_field(std::string_view key)
+        {
+            return root().find_field(key);
+        }
+
+      private:
+        friend on_demand_value;
+
+        /// an object or array which the cursor has entered
+        struct frame
+        {
+            bool        is_object = false;
+            bool        first     = true;   // no member or element has been located yet
+            std::string key;                // key of the current member
+        };
+
+        /// progress through a value being skipped, kept across need_more
+        struct skip_state
+        {
+            bool        active    = false;
+            bool        started   = false;
+            bool        in_string = false;
+            bool        escape    = false;
+            std::size_t depth     = 0;
+        };
+
+        struct scalar_capture : null_handler
+        {
+            enum kind_type
+            {
+                none,
+                string_kind,
+                number_kind,
+                bool_kind,
+                null_kind,
+            };
+
+            void
+            on_string(std::string_view s, system::error_code &)
+            {
+                kind = string_kind;
+                text.assign(s.data(), s.size());
+            }
+            void
+            on_number(number const &n, system::error_code &)
+            {
+                kind  = number_kind;
+                value = n;
+            }
+            void
+            on_bool(bool b, system::error_code &)
+            {
+                kind    = bool_kind;
+                boolean = b;
+            }
+            void
+            on_null(system::error_code &)
+            {
+                kind = null_kind;
+            }
+
+            kind_type   kind = none;
+            std::string text;
+            number      value;
+            bool        boolean = false;
+        };
+
+        static bool
+        is_ws(char c)
+        {
+            return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+        }
+
+        std::size_t
+        skip_ws(std::size_t p) const
+        {
+            while (p < buffer_.size() && is_ws(buffer_[p]))
+                ++p;
+            return p;
+        }
+
+        system::error_code
+        fail()
+        {
+            error_ = asio::error::invalid_argument;
+            return error_;
+        }
+
+        /// the input ran out at p: more is needed, unless there is no more
+        system::error_code
+        starved()
+        {
+            if (finished_)
+                return fail();
+            return error::need_more;
+        }
+
+        /// position just after the closing quote of the string starting at p, or npos if it is not all here
+        std::size_t
+        string_end(std::size_t p) const
+        {
+            for (++p; p < buffer_.size(); ++p)
+            {
+                if (buffer_[p] == '\\')
+                    ++p;
+                else if (buffer_[p] == '"')
+                    return p + 1;
+            }
+            return std::string::npos;
+        }
+
+        /// position just after the number or literal starting at p, or npos if it may continue beyond the
+        /// input held
+        std::size_t
+        scalar_end(std::size_t p) const
+        {
+            while (p < buffer_.size() && !is_ws(buffer_[p]) && buffer_[p] != ',' && buffer_[p] != '}' &&
+                   buffer_[p] != ']')
+                ++p;
+            return p < buffer_.size() || finished_ ? p : std::string::npos;
+        }
+
+        /// fully parse the scalar in [first, last) with the tokenizer, so that its rules are applied exactly
+        system::error_code
+        parse_scalar(std::size_t first, std::size_t last)
+        {
+            capture_.reset();
+            capture_.handler().kind = scalar_capture::none;
+            if (tokenize(capture_, std::string_view(buffer_).substr(first, last - first)))
+                return fail();
+            return {};
+        }
+
+        /// continue, or start, skipping the value at the cursor
+        system::error_code
+        skip_pending()
+        {
+            if (!skip_.active)
+            {
+                skip_        = skip_state();
+                skip_.active = true;
+            }
+            auto p        = pos_;
+            auto complete = false;
+            for (; p < buffer_.size(); ++p)
+            {
+                auto c = buffer_[p];
+                if (skip_.in_string)
+                {
+                    if (skip_.escape)
+                        skip_.escape = false;
+                    else if (c == '\\')
+                        skip_.escape = true;
+                    else if (c == '"')
+                    {
+                        skip_.in_string = false;
+                        if (skip_.depth == 0)
+                        {
+                            ++p;
+                            complete = true;
+                            break;
+                        }
+                    }
+                    continue;
+                }
+                if (!skip_.started)
+                {
+                    if (is_ws(c))
+                        continue;
+                    if (c != '"' && c != '{' && c != '[' && c != '-' && c != 't' && c != 'f' && c != 'n' &&
+                        !(c >= '0' && c <= '9'))
+                        return fail();
+                    skip_.started = true;
+                }
+                if (c == '"')
+                    skip_.in_string = true;
+                else if (c == '{' || c == '[')
+                    ++skip_.depth;
+                else if (c == '}' || c == ']')
+                {
+                    if (skip_.depth == 0)
+                    {
+                        complete = true;   // the end of the enclosing container ends a scalar
+                        break;
+                    }
+                    if (--skip_.depth == 0)
+                    {
+                        ++p;
+                        complete = true;
+                        break;
+                    }
+                }
+                else if (skip_.depth == 0 && (c == ',' || is_ws(c)))
+                {
+                    complete = true;
+                    break;
+                }
+            }
+            pos_ = p;
+            // a number or literal running to the end of the input is complete only if there is no more
+            if (!complete && !(finished_ && skip_.started && skip_.depth == 0 && !skip_.in_string))
+                return starved();
+            skip_    = skip_state();
+            pending_ = false;
+            return {};
+        }
+
+        /// locate the next member or element of the innermost container, passing over the current one.
+        /// Leaves pending_ set if there is one, otherwise leaves the container.
+        system::error_code
+        step(bool &found)
+        {
+            found = false;
+            if (pending_)
+                if (auto ec = skip_pending())
+                    return ec;
+
+            auto &f = frames_.back();
+            auto  p = skip_ws(pos_);
+            if (p == buffer_.size())
+                return starved();
+            auto close = f.is_object ? '}' : ']';
+            if (buffer_[p] == close)
+            {
+                pos_ = p + 1;
+                frames_.pop_back();
+                return {};
+            }
+            if (!f.first)
+            {
+                if (buffer_[p] != ',')
+                    return fail();
+                p = skip_ws(p + 1);
+                if (p == buffer_.size())
+                    return starved();
+            }
+
+            if (f.is_object)
+            {
+                if (buffer_[p] != '"')
+                    return fail();
+                auto last = string_end(p);
+                if (last == std::string::npos)
+                    return starved();
+                auto raw = std::string_view(buffer_).substr(p + 1, last - p - 2);
+                auto q   = skip_ws(last);
+                if (q == buffer_.size())
+                    return starved();
+                if (buffer_[q] != ':')
+                    return fail();
+                if (raw.find('\\') == std::string_view::npos)
+                    f.key.assign(raw.data(), raw.size());
+                else
+                {
+                    if (auto ec = parse_scalar(p, last))
+                        return ec;
+                    f.key = std::move(capture_.handler().text);
+                }
+                p = q + 1;
+            }
+
+            f.first  = false;
+            pos_     = p;
+            pending_ = true;
+            found    = true;
+            return {};
+        }
+
+        /// pass over everything up to the end of the container at depth
+        system::error_code
+        leave(std::size_t depth)
+        {
+            while (frames_.size() > depth)
+            {
+                bool found;
+                if (auto ec = step(found))
+                    return ec;
+            }
+            return {};
+        }
+
+        /// make the container at depth the innermost one, entering it if the cursor is at its start
+        system::error_code
+        enter(std::size_t depth, bool is_object)
+        {
+            if (error_)
+                return error_;
+            if (frames_.size() == depth)
+            {
+                if (!pending_)
+                    return error::out_of_order;
+                auto p = skip_ws(pos_);
+                if (p == buffer_.size())
+                    return starved();
+                if (buffer_[p] != (is_object ? '{' : '['))
+                    return error::type_mismatch;
+                pos_     = p + 1;
+                pending_ = false;
+                frames_.push_back({ is_object, true, {} });
+                return {};
+            }
+            if (frames_.size() < depth || frames_[depth].is_object != is_object)
+                return frames_.size() < depth ? error::out_of_order : error::type_mismatch;
+            return leave(depth + 1);
+        }
+
+        /// locate the scalar at depth, parse it and, unless accept fails, consume it
+        template < class Accept >
+        system::error_code
+        read_scalar(std::size_t depth, Accept accept)
+        {
+            if (error_)
+                return error_;
+            if (frames_.size() != depth || !pending_)
+                return frames_.size() > depth ? error::type_mismatch : error::out_of_order;
+            auto p = skip_ws(pos_);
+            if (p == buffer_.size())
+                return starved();
+            if (buffer_[p] == '{' || buffer_[p] == '[')
+                return error::type_mismatch;
+            auto last = buffer_[p] == '"' ? string_end(p) : scalar_end(p);
+            if (last == std::string::npos)
+                return starved();
+            if (auto ec = parse_scalar(p, last))
+                return ec;
+            if (auto ec = accept(capture_.handler()))
+                return ec;
+            pos_     = last;
+            pending_ = false;
+            return {};
+        }
+
+        std::string                       buffer_;
+        std::size_t                       pos_ = 0;
+        std::vector< frame >              frames_;
+        bool                              pending_  = true;   // the value at depth frames_.size() is unread
+        bool                              finished_ = false;
+        skip_state                        skip_;
+        basic_tokenizer< scalar_capture > capture_;
+        system::error_code                error_;
+    };
+
+    inline on_demand_value
+    on_demand_value::find_field(std::string_view key) const
+    {
+        if (ec_)
+            return *this;
+        auto &doc = *doc_;
+
+        // when an access is repeated after need_more, the member it found may already be current
+        if (doc.frames_.size() > depth_ && doc.frames_[depth_].is_object && !doc.frames_[depth_].first &&
+            doc.frames_[depth_].key == key && (doc.frames_.size() > depth_ + 1 || doc.pending_))
+            return on_demand_value(doc_, depth_ + 1);
+
+        if (auto ec = doc.enter(depth_, true))
+            return on_demand_value(doc_, depth_, ec);
+        for (;;)
+        {
+            bool found;
+            if (auto ec = doc.step(found))
+                return on_demand_value(doc_, depth_, ec);
+            if (!found)
+                return on_demand_value(doc_, depth_, error::no_such_path);
+            if (doc.frames_.back().key == key)
+                return on_demand_value(doc_, depth_ + 1);
+        }
+    }
+
+    inline bool
+    on_demand_value::next_field(std::string &key, on_demand_value &v, system::error_code &ec) const
+    {
+        ec = ec_;
+        if (!ec)
+            ec = doc_->enter(depth_, true);
+        bool found = false;
+        if (!ec)
+            ec = doc_->step(found);
+        if (ec || !found)
+            return false;
+        key = doc_->frames_.back().key;
+        v   = on_demand_value(doc_, depth_ + 1);
+        return true;
+    }
+
+    inline bool
+    on_demand_value::next_element(on_demand_value &element, system::error_code &ec) const
+    {
+        ec = ec_;
+        if (!ec)
+            ec = doc_->enter(depth_, false);
+        bool found = false;
+        if (!ec)
+            ec = doc_->step(found);
+        if (ec || !found)
+            return false;
+        element = on_demand_value(doc_, depth_ + 1);
+        return true;
+    }
+
+    inline number
+    on_demand_value::get_number(system::error_code &ec) const
+    {
+        using capture = on_demand_document::scalar_capture;
+        number result;
+        ec = ec_;
+        if (!ec)
+            ec = doc_->read_scalar(depth_, [&](capture &c) -> system::error_code {
+                if (c.kind != capture::number_kind)
+                    return error::type_mismatch;
+                result = std::move(c.value);
+                return {};
+            });
+        return result;
+    }
+
+    inline double
+    on_demand_value::get_double(system::error_code &ec) const
+    {
+        auto n = get_number(ec);
+        if (ec)
+            return 0;
+        auto text = n.mantissa.buffer + n.exponent.buffer;
+        return std::strtod(text.c_str(), nullptr);
+    }
+
+    namespace detail
+    {
+        /// the exact integer value of n, if it has one that fits
+        inline system::error_code
+        to_int64(number const &n, std::int64_t &result)
+        {
+            auto d = to_decimal(n);
+            result = 0;
+            if (d.is_zero())
+                return {};
+            if (d.exponent < static_cast< long long >(d.digits.size()))
+                return error::type_mismatch;
+            if (d.exponent > 19)
+                return error::out_of_range;
+            std::uint64_t magnitude = 0;
+            auto limit = std::uint64_t(std::numeric_limits< std::int64_t >::max()) + (d.negative ? 1 : 0);
+            for (long long i = 0; i < d.exponent; ++i)
+            {
+                auto digit = std::size_t(i) < d.digits.size() ? unsigned(d.digits[std::size_t(i)] - '0') : 0u;
+                if (magnitude > (limit - digit) / 10)
+                    return error::out_of_range;
+                magnitude = magnitude * 10 + digit;
+            }
+            result = d.negative ? std::int64_t(0 - magnitude) : std::int64_t(magnitude);
+            return {};
+        }
+    }   // namespace detail
+
+    inline std::int64_t
+    on_demand_value::get_int64(system::error_code &ec) const
+    {
+        using capture       = on_demand_document::scalar_capture;
+        std::int64_t result = 0;
+        ec                  = ec_;
+        if (!ec)
+            ec = doc_->read_scalar(depth_, [&](capture &c) -> system::error_code {
+                if (c.kind != capture::number_kind)
+                    return error::type_mismatch;
+                return detail::to_int64(c.value, result);
+            });
+        return result;
+    }
+
+    inline std::string
+    on_demand_value::get_string(system::error_code &ec) const
+    {
+        using capture = on_demand_document::scalar_capture;
+        std::string result;
+        ec = ec_;
+        if (!ec)
+            ec = doc_->read_scalar(depth_, [&](capture &c) -> system::error_code {
+                if (c.kind != capture::string_kind)
+                    return error::type_mismatch;
+                result = std::move(c.text);
+                return {};
+            });
+        return result;
+    }
+
+    inline bool
+    on_demand_value::get_bool(system::error_code &ec) const
+    {
+        using capture = on_demand_document::scalar_capture;
+        bool result   = false;
+        ec            = ec_;
+        if (!ec)
+            ec = doc_->read_scalar(depth_, [&](capture &c) -> system::error_code {
+                if (c.kind != capture::bool_kind)
+                    return error::type_mismatch;
+                result = c.boolean;
+                return {};
+            });
+        return result;
+    }
+
+    inline bool
+    on_demand_value::is_null(system::error_code &ec) const
+    {
+        using capture = on_demand_document::scalar_capture;
+        ec            = ec_;
+        if (ec)
+            return false;
+        auto &doc = *doc_;
+        if (doc.frames_.size() > depth_)
+            return false;
+        auto result = false;
+        ec          = doc.read_scalar(depth_, [&](capture &c) -> system::error_code {
+            result = c.kind == capture::null_kind;
+            return result ? system::error_code() : error::type_mismatch;
+        });
+        if (ec == error::type_mismatch)
+            ec.clear();
+        return result;
+    }
+
+    inline system::error_code
+    on_demand_value::skip() const
+    {
+        if (ec_)
+            return ec_;
+        auto &doc = *doc_;
+        if (doc.error_)
+            return doc.error_;
+        if (doc.frames_.size() > depth_)
+            return doc.leave(depth_);
+        if (doc.frames_.size() < depth_ || !doc.pending_)
+            return error::out_of_order;
+        return doc.skip_pending();
+    }
+}   // namespace program
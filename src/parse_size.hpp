@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace program
+{
+    /// a byte count for a command line, which may end in k, M or G for multiples of 2^10, 2^20 and 2^30
+    inline std::uint64_t
+    parse_size(std::string const &text)
+    {
+        std::size_t end;
+        auto        n = std::stoull(text, &end);
+        if (end < text.size())
+            switch (text[end])
+            {
+            case 'k':
+                return n << 10;
+            case 'M':
+                return n << 20;
+            case 'G':
+                return n << 30;
+            default:
+                break;
+            }
+        return n;
+    }
+}   // namespace program
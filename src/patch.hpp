@@ -0,0 +1,871 @@
+#pragma once
+
+#include "config.hpp"
+#include "error.hpp"
+#include "pointer.hpp"
+#include "serializer.hpp"
+#include "tokenizer.hpp"
+#include "value.hpp"
+
+#include <cstddef>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace program
+{
+    enum class patch_op
+    {
+        add,
+        remove,
+        replace,
+        remove_if_present,   // as remove, but not an error if there is nothing to remove. Used by merge patches.
+    };
+
+    struct patch_operation
+    {
+        patch_op                   op = patch_op::add;
+        std::vector< std::string > path;
+        value                      v;
+    };
+
+    /// apply one operation to a document held in memory, starting from path[first]. An absent target stands
+    /// for a member which does not exist; the operation may create it or remove it.
+    inline system::error_code
+    apply_operation(std::optional< value > &target, patch_operation const &op, std::size_t first = 0)
+    {
+        auto &path = op.path;
+        if (first == path.size())
+        {
+            if (!target && (op.op == patch_op::replace || op.op == patch_op::remove))
+                return error::no_such_path;
+            if (op.op == patch_op::add || op.op == patch_op::replace)
+                target = op.v;
+            else
+                target.reset();
+            return {};
+        }
+        if (!target)
+            return error::no_such_path;
+
+        auto current = &*target;
+        for (auto i = first; i + 1 < path.size(); ++i)
+        {
+            std::size_t index;
+            if (auto o = current->if_is< object >())
+                current = o->find(path[i]);
+            else if (auto a = current->if_is< array >())
+                current = pointer_index(path[i], index) && index < a->size() ? &(*a)[index] : nullptr;
+            else
+                current = nullptr;
+            if (!current)
+                return error::no_such_path;
+        }
+
+        auto &last = path.back();
+        if (auto o = current->if_is< object >())
+        {
+            auto found = o->find(last);
+            if (!found)
+            {
+                if (op.op == patch_op::add)
+                    o->emplace_back(last, op.v);
+                else if (op.op != patch_op::remove_if_present)
+                    return error::no_such_path;
+            }
+            else if (op.op == patch_op::add || op.op == patch_op::replace)
+                *found = op.v;
+            else
+                o->erase(last);
+            return {};
+        }
+        if (auto a = current->if_is< array >())
+        {
+            std::size_t index;
+            if (op.op == patch_op::add && last == "-")
+                index = a->size();
+            else if (!pointer_index(last, index))
+                return error::no_such_path;
+            if (op.op == patch_op::add)
+            {
+                if (index > a->size())
+                    return error::no_such_path;
+                a->insert(a->begin() + std::ptrdiff_t(index), op.v);
+            }
+            else if (index >= a->size())
+                return op.op == patch_op::remove_if_present ? system::error_code() : error::no_such_path;
+            else if (op.op == patch_op::replace)
+                (*a)[index] = op.v;
+            else
+                a->erase(a->begin() + std::ptrdiff_t(index));
+            return {};
+        }
+        return error::no_such_path;
+    }
+
+    /// apply a merge patch (RFC 7386) to a document held in memory
+    inline void
+    merge_patch(value &target, value const &patch)
+    {
+        auto p = patch.if_is< object >();
+        if (!p)
+        {
+            target = patch;
+            return;
+        }
+        if (!target.if_is< object >())
+            target = object {};
+        auto &o = std::get< object >(target.data);
+        for (auto &m : p->members())
+        {
+            if (m.second.is_null())
+            {
+                o.erase(m.first);
+                continue;
+            }
+            auto found = o.find(m.first);
+            if (!found)
+                found = &o.emplace_back(m.first, value());
+            merge_patch(*found, m.second);
+        }
+    }
+
+    /// the operations anchored at an array, resolved before the array is seen into a list of what to write
+    /// in place of its elements: each element passes through, is dropped or is patched on its own, and new
+    /// elements are written before the element they precede or before the closing bracket.
+    struct array_splice
+    {
+        struct entry
+        {
+            static constexpr std::size_t inserted = std::size_t(-1);
+
+            /// index of the element in the array as it arrives, or inserted
+            std::size_t                    origin = inserted;
+            bool                           removed = false;
+            value                          v;     // an inserted element
+            std::vector< patch_operation > ops;   // with paths relative to the element
+        };
+
+        /// every element the operations refer to, and the insertions among them, in order. Elements beyond
+        /// the last listed pass through.
+        std::vector< entry > entries;
+        /// elements added with "-", written after the last element
+        std::vector< value > appends;
+        /// the fewest elements the array must have for every operation to find its target
+        std::size_t min_length = 0;
+
+        /// the plan for ops, or nothing if they cannot be applied as the array streams by: an operation on the
+        /// array itself, or an index which follows an append and so depends on the array's length
+        static std::optional< array_splice >
+        plan(std::vector< patch_operation > const &ops)
+        {
+            array_splice result;
+            auto &       entries = result.entries;
+            // the entry at position p of the array as patched so far, listing the elements before it as needed
+            auto locate = [&](std::size_t p) {
+                std::size_t live = 0;
+                for (std::size_t e = 0; e < entries.size(); ++e)
+                    if (!entries[e].removed && live++ == p)
+                        return e;
+                for (; live <= p; ++live)
+                    entries.push_back({ result.min_length++, false, {}, {} });
+                return entries.size() - 1;
+            };
+
+            for (auto &op : ops)
+            {
+                if (op.path.empty())
+                    return std::nullopt;
+                auto &      token = op.path.front();
+                std::size_t index;
+                if (token == "-" && op.op == patch_op::add && op.path.size() == 1)
+                {
+                    result.appends.push_back(op.v);
+                    continue;
+                }
+                if (!pointer_index(token, index) || !result.appends.empty())
+                    return std::nullopt;
+
+                if (op.path.size() == 1 && op.op == patch_op::add)
+                {
+                    auto at = index ? locate(index - 1) + 1 : 0;
+                    entries.insert(entries.begin() + std::ptrdiff_t(at), entry { entry::inserted, false, op.v, {} });
+                    continue;
+                }
+                auto &e = entries[locate(index)];
+                if (op.path.size() == 1 && op.op == patch_op::remove)
+                {
+                    if (e.origin == entry::inserted)
+                        entries.erase(entries.begin() + (&e - entries.data()));
+                    else
+                        e.removed = true;
+                    continue;
+                }
+                auto relative = op;
+                relative.path.erase(relative.path.begin());
+                e.ops.push_back(std::move(relative));
+            }
+            return result;
+        }
+    };
+
+    /// one step of the path to a patched value
+    struct patch_node
+    {
+        enum kind_type
+        {
+            descend,   // the value passes through; some of its members or elements are patched
+            apply,     // the value is buffered and ops are applied to it
+            merge,     // members of an object value are merged, or any other value replaced, by merge
+        };
+
+        kind_type kind = descend;
+        /// member key or array index, and node
+        std::vector< std::pair< std::string, std::size_t > > children;
+        /// operations with paths relative to this node, in patch order
+        std::vector< patch_operation > ops;
+        /// the same operations as applied to an array while it streams, if they can be
+        std::optional< array_splice > splice;
+        value                         merge_value;
+
+        std::size_t
+        find(std::string_view token) const
+        {
+            for (std::size_t i = 0; i < children.size(); ++i)
+                if (children[i].first == token)
+                    return i;
+            return std::size_t(-1);
+        }
+    };
+
+    /// a JSON Patch (RFC 6902) or JSON Merge Patch (RFC 7386) compiled into a trie of the paths it touches.
+    /// Each operation is anchored at the shallowest value it can be applied to in isolation: the member it
+    /// targets, or the array containing the element it adds or removes, since that shifts the indices of the
+    /// others. Operations whose anchors are nested are gathered at the outer one, so that they are applied in
+    /// patch order. Operations anchored at an array are also planned as an array_splice, so that the array
+    /// need not be held in memory.
+    /// move, copy and test are not supported. Throws system_error(error::invalid_patch) if the patch is
+    /// malformed.
+    struct compiled_patch
+    {
+        std::vector< patch_node > nodes;
+
+        static compiled_patch
+        compile(value const &patch)
+        {
+            auto list = patch.if_is< array >();
+            if (!list)
+                invalid("patch must be an array");
+
+            std::vector< patch_operation >              ops;
+            std::vector< std::vector< std::string > > anchors;
+            for (auto &entry : *list)
+            {
+                auto o = entry.if_is< object >();
+                if (!o)
+                    invalid("patch operation must be an object");
+                auto name = o->find("op");
+                auto path = o->find("path");
+                if (!name || !name->if_is< std::string >() || !path || !path->if_is< std::string >())
+                    invalid("patch operation requires op and path");
+
+                patch_operation op;
+                auto &          n = *name->if_is< std::string >();
+                if (n == "add")
+                    op.op = patch_op::add;
+                else if (n == "remove")
+                    op.op = patch_op::remove;
+                else if (n == "replace")
+                    op.op = patch_op::replace;
+                else
+                    invalid("unsupported patch operation");
+                if (op.op != patch_op::remove)
+                {
+                    auto v = o->find("value");
+                    if (!v)
+                        invalid("patch operation requires value");
+                    op.v = *v;
+                }
+                system::error_code ec;
+                op.path = parse_pointer(*path->if_is< std::string >(), ec);
+                if (ec)
+                    invalid("invalid path in patch");
+
+                auto        anchor = op.path;
+                std::size_t index;
+                if (!anchor.empty() && op.op != patch_op::replace &&
+                    (anchor.back() == "-" || pointer_index(anchor.back(), index)))
+                    anchor.pop_back();
+                ops.push_back(std::move(op));
+                anchors.push_back(std::move(anchor));
+            }
+
+            compiled_patch result;
+            result.nodes.emplace_back();
+            for (std::size_t i = 0; i < ops.size(); ++i)
+            {
+                auto depth = anchors[i].size();
+                for (auto &a : anchors)
+                    if (a.size() < depth && std::equal(a.begin(), a.end(), anchors[i].begin()))
+                        depth = a.size();
+
+                std::size_t node = 0;
+                for (std::size_t t = 0; t < depth; ++t)
+                    node = result.child(node, anchors[i][t]);
+                auto &op = ops[i];
+                op.path.erase(op.path.begin(), op.path.begin() + std::ptrdiff_t(depth));
+                result.nodes[node].kind = patch_node::apply;
+                result.nodes[node].ops.push_back(std::move(op));
+            }
+            for (auto &n : result.nodes)
+                if (n.kind == patch_node::apply)
+                    n.splice = array_splice::plan(n.ops);
+            return result;
+        }
+
+        static compiled_patch
+        compile_merge(value const &patch)
+        {
+            compiled_patch result;
+            result.nodes.emplace_back();
+            result.add_merge(0, patch);
+            return result;
+        }
+
+        static compiled_patch
+        parse(std::string_view patch_text)
+        {
+            system::error_code ec;
+            auto               patch = program::parse(patch_text, ec);
+            if (ec)
+                throw system::system_error(ec, "compiled_patch::parse");
+            return compile(patch);
+        }
+
+        static compiled_patch
+        parse_merge(std::string_view patch_text)
+        {
+            system::error_code ec;
+            auto               patch = program::parse(patch_text, ec);
+            if (ec)
+                throw system::system_error(ec, "compiled_patch::parse_merge");
+            return compile_merge(patch);
+        }
+
+      private:
+        [[noreturn]] static void
+        invalid(const char *what)
+        {
+            throw system::system_error(make_error_code(error::invalid_patch), what);
+        }
+
+        std::size_t
+        child(std::size_t parent, std::string const &token)
+        {
+            auto i = nodes[parent].find(token);
+            if (i != std::size_t(-1))
+                return nodes[parent].children[i].second;
+            nodes.emplace_back();
+            nodes[parent].children.emplace_back(token, nodes.size() - 1);
+            return nodes.size() - 1;
+        }
+
+        void
+        add_merge(std::size_t node, value const &patch)
+        {
+            auto o = patch.if_is< object >();
+            if (!o)
+            {
+                nodes[node].kind = patch_node::apply;
+                nodes[node].ops  = { { patch_op::add, {}, patch } };
+                return;
+            }
+            nodes[node].kind        = patch_node::merge;
+            nodes[node].merge_value = patch;
+            for (auto &m : o->members())
+            {
+                auto c = child(node, m.first);
+                if (m.second.is_null())
+                {
+                    nodes[c].kind = patch_node::apply;
+                    nodes[c].ops  = { { patch_op::remove_if_present, {}, {} } };
+                }
+                else
+                    add_merge(c, m.second);
+            }
+        }
+    };
+
+    /// applies a compiled patch to a document as it streams from input to output.
+    /// Values the patch does not touch are re-serialized event by event and only the anchors of its operations
+    /// are buffered, so memory is bounded by the size of the patched values and not the document. Arrays whose
+    /// elements are added or removed stream too: elements are counted as they pass, and only those which are
+    /// themselves patched are buffered.
+    /// Output is compact JSON.
+    /// given pt is an instance of patcher:
+    /// while there is input and !pt.is_complete()
+    ///   write(pt.feed(begin, end));
+    /// write(pt.finalise());
+    struct patcher
+    {
+        explicit patcher(compiled_patch const &patch)
+        : patch_(patch)
+        , tk_(events { this })
+        {
+        }
+
+        patcher(patcher const &) = delete;
+        patcher &
+        operator=(patcher const &) = delete;
+
+        void
+        reset()
+        {
+            tk_.reset();
+            writer_.reset();
+            frames_.clear();
+            builder_     = value_builder();
+            capture_     = none;
+            depth_       = 0;
+            plain_depth_ = 0;
+        }
+
+        /// consume a chunk of input and return the output it produced, valid until the next call
+        std::string_view
+        feed(const char *begin, const char *end)
+        {
+            writer_.output().clear();
+            if (!is_complete())
+                tk_(begin, end);
+            return writer_.output();
+        }
+
+        /// signal the end of input and return the last of the output
+        std::string_view
+        finalise()
+        {
+            writer_.output().clear();
+            tk_.finalise();
+            return writer_.output();
+        }
+
+        bool
+        is_complete() const
+        {
+            return tk_.is_complete();
+        }
+
+        /// syntax error in the document, or error::no_such_path if an operation's target is missing
+        system::error_code const &
+        error() const
+        {
+            return tk_.error();
+        }
+
+      private:
+        static constexpr std::size_t npos = std::size_t(-1);
+
+        /// an object or array containing patched values
+        struct frame
+        {
+            std::size_t         node;
+            bool                is_object;
+            std::size_t         index;   // of the current element
+            std::vector< bool > seen;    // children which have been found
+            std::string         key;     // of the current member
+            /// the plan of an array being spliced, and the next of its entries
+            array_splice const *splice = nullptr;
+            std::size_t         entry  = 0;
+        };
+
+        enum capture_type
+        {
+            none,
+            build,     // the value is being assembled for capture_ops_
+            discard,   // the value is being replaced by a merge node
+            drop,      // the value is an element being removed
+        };
+
+        /// what to do with the element starting now in a spliced array
+        enum element_action
+        {
+            pass,
+            remove,
+            patch,
+        };
+
+        struct events
+        {
+            patcher *owner;
+
+            void
+            on_object_begin(system::error_code &ec)
+            {
+                owner->container_begin(true, ec);
+            }
+            void
+            on_object_end(system::error_code &ec)
+            {
+                owner->container_end(true, ec);
+            }
+            void
+            on_array_begin(system::error_code &ec)
+            {
+                owner->container_begin(false, ec);
+            }
+            void
+            on_array_end(system::error_code &ec)
+            {
+                owner->container_end(false, ec);
+            }
+            void
+            on_key(std::string_view k, system::error_code &ec)
+            {
+                owner->key(k, ec);
+            }
+            void
+            on_string(std::string_view s, system::error_code &ec)
+            {
+                owner->scalar(
+                    ec, [&](auto &h) { h.on_string(s, ec); }, [&] { return value(std::string(s)); });
+            }
+            number_range const *
+            on_number_begin(system::error_code &)
+            {
+                return nullptr;
+            }
+            void
+            on_number(number const &n, system::error_code &ec)
+            {
+                owner->scalar(
+                    ec, [&](auto &h) { h.on_number(n, ec); }, [&] { return value(n); });
+            }
+            void
+            on_bool(bool b, system::error_code &ec)
+            {
+                owner->scalar(
+                    ec, [&](auto &h) { h.on_bool(b, ec); }, [&] { return value(b); });
+            }
+            void
+            on_null(system::error_code &ec)
+            {
+                owner->scalar(
+                    ec, [&](auto &h) { h.on_null(ec); }, [&] { return value(nullptr); });
+            }
+        };
+
+        /// the patch node of the value starting now, if any
+        std::size_t
+        value_node()
+        {
+            std::size_t n = 0;
+            if (!frames_.empty())
+            {
+                auto &f = frames_.back();
+                if (!f.is_object)
+                    ++f.index;
+                auto i = patch_.nodes[f.node].find(f.is_object ? f.key : std::to_string(f.index));
+                if (i == npos)
+                    return npos;
+                f.seen[i] = true;
+                n         = patch_.nodes[f.node].children[i].second;
+            }
+            auto &node = patch_.nodes[n];
+            return node.kind == patch_node::descend && node.children.empty() ? npos : n;
+        }
+
+        /// write the key of the current member, which is held back until it is known to be wanted
+        void
+        flush_key()
+        {
+            if (!frames_.empty() && frames_.back().is_object)
+                writer_.key(frames_.back().key);
+        }
+
+        void
+        emit(std::string const *key, std::optional< value > const &v, system::error_code &ec)
+        {
+            if (!v)
+            {
+                if (!key)
+                    ec = error::no_such_path;   // the document itself, or an element, cannot be removed here
+                return;
+            }
+            if (key)
+                writer_.key(*key);
+            writer_.write(*v);
+        }
+
+        std::string const *
+        current_key() const
+        {
+            return !frames_.empty() && frames_.back().is_object ? &frames_.back().key : nullptr;
+        }
+
+        void
+        finish_apply(std::vector< patch_operation > const &ops,
+                     std::optional< value >                target,
+                     std::string const *                   key,
+                     system::error_code &                  ec)
+        {
+            for (auto &op : ops)
+                if ((ec = apply_operation(target, op)))
+                    return;
+            emit(key, target, ec);
+        }
+
+        /// write the inserted entries of a spliced array which come before the next element from the input, or
+        /// all that remain
+        void
+        write_insertions(frame &f, system::error_code &ec)
+        {
+            auto &entries = f.splice->entries;
+            for (; f.entry < entries.size() && entries[f.entry].origin == array_splice::entry::inserted && !ec;
+                 ++f.entry)
+                finish_apply(entries[f.entry].ops, entries[f.entry].v, nullptr, ec);
+        }
+
+        /// count the element starting now in a spliced array, writing any insertions before it
+        element_action
+        next_element(system::error_code &ec)
+        {
+            auto &f = frames_.back();
+            ++f.index;
+            write_insertions(f, ec);
+            auto &entries = f.splice->entries;
+            if (f.entry == entries.size())
+                return pass;
+            auto &e = entries[f.entry++];
+            capture_ops_ = &e.ops;
+            return e.removed ? remove : e.ops.empty() ? pass : patch;
+        }
+
+        void
+        finish_merge(std::size_t n, std::string const *key, system::error_code &ec)
+        {
+            std::optional< value > target = value(object {});
+            merge_patch(*target, patch_.nodes[n].merge_value);
+            emit(key, target, ec);
+        }
+
+        template < class Event, class Make >
+        void
+        scalar(system::error_code &ec, Event event, Make make)
+        {
+            if (capture_ == build)
+                return event(builder_);
+            if (capture_ == discard || capture_ == drop)
+                return;
+            if (plain_depth_)
+                return event(writer_);
+            if (!frames_.empty() && frames_.back().splice)
+            {
+                auto action = next_element(ec);
+                if (action == patch)
+                    finish_apply(*capture_ops_, make(), nullptr, ec);
+                else if (action == pass)
+                    event(writer_);
+                return;
+            }
+            auto n = value_node();
+            if (n == npos)
+            {
+                flush_key();
+                return event(writer_);
+            }
+            auto &node = patch_.nodes[n];
+            if (node.kind == patch_node::apply)
+                finish_apply(node.ops, make(), current_key(), ec);
+            else if (node.kind == patch_node::merge)
+                finish_merge(n, current_key(), ec);
+            else
+                ec = error::no_such_path;
+        }
+
+        void
+        container_begin(bool is_object, system::error_code &ec)
+        {
+            if (capture_ != none)
+            {
+                ++depth_;
+                if (capture_ == build)
+                    is_object ? builder_.on_object_begin(ec) : builder_.on_array_begin(ec);
+                return;
+            }
+            if (plain_depth_)
+            {
+                ++plain_depth_;
+                is_object ? writer_.on_object_begin(ec) : writer_.on_array_begin(ec);
+                return;
+            }
+
+            if (!frames_.empty() && frames_.back().splice)
+            {
+                auto action = next_element(ec);
+                if (action == pass)
+                {
+                    plain_depth_ = 1;
+                    is_object ? writer_.on_object_begin(ec) : writer_.on_array_begin(ec);
+                    return;
+                }
+                capture_ = action == remove ? drop : build;
+                depth_   = 1;
+                builder_ = value_builder();
+                if (capture_ == build)
+                    is_object ? builder_.on_object_begin(ec) : builder_.on_array_begin(ec);
+                return;
+            }
+
+            auto n = value_node();
+            if (n != npos && patch_.nodes[n].kind == patch_node::apply && patch_.nodes[n].splice && !is_object)
+            {
+                flush_key();
+                writer_.on_array_begin(ec);
+                frames_.push_back({ n, false, npos, {}, {}, &*patch_.nodes[n].splice, 0 });
+                return;
+            }
+            if (n != npos && patch_.nodes[n].kind == patch_node::apply)
+            {
+                capture_      = build;
+                capture_ops_  = &patch_.nodes[n].ops;
+                depth_        = 1;
+                builder_      = value_builder();
+                is_object ? builder_.on_object_begin(ec) : builder_.on_array_begin(ec);
+                return;
+            }
+            if (n != npos && patch_.nodes[n].kind == patch_node::merge && !is_object)
+            {
+                capture_      = discard;
+                capture_node_ = n;
+                depth_        = 1;
+                return;
+            }
+
+            flush_key();
+            is_object ? writer_.on_object_begin(ec) : writer_.on_array_begin(ec);
+            if (n == npos)
+            {
+                plain_depth_ = 1;
+                return;
+            }
+            frames_.push_back(
+                { n, is_object, npos, std::vector< bool >(patch_.nodes[n].children.size()), {}, nullptr, 0 });
+        }
+
+        void
+        container_end(bool is_object, system::error_code &ec)
+        {
+            if (capture_ != none)
+            {
+                if (capture_ == build)
+                    is_object ? builder_.on_object_end(ec) : builder_.on_array_end(ec);
+                if (--depth_)
+                    return;
+                auto kind = capture_;
+                capture_  = none;
+                if (kind == build)
+                    finish_apply(*capture_ops_, std::move(builder_.get()), current_key(), ec);
+                else if (kind == discard)
+                    finish_merge(capture_node_, current_key(), ec);
+                return;
+            }
+            if (plain_depth_)
+            {
+                --plain_depth_;
+                is_object ? writer_.on_object_end(ec) : writer_.on_array_end(ec);
+                return;
+            }
+
+            auto &f = frames_.back();
+            if (f.splice)
+            {
+                if (f.index + 1 < f.splice->min_length)
+                    ec = error::no_such_path;
+                write_insertions(f, ec);
+                for (auto &v : f.splice->appends)
+                    writer_.write(v);
+                writer_.on_array_end(ec);
+                frames_.pop_back();
+                return;
+            }
+            auto &node = patch_.nodes[f.node];
+            for (std::size_t i = 0; i < node.children.size() && !ec; ++i)
+            {
+                if (f.seen[i])
+                    continue;
+                auto &c     = node.children[i];
+                auto &child = patch_.nodes[c.second];
+                if (!f.is_object || child.kind == patch_node::descend)
+                    ec = error::no_such_path;
+                else if (child.kind == patch_node::apply)
+                    finish_apply(child.ops, std::nullopt, &c.first, ec);
+                else
+                    finish_merge(c.second, &c.first, ec);
+            }
+            is_object ? writer_.on_object_end(ec) : writer_.on_array_end(ec);
+            frames_.pop_back();
+        }
+
+        void
+        key(std::string_view k, system::error_code &ec)
+        {
+            if (capture_ == build)
+                builder_.on_key(k, ec);
+            else if (capture_ == discard || capture_ == drop)
+                return;
+            else if (plain_depth_)
+                writer_.key(k);
+            else
+                frames_.back().key.assign(k.data(), k.size());
+        }
+
+        compiled_patch const &                patch_;
+        basic_tokenizer< events >             tk_;
+        json_writer                           writer_;
+        std::vector< frame >                  frames_;
+        value_builder                         builder_;
+        capture_type                          capture_      = none;
+        std::size_t                           capture_node_ = 0;         // of a merge node
+        std::vector< patch_operation > const *capture_ops_  = nullptr;   // applied to a built value
+        std::size_t                           depth_        = 0;         // of the captured value
+        std::size_t                           plain_depth_  = 0;   // of the unpatched value being passed through
+    };
+
+    /// apply a patch to a document held in memory. Throws system_error on a syntax error or a missing target.
+    inline std::string
+    apply_patch(std::string_view document, compiled_patch const &patch)
+    {
+        patcher     pt(patch);
+        std::string result(pt.feed(document.data(), document.data() + document.size()));
+        result += pt.finalise();
+        if (pt.error())
+            throw system::system_error(pt.error(), "apply_patch");
+        return result;
+    }
+
+    /// apply a patch to the first value of a stream, chunk by chunk. Throws system_error on a syntax error or a
+    /// missing target.
+    inline void
+    apply_patch(std::istream &in, std::ostream &out, compiled_patch const &patch, std::size_t chunk_size = 65536)
+    {
+        patcher     pt(patch);
+        std::string buffer(chunk_size, '\0');
+        while (!pt.is_complete() && !pt.error())
+        {
+            in.read(&buffer[0], std::streamsize(chunk_size));
+            auto n = std::size_t(in.gcount());
+            if (!n)
+                break;
+            auto produced = pt.feed(buffer.data(), buffer.data() + n);
+            out.write(produced.data(), std::streamsize(produced.size()));
+        }
+        auto produced = pt.finalise();
+        out.write(produced.data(), std::streamsize(produced.size()));
+        if (pt.error())
+            throw system::system_error(pt.error(), "apply_patch");
+    }
+}   // namespace program
@@ -0,0 +1,283 @@
+#pragma once
+
+#include "config.hpp"
+#include "number_parser.hpp"
+#include "tokenizer.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace program
+{
+    // Workloads for hunting inputs whose cost per byte grows with their size, shared by the performance fuzzer
+    // and the regression benchmarks built from what it finds.
+
+    /// what an input is fed to, and how
+    enum class perf_target : unsigned char
+    {
+        number_parser,            // number_parser over the whole input
+        number_parser_bytewise,   // number_parser one byte per call
+        tokenizer,                // basic_tokenizer< null_handler > over the whole input
+        tokenizer_bytewise,       // basic_tokenizer< null_handler > one byte per call
+    };
+
+    constexpr unsigned perf_target_count = 4;
+
+    inline const char *
+    to_string(perf_target t)
+    {
+        switch (t)
+        {
+        case perf_target::number_parser:
+            return "number_parser";
+        case perf_target::number_parser_bytewise:
+            return "number_parser_bytewise";
+        case perf_target::tokenizer:
+            return "tokenizer";
+        case perf_target::tokenizer_bytewise:
+            return "tokenizer_bytewise";
+        }
+        return "unknown";
+    }
+
+    /// the target named s, or false
+    inline bool
+    from_string(std::string_view s, perf_target &t)
+    {
+        for (unsigned i = 0; i < perf_target_count; ++i)
+            if (s == to_string(perf_target(i)))
+            {
+                t = perf_target(i);
+                return true;
+            }
+        return false;
+    }
+
+    /// feed input to target. Errors in the input are expected and ignored; only the work done matters.
+    inline void
+    run_perf_target(perf_target target, std::string_view input)
+    {
+        auto first = input.data(), last = input.data() + input.size();
+        switch (target)
+        {
+        case perf_target::number_parser:
+        case perf_target::number_parser_bytewise:
+        {
+            number_parser np;
+            auto          p    = first;
+            auto          step = target == perf_target::number_parser ? input.size() : 1;
+            while (p != last && !np.is_complete() && !np.error())
+                p = np(p, p + std::min< std::size_t >(step, std::size_t(last - p)));
+            if (!np.is_complete() && !np.error())
+                np.finalise();
+            break;
+        }
+        case perf_target::tokenizer:
+        case perf_target::tokenizer_bytewise:
+        {
+            basic_tokenizer< null_handler > tk;
+            auto                            p    = first;
+            auto                            step = target == perf_target::tokenizer ? input.size() : 1;
+            while (p != last && !tk.is_complete() && !tk.error())
+                p = tk(p, p + std::min< std::size_t >(step, std::size_t(last - p)));
+            tk.finalise();
+            break;
+        }
+        }
+    }
+
+    /// pathological input families, each generated at any size
+    enum class perf_family : unsigned char
+    {
+        deep_nesting,    // [[[[ ... ]]]]
+        digit_run,       // 1111 ... 1
+        fraction_run,    // 0.000 ... 1
+        exponent_run,    // 1e000 ... 1
+        escape_storm,    // "\né😀 ... "
+        long_string,     // "aaaa ... a"
+        many_numbers,    // [1.5e3,1.5e3, ... ]
+    };
+
+    constexpr unsigned perf_family_count = 7;
+
+    inline const char *
+    to_string(perf_family f)
+    {
+        switch (f)
+        {
+        case perf_family::deep_nesting:
+            return "deep_nesting";
+        case perf_family::digit_run:
+            return "digit_run";
+        case perf_family::fraction_run:
+            return "fraction_run";
+        case perf_family::exponent_run:
+            return "exponent_run";
+        case perf_family::escape_storm:
+            return "escape_storm";
+        case perf_family::long_string:
+            return "long_string";
+        case perf_family::many_numbers:
+            return "many_numbers";
+        }
+        return "unknown";
+    }
+
+    /// a member of family of about bytes bytes
+    inline std::string
+    make_perf_input(perf_family family, std::size_t bytes)
+    {
+        std::string s;
+        s.reserve(bytes + 16);
+        switch (family)
+        {
+        case perf_family::deep_nesting:
+            s.append(bytes / 2, '[');
+            s.append(bytes / 2, ']');
+            break;
+        case perf_family::digit_run:
+            s.append(bytes, '1');
+            s += ' ';
+            break;
+        case perf_family::fraction_run:
+            s = "0.";
+            s.append(bytes, '0');
+            s += "1 ";
+            break;
+        case perf_family::exponent_run:
+            s = "1e";
+            s.append(bytes, '0');
+            s += "1 ";
+            break;
+        case perf_family::escape_storm:
+            s = "\"";
+            while (s.size() < bytes)
+                s += "\\n\\u00e9\\ud83d\\ude00\\\"";
+            s += '"';
+            break;
+        case perf_family::long_string:
+            s = "\"";
+            s.append(bytes, 'a');
+            s += '"';
+            break;
+        case perf_family::many_numbers:
+            s = "[";
+            while (s.size() < bytes)
+                s += "1.5e3,";
+            s.back() = ']';
+            break;
+        }
+        return s;
+    }
+
+    /// the work one call did
+    struct perf_cost
+    {
+        std::uint64_t instructions = 0;   // zero where hardware counters are unavailable
+        std::uint64_t allocations  = 0;   // counted only in programs which replace operator new
+        std::uint64_t allocated    = 0;   // bytes
+        std::uint64_t nanoseconds  = 0;
+    };
+
+    namespace detail
+    {
+        /// incremented by a replacement operator new, where a program installs one
+        struct allocation_counts
+        {
+            std::atomic< std::uint64_t > allocations { 0 };
+            std::atomic< std::uint64_t > bytes { 0 };
+
+            static allocation_counts &
+            instance()
+            {
+                static allocation_counts counts;
+                return counts;
+            }
+        };
+    }   // namespace detail
+
+    /// measures the cost of a call: user space instructions retired where the kernel allows perf events,
+    /// allocations, and time
+    struct perf_meter
+    {
+        perf_meter()
+        {
+#if defined(__linux__)
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.type           = PERF_TYPE_HARDWARE;
+            attr.size           = sizeof(attr);
+            attr.config         = PERF_COUNT_HW_INSTRUCTIONS;
+            attr.disabled       = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv     = 1;
+            fd_                 = int(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+        }
+
+        perf_meter(perf_meter const &) = delete;
+        perf_meter &
+        operator=(perf_meter const &) = delete;
+
+        ~perf_meter()
+        {
+#if defined(__linux__)
+            if (fd_ >= 0)
+                ::close(fd_);
+#endif
+        }
+
+        bool
+        counts_instructions() const
+        {
+            return fd_ >= 0;
+        }
+
+        template < class F >
+        perf_cost
+        measure(F &&f)
+        {
+            auto &counts      = detail::allocation_counts::instance();
+            auto  allocations = counts.allocations.load(std::memory_order_relaxed);
+            auto  bytes       = counts.bytes.load(std::memory_order_relaxed);
+#if defined(__linux__)
+            if (fd_ >= 0)
+            {
+                ::ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+                ::ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+            }
+#endif
+            auto start = std::chrono::steady_clock::now();
+            f();
+            auto      elapsed = std::chrono::steady_clock::now() - start;
+            perf_cost cost;
+#if defined(__linux__)
+            if (fd_ >= 0)
+            {
+                ::ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+                if (::read(fd_, &cost.instructions, sizeof(cost.instructions)) != sizeof(cost.instructions))
+                    cost.instructions = 0;
+            }
+#endif
+            cost.nanoseconds =
+                std::uint64_t(std::chrono::duration_cast< std::chrono::nanoseconds >(elapsed).count());
+            cost.allocations = counts.allocations.load(std::memory_order_relaxed) - allocations;
+            cost.allocated   = counts.bytes.load(std::memory_order_relaxed) - bytes;
+            return cost;
+        }
+
+      private:
+        int fd_ = -1;
+    };
+}   // namespace program
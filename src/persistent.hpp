@@ -0,0 +1,1100 @@
+#pragma once
+
+#include "config.hpp"
+#include "error.hpp"
+#include "hash.hpp"
+#include "number_parser.hpp"
+#include "pointer.hpp"
+#include "tokenizer.hpp"
+#include "value.hpp"
+
+#include <algorithm>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace program
+{
+    // Persistent document object model.
+    // Every node is immutable once built and shared through shared_ptr<const>, so a modification copies
+    // only the nodes on the path from the root to the change and any number of threads may read a
+    // document, and documents derived from it, without locking.
+
+    struct pvalue;
+    struct hamt_node;
+    struct pvec_node;
+
+    /// persistent object: a hash array mapped trie keyed on hash_bytes(key).
+    /// Members are visited in hash order, not in document order. The order depends only on the keys, so objects
+    /// with the same keys visit them alike however they were built, and set and erase leave the order of the
+    /// other members as it was.
+    struct pobject
+    {
+        std::size_t
+        size() const
+        {
+            return size_;
+        }
+
+        bool
+        empty() const
+        {
+            return size_ == 0;
+        }
+
+        pvalue const *
+        find(std::string_view key) const;
+
+        /// a copy with key set to v
+        pobject
+        set(std::string key, pvalue v) const;
+
+        /// a copy without key
+        pobject
+        erase(std::string_view key) const;
+
+        /// call f(std::string const &key, pvalue const &value) for every member
+        template < class F >
+        void
+        for_each(F &&f) const;
+
+        /// the storage shared by copies of this object; null when it is empty
+        void const *
+        identity() const
+        {
+            return root_.get();
+        }
+
+      private:
+        std::shared_ptr< const hamt_node > root_;
+        std::size_t                        size_ = 0;
+    };
+
+    /// persistent array: a 32-way radix balanced trie.
+    /// Indexed access, set and push_back copy one path; insertion and removal other than at the end rebuild
+    /// the trie.
+    struct parray
+    {
+        static constexpr unsigned    bits     = 5;
+        static constexpr std::size_t branches = std::size_t(1) << bits;
+
+        parray() = default;
+
+        /// build in O(n) from values held in order
+        explicit parray(std::vector< pvalue > values);
+
+        std::size_t
+        size() const
+        {
+            return size_;
+        }
+
+        bool
+        empty() const
+        {
+            return size_ == 0;
+        }
+
+        pvalue const &
+        operator[](std::size_t i) const;
+
+        parray
+        set(std::size_t i, pvalue v) const;
+
+        parray
+        push_back(pvalue v) const;
+
+        parray
+        insert(std::size_t i, pvalue v) const;
+
+        parray
+        erase(std::size_t i) const;
+
+        /// call f(pvalue const &) for every element in order
+        template < class F >
+        void
+        for_each(F &&f) const;
+
+        /// the storage shared by copies of this array; null when it is empty
+        void const *
+        identity() const
+        {
+            return root_.get();
+        }
+
+      private:
+        std::shared_ptr< const pvec_node > root_;
+        std::size_t                        size_  = 0;
+        unsigned                           shift_ = 0;
+    };
+
+    /// immutable value. Strings and numbers are shared too, so copying a pvalue never copies text.
+    struct pvalue
+    {
+        using storage = std::variant< std::nullptr_t,
+                                      bool,
+                                      std::shared_ptr< const number >,
+                                      std::shared_ptr< const std::string >,
+                                      parray,
+                                      pobject >;
+
+        storage data;
+
+        pvalue() = default;
+
+        pvalue(std::nullptr_t)
+        {
+        }
+
+        pvalue(bool b)
+        : data(b)
+        {
+        }
+
+        pvalue(number n)
+        : data(std::make_shared< const number >(std::move(n)))
+        {
+        }
+
+        pvalue(std::string s)
+        : data(std::make_shared< const std::string >(std::move(s)))
+        {
+        }
+
+        pvalue(parray a)
+        : data(std::move(a))
+        {
+        }
+
+        pvalue(pobject o)
+        : data(std::move(o))
+        {
+        }
+
+        bool
+        is_null() const
+        {
+            return std::holds_alternative< std::nullptr_t >(data);
+        }
+
+        bool const *
+        if_bool() const
+        {
+            return std::get_if< bool >(&data);
+        }
+
+        number const *
+        if_number() const
+        {
+            auto p = std::get_if< std::shared_ptr< const number > >(&data);
+            return p ? p->get() : nullptr;
+        }
+
+        std::string const *
+        if_string() const
+        {
+            auto p = std::get_if< std::shared_ptr< const std::string > >(&data);
+            return p ? p->get() : nullptr;
+        }
+
+        parray const *
+        if_array() const
+        {
+            return std::get_if< parray >(&data);
+        }
+
+        pobject const *
+        if_object() const
+        {
+            return std::get_if< pobject >(&data);
+        }
+    };
+
+    struct hamt_node
+    {
+        struct slot
+        {
+            std::shared_ptr< const hamt_node > child;
+            std::uint64_t                      hash = 0;
+            std::string                        key;
+            pvalue                             value;
+        };
+
+        /// one bit per occupied slot, indexed by 5 bits of the hash. Unused by collision nodes.
+        std::uint32_t       bitmap = 0;
+        /// keys whose hashes are identical are kept in a flat list once the hash is exhausted
+        bool                collision = false;
+        std::vector< slot > slots;
+
+        static constexpr unsigned bits = 5;
+
+        static std::uint32_t
+        bit(std::uint64_t hash, unsigned shift)
+        {
+            return std::uint32_t(1) << ((hash >> shift) & 31);
+        }
+
+        std::size_t
+        position(std::uint32_t b) const
+        {
+            return std::bitset< 32 >(bitmap & (b - 1)).count();
+        }
+
+        static std::shared_ptr< const hamt_node >
+        merge(unsigned shift, slot a, slot b)
+        {
+            auto node = std::make_shared< hamt_node >();
+            if (shift >= 64)
+            {
+                node->collision = true;
+                node->slots.push_back(std::move(a));
+                node->slots.push_back(std::move(b));
+                return node;
+            }
+            auto ba = bit(a.hash, shift);
+            auto bb = bit(b.hash, shift);
+            if (ba == bb)
+            {
+                node->bitmap = ba;
+                node->slots.push_back({ merge(shift + bits, std::move(a), std::move(b)), 0, {}, {} });
+                return node;
+            }
+            node->bitmap = ba | bb;
+            if (ba < bb)
+            {
+                node->slots.push_back(std::move(a));
+                node->slots.push_back(std::move(b));
+            }
+            else
+            {
+                node->slots.push_back(std::move(b));
+                node->slots.push_back(std::move(a));
+            }
+            return node;
+        }
+
+        static std::shared_ptr< const hamt_node >
+        assoc(std::shared_ptr< const hamt_node > const &node, unsigned shift, slot leaf, bool &added)
+        {
+            if (!node)
+            {
+                auto result    = std::make_shared< hamt_node >();
+                result->bitmap = bit(leaf.hash, shift);
+                result->slots.push_back(std::move(leaf));
+                added = true;
+                return result;
+            }
+
+            auto copy = std::make_shared< hamt_node >(*node);
+            if (node->collision)
+            {
+                for (auto &s : copy->slots)
+                    if (s.key == leaf.key)
+                    {
+                        s.value = std::move(leaf.value);
+                        return copy;
+                    }
+                copy->slots.push_back(std::move(leaf));
+                added = true;
+                return copy;
+            }
+
+            auto b   = bit(leaf.hash, shift);
+            auto pos = node->position(b);
+            if (!(node->bitmap & b))
+            {
+                copy->bitmap |= b;
+                copy->slots.insert(copy->slots.begin() + std::ptrdiff_t(pos), std::move(leaf));
+                added = true;
+                return copy;
+            }
+
+            auto &s = copy->slots[pos];
+            if (s.child)
+                s.child = assoc(s.child, shift + bits, std::move(leaf), added);
+            else if (s.hash == leaf.hash && s.key == leaf.key)
+                s.value = std::move(leaf.value);
+            else
+            {
+                auto child = merge(shift + bits, std::move(s), std::move(leaf));
+                s          = { std::move(child), 0, {}, {} };
+                added = true;
+            }
+            return copy;
+        }
+
+        static std::shared_ptr< const hamt_node >
+        dissoc(std::shared_ptr< const hamt_node > const &node,
+               unsigned                                  shift,
+               std::uint64_t                             hash,
+               std::string_view                          key,
+               bool &                                    removed)
+        {
+            if (!node)
+                return node;
+
+            if (node->collision)
+            {
+                for (std::size_t i = 0; i < node->slots.size(); ++i)
+                    if (node->slots[i].key == key)
+                    {
+                        removed = true;
+                        if (node->slots.size() == 1)
+                            return nullptr;
+                        auto copy = std::make_shared< hamt_node >(*node);
+                        copy->slots.erase(copy->slots.begin() + std::ptrdiff_t(i));
+                        return copy;
+                    }
+                return node;
+            }
+
+            auto b = bit(hash, shift);
+            if (!(node->bitmap & b))
+                return node;
+            auto  pos = node->position(b);
+            auto &s   = node->slots[pos];
+
+            std::shared_ptr< const hamt_node > child;
+            if (s.child)
+            {
+                child = dissoc(s.child, shift + bits, hash, key, removed);
+                if (!removed)
+                    return node;
+            }
+            else if (s.hash == hash && s.key == key)
+                removed = true;
+            else
+                return node;
+
+            auto copy = std::make_shared< hamt_node >(*node);
+            if (child && !child->collision && child->slots.size() == 1 && !child->slots[0].child)
+                copy->slots[pos] = child->slots[0];   // pull a lone leaf back up
+            else if (child)
+                copy->slots[pos].child = std::move(child);
+            else
+            {
+                copy->bitmap &= ~b;
+                copy->slots.erase(copy->slots.begin() + std::ptrdiff_t(pos));
+                if (copy->slots.empty())
+                    return nullptr;
+            }
+            return copy;
+        }
+
+        template < class F >
+        void
+        for_each(F &f) const
+        {
+            for (auto &s : slots)
+            {
+                if (s.child)
+                    s.child->for_each(f);
+                else
+                    f(s.key, s.value);
+            }
+        }
+    };
+
+    struct pvec_node
+    {
+        std::vector< pvalue >                            values;     // leaf level
+        std::vector< std::shared_ptr< const pvec_node > > children;   // interior levels
+    };
+
+    inline pvalue const *
+    pobject::find(std::string_view key) const
+    {
+        auto     hash  = hash_bytes(key);
+        auto     node  = root_.get();
+        unsigned shift = 0;
+        while (node)
+        {
+            if (node->collision)
+            {
+                for (auto &s : node->slots)
+                    if (s.key == key)
+                        return &s.value;
+                return nullptr;
+            }
+            auto b = hamt_node::bit(hash, shift);
+            if (!(node->bitmap & b))
+                return nullptr;
+            auto &s = node->slots[node->position(b)];
+            if (!s.child)
+                return s.hash == hash && s.key == key ? &s.value : nullptr;
+            node = s.child.get();
+            shift += hamt_node::bits;
+        }
+        return nullptr;
+    }
+
+    inline pobject
+    pobject::set(std::string key, pvalue v) const
+    {
+        pobject result;
+        bool    added = false;
+        auto    hash  = hash_bytes(key);
+        result.root_  = hamt_node::assoc(root_, 0, { nullptr, hash, std::move(key), std::move(v) }, added);
+        result.size_  = size_ + (added ? 1 : 0);
+        return result;
+    }
+
+    inline pobject
+    pobject::erase(std::string_view key) const
+    {
+        bool removed = false;
+        auto root    = hamt_node::dissoc(root_, 0, hash_bytes(key), key, removed);
+        if (!removed)
+            return *this;
+        pobject result;
+        result.root_ = std::move(root);
+        result.size_ = size_ - 1;
+        return result;
+    }
+
+    template < class F >
+    void
+    pobject::for_each(F &&f) const
+    {
+        if (root_)
+            root_->for_each(f);
+    }
+
+    inline parray::parray(std::vector< pvalue > values)
+    : size_(values.size())
+    {
+        if (values.empty())
+            return;
+
+        std::vector< std::shared_ptr< const pvec_node > > level;
+        for (std::size_t i = 0; i < values.size(); i += branches)
+        {
+            auto leaf = std::make_shared< pvec_node >();
+            auto last = std::min(values.size(), i + branches);
+            leaf->values.assign(std::make_move_iterator(values.begin() + std::ptrdiff_t(i)),
+                                std::make_move_iterator(values.begin() + std::ptrdiff_t(last)));
+            level.push_back(std::move(leaf));
+        }
+        while (level.size() > 1)
+        {
+            std::vector< std::shared_ptr< const pvec_node > > above;
+            for (std::size_t i = 0; i < level.size(); i += branches)
+            {
+                auto node = std::make_shared< pvec_node >();
+                auto last = std::min(level.size(), i + branches);
+                node->children.assign(level.begin() + std::ptrdiff_t(i), level.begin() + std::ptrdiff_t(last));
+                above.push_back(std::move(node));
+            }
+            level = std::move(above);
+            shift_ += bits;
+        }
+        root_ = std::move(level.front());
+    }
+
+    inline pvalue const &
+    parray::operator[](std::size_t i) const
+    {
+        auto node = root_.get();
+        for (auto shift = shift_; shift > 0; shift -= bits)
+            node = node->children[(i >> shift) & (branches - 1)].get();
+        return node->values[i & (branches - 1)];
+    }
+
+    inline parray
+    parray::set(std::size_t i, pvalue v) const
+    {
+        struct rec
+        {
+            static std::shared_ptr< const pvec_node >
+            apply(pvec_node const &node, unsigned shift, std::size_t i, pvalue &v)
+            {
+                auto copy = std::make_shared< pvec_node >(node);
+                if (shift == 0)
+                    copy->values[i & (branches - 1)] = std::move(v);
+                else
+                {
+                    auto &child = copy->children[(i >> shift) & (branches - 1)];
+                    child       = apply(*child, shift - bits, i, v);
+                }
+                return copy;
+            }
+        };
+
+        auto result  = *this;
+        result.root_ = rec::apply(*root_, shift_, i, v);
+        return result;
+    }
+
+    inline parray
+    parray::push_back(pvalue v) const
+    {
+        struct rec
+        {
+            static std::shared_ptr< const pvec_node >
+            apply(pvec_node const *node, unsigned shift, std::size_t i, pvalue &v)
+            {
+                auto copy = node ? std::make_shared< pvec_node >(*node) : std::make_shared< pvec_node >();
+                if (shift == 0)
+                    copy->values.push_back(std::move(v));
+                else
+                {
+                    auto slot = (i >> shift) & (branches - 1);
+                    if (slot == copy->children.size())
+                        copy->children.push_back(apply(nullptr, shift - bits, i, v));
+                    else
+                        copy->children[slot] = apply(copy->children[slot].get(), shift - bits, i, v);
+                }
+                return copy;
+            }
+        };
+
+        auto result = *this;
+        if (root_ && size_ == (std::size_t(1) << (shift_ + bits)))
+        {
+            // the trie is full: grow a level
+            auto top = std::make_shared< pvec_node >();
+            top->children.push_back(root_);
+            result.root_ = std::move(top);
+            result.shift_ += bits;
+        }
+        result.root_ = rec::apply(result.root_.get(), result.shift_, size_, v);
+        ++result.size_;
+        return result;
+    }
+
+    template < class F >
+    void
+    parray::for_each(F &&f) const
+    {
+        struct rec
+        {
+            static void
+            apply(pvec_node const &node, unsigned shift, F &f)
+            {
+                if (shift == 0)
+                    for (auto &v : node.values)
+                        f(v);
+                else
+                    for (auto &c : node.children)
+                        apply(*c, shift - bits, f);
+            }
+        };
+        if (root_)
+            rec::apply(*root_, shift_, f);
+    }
+
+    inline parray
+    parray::insert(std::size_t i, pvalue v) const
+    {
+        if (i == size_)
+            return push_back(std::move(v));
+        std::vector< pvalue > values;
+        values.reserve(size_ + 1);
+        for_each([&](pvalue const &x) {
+            if (values.size() == i)
+                values.push_back(std::move(v));
+            values.push_back(x);
+        });
+        return parray(std::move(values));
+    }
+
+    inline parray
+    parray::erase(std::size_t i) const
+    {
+        std::vector< pvalue > values;
+        values.reserve(size_);
+        std::size_t n = 0;
+        for_each([&](pvalue const &x) {
+            if (n++ != i)
+                values.push_back(x);
+        });
+        return parray(std::move(values));
+    }
+
+    /// share a mutable document as a persistent one. The members of its objects keep their keys and values but
+    /// not their document order; see pobject.
+    inline pvalue
+    freeze(value const &v)
+    {
+        struct visitor
+        {
+            pvalue
+            operator()(std::nullptr_t) const
+            {
+                return {};
+            }
+            pvalue
+            operator()(bool b) const
+            {
+                return b;
+            }
+            pvalue
+            operator()(number const &n) const
+            {
+                return n;
+            }
+            pvalue
+            operator()(std::string const &s) const
+            {
+                return s;
+            }
+            pvalue
+            operator()(array const &a) const
+            {
+                std::vector< pvalue > values;
+                values.reserve(a.size());
+                for (auto &e : a)
+                    values.push_back(freeze(e));
+                return parray(std::move(values));
+            }
+            pvalue
+            operator()(object const &o) const
+            {
+                pobject result;
+                for (auto &m : o.members())
+                    result = result.set(m.first, freeze(m.second));
+                return result;
+            }
+        };
+        return std::visit(visitor {}, v.data);
+    }
+
+    /// copy a persistent document into a mutable one. Its objects list their members in the order pobject
+    /// visits them, so thaw(freeze(v)) is v with the members of each object in hash order, and written out
+    /// they appear in that order.
+    inline value
+    thaw(pvalue const &v)
+    {
+        if (auto b = v.if_bool())
+            return *b;
+        if (auto n = v.if_number())
+            return *n;
+        if (auto s = v.if_string())
+            return *s;
+        if (auto a = v.if_array())
+        {
+            array result;
+            result.reserve(a->size());
+            a->for_each([&](pvalue const &e) { result.push_back(thaw(e)); });
+            return result;
+        }
+        if (auto o = v.if_object())
+        {
+            object result;
+            o->for_each([&](std::string const &k, pvalue const &e) { result.emplace_back(k, thaw(e)); });
+            return result;
+        }
+        return nullptr;
+    }
+
+    /// the value at a JSON pointer, or nullptr if there is none
+    inline pvalue const *
+    find_pointer(pvalue const &root, std::string_view pointer)
+    {
+        system::error_code ec;
+        auto               tokens = parse_pointer(pointer, ec);
+        if (ec)
+            return nullptr;
+        auto current = &root;
+        for (auto &t : tokens)
+        {
+            if (auto o = current->if_object())
+                current = o->find(t);
+            else if (auto a = current->if_array())
+            {
+                std::size_t i;
+                current = pointer_index(t, i) && i < a->size() ? &(*a)[i] : nullptr;
+            }
+            else
+                current = nullptr;
+            if (!current)
+                return nullptr;
+        }
+        return current;
+    }
+
+    namespace detail
+    {
+        enum class path_edit
+        {
+            set,
+            erase,
+        };
+
+        /// rebuild the path to tokens[depth...], sharing everything off the path
+        inline pvalue
+        edit_path(pvalue const &                    node,
+                  std::vector< std::string > const &tokens,
+                  std::size_t                       depth,
+                  path_edit                         op,
+                  pvalue const &                    replacement,
+                  system::error_code &              ec)
+        {
+            auto &t    = tokens[depth];
+            auto  last = depth + 1 == tokens.size();
+            if (auto o = node.if_object())
+            {
+                auto child = o->find(t);
+                if (last)
+                {
+                    if (op == path_edit::erase)
+                    {
+                        if (!child)
+                            ec = error::no_such_path;
+                        return o->erase(t);
+                    }
+                    return o->set(t, replacement);
+                }
+                if (!child)
+                {
+                    ec = error::no_such_path;
+                    return node;
+                }
+                auto updated = edit_path(*child, tokens, depth + 1, op, replacement, ec);
+                return ec ? node : pvalue(o->set(t, std::move(updated)));
+            }
+            if (auto a = node.if_array())
+            {
+                std::size_t i;
+                if (last && op == path_edit::set && t == "-")
+                    return a->push_back(replacement);
+                if (!pointer_index(t, i) || i >= a->size())
+                {
+                    ec = error::no_such_path;
+                    return node;
+                }
+                if (last)
+                    return op == path_edit::erase ? a->erase(i) : a->set(i, replacement);
+                auto updated = edit_path((*a)[i], tokens, depth + 1, op, replacement, ec);
+                return ec ? node : pvalue(a->set(i, std::move(updated)));
+            }
+            ec = error::no_such_path;
+            return node;
+        }
+    }   // namespace detail
+
+    /// a copy of root with the value at pointer replaced, or added as an object member or appended to an
+    /// array with the "-" token. Only the nodes on the path are copied.
+    inline pvalue
+    set_pointer(pvalue const &root, std::string_view pointer, pvalue v, system::error_code &ec)
+    {
+        auto tokens = parse_pointer(pointer, ec);
+        if (ec)
+            return root;
+        if (tokens.empty())
+            return v;
+        return detail::edit_path(root, tokens, 0, detail::path_edit::set, v, ec);
+    }
+
+    /// a copy of root without the value at pointer. Only the nodes on the path are copied.
+    inline pvalue
+    erase_pointer(pvalue const &root, std::string_view pointer, system::error_code &ec)
+    {
+        auto tokens = parse_pointer(pointer, ec);
+        if (ec)
+            return root;
+        if (tokens.empty())
+        {
+            ec = error::invalid_pointer;
+            return root;
+        }
+        return detail::edit_path(root, tokens, 0, detail::path_edit::erase, {}, ec);
+    }
+
+    namespace detail
+    {
+        /// what distinguishes a value whose children are all interned: the kind, and the shared storage or
+        /// the value itself. Two such values are equal exactly when their identities are.
+        inline std::pair< std::size_t, std::uintptr_t >
+        identity(pvalue const &v)
+        {
+            std::uintptr_t id = 0;
+            if (auto b = v.if_bool())
+                id = *b;
+            else if (auto n = v.if_number())
+                id = reinterpret_cast< std::uintptr_t >(n);
+            else if (auto s = v.if_string())
+                id = reinterpret_cast< std::uintptr_t >(s);
+            else if (auto a = v.if_array())
+                id = reinterpret_cast< std::uintptr_t >(a->identity());
+            else if (auto o = v.if_object())
+                id = reinterpret_cast< std::uintptr_t >(o->identity());
+            return { v.data.index(), id };
+        }
+
+        inline std::uint64_t
+        identity_hash(pvalue const &v)
+        {
+            auto id = identity(v);
+            auto h  = (std::uint64_t(id.second) ^ id.first) * 0x9E3779B97F4A7C15ull;
+            return h ^ (h >> 29);
+        }
+    }   // namespace detail
+
+    struct intern_stats
+    {
+        std::size_t strings    = 0;   // distinct
+        std::size_t numbers    = 0;
+        std::size_t containers = 0;
+        std::size_t hits       = 0;   // values replaced by one already held
+    };
+
+    /// hash-consing of persistent documents: equal strings, numbers, arrays and objects are stored once and
+    /// shared. Containers are hashed bottom up as they complete; since their children have already been
+    /// interned, equal children are the same storage, so hashing and comparing a container looks only at its
+    /// children's identities and never descends further. Numbers are shared when their text is the same.
+    /// The interner holds a reference to everything it has seen, so one may be used for a whole dataset of
+    /// documents and then destroyed, leaving the sharing in place.
+    struct pvalue_interner
+    {
+        pvalue
+        make_string(std::string_view s)
+        {
+            auto it = strings_.find(s);
+            if (it != strings_.end())
+            {
+                ++stats_.hits;
+                return it->second;
+            }
+            pvalue v = std::string(s);
+            strings_.emplace(*v.if_string(), v);
+            ++stats_.strings;
+            return v;
+        }
+
+        pvalue
+        make_number(number const &n)
+        {
+            auto key = n.mantissa.buffer + n.exponent.buffer;
+            auto it  = numbers_.find(key);
+            if (it != numbers_.end())
+            {
+                ++stats_.hits;
+                return it->second;
+            }
+            pvalue v(n);
+            numbers_.emplace(std::move(key), v);
+            ++stats_.numbers;
+            return v;
+        }
+
+        /// values must already be interned
+        pvalue
+        make_array(std::vector< pvalue > values)
+        {
+            std::uint64_t h = 0xA77A1;
+            for (auto &v : values)
+                h = hash_combine(h, detail::identity_hash(v));
+
+            auto range = containers_.equal_range(h);
+            for (auto it = range.first; it != range.second; ++it)
+            {
+                auto a = it->second.if_array();
+                if (!a || a->size() != values.size())
+                    continue;
+                std::size_t i = 0;
+                while (i < values.size() && detail::identity((*a)[i]) == detail::identity(values[i]))
+                    ++i;
+                if (i == values.size())
+                {
+                    ++stats_.hits;
+                    return it->second;
+                }
+            }
+            return add(h, parray(std::move(values)));
+        }
+
+        /// values must already be interned. As in pvalue_builder, the last of duplicate keys wins.
+        pvalue
+        make_object(std::vector< std::string > keys, std::vector< pvalue > values)
+        {
+            // members are combined by addition so that the hash does not depend on their order
+            std::uint64_t h = 0x0B7EC7;
+            for (std::size_t i = 0; i < keys.size(); ++i)
+                h += hash_combine(hash_bytes(keys[i]), detail::identity_hash(values[i]));
+
+            // candidates are compared with the members as given, so that a hit builds nothing
+            auto range = containers_.equal_range(h);
+            for (auto it = range.first; it != range.second; ++it)
+            {
+                auto c = it->second.if_object();
+                if (c && same_members(*c, keys, values))
+                {
+                    ++stats_.hits;
+                    return it->second;
+                }
+            }
+
+            pobject o;
+            for (std::size_t i = 0; i < keys.size(); ++i)
+                o = o.set(std::move(keys[i]), std::move(values[i]));
+            return add(h, std::move(o));
+        }
+
+        intern_stats const &
+        stats() const
+        {
+            return stats_;
+        }
+
+      private:
+        pvalue
+        add(std::uint64_t h, pvalue v)
+        {
+            containers_.emplace(h, v);
+            ++stats_.containers;
+            return v;
+        }
+
+        /// whether o holds exactly the members which setting these keys in turn would give
+        bool
+        same_members(pobject const &o, std::vector< std::string > const &keys, std::vector< pvalue > const &values)
+        {
+            if (o.size() > keys.size())
+                return false;
+            found_.clear();
+            for (std::size_t i = 0; i < keys.size(); ++i)
+            {
+                auto f = o.find(keys[i]);
+                if (!f)
+                    return false;
+                found_.emplace_back(f, i);
+            }
+            // repeated keys find the same member; the value given last is the one to compare
+            std::sort(found_.begin(), found_.end());
+            std::size_t distinct = 0;
+            for (std::size_t i = 0; i < found_.size(); ++i)
+                if (i + 1 == found_.size() || found_[i + 1].first != found_[i].first)
+                {
+                    if (detail::identity(*found_[i].first) != detail::identity(values[found_[i].second]))
+                        return false;
+                    ++distinct;
+                }
+            return distinct == o.size();
+        }
+
+        std::unordered_map< std::string_view, pvalue >          strings_;   // keyed on the interned text
+        std::unordered_map< std::string, pvalue >               numbers_;
+        std::unordered_multimap< std::uint64_t, pvalue >        containers_;
+        intern_stats                                            stats_;
+        std::vector< std::pair< pvalue const *, std::size_t > > found_;   // scratch for same_members
+    };
+
+    /// tokenizer handler which builds a persistent document directly from the event stream.
+    /// With an interner, equal values are stored once; see pvalue_interner.
+    struct pvalue_builder
+    {
+        explicit pvalue_builder(pvalue_interner *interner = nullptr)
+        : interner_(interner)
+        {
+        }
+
+        void
+        on_object_begin(system::error_code &)
+        {
+            frames_.push_back({ true, {}, {} });
+        }
+        void
+        on_object_end(system::error_code &)
+        {
+            auto f = std::move(frames_.back());
+            frames_.pop_back();
+            if (interner_)
+            {
+                insert(interner_->make_object(std::move(f.keys), std::move(f.values)));
+                return;
+            }
+            pobject o;
+            for (std::size_t i = 0; i < f.keys.size(); ++i)
+                o = o.set(std::move(f.keys[i]), std::move(f.values[i]));
+            insert(std::move(o));
+        }
+        void
+        on_array_begin(system::error_code &)
+        {
+            frames_.push_back({ false, {}, {} });
+        }
+        void
+        on_array_end(system::error_code &)
+        {
+            auto values = std::move(frames_.back().values);
+            frames_.pop_back();
+            insert(interner_ ? interner_->make_array(std::move(values)) : pvalue(parray(std::move(values))));
+        }
+        void
+        on_key(std::string_view key, system::error_code &)
+        {
+            frames_.back().keys.emplace_back(key);
+        }
+        void
+        on_string(std::string_view s, system::error_code &)
+        {
+            insert(interner_ ? interner_->make_string(s) : pvalue(std::string(s)));
+        }
+        number_range const *
+        on_number_begin(system::error_code &)
+        {
+            return nullptr;
+        }
+        void
+        on_number(number const &n, system::error_code &)
+        {
+            insert(interner_ ? interner_->make_number(n) : pvalue(n));
+        }
+        void
+        on_bool(bool b, system::error_code &)
+        {
+            insert(b);
+        }
+        void
+        on_null(system::error_code &)
+        {
+            insert(nullptr);
+        }
+
+        /// the completed document
+        pvalue const &
+        get() const
+        {
+            return root_;
+        }
+
+      private:
+        struct frame
+        {
+            bool                       is_object;
+            std::vector< std::string > keys;
+            std::vector< pvalue >      values;
+        };
+
+        void
+        insert(pvalue v)
+        {
+            if (frames_.empty())
+                root_ = std::move(v);
+            else
+                frames_.back().values.push_back(std::move(v));
+        }
+
+        pvalue_interner *    interner_;
+        std::vector< frame > frames_;
+        pvalue               root_;
+    };
+
+    /// parse a complete document held in memory into a persistent document, storing equal values once if an
+    /// interner is given
+    inline pvalue
+    parse_persistent(std::string_view input, system::error_code &ec, pvalue_interner *interner = nullptr)
+    {
+        basic_tokenizer< pvalue_builder > tk(pvalue_builder { interner });
+        ec = tokenize(tk, input);
+        return tk.handler().get();
+    }
+}   // namespace program
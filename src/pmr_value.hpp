@@ -0,0 +1,233 @@
+#pragma once
+
+#include "config.hpp"
+#include "number_parser.hpp"
+#include "tokenizer.hpp"
+#include "value.hpp"
+
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace program
+{
+    // Document object model whose strings, arrays, objects and builder stacks all take their memory from a
+    // std::pmr::memory_resource, so that a document can be built in a per-request monotonic buffer and dropped
+    // with it, or in a per-thread pool. Every part of a document built by pmr_value_builder uses the builder's
+    // resource; copies of parts, like copies of any pmr container, use the default resource unless given one.
+    // Numbers keep the std::string text of number, which short numbers hold without allocating.
+
+    struct pmr_value;
+
+    using pmr_array  = std::pmr::vector< pmr_value >;
+    using pmr_member = std::pair< std::pmr::string, pmr_value >;
+
+    /// JSON object preserving the insertion order of its members
+    struct pmr_object
+    {
+        std::pmr::vector< pmr_member > members;
+
+        pmr_object() = default;
+
+        explicit pmr_object(std::pmr::memory_resource *resource)
+        : members(resource)
+        {
+        }
+
+        pmr_value const *
+        find(std::string_view key) const;
+
+        std::size_t
+        size() const
+        {
+            return members.size();
+        }
+    };
+
+    struct pmr_value
+    {
+        using storage = std::variant< std::nullptr_t, bool, number, std::pmr::string, pmr_array, pmr_object >;
+
+        storage data;
+
+        pmr_value() = default;
+
+        template < class T, std::enable_if_t< std::is_constructible< storage, T && >::value > * = nullptr >
+        pmr_value(T &&x)
+        : data(std::forward< T >(x))
+        {
+        }
+
+        bool
+        is_null() const
+        {
+            return std::holds_alternative< std::nullptr_t >(data);
+        }
+
+        template < class T >
+        T const *
+        if_is() const
+        {
+            return std::get_if< T >(&data);
+        }
+
+        template < class T >
+        T *
+        if_is()
+        {
+            return std::get_if< T >(&data);
+        }
+    };
+
+    inline pmr_value const *
+    pmr_object::find(std::string_view key) const
+    {
+        for (auto &m : members)
+            if (m.first == key)
+                return &m.second;
+        return nullptr;
+    }
+
+    /// tokenizer handler which assembles a pmr_value, taking all its memory from one resource
+    struct pmr_value_builder
+    {
+        explicit pmr_value_builder(std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+        : resource_(resource)
+        , stack_(resource)
+        , key_(resource)
+        {
+        }
+
+        void
+        on_object_begin(system::error_code &)
+        {
+            push(pmr_object(resource_));
+        }
+        void
+        on_object_end(system::error_code &)
+        {
+            stack_.pop_back();
+        }
+        void
+        on_array_begin(system::error_code &)
+        {
+            push(pmr_array(resource_));
+        }
+        void
+        on_array_end(system::error_code &)
+        {
+            stack_.pop_back();
+        }
+        void
+        on_key(std::string_view key, system::error_code &)
+        {
+            key_.assign(key.begin(), key.end());
+        }
+        void
+        on_string(std::string_view s, system::error_code &)
+        {
+            insert(std::pmr::string(s, resource_));
+        }
+        number_range const *
+        on_number_begin(system::error_code &)
+        {
+            return nullptr;
+        }
+        void
+        on_number(number const &n, system::error_code &)
+        {
+            insert(n);
+        }
+        void
+        on_bool(bool b, system::error_code &)
+        {
+            insert(b);
+        }
+        void
+        on_null(system::error_code &)
+        {
+            insert(nullptr);
+        }
+
+        /// the completed document
+        pmr_value &
+        get()
+        {
+            return root_;
+        }
+
+      private:
+        // pmr containers propagate nothing on move, so a moved value keeps the resource it was built with
+        pmr_value *
+        insert(pmr_value v)
+        {
+            if (stack_.empty())
+            {
+                root_ = std::move(v);
+                return &root_;
+            }
+            auto &top = *stack_.back();
+            if (auto a = top.if_is< pmr_array >())
+            {
+                a->push_back(std::move(v));
+                return &a->back();
+            }
+            auto &members = std::get< pmr_object >(top.data).members;
+            members.emplace_back(std::move(key_), std::move(v));
+            return &members.back().second;
+        }
+
+        void
+        push(pmr_value v)
+        {
+            stack_.push_back(insert(std::move(v)));
+        }
+
+        std::pmr::memory_resource *         resource_;
+        pmr_value                           root_;
+        std::pmr::vector< pmr_value * >     stack_;
+        std::pmr::string                    key_;
+    };
+
+    /// parse a complete document held in memory, taking the memory of the document and of the parse from
+    /// resource
+    inline pmr_value
+    parse_pmr(std::string_view input, std::pmr::memory_resource *resource, system::error_code &ec)
+    {
+        basic_tokenizer< pmr_value_builder > tk(pmr_value_builder(resource), resource);
+        ec = tokenize(tk, input);
+        return std::move(tk.handler().get());
+    }
+
+    /// copy a pmr document into one using the default allocator
+    inline value
+    to_value(pmr_value const &v)
+    {
+        if (auto b = v.if_is< bool >())
+            return *b;
+        if (auto n = v.if_is< number >())
+            return *n;
+        if (auto s = v.if_is< std::pmr::string >())
+            return std::string(*s);
+        if (auto a = v.if_is< pmr_array >())
+        {
+            array result;
+            result.reserve(a->size());
+            for (auto &e : *a)
+                result.push_back(to_value(e));
+            return result;
+        }
+        if (auto o = v.if_is< pmr_object >())
+        {
+            object result;
+            result.reserve(o->size());
+            for (auto &m : o->members)
+                result.emplace_back(std::string(m.first), to_value(m.second));
+            return result;
+        }
+        return nullptr;
+    }
+}   // namespace program
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "config.hpp"
+#include "error.hpp"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace program
+{
+    /// one step of a path through a document: a key within an object or an index within an array
+    struct path_segment
+    {
+        bool        is_object = false;
+        std::string key;
+        std::size_t index = std::size_t(-1);
+    };
+
+    /// append one reference token to a JSON pointer (RFC 6901), escaping ~ and /
+    inline void
+    append_pointer_token(std::string &pointer, std::string_view token)
+    {
+        pointer += '/';
+        for (auto c : token)
+        {
+            if (c == '~')
+                pointer += "~0";
+            else if (c == '/')
+                pointer += "~1";
+            else
+                pointer += c;
+        }
+    }
+
+    /// render a path as a JSON pointer
+    inline std::string
+    to_pointer(std::vector< path_segment > const &path)
+    {
+        std::string result;
+        for (auto &s : path)
+        {
+            if (s.is_object)
+                append_pointer_token(result, s.key);
+            else
+                append_pointer_token(result, std::to_string(s.index));
+        }
+        return result;
+    }
+
+    /// split a JSON pointer into its unescaped reference tokens
+    inline std::vector< std::string >
+    parse_pointer(std::string_view pointer, system::error_code &ec)
+    {
+        std::vector< std::string > tokens;
+        if (pointer.empty())
+            return tokens;
+        if (pointer.front() != '/')
+        {
+            ec = error::invalid_pointer;
+            return tokens;
+        }
+        for (std::size_t i = 0; i < pointer.size();)
+        {
+            auto &token = tokens.emplace_back();
+            for (++i; i < pointer.size() && pointer[i] != '/'; ++i)
+            {
+                if (pointer[i] != '~')
+                    token += pointer[i];
+                else if (i + 1 < pointer.size() && (pointer[i + 1] == '0' || pointer[i + 1] == '1'))
+                    token += pointer[++i] == '0' ? '~' : '/';
+                else
+                {
+                    ec = error::invalid_pointer;
+                    return {};
+                }
+            }
+        }
+        return tokens;
+    }
+
+    /// interpret a reference token as an array index. Returns false if it is not a canonical non-negative
+    /// integer.
+    inline bool
+    pointer_index(std::string const &token, std::size_t &index)
+    {
+        if (token.empty() || token.size() > 18 || (token.size() > 1 && token[0] == '0'))
+            return false;
+        index = 0;
+        for (auto c : token)
+        {
+            if (c < '0' || c > '9')
+                return false;
+            index = index * 10 + std::size_t(c - '0');
+        }
+        return true;
+    }
+}   // namespace program
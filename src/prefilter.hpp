@@ -0,0 +1,211 @@
+#pragma once
+
+#include "config.hpp"
+#include "error.hpp"
+#include "projection.hpp"
+#include "value.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace program
+{
+    /// position of the first occurrence of needle in haystack, or npos.
+    /// With SSE2, 16 candidate positions are tested at once by comparing the first and last bytes of the
+    /// needle against two overlapping loads, and only positions where both agree are compared in full.
+    inline std::size_t
+    find_bytes(std::string_view haystack, std::string_view needle)
+    {
+        auto n = needle.size();
+        if (n == 0)
+            return 0;
+        if (n > haystack.size())
+            return std::string_view::npos;
+
+        std::size_t i = 0;
+#if defined(__SSE2__)
+        if (n > 1)
+        {
+            auto first = _mm_set1_epi8(needle.front());
+            auto last  = _mm_set1_epi8(needle.back());
+            auto h     = haystack.data();
+            for (; i + n - 1 + 16 <= haystack.size(); i += 16)
+            {
+                auto block_first = _mm_loadu_si128(reinterpret_cast< const __m128i * >(h + i));
+                auto block_last  = _mm_loadu_si128(reinterpret_cast< const __m128i * >(h + i + n - 1));
+                auto mask        = unsigned(_mm_movemask_epi8(
+                    _mm_and_si128(_mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, last))));
+                while (mask)
+                {
+                    auto bit = unsigned(__builtin_ctz(mask));
+                    if (std::memcmp(h + i + bit + 1, needle.data() + 1, n - 2) == 0)
+                        return i + bit;
+                    mask &= mask - 1;
+                }
+            }
+        }
+#endif
+        auto pos = haystack.substr(i).find(needle);
+        return pos == std::string_view::npos ? pos : i + pos;
+    }
+
+    /// literal byte strings which must all appear in the text of a record for it to possibly match.
+    /// A literal inside a JSON string can be hidden by an escape sequence, so a record containing a backslash
+    /// is always a candidate; with that rule the filter never rejects a record the precise predicate would
+    /// accept, provided the literals are spelled as the predicate's values are when unescaped.
+    struct prefilter
+    {
+        std::vector< std::string > required;
+
+        bool
+        may_match(std::string_view record) const
+        {
+            for (auto &r : required)
+                if (find_bytes(record, r) == std::string_view::npos)
+                    return record.find('\\') != std::string_view::npos;
+            return true;
+        }
+    };
+
+    /// Bloom filters of the 4 byte substrings of each block of an NDJSON document, built once and kept so that
+    /// repeated searches can skip whole blocks. Blocks end at line boundaries. A block containing a backslash
+    /// is never skipped, for the same reason as in prefilter.
+    struct block_bloom
+    {
+        std::size_t                  bits = 0;   // per block, a power of two
+        std::vector< std::size_t >   starts;     // offset of each block, then the document size
+        std::vector< std::uint64_t > words;
+        std::vector< bool >          escaped;
+
+        static block_bloom
+        build(std::string_view data, std::size_t block_size = 65536, std::size_t bits = 32768)
+        {
+            block_bloom result;
+            result.bits = std::max< std::size_t >(64, bits);
+            while (result.bits & (result.bits - 1))
+                result.bits &= result.bits - 1;
+
+            for (std::size_t start = 0; start < data.size();)
+            {
+                auto end = line_start(data, std::min(data.size(), start + std::max< std::size_t >(1, block_size)));
+                result.starts.push_back(start);
+                result.words.resize(result.words.size() + result.bits / 64);
+                auto block = data.substr(start, end - start);
+                auto bloom = result.words.data() + result.words.size() - result.bits / 64;
+                for (std::size_t i = 0; i + 4 <= block.size(); ++i)
+                    result.set(bloom, gram(block.data() + i));
+                result.escaped.push_back(block.find('\\') != std::string_view::npos);
+                start = end;
+            }
+            result.starts.push_back(data.size());
+            return result;
+        }
+
+        std::size_t
+        blocks() const
+        {
+            return escaped.size();
+        }
+
+        /// false only if block certainly does not contain every pattern
+        bool
+        may_contain(std::size_t block, std::vector< std::string > const &patterns) const
+        {
+            if (escaped[block])
+                return true;
+            auto bloom = words.data() + block * (bits / 64);
+            for (auto &p : patterns)
+                for (std::size_t i = 0; i + 4 <= p.size(); ++i)
+                    if (!test(bloom, gram(p.data() + i)))
+                        return false;
+            return true;
+        }
+
+      private:
+        static std::uint64_t
+        gram(const char *p)
+        {
+            std::uint32_t x;
+            std::memcpy(&x, p, sizeof(x));
+            return (std::uint64_t(x) * 0x9E3779B97F4A7C15ull) ^ (std::uint64_t(x) << 17);
+        }
+
+        // two probes from the halves of one hash
+        void
+        set(std::uint64_t *bloom, std::uint64_t h) const
+        {
+            for (auto b : { h >> 40, h >> 8 })
+                bloom[(b & (bits - 1)) / 64] |= std::uint64_t(1) << (b & 63);
+        }
+
+        bool
+        test(std::uint64_t const *bloom, std::uint64_t h) const
+        {
+            for (auto b : { h >> 40, h >> 8 })
+                if (!(bloom[(b & (bits - 1)) / 64] >> (b & 63) & 1))
+                    return false;
+            return true;
+        }
+    };
+
+    struct filter_stats
+    {
+        std::uint64_t records    = 0;   // in the blocks searched
+        std::uint64_t candidates = 0;   // passed the prefilter and were parsed
+        std::uint64_t matches    = 0;
+        std::uint64_t skipped    = 0;   // blocks skipped by the Bloom filters
+    };
+
+    /// call on_match(record, offset) for each record of an NDJSON document for which predicate(value) is true.
+    /// Records are parsed only if they pass the prefilter, and, when blooms is given, only if their block
+    /// passes its Bloom filter, so the result is that of applying the predicate to every record as long as the
+    /// prefilter's literals are implied by the predicate. Records which fail to parse are treated as not
+    /// matching. Throws system_error(error::bad_index) if blooms were built from another document.
+    template < class Predicate, class F >
+    filter_stats
+    filter_ndjson(std::string_view   data,
+                  prefilter const &  filter,
+                  Predicate &&       predicate,
+                  F &&               on_match,
+                  block_bloom const *blooms = nullptr)
+    {
+        filter_stats stats;
+        auto         search = [&](std::size_t first, std::size_t last) {
+            for_each_record(data, first, last, [&](std::string_view record, std::size_t offset) {
+                ++stats.records;
+                if (!filter.may_match(record))
+                    return;
+                ++stats.candidates;
+                system::error_code ec;
+                auto               v = parse(record, ec);
+                if (!ec && predicate(static_cast< value const & >(v)))
+                {
+                    ++stats.matches;
+                    on_match(record, offset);
+                }
+            });
+        };
+
+        if (blooms && blooms->starts.back() != data.size())
+            throw system::system_error(make_error_code(error::bad_index), "filter_ndjson");
+        if (!blooms)
+            search(0, data.size());
+        else
+            for (std::size_t b = 0; b < blooms->blocks(); ++b)
+            {
+                if (blooms->may_contain(b, filter.required))
+                    search(blooms->starts[b], blooms->starts[b + 1]);
+                else
+                    ++stats.skipped;
+            }
+        return stats;
+    }
+}   // namespace program
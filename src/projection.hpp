@@ -0,0 +1,211 @@
+#pragma once
+
+#include "config.hpp"
+#include "decimal.hpp"
+#include "number_parser.hpp"
+#include "pointer.hpp"
+#include "sort_key.hpp"
+#include "tokenizer.hpp"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace program
+{
+    /// tokenizer handler which picks out the value at one path of a record as an encoded key (see
+    /// sort_key.hpp). Only strings and numbers are keys; any other value at the path is treated as absent.
+    /// Only the open containers which lie along the path are tracked, so records are projected at close to the
+    /// cost of tokenizing them.
+    struct key_projection
+    {
+        key_projection() = default;
+
+        explicit key_projection(std::vector< std::string > path)
+        : path_(std::move(path))
+        , indices_(path_.size())
+        , is_array_(path_.size())
+        , wanted_(path_.size(), std::size_t(-1))
+        {
+            for (std::size_t i = 0; i < path_.size(); ++i)
+                pointer_index(path_[i], wanted_[i]);
+        }
+
+        /// prepare for another record
+        void
+        reset()
+        {
+            depth_   = 0;
+            matched_ = 0;
+            found_   = false;
+            key_.clear();
+        }
+
+        bool
+        found() const
+        {
+            return found_;
+        }
+
+        /// the encoded key, if found
+        std::string const &
+        key() const
+        {
+            return key_;
+        }
+
+        void
+        on_object_begin(system::error_code &)
+        {
+            container_begin(false);
+        }
+        void
+        on_object_end(system::error_code &)
+        {
+            container_end();
+        }
+        void
+        on_array_begin(system::error_code &)
+        {
+            container_begin(true);
+        }
+        void
+        on_array_end(system::error_code &)
+        {
+            container_end();
+        }
+        void
+        on_key(std::string_view key, system::error_code &)
+        {
+            if (matched_ == depth_)
+                key_match_ = key == path_[depth_ - 1];
+        }
+        void
+        on_string(std::string_view s, system::error_code &)
+        {
+            if (at_target())
+            {
+                encode_key(key_, s);
+                found_ = true;
+            }
+        }
+        number_range const *
+        on_number_begin(system::error_code &)
+        {
+            return nullptr;
+        }
+        void
+        on_number(number const &n, system::error_code &)
+        {
+            if (at_target())
+            {
+                encode_key(key_, to_decimal(n));
+                found_ = true;
+            }
+        }
+        void
+        on_bool(bool, system::error_code &)
+        {
+            on_path();
+        }
+        void
+        on_null(system::error_code &)
+        {
+            on_path();
+        }
+
+      private:
+        /// called as each value starts: true if it lies on the path, counting elements of arrays that do
+        bool
+        on_path()
+        {
+            if (matched_ != depth_)
+                return false;
+            if (depth_ == 0)
+                return true;
+            auto level = depth_ - 1;
+            if (is_array_[level])
+                return ++indices_[level] == wanted_[level];
+            return key_match_;
+        }
+
+        bool
+        at_target()
+        {
+            return on_path() && depth_ == path_.size() && !found_;
+        }
+
+        void
+        container_begin(bool is_array)
+        {
+            if (on_path() && depth_ < path_.size())
+            {
+                is_array_[depth_] = is_array;
+                indices_[depth_]  = std::size_t(-1);
+                ++matched_;
+            }
+            ++depth_;
+            key_match_ = false;
+        }
+
+        void
+        container_end()
+        {
+            --depth_;
+            if (matched_ > depth_)
+                matched_ = depth_;
+            key_match_ = false;
+        }
+
+        std::vector< std::string > path_;
+        std::vector< std::size_t > indices_;
+        std::vector< bool >        is_array_;
+        std::vector< std::size_t > wanted_;
+        std::size_t                depth_     = 0;
+        std::size_t                matched_   = 0;
+        bool                       key_match_ = false;
+        bool                       found_     = false;
+        std::string                key_;
+    };
+
+    /// project the key of one record using tk, which is reset first. Returns false if the record has no key;
+    /// ec is set if it is not valid JSON.
+    inline bool
+    project_key(basic_tokenizer< key_projection > &tk, std::string_view record, system::error_code &ec)
+    {
+        tk.reset();
+        tk.handler().reset();
+        ec = tokenize(tk, record);
+        return !ec && tk.handler().found();
+    }
+
+    /// call f(record, offset) for each non-blank line of NDJSON starting in [first, last) of data.
+    /// Lines end at '\n'; a trailing '\r' is left to the parser, which treats it as whitespace.
+    template < class F >
+    void
+    for_each_record(std::string_view data, std::size_t first, std::size_t last, F &&f)
+    {
+        while (first < last)
+        {
+            auto eol = data.find('\n', first);
+            if (eol == std::string_view::npos)
+                eol = data.size();
+            auto line = data.substr(first, eol - first);
+            if (line.find_first_not_of(" \t\r") != std::string_view::npos)
+                f(line, first);
+            first = eol + 1;
+        }
+    }
+
+    /// the start of the first line at or after offset
+    inline std::size_t
+    line_start(std::string_view data, std::size_t offset)
+    {
+        if (offset == 0 || offset >= data.size())
+            return std::min(offset, data.size());
+        auto eol = data.find('\n', offset - 1);
+        return eol == std::string_view::npos ? data.size() : eol + 1;
+    }
+}   // namespace program
@@ -0,0 +1,508 @@
+#pragma once
+
+#include "config.hpp"
+#include "error.hpp"
+#include "pointer.hpp"
+#include "serializer.hpp"
+#include "tokenizer.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace program
+{
+    /// one edit made by a rewriter. Replacement text is inserted verbatim and must be valid JSON.
+    struct rewrite_rule
+    {
+        enum kind_type
+        {
+            replace,   // replace the value at pointer with json
+            insert,    // add the member key: json to the end of the object at pointer
+        };
+
+        kind_type   kind = replace;
+        std::string pointer;
+        std::string key;
+        std::string json;
+
+        static rewrite_rule
+        replace_value(std::string pointer, std::string json)
+        {
+            return { replace, std::move(pointer), {}, std::move(json) };
+        }
+
+        static rewrite_rule
+        insert_member(std::string pointer, std::string key, std::string json)
+        {
+            return { insert, std::move(pointer), std::move(key), std::move(json) };
+        }
+    };
+
+    /// applies rewrite rules to a document as it streams through, without copying it.
+    /// Each chunk fed in produces a sequence of buffers referring to the unchanged parts of that chunk and to
+    /// the replacement text held by the rewriter, suitable for a gather write:
+    ///   asio::async_write(stream, rw.feed(asio::buffer(chunk, n)), ...);
+    /// The buffers remain valid until the next call to feed, finalise or reset, and for as long as the chunk
+    /// they were produced from.
+    /// Throws system_error(error::invalid_pointer) if a rule's pointer is malformed.
+    struct rewriter
+    {
+        explicit rewriter(std::vector< rewrite_rule > const &rules)
+        : tk_(events { this })
+        {
+            for (auto &r : rules)
+            {
+                system::error_code ec;
+                auto               tokens = parse_pointer(r.pointer, ec);
+                if (ec)
+                    throw system::system_error(ec, "rewriter: " + r.pointer);
+                if (r.kind == rewrite_rule::replace)
+                    rules_.push_back({ r.kind, std::move(tokens), r.json, {} });
+                else
+                {
+                    std::string member;
+                    append_json_string(member, r.key);
+                    member += ':';
+                    member += r.json;
+                    rules_.push_back({ r.kind, std::move(tokens), "," + member, member });
+                }
+            }
+            reset();
+        }
+
+        rewriter(rewriter const &) = delete;
+        rewriter &
+        operator=(rewriter const &) = delete;
+
+        /// prepare for another document
+        void
+        reset()
+        {
+            tk_.reset();
+            path_.clear();
+            out_.clear();
+            chunk_start_ = 0;
+            emitted_     = 0;
+            started_ = false;
+            mode_    = pass;
+            active_  = nullptr;
+            arm();
+        }
+
+        /// rewrite the next chunk of input. Input after the end of the document is not consumed or emitted.
+        std::vector< asio::const_buffer > const &
+        feed(asio::const_buffer chunk)
+        {
+            out_.clear();
+            chunk_       = chunk;
+            chunk_start_ = tk_.consumed();
+            if (!is_complete())
+            {
+                auto begin = static_cast< const char * >(chunk.data());
+                tk_(begin, begin + chunk.size());
+            }
+            end_of_chunk();
+            return out_;
+        }
+
+        /// signal the end of input. Returns anything still to be written.
+        std::vector< asio::const_buffer > const &
+        finalise()
+        {
+            out_.clear();
+            chunk_       = asio::const_buffer();
+            chunk_start_ = tk_.consumed();
+            tk_.finalise();
+            return out_;
+        }
+
+        /// buffers produced by the last call to feed or finalise
+        std::vector< asio::const_buffer > const &
+        buffers() const
+        {
+            return out_;
+        }
+
+        bool
+        is_complete() const
+        {
+            return tk_.is_complete();
+        }
+
+        /// syntax error in the document
+        system::error_code const &
+        error() const
+        {
+            return tk_.error();
+        }
+
+      private:
+        struct compiled_rule
+        {
+            rewrite_rule::kind_type    kind;
+            std::vector< std::string > tokens;
+            std::string                text;         // replacement, or member with a leading comma
+            std::string                first_text;   // member for an empty object
+        };
+
+        /// passes the tokenizer's events to the rewriter
+        struct events
+        {
+            rewriter *owner;
+
+            void
+            on_object_begin(system::error_code &)
+            {
+                owner->container_begin(true);
+            }
+            void
+            on_object_end(system::error_code &)
+            {
+                owner->container_end();
+            }
+            void
+            on_array_begin(system::error_code &)
+            {
+                owner->container_begin(false);
+            }
+            void
+            on_array_end(system::error_code &)
+            {
+                owner->container_end();
+            }
+            void
+            on_key(std::string_view key, system::error_code &)
+            {
+                owner->key(key);
+            }
+            void
+            on_string(std::string_view, system::error_code &)
+            {
+                owner->scalar();
+            }
+            number_range const *
+            on_number_begin(system::error_code &)
+            {
+                return nullptr;
+            }
+            void
+            on_number(number const &, system::error_code &)
+            {
+                owner->scalar();
+            }
+            void
+            on_bool(bool, system::error_code &)
+            {
+                owner->scalar();
+            }
+            void
+            on_null(system::error_code &)
+            {
+                owner->scalar();
+            }
+        };
+
+        enum mode_type
+        {
+            pass,   // input is copied to the output
+            seek,   // the next value is to be replaced; input up to its start is copied
+            drop,   // input is discarded up to the end of the value being replaced
+        };
+
+        bool
+        matches(compiled_rule const &r, std::size_t depth) const
+        {
+            if (r.tokens.size() != depth)
+                return false;
+            for (std::size_t i = 0; i < depth; ++i)
+            {
+                auto &s = path_[i];
+                if (s.is_object)
+                {
+                    if (s.key != r.tokens[i])
+                        return false;
+                }
+                else
+                {
+                    std::size_t index;
+                    if (!pointer_index(r.tokens[i], index) || index != s.index)
+                        return false;
+                }
+            }
+            return true;
+        }
+
+        /// look for a replacement of the value about to start at the end of path_. The input up to the
+        /// current position is passed first, so that only separators lie between it and the value.
+        void
+        arm()
+        {
+            if (mode_ != pass)
+                return;
+            for (auto &r : rules_)
+                if (r.kind == rewrite_rule::replace && matches(r, path_.size()))
+                {
+                    emit_to(tk_.offset());
+                    mode_    = seek;
+                    active_  = &r;
+                    started_ = false;
+                    return;
+                }
+        }
+
+        /// the next array element's index is known as soon as the previous one ends
+        void
+        arm_next_element()
+        {
+            if (mode_ != pass || path_.empty() || path_.back().is_object)
+                return;
+            ++path_.back().index;
+            arm();
+            --path_.back().index;
+        }
+
+        /// emit the input from where emission stopped up to offset, which lies within the current chunk
+        void
+        emit_to(std::size_t offset)
+        {
+            auto first = std::max(emitted_, chunk_start_);
+            if (offset > first)
+            {
+                auto data = static_cast< const char * >(chunk_.data()) + (first - chunk_start_);
+                auto size = offset - first;
+                if (!out_.empty() && static_cast< const char * >(out_.back().data()) + out_.back().size() == data)
+                    out_.back() = asio::const_buffer(out_.back().data(), out_.back().size() + size);
+                else
+                    out_.emplace_back(data, size);
+            }
+            emitted_ = std::max(emitted_, offset);
+        }
+
+        void
+        emit_text(std::string const &text)
+        {
+            out_.emplace_back(text.data(), text.size());
+        }
+
+        /// skip over the separators preceding a value, within the current chunk. Returns the offset of the
+        /// value's first character, if it is in the chunk.
+        bool
+        find_value_start(std::size_t &offset) const
+        {
+            auto data = static_cast< const char * >(chunk_.data());
+            for (auto i = std::max(emitted_, chunk_start_) - chunk_start_; i < chunk_.size(); ++i)
+            {
+                auto c = data[i];
+                if (c != ' ' && c != '\t' && c != '\n' && c != '\r' && c != ':' && c != ',')
+                {
+                    offset = chunk_start_ + i;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /// a value which may be being replaced has started
+        void
+        value_start()
+        {
+            if (mode_ != seek || started_)
+                return;
+            std::size_t start;
+            if (find_value_start(start))
+                emit_to(start);
+            started_ = true;
+        }
+
+        /// the value being replaced has ended at the current position
+        void
+        value_end()
+        {
+            emit_text(active_->text);
+            emitted_ = tk_.offset();
+            mode_    = pass;
+            active_  = nullptr;
+        }
+
+        void
+        element_start()
+        {
+            if (!path_.empty() && !path_.back().is_object)
+                ++path_.back().index;
+        }
+
+        void
+        key(std::string_view k)
+        {
+            auto &s = path_.back();
+            s.key.assign(k.data(), k.size());
+            ++s.index;
+            arm();
+        }
+
+        void
+        scalar()
+        {
+            element_start();
+            if (mode_ == seek)
+            {
+                value_start();
+                value_end();
+            }
+            arm_next_element();
+        }
+
+        void
+        container_begin(bool is_object)
+        {
+            element_start();
+            if (mode_ == seek)
+            {
+                value_start();
+                mode_       = drop;
+                drop_depth_ = tk_.depth();
+            }
+            path_.push_back({ is_object, {}, std::size_t(-1) });
+            if (!is_object)
+                arm_next_element();
+        }
+
+        void
+        container_end()
+        {
+            auto is_object = path_.back().is_object;
+            if (mode_ == seek)
+                mode_ = pass;   // an array ended where an element was expected
+            if (mode_ == pass && is_object)
+            {
+                auto members = path_.back().index != std::size_t(-1);
+                for (auto &r : rules_)
+                    if (r.kind == rewrite_rule::insert && matches(r, path_.size() - 1))
+                    {
+                        emit_to(tk_.offset() - 1);
+                        emit_text(members ? r.text : r.first_text);
+                        members = true;
+                    }
+            }
+            path_.pop_back();
+            if (mode_ == drop && tk_.depth() == drop_depth_)
+                value_end();
+            arm_next_element();
+        }
+
+        void
+        end_of_chunk()
+        {
+            auto end = tk_.consumed();
+            if (mode_ == pass)
+                emit_to(end);
+            else if (mode_ == seek && !started_)
+            {
+                std::size_t start;
+                if (find_value_start(start) && start < end)
+                {
+                    emit_to(start);
+                    started_ = true;
+                    emitted_ = end;
+                }
+                else
+                    emit_to(end);
+            }
+            else
+                emitted_ = end;
+        }
+
+        basic_tokenizer< events >         tk_;
+        std::vector< compiled_rule >      rules_;
+        std::vector< path_segment >       path_;
+        std::vector< asio::const_buffer > out_;
+        asio::const_buffer                chunk_;
+        std::size_t                       chunk_start_ = 0;
+        std::size_t                       emitted_     = 0;
+        std::size_t                       drop_depth_  = 0;
+        mode_type                         mode_        = pass;
+        bool                              started_     = false;
+        compiled_rule const *             active_      = nullptr;
+    };
+
+    /// rewrite a document held in memory
+    inline std::string
+    rewrite(std::string_view input, std::vector< rewrite_rule > const &rules)
+    {
+        rewriter rw(rules);
+        std::string result;
+        auto        append = [&](std::vector< asio::const_buffer > const &bufs) {
+            auto n = result.size();
+            result.resize(n + asio::buffer_size(bufs));
+            asio::buffer_copy(asio::buffer(&result[n], result.size() - n), bufs);
+        };
+        append(rw.feed(asio::buffer(input.data(), input.size())));
+        append(rw.finalise());
+        if (rw.error())
+            throw system::system_error(rw.error(), "rewrite");
+        return result;
+    }
+
+#include <boost/asio/yield.hpp>
+    /// composed operation reading a document from in, rewriting it and writing the result to out with gather
+    /// writes, using buffer for input
+    template < class AsyncReadStream, class AsyncWriteStream >
+    struct rewrite_op : asio::coroutine
+    {
+        AsyncReadStream &   in;
+        AsyncWriteStream &  out;
+        rewriter &          rw;
+        asio::mutable_buffer buffer;
+        bool                eof = false;
+
+        template < class Self >
+        void
+        operator()(Self &self, system::error_code ec = {}, std::size_t n = 0)
+        {
+            reenter(this)
+            {
+                while (!rw.is_complete() && !eof)
+                {
+                    yield in.async_read_some(buffer, std::move(self));
+                    if (ec == asio::error::eof)
+                    {
+                        eof = true;
+                        rw.finalise();
+                    }
+                    else if (ec)
+                        break;
+                    else
+                        rw.feed(asio::buffer(buffer.data(), n));
+                    if (rw.error())
+                        break;
+                    if (asio::buffer_size(rw.buffers()))
+                    {
+                        yield asio::async_write(out, rw.buffers(), std::move(self));
+                        if (ec)
+                            break;
+                    }
+                }
+                if (!ec)
+                    ec = rw.error();
+                self.complete(ec);
+            }
+        }
+    };
+#include <boost/asio/unyield.hpp>
+
+    template < class AsyncReadStream, class AsyncWriteStream, class CompletionToken >
+    auto
+    async_rewrite(AsyncReadStream &    in,
+                  AsyncWriteStream &   out,
+                  rewriter &           rw,
+                  asio::mutable_buffer buffer,
+                  CompletionToken &&   token)
+    {
+        return asio::async_compose< CompletionToken, void(system::error_code) >(
+            rewrite_op< AsyncReadStream, AsyncWriteStream > { {}, in, out, rw, buffer }, token, in, out);
+    }
+}   // namespace program
@@ -0,0 +1,508 @@
+#pragma once
+
+#include "config.hpp"
+#include "decimal.hpp"
+#include "error.hpp"
+#include "number_range.hpp"
+#include "tokenizer.hpp"
+#include "value.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace program
+{
+    enum schema_type : unsigned
+    {
+        schema_null    = 1,
+        schema_boolean = 2,
+        schema_integer = 4,
+        schema_number  = 8,
+        schema_string  = 16,
+        schema_array   = 32,
+        schema_object  = 64,
+        schema_any     = 127,
+    };
+
+    /// one state of a compiled schema. Transitions to child states are indices into compiled_schema::nodes.
+    struct schema_node
+    {
+        static constexpr std::size_t unconstrained = std::size_t(-1);
+
+        struct property
+        {
+            std::string key;
+            std::size_t node = unconstrained;
+            /// index into the required key set of the owning node, or -1 if the key is optional
+            int required = -1;
+        };
+
+        unsigned                     types = schema_any;
+        std::vector< property >      properties;   // sorted by key
+        std::size_t                  required_count = 0;
+        std::size_t                  items          = unconstrained;
+        number_range                 range;
+        std::optional< std::size_t > min_length, max_length;
+        /// permitted scalar values, canonicalised by enum_token
+        std::vector< std::string > enumeration;
+
+        property const *
+        find(std::string_view key) const
+        {
+            auto i = std::lower_bound(
+                properties.begin(), properties.end(), key, [](property const &p, std::string_view k) {
+                    return p.key < k;
+                });
+            if (i != properties.end() && i->key == key)
+                return &*i;
+            return nullptr;
+        }
+    };
+
+    /// canonical text of a scalar for enum comparison, independent of how the value was spelled
+    inline std::string
+    enum_token(char kind, std::string_view text)
+    {
+        std::string result;
+        result.reserve(text.size() + 1);
+        result += kind;
+        result.append(text.begin(), text.end());
+        return result;
+    }
+
+    inline std::string
+    enum_token(decimal const &d)
+    {
+        std::ostringstream ss;
+        ss << d;
+        return enum_token('n', ss.str());
+    }
+
+    /// a JSON schema compiled ahead of time into a table of states.
+    /// Supports type, properties, required, items, minimum, maximum, exclusiveMinimum, exclusiveMaximum,
+    /// minLength, maxLength and enum (of scalars). Other keywords are ignored.
+    /// Numbers checked against a minimum or maximum may have at most max_digits mantissa digits, plus as many
+    /// as it takes to write out the largest bound, so that a run of digits is rejected as it arrives.
+    struct compiled_schema
+    {
+        static constexpr std::size_t default_max_digits = 1000;
+
+        std::vector< schema_node > nodes;
+
+        static compiled_schema
+        compile(value const &schema, std::size_t max_digits = default_max_digits)
+        {
+            compiled_schema result;
+            result.max_digits_ = max_digits;
+            result.add(schema);
+            return result;
+        }
+
+        static compiled_schema
+        parse(std::string_view schema_text, std::size_t max_digits = default_max_digits)
+        {
+            system::error_code ec;
+            auto               schema = program::parse(schema_text, ec);
+            if (ec)
+                throw system::system_error(ec, "compiled_schema::parse");
+            return compile(schema, max_digits);
+        }
+
+      private:
+        /// the digit budget of a bounded range: max_digits_, widened to fit the bounds written out in full
+        std::size_t
+        digit_budget(number_range const &range) const
+        {
+            long long widest = 0;
+            for (auto b : { &range.minimum, &range.maximum })
+                if (*b)
+                    widest = std::max({ widest, (*b)->exponent, -(*b)->exponent });
+            auto budget = max_digits_ + std::size_t(widest);
+            return budget < max_digits_ ? std::size_t(-1) : budget;
+        }
+
+        [[noreturn]] static void
+        invalid(const char *what)
+        {
+            throw system::system_error(make_error_code(error::invalid_schema), what);
+        }
+
+        static unsigned
+        type_bit(value const &v)
+        {
+            auto s = v.if_is< std::string >();
+            if (!s)
+                invalid("type must be a string");
+            if (*s == "null")
+                return schema_null;
+            if (*s == "boolean")
+                return schema_boolean;
+            if (*s == "integer")
+                return schema_integer;
+            if (*s == "number")
+                return schema_number | schema_integer;
+            if (*s == "string")
+                return schema_string;
+            if (*s == "array")
+                return schema_array;
+            if (*s == "object")
+                return schema_object;
+            invalid("unknown type");
+        }
+
+        static decimal
+        bound(value const &v)
+        {
+            auto n = v.if_is< number >();
+            if (!n)
+                invalid("numeric bound must be a number");
+            return to_decimal(*n);
+        }
+
+        static std::size_t
+        length(value const &v)
+        {
+            auto d = bound(v);
+            if (d.negative || d.exponent > 18 || std::ptrdiff_t(d.digits.size()) > d.exponent)
+                invalid("length must be a non-negative integer");
+            auto digits = d.digits;
+            digits.resize(std::size_t(d.exponent), '0');
+            return digits.empty() ? 0 : std::stoull(digits);
+        }
+
+        std::size_t
+        add(value const &schema)
+        {
+            auto obj = schema.if_is< object >();
+            if (!obj)
+                invalid("schema must be an object");
+
+            auto index = nodes.size();
+            nodes.emplace_back();
+            schema_node node;
+
+            if (auto t = obj->find("type"))
+            {
+                node.types = 0;
+                if (auto list = t->if_is< array >())
+                    for (auto &e : *list)
+                        node.types |= type_bit(e);
+                else
+                    node.types = type_bit(*t);
+            }
+
+            if (auto props = obj->find("properties"))
+            {
+                auto p = props->if_is< object >();
+                if (!p)
+                    invalid("properties must be an object");
+                for (auto &m : p->members())
+                    node.properties.push_back({ m.first, add(m.second) });
+            }
+
+            if (auto req = obj->find("required"))
+            {
+                auto list = req->if_is< array >();
+                if (!list)
+                    invalid("required must be an array");
+                for (auto &e : *list)
+                {
+                    auto key = e.if_is< std::string >();
+                    if (!key)
+                        invalid("required must contain strings");
+                    auto i = std::find_if(node.properties.begin(), node.properties.end(), [&](auto &p) {
+                        return p.key == *key;
+                    });
+                    if (i == node.properties.end())
+                        i = node.properties.insert(node.properties.end(), schema_node::property { *key });
+                    if (i->required < 0)
+                        i->required = int(node.required_count++);
+                }
+            }
+            std::sort(node.properties.begin(), node.properties.end(), [](auto &l, auto &r) { return l.key < r.key; });
+
+            if (auto items = obj->find("items"))
+                node.items = add(*items);
+
+            if (auto v = obj->find("minimum"))
+                node.range.minimum = bound(*v);
+            if (auto v = obj->find("maximum"))
+                node.range.maximum = bound(*v);
+            if (auto v = obj->find("exclusiveMinimum"))
+            {
+                node.range.minimum           = bound(*v);
+                node.range.exclusive_minimum = true;
+            }
+            if (auto v = obj->find("exclusiveMaximum"))
+            {
+                node.range.maximum           = bound(*v);
+                node.range.exclusive_maximum = true;
+            }
+            if (node.range.minimum || node.range.maximum)
+                node.range.max_digits = digit_budget(node.range);
+            if (auto v = obj->find("minLength"))
+                node.min_length = length(*v);
+            if (auto v = obj->find("maxLength"))
+                node.max_length = length(*v);
+
+            if (auto e = obj->find("enum"))
+            {
+                auto list = e->if_is< array >();
+                if (!list)
+                    invalid("enum must be an array");
+                for (auto &x : *list)
+                {
+                    if (x.is_null())
+                        node.enumeration.push_back(enum_token('z', {}));
+                    else if (auto b = x.if_is< bool >())
+                        node.enumeration.push_back(enum_token('b', *b ? "1" : "0"));
+                    else if (auto n = x.if_is< number >())
+                        node.enumeration.push_back(enum_token(to_decimal(*n)));
+                    else if (auto s = x.if_is< std::string >())
+                        node.enumeration.push_back(enum_token('s', *s));
+                    else
+                        invalid("enum values must be scalars");
+                }
+                std::sort(node.enumeration.begin(), node.enumeration.end());
+            }
+
+            nodes[index] = std::move(node);
+            return index;
+        }
+
+        std::size_t max_digits_ = default_max_digits;
+    };
+
+    /// tokenizer handler which validates the event stream against a compiled schema while forwarding each
+    /// event to Next. The first violation stops the parse with one of the program::error codes.
+    template < class Next = null_handler >
+    struct validating_handler
+    {
+        explicit validating_handler(compiled_schema const &schema, Next next = Next())
+        : schema_(&schema)
+        , next_(std::move(next))
+        {
+        }
+
+        Next &
+        next()
+        {
+            return next_;
+        }
+
+        /// prepare for another document
+        void
+        reset()
+        {
+            frames_.clear();
+            seen_.clear();
+            key_node_ = 0;
+        }
+
+        void
+        on_object_begin(system::error_code &ec)
+        {
+            auto n = enter(schema_object, ec);
+            if (ec)
+                return;
+            if (!permits_container(n))
+            {
+                ec = error::not_in_enum;
+                return;
+            }
+            frames_.push_back({ n, true, seen_.size() });
+            if (n != schema_node::unconstrained)
+                seen_.resize(seen_.size() + schema_->nodes[n].required_count, false);
+            next_.on_object_begin(ec);
+        }
+
+        void
+        on_object_end(system::error_code &ec)
+        {
+            auto &f = frames_.back();
+            if (std::find(seen_.begin() + f.seen_base, seen_.end(), false) != seen_.end())
+            {
+                ec = error::missing_required_key;
+                return;
+            }
+            seen_.resize(f.seen_base);
+            frames_.pop_back();
+            next_.on_object_end(ec);
+        }
+
+        void
+        on_array_begin(system::error_code &ec)
+        {
+            auto n = enter(schema_array, ec);
+            if (ec)
+                return;
+            if (!permits_container(n))
+            {
+                ec = error::not_in_enum;
+                return;
+            }
+            frames_.push_back({ n, false, seen_.size() });
+            next_.on_array_begin(ec);
+        }
+
+        void
+        on_array_end(system::error_code &ec)
+        {
+            frames_.pop_back();
+            next_.on_array_end(ec);
+        }
+
+        void
+        on_key(std::string_view key, system::error_code &ec)
+        {
+            auto &f   = frames_.back();
+            key_node_ = schema_node::unconstrained;
+            if (f.node != schema_node::unconstrained)
+                if (auto p = schema_->nodes[f.node].find(key))
+                {
+                    key_node_ = p->node;
+                    if (p->required >= 0)
+                        seen_[f.seen_base + std::size_t(p->required)] = true;
+                }
+            next_.on_key(key, ec);
+        }
+
+        void
+        on_string(std::string_view s, system::error_code &ec)
+        {
+            auto n = enter(schema_string, ec);
+            if (ec)
+                return;
+            if (n == schema_node::unconstrained)
+                return next_.on_string(s, ec);
+            auto &node = schema_->nodes[n];
+            if (node.min_length || node.max_length)
+            {
+                // lengths are measured in code points: count everything but continuation bytes
+                auto len = std::size_t(std::count_if(
+                    s.begin(), s.end(), [](char c) { return (static_cast< unsigned char >(c) & 0xC0) != 0x80; }));
+                if ((node.min_length && len < *node.min_length) || (node.max_length && len > *node.max_length))
+                {
+                    ec = error::bad_string_length;
+                    return;
+                }
+            }
+            if (!node.enumeration.empty() && !permitted(node, enum_token('s', s)))
+            {
+                ec = error::not_in_enum;
+                return;
+            }
+            next_.on_string(s, ec);
+        }
+
+        /// hand the bounds of the expected number to the parser so absurd values are rejected early
+        number_range const *
+        on_number_begin(system::error_code &ec)
+        {
+            auto n = enter(schema_integer | schema_number, ec);
+            if (ec || n == schema_node::unconstrained || !schema_->nodes[n].range.bounded())
+                return nullptr;
+            return &schema_->nodes[n].range;
+        }
+
+        void
+        on_number(number const &num, system::error_code &ec)
+        {
+            auto d = to_decimal(num);
+            auto is_integer =
+                d.is_zero() || (d.exponent >= 0 && std::ptrdiff_t(d.digits.size()) <= d.exponent);
+            auto n = enter(is_integer ? schema_integer : schema_number, ec);
+            if (ec)
+                return;
+            if (n == schema_node::unconstrained)
+                return next_.on_number(num, ec);
+            auto &node = schema_->nodes[n];
+            if (!node.range.contains(d))
+            {
+                ec = error::out_of_range;
+                return;
+            }
+            if (!node.enumeration.empty() && !permitted(node, enum_token(d)))
+            {
+                ec = error::not_in_enum;
+                return;
+            }
+            next_.on_number(num, ec);
+        }
+
+        void
+        on_bool(bool b, system::error_code &ec)
+        {
+            auto n = enter(schema_boolean, ec);
+            if (!ec && n != schema_node::unconstrained && !schema_->nodes[n].enumeration.empty() &&
+                !permitted(schema_->nodes[n], enum_token('b', b ? "1" : "0")))
+                ec = error::not_in_enum;
+            if (!ec)
+                next_.on_bool(b, ec);
+        }
+
+        void
+        on_null(system::error_code &ec)
+        {
+            auto n = enter(schema_null, ec);
+            if (!ec && n != schema_node::unconstrained && !schema_->nodes[n].enumeration.empty() &&
+                !permitted(schema_->nodes[n], enum_token('z', {})))
+                ec = error::not_in_enum;
+            if (!ec)
+                next_.on_null(ec);
+        }
+
+      private:
+        struct frame
+        {
+            std::size_t node;
+            bool        is_object;
+            std::size_t seen_base;
+        };
+
+        /// the state governing the value about to start, after checking that its type is permitted
+        std::size_t
+        enter(unsigned type, system::error_code &ec)
+        {
+            std::size_t n;
+            if (frames_.empty())
+                n = schema_->nodes.empty() ? schema_node::unconstrained : 0;
+            else if (frames_.back().is_object)
+                n = key_node_;
+            else if (frames_.back().node == schema_node::unconstrained)
+                n = schema_node::unconstrained;
+            else
+                n = schema_->nodes[frames_.back().node].items;
+
+            if (n != schema_node::unconstrained && !(schema_->nodes[n].types & type))
+                ec = error::type_mismatch;
+            return n;
+        }
+
+        /// enum holds only scalars, so a node with one admits no object or array
+        bool
+        permits_container(std::size_t n) const
+        {
+            return n == schema_node::unconstrained || schema_->nodes[n].enumeration.empty();
+        }
+
+        static bool
+        permitted(schema_node const &node, std::string const &token)
+        {
+            return std::binary_search(node.enumeration.begin(), node.enumeration.end(), token);
+        }
+
+        compiled_schema const *schema_;
+        Next                   next_;
+        std::vector< frame >   frames_;
+        std::vector< bool >    seen_;
+        std::size_t            key_node_ = 0;
+    };
+}   // namespace program
@@ -0,0 +1,248 @@
+#pragma once
+
+#include "config.hpp"
+#include "number_parser.hpp"
+#include "value.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace program
+{
+    /// append s as a quoted JSON string, escaping only what must be escaped
+    inline void
+    append_json_string(std::string &out, std::string_view s)
+    {
+        static const char hex[] = "0123456789abcdef";
+
+        out += '"';
+        auto first = s.data();
+        auto last  = s.data() + s.size();
+        for (auto p = first; p != last; ++p)
+        {
+            auto u = static_cast< unsigned char >(*p);
+            if (u >= 0x20 && u != '"' && u != '\\')
+                continue;
+            out.append(first, p);
+            first = p + 1;
+            out += '\\';
+            if (u == '"' || u == '\\')
+                out += char(u);
+            else if (u == '\n')
+                out += 'n';
+            else if (u == '\t')
+                out += 't';
+            else if (u == '\r')
+                out += 'r';
+            else
+            {
+                out += "u00";
+                out += hex[u >> 4];
+                out += hex[u & 15];
+            }
+        }
+        out.append(first, last);
+        out += '"';
+    }
+
+    /// append a number as parsed. The zero which the parser leaves out of the mantissa of numbers such as 0.5
+    /// and -0 is put back, and an exponent of zero is omitted.
+    inline void
+    append_number(std::string &out, number const &n)
+    {
+        auto &m    = n.mantissa.buffer;
+        auto  sign = std::size_t(!m.empty() && m[0] == '-');
+        out.append(m, 0, sign);
+        if (m.size() == sign || m[sign] == '.')
+            out += '0';
+        out.append(m, sign, std::string::npos);
+        if (n.exponent.buffer != "e0")
+            out += n.exponent.buffer;
+    }
+
+    /// append v as compact JSON
+    inline void
+    serialize(value const &v, std::string &out)
+    {
+        if (v.is_null())
+            out += "null";
+        else if (auto b = v.if_is< bool >())
+            out += *b ? "true" : "false";
+        else if (auto n = v.if_is< number >())
+            append_number(out, *n);
+        else if (auto s = v.if_is< std::string >())
+            append_json_string(out, *s);
+        else if (auto a = v.if_is< array >())
+        {
+            out += '[';
+            for (std::size_t i = 0; i < a->size(); ++i)
+            {
+                if (i)
+                    out += ',';
+                serialize((*a)[i], out);
+            }
+            out += ']';
+        }
+        else
+        {
+            auto &members = std::get< object >(v.data).members();
+            out += '{';
+            for (std::size_t i = 0; i < members.size(); ++i)
+            {
+                if (i)
+                    out += ',';
+                append_json_string(out, members[i].first);
+                out += ':';
+                serialize(members[i].second, out);
+            }
+            out += '}';
+        }
+    }
+
+    inline std::string
+    serialize(value const &v)
+    {
+        std::string result;
+        serialize(v, result);
+        return result;
+    }
+
+    /// tokenizer handler which writes the events it receives as compact JSON.
+    /// Keys and preformatted values may also be written directly, with separators placed as for events.
+    struct json_writer
+    {
+        void
+        on_object_begin(system::error_code &)
+        {
+            begin_value();
+            out_ += '{';
+            first_.push_back(true);
+        }
+        void
+        on_object_end(system::error_code &)
+        {
+            out_ += '}';
+            first_.pop_back();
+        }
+        void
+        on_array_begin(system::error_code &)
+        {
+            begin_value();
+            out_ += '[';
+            first_.push_back(true);
+        }
+        void
+        on_array_end(system::error_code &)
+        {
+            out_ += ']';
+            first_.pop_back();
+        }
+        void
+        on_key(std::string_view k, system::error_code &)
+        {
+            key(k);
+        }
+        void
+        on_string(std::string_view s, system::error_code &)
+        {
+            begin_value();
+            append_json_string(out_, s);
+        }
+        number_range const *
+        on_number_begin(system::error_code &)
+        {
+            return nullptr;
+        }
+        void
+        on_number(number const &n, system::error_code &)
+        {
+            begin_value();
+            append_number(out_, n);
+        }
+        void
+        on_bool(bool b, system::error_code &)
+        {
+            begin_value();
+            out_ += b ? "true" : "false";
+        }
+        void
+        on_null(system::error_code &)
+        {
+            begin_value();
+            out_ += "null";
+        }
+
+        void
+        key(std::string_view k)
+        {
+            separate();
+            append_json_string(out_, k);
+            out_ += ':';
+            after_key_ = true;
+        }
+
+        /// write a key which is already JSON text, quoted and followed by ':'
+        void
+        raw_key(std::string_view json)
+        {
+            separate();
+            out_.append(json.data(), json.size());
+            after_key_ = true;
+        }
+
+        /// write a value which is already JSON text
+        void
+        raw(std::string_view json)
+        {
+            begin_value();
+            out_.append(json.data(), json.size());
+        }
+
+        void
+        write(value const &v)
+        {
+            begin_value();
+            serialize(v, out_);
+        }
+
+        std::string &
+        output()
+        {
+            return out_;
+        }
+
+        void
+        reset()
+        {
+            out_.clear();
+            first_.clear();
+            after_key_ = false;
+        }
+
+      private:
+        void
+        separate()
+        {
+            if (!first_.empty())
+            {
+                if (!first_.back())
+                    out_ += ',';
+                first_.back() = false;
+            }
+        }
+
+        void
+        begin_value()
+        {
+            if (after_key_)
+                after_key_ = false;
+            else
+                separate();
+        }
+
+        std::string         out_;
+        std::vector< bool > first_;
+        bool                after_key_ = false;
+    };
+}   // namespace program
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "config.hpp"
+#include "decimal.hpp"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace program
+{
+    /// Keys are encoded as byte strings whose bytewise order is the natural order of the values they encode:
+    /// every number before every string, numbers by value and strings by their UTF-8 bytes. Numbers which are
+    /// equal in value, such as 1, 1.0 and 10e-1, encode identically.
+    enum key_tag : unsigned char
+    {
+        key_number = 0x01,
+        key_string = 0x02,
+    };
+
+    inline void
+    encode_key(std::string &out, decimal const &d)
+    {
+        out += char(key_number);
+        if (d.is_zero())
+        {
+            out += char(0x80);
+            return;
+        }
+
+        // a larger exponent means a larger magnitude, and for negative numbers a smaller value, so the
+        // exponent and digits of negative numbers are inverted. The terminator makes a shorter run of digits
+        // compare as a smaller magnitude.
+        auto flip = d.negative ? 0xFF : 0x00;
+        out += char(d.negative ? 0x7F : 0x81);
+        auto biased = std::uint64_t(d.exponent) ^ (std::uint64_t(1) << 63);
+        for (int shift = 56; shift >= 0; shift -= 8)
+            out += char(((biased >> shift) & 0xFF) ^ flip);
+        for (auto c : d.digits)
+            out += char(static_cast< unsigned char >(c) ^ flip);
+        out += char(flip);
+    }
+
+    inline void
+    encode_key(std::string &out, std::string_view s)
+    {
+        out += char(key_string);
+        out.append(s.data(), s.size());
+    }
+
+    inline std::string
+    encode_key(decimal const &d)
+    {
+        std::string result;
+        encode_key(result, d);
+        return result;
+    }
+
+    inline std::string
+    encode_key(std::string_view s)
+    {
+        std::string result;
+        encode_key(result, s);
+        return result;
+    }
+}   // namespace program
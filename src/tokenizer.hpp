@@ -0,0 +1,641 @@
+#pragma once
+
+#include "config.hpp"
+#include "number_engines.hpp"
+#include "number_parser.hpp"
+#include "number_range.hpp"
+
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace program
+{
+    /// handler which ignores every event. Handlers may derive from it and define only the events they need.
+    /// Any event may stop the parse by setting ec.
+    struct null_handler
+    {
+        void
+        on_object_begin(system::error_code &)
+        {
+        }
+        void
+        on_object_end(system::error_code &)
+        {
+        }
+        void
+        on_array_begin(system::error_code &)
+        {
+        }
+        void
+        on_array_end(system::error_code &)
+        {
+        }
+        void
+        on_key(std::string_view, system::error_code &)
+        {
+        }
+        void
+        on_string(std::string_view, system::error_code &)
+        {
+        }
+        /// called as a number starts. The bounds returned, if any, are checked while the number is parsed.
+        number_range const *
+        on_number_begin(system::error_code &)
+        {
+            return nullptr;
+        }
+        void
+        on_number(number const &, system::error_code &)
+        {
+        }
+        void
+        on_bool(bool, system::error_code &)
+        {
+        }
+        void
+        on_null(system::error_code &)
+        {
+        }
+    };
+
+    /// state machine tokenizing one JSON value, delivering events to Handler as they are recognised.
+    /// given tk is an instance of basic_tokenizer:
+    /// while there is input and !tk.is_complete()
+    ///   next = tk(begin, end);
+    /// tk.finalise();
+    /// The tokenizer completes as soon as the top level value is complete, leaving next at the
+    /// first character after it. Keys and strings are delivered unescaped and whole, even when
+    /// split across calls.
+    template < class Handler >
+    struct basic_tokenizer : asio::coroutine
+    {
+        using const_iterator = const char *;
+
+        basic_tokenizer() = default;
+
+        explicit basic_tokenizer(Handler handler)
+        : handler_(std::move(handler))
+        {
+        }
+
+        /// take the memory for the carry buffer of strings and keys split across calls, and for the nesting
+        /// stack, from resource. Numbers are assembled in buffers which are kept from one number to the next, so
+        /// they allocate only while growing and are left with the default allocator.
+        basic_tokenizer(Handler handler, std::pmr::memory_resource *resource)
+        : handler_(std::move(handler))
+        , stack_(resource)
+        , buffer_(resource)
+        {
+        }
+
+        Handler &
+        handler()
+        {
+            return handler_;
+        }
+
+        Handler const &
+        handler() const
+        {
+            return handler_;
+        }
+
+        system::error_code const &
+        error() const
+        {
+            return error_;
+        }
+
+        /// nesting depth of the value currently being parsed
+        std::size_t
+        depth() const
+        {
+            return stack_.size();
+        }
+
+        static constexpr std::size_t default_max_depth = 4096;
+
+        /// fail with error::too_deep on a container nested more than max deep, which bounds the recursion of
+        /// handlers and of the values they build. Kept across reset().
+        void
+        set_max_depth(std::size_t max)
+        {
+            max_depth_ = max;
+        }
+
+        std::size_t
+        max_depth() const
+        {
+            return max_depth_;
+        }
+
+        /// offset within the whole input of the character following the token just recognised.
+        /// Valid while the handler is being called; on_number_begin sees the offset of the number's first
+        /// character.
+        std::size_t
+        offset() const
+        {
+            return chunk_offset_ + std::size_t(cursor_ - chunk_begin_);
+        }
+
+        /// number of characters consumed by all calls so far
+        std::size_t
+        consumed() const
+        {
+            return chunk_offset_;
+        }
+
+        /// the engine selection for numbers, which persists across documents so a stream of small ones is still
+        /// sampled as a whole
+        adaptive_number_engine &
+        number_engines()
+        {
+            return engines_;
+        }
+
+        number_engine_stats const &
+        number_stats() const
+        {
+            return engines_.stats();
+        }
+
+        /// prepare the tokenizer for another document, retaining the capacity of its buffers
+        void
+        reset()
+        {
+            static_cast< asio::coroutine & >(*this) = asio::coroutine();
+            chunk_begin_  = nullptr;
+            cursor_       = nullptr;
+            chunk_offset_ = 0;
+            stack_.clear();
+            buffer_.clear();
+            np_.reset();
+            error_.clear();
+            resuming_ = false;
+        }
+
+        /// continue a document from a point just after a value, inside the containers listed in stack ('{' or
+        /// '[', outermost first), with offset the position of that point in the whole input. Events continue
+        /// from there, starting with the separator or the end of the innermost container.
+        void
+        resume(std::vector< char > stack, std::size_t offset)
+        {
+            reset();
+            stack_.assign(stack.begin(), stack.end());
+            chunk_offset_ = offset;
+            resuming_     = true;
+        }
+
+#include <boost/asio/yield.hpp>
+        const_iterator
+        operator()(const_iterator begin, const_iterator end)
+        {
+            auto p       = begin;
+            chunk_begin_ = begin;
+
+            auto exhausted = [&] { return p == end; };
+
+            auto finalising = [&] { return begin == end; };
+
+            auto skip_ws = [&] {
+                while (!exhausted() && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+                    ++p;
+                return exhausted();
+            };
+
+            reenter(this)
+            {
+                if (resuming_)
+                {
+                    resuming_ = false;
+                    goto on_after_value;
+                }
+            on_value:
+                while (skip_ws())
+                {
+                    yield;
+                    if (finalising())
+                        goto incomplete;
+                }
+                // no switch here: a yield inside it would bind to the wrong switch
+                if (*p == '{')
+                {
+                    ++p;
+                    if (stack_.size() >= max_depth_)
+                    {
+                        error_ = error::too_deep;
+                        goto fail;
+                    }
+                    stack_.push_back('{');
+                    cursor_ = p;
+                    handler_.on_object_begin(error_);
+                    if (error_)
+                        goto fail;
+                    while (skip_ws())
+                    {
+                        yield;
+                        if (finalising())
+                            goto incomplete;
+                    }
+                    if (*p == '}')
+                        goto on_container_end;
+                    goto on_key;
+                }
+                if (*p == '[')
+                {
+                    ++p;
+                    if (stack_.size() >= max_depth_)
+                    {
+                        error_ = error::too_deep;
+                        goto fail;
+                    }
+                    stack_.push_back('[');
+                    cursor_ = p;
+                    handler_.on_array_begin(error_);
+                    if (error_)
+                        goto fail;
+                    while (skip_ws())
+                    {
+                        yield;
+                        if (finalising())
+                            goto incomplete;
+                    }
+                    if (*p == ']')
+                        goto on_container_end;
+                    goto on_value;
+                }
+                if (*p == '"')
+                {
+                    in_key_ = false;
+                    goto on_string;
+                }
+                if (*p == '-' || (*p >= '0' && *p <= '9'))
+                    goto on_number;
+                if (*p == 't')
+                    literal_ = "true";
+                else if (*p == 'f')
+                    literal_ = "false";
+                else if (*p == 'n')
+                    literal_ = "null";
+                else
+                    goto invalid;
+                for (++literal_, ++p; *literal_; ++literal_, ++p)
+                {
+                    while (exhausted())
+                    {
+                        yield;
+                        if (finalising())
+                            goto incomplete;
+                    }
+                    if (*p != *literal_)
+                        goto invalid;
+                }
+                cursor_ = p;
+                if (literal_[-1] == 'l')
+                    handler_.on_null(error_);
+                else
+                    handler_.on_bool(literal_[-1] == 'e' && literal_[-2] == 'u', error_);
+                if (error_)
+                    goto fail;
+                goto on_after_value;
+
+            on_key:
+                if (*p != '"')
+                    goto invalid;
+                in_key_ = true;
+
+            on_string:
+                ++p;
+                buffer_.clear();
+                for (;;)
+                {
+                    p = scan_string(p, end);
+                    if (exhausted())
+                    {
+                        yield;
+                        if (finalising())
+                            goto incomplete;
+                        continue;
+                    }
+                    if (*p == '"')
+                        break;
+                    if (*p != '\\')
+                        goto invalid;
+                    ++p;
+                    while (exhausted())
+                    {
+                        yield;
+                        if (finalising())
+                            goto incomplete;
+                    }
+                    if (*p == 'u')
+                    {
+                        for (escape_digits_ = 0, code_point_ = 0; escape_digits_ < 4; ++escape_digits_)
+                        {
+                            ++p;
+                            while (exhausted())
+                            {
+                                yield;
+                                if (finalising())
+                                    goto incomplete;
+                            }
+                            if (!accumulate_hex(*p))
+                                goto invalid;
+                        }
+                        append_code_point();
+                    }
+                    else if (!append_escape(*p))
+                        goto invalid;
+                    ++p;
+                }
+                ++p;
+                flush_surrogate();
+                if (in_key_)
+                {
+                    cursor_ = p;
+                    handler_.on_key(std::string_view(buffer_), error_);
+                    if (error_)
+                        goto fail;
+                    while (skip_ws())
+                    {
+                        yield;
+                        if (finalising())
+                            goto incomplete;
+                    }
+                    if (*p != ':')
+                        goto invalid;
+                    ++p;
+                    goto on_value;
+                }
+                cursor_ = p;
+                handler_.on_string(std::string_view(buffer_), error_);
+                if (error_)
+                    goto fail;
+                goto on_after_value;
+
+            on_number:
+                np_.reset();
+                cursor_ = p;
+                np_.set_range(handler_.on_number_begin(error_));
+                if (error_)
+                    goto fail;
+                // a number lying wholly within this buffer may go to a faster engine; otherwise, or if that
+                // engine declines it, number_parser takes it a character at a time
+                number_end_ = engines_.scan(p, end, np_);
+                if (number_end_)
+                {
+                    p = number_end_;
+                    engines_.observe(np_, true);
+                }
+                else
+                {
+                    for (;;)
+                    {
+                        p = np_(p, end);
+                        if (np_.is_complete())
+                            break;
+                        yield;
+                        if (finalising())
+                            break;
+                    }
+                    np_.finalise();
+                    if (np_.error())
+                    {
+                        error_ = np_.error();
+                        goto fail;
+                    }
+                    engines_.observe(np_, false);
+                }
+                cursor_ = p;
+                handler_.on_number(np_.get_number(), error_);
+                if (error_)
+                    goto fail;
+
+            on_after_value:
+                if (stack_.empty())
+                {
+                    yield break;
+                }
+                while (skip_ws())
+                {
+                    yield;
+                    if (finalising())
+                        goto incomplete;
+                }
+                if (*p == ',')
+                {
+                    ++p;
+                    if (stack_.back() == '[')
+                        goto on_value;
+                    while (skip_ws())
+                    {
+                        yield;
+                        if (finalising())
+                            goto incomplete;
+                    }
+                    goto on_key;
+                }
+                if (*p != (stack_.back() == '{' ? '}' : ']'))
+                    goto invalid;
+
+            on_container_end:
+                ++p;
+                cursor_ = p;
+                if (stack_.back() == '{')
+                    handler_.on_object_end(error_);
+                else
+                    handler_.on_array_end(error_);
+                stack_.pop_back();
+                if (error_)
+                    goto fail;
+                goto on_after_value;
+
+            incomplete:
+            invalid:
+                error_ = asio::error::invalid_argument;
+            fail:
+                yield break;
+            }
+
+            chunk_offset_ += std::size_t(p - begin);
+            return p;
+        }
+#include <boost/asio/unyield.hpp>
+
+        /// signal the end of input. Sets error() if the value is incomplete.
+        void
+        finalise()
+        {
+            static const char empty[] = "";
+            if (!error_ && !is_complete())
+            {
+                (*this)(empty, empty);
+                if (!error_ && !is_complete())
+                    error_ = asio::error::invalid_argument;
+            }
+        }
+
+      private:
+        /// append the run of unescaped characters starting at p to the buffer and return the first character
+        /// not consumed
+        const_iterator
+        scan_string(const_iterator p, const_iterator end)
+        {
+            auto first = p;
+            while (p != end && *p != '"' && *p != '\\' && static_cast< unsigned char >(*p) >= 0x20)
+                ++p;
+            if (p != first)
+            {
+                flush_surrogate();
+                buffer_.append(first, p);
+            }
+            return p;
+        }
+
+        bool
+        accumulate_hex(char c)
+        {
+            unsigned digit;
+            if (c >= '0' && c <= '9')
+                digit = c - '0';
+            else if (c >= 'a' && c <= 'f')
+                digit = c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                digit = c - 'A' + 10;
+            else
+                return false;
+            code_point_ = code_point_ * 16 + digit;
+            return true;
+        }
+
+        bool
+        append_escape(char c)
+        {
+            switch (c)
+            {
+            case '"':
+            case '\\':
+            case '/':
+                break;
+            case 'b':
+                c = '\b';
+                break;
+            case 'f':
+                c = '\f';
+                break;
+            case 'n':
+                c = '\n';
+                break;
+            case 'r':
+                c = '\r';
+                break;
+            case 't':
+                c = '\t';
+                break;
+            default:
+                return false;
+            }
+            flush_surrogate();
+            buffer_ += c;
+            return true;
+        }
+
+        /// combine surrogate pairs. Unpaired surrogates are replaced with U+FFFD.
+        void
+        append_code_point()
+        {
+            if (code_point_ >= 0xD800 && code_point_ < 0xDC00)
+            {
+                flush_surrogate();
+                high_surrogate_ = code_point_;
+                return;
+            }
+            if (code_point_ >= 0xDC00 && code_point_ < 0xE000)
+            {
+                if (high_surrogate_)
+                {
+                    code_point_     = 0x10000 + ((high_surrogate_ - 0xD800) << 10) + (code_point_ - 0xDC00);
+                    high_surrogate_ = 0;
+                }
+                else
+                    code_point_ = 0xFFFD;
+            }
+            flush_surrogate();
+            append_utf8(code_point_);
+        }
+
+        void
+        flush_surrogate()
+        {
+            if (high_surrogate_)
+            {
+                high_surrogate_ = 0;
+                append_utf8(0xFFFD);
+            }
+        }
+
+        void
+        append_utf8(unsigned cp)
+        {
+            if (cp < 0x80)
+                buffer_ += char(cp);
+            else if (cp < 0x800)
+            {
+                buffer_ += char(0xC0 | (cp >> 6));
+                buffer_ += char(0x80 | (cp & 0x3F));
+            }
+            else if (cp < 0x10000)
+            {
+                buffer_ += char(0xE0 | (cp >> 12));
+                buffer_ += char(0x80 | ((cp >> 6) & 0x3F));
+                buffer_ += char(0x80 | (cp & 0x3F));
+            }
+            else
+            {
+                buffer_ += char(0xF0 | (cp >> 18));
+                buffer_ += char(0x80 | ((cp >> 12) & 0x3F));
+                buffer_ += char(0x80 | ((cp >> 6) & 0x3F));
+                buffer_ += char(0x80 | (cp & 0x3F));
+            }
+        }
+
+        Handler            handler_;
+        const char *       chunk_begin_  = nullptr;
+        const char *       cursor_       = nullptr;
+        std::size_t        chunk_offset_ = 0;
+        std::pmr::vector< char > stack_;
+        std::pmr::string   buffer_;
+        number_parser      np_;
+        adaptive_number_engine engines_;
+        const char *       number_end_     = nullptr;
+        std::size_t        max_depth_      = default_max_depth;
+        const char *       literal_        = nullptr;
+        unsigned           code_point_     = 0;
+        unsigned           high_surrogate_ = 0;
+        int                escape_digits_  = 0;
+        bool               in_key_         = false;
+        bool               resuming_       = false;
+        system::error_code error_;
+    };
+
+    /// parse a complete document held in memory, requiring nothing but whitespace after the value
+    template < class Handler >
+    system::error_code
+    tokenize(basic_tokenizer< Handler > &tk, std::string_view input)
+    {
+        auto next = tk(input.data(), input.data() + input.size());
+        tk.finalise();
+        if (!tk.error())
+        {
+            auto end = input.data() + input.size();
+            while (next != end && (*next == ' ' || *next == '\t' || *next == '\n' || *next == '\r'))
+                ++next;
+            if (next != end)
+                return asio::error::invalid_argument;
+        }
+        return tk.error();
+    }
+}   // namespace program
@@ -0,0 +1,319 @@
+#pragma once
+
+#include "config.hpp"
+#include "error.hpp"
+#include "hash.hpp"
+#include "tokenizer.hpp"
+
+#include <boost/config.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace program
+{
+    /// set of the keys seen in one object.
+    /// Objects in the same place usually repeat the keys of the one before in the same order, so keys are first
+    /// matched against the previous object's keys by position, which needs no hashing: a prefix of a list of
+    /// distinct keys is itself distinct. From the first key which differs the set falls back to an open
+    /// addressing table of key hashes and indices into the list of keys, whose bytes are compared only when the
+    /// hashes match. Keys of up to 16 bytes are held as the two words they are hashed from, so the common case
+    /// copies nothing; longer keys are copied to an arena.
+    /// Clearing is O(1): slots from earlier objects are recognised by a stale generation.
+    struct key_set
+    {
+        /// returns false if key is already present
+        bool
+        insert(std::string_view key)
+        {
+            if (matched_ < matchable_ && same(keys_[matched_], key))
+            {
+                ++matched_;
+                return true;
+            }
+            return insert_hashed(key);
+        }
+
+        void
+        clear()
+        {
+            matched_   = 0;
+            matchable_ = keys_.size();
+            if (!hashing_)
+                return;
+            hashing_ = false;
+            count_   = 0;
+            if (++generation_ == 0)
+            {
+                // generation wrapped: stale slots could look current, so wipe them for real
+                for (auto &s : slots_)
+                    s.generation = 0;
+                generation_ = 1;
+            }
+        }
+
+      private:
+        /// a key of the current object, or of the previous one beyond those matched so far. w0 and w1 are the
+        /// words of a short key; a long one starts at offset w0 in arena_.
+        struct key_entry
+        {
+            std::uint64_t w0, w1;
+            std::uint32_t length;
+        };
+
+        struct slot
+        {
+            std::uint64_t hash;
+            std::uint32_t generation;
+            std::uint32_t index;
+        };
+
+        // kept out of line so that the positional match, which is all homogeneous records need, inlines into
+        // the tokenizer's handling of keys
+        BOOST_NOINLINE bool
+        insert_hashed(std::string_view key)
+        {
+            if (!hashing_)
+                start_hashing();
+
+            key_entry e { arena_.size(), 0, std::uint32_t(key.size()) };
+            if (key.size() <= 16)
+                load_words(key, e.w0, e.w1);
+            auto h = hash(e, key);
+            if ((count_ + 1) * 2 > slots_.size())
+                grow();
+            auto mask = slots_.size() - 1;
+            for (auto i = home(h);; i = (i + 1) & mask)
+            {
+                auto &s = slots_[i];
+                if (s.generation != generation_)
+                {
+                    s = { h, generation_, std::uint32_t(keys_.size()) };
+                    keys_.push_back(e);
+                    if (key.size() > 16)
+                        arena_.append(key.data(), key.size());
+                    ++count_;
+                    return true;
+                }
+                if (s.hash == h && same(keys_[s.index], key))
+                    return false;
+            }
+        }
+
+        /// the bytes of a key of up to 16 bytes as two words which, with its length, identify it. Both words are
+        /// read with fixed size loads which overlap for keys shorter than 16 bytes.
+        BOOST_FORCEINLINE static void
+        load_words(std::string_view key, std::uint64_t &w0, std::uint64_t &w1)
+        {
+            auto p = key.data();
+            auto n = key.size();
+            if (n >= 8)
+            {
+                std::memcpy(&w0, p, 8);
+                std::memcpy(&w1, p + n - 8, 8);
+            }
+            else if (n >= 4)
+            {
+                std::uint32_t lo, hi;
+                std::memcpy(&lo, p, 4);
+                std::memcpy(&hi, p + n - 4, 4);
+                w0 = lo | (std::uint64_t(hi) << 32);
+                w1 = 0;
+            }
+            else
+            {
+                w0 = 0;
+                for (std::size_t i = 0; i < n; ++i)
+                    w0 = (w0 << 8) | static_cast< unsigned char >(p[i]);
+                w1 = 0;
+            }
+        }
+
+        std::string_view
+        long_key(key_entry const &e) const
+        {
+            return e.length > 16 ? std::string_view(arena_.data() + e.w0, e.length) : std::string_view();
+        }
+
+        /// a short key is hashed from its words, which is all it takes to reach the top bits used by home()
+        static std::uint64_t
+        hash(key_entry const &e, std::string_view key)
+        {
+            if (e.length > 16)
+                return hash_bytes(key);
+            return ((e.w0 * 0x9e3779b97f4a7c15ULL) ^ e.w1 ^ e.length) * 0xff51afd7ed558ccdULL;
+        }
+
+        BOOST_FORCEINLINE bool
+        same(key_entry const &e, std::string_view key) const
+        {
+            if (e.length != key.size())
+                return false;
+            if (key.size() > 16)
+                return long_key(e) == key;
+            std::uint64_t w0, w1;
+            load_words(key, w0, w1);
+            return w0 == e.w0 && w1 == e.w1;
+        }
+
+        /// the current object has left the keys of the previous one: forget the rest of them and put the ones
+        /// matched so far in the table
+        void
+        start_hashing()
+        {
+            hashing_   = true;
+            matchable_ = 0;
+            keys_.resize(matched_);
+            auto arena_size = std::size_t(0);
+            for (auto &e : keys_)
+                if (e.length > 16)
+                    arena_size = e.w0 + e.length;
+            arena_.resize(arena_size);
+            for (std::size_t k = 0; k < keys_.size(); ++k)
+            {
+                auto h = hash(keys_[k], long_key(keys_[k]));
+                if ((count_ + 1) * 2 > slots_.size())
+                    grow();
+                auto mask = slots_.size() - 1;
+                auto i    = home(h);
+                while (slots_[i].generation == generation_)
+                    i = (i + 1) & mask;
+                slots_[i] = { h, generation_, std::uint32_t(k) };
+                ++count_;
+            }
+        }
+
+        /// the first slot to probe, taken from the top bits of the hash, which every bit of a short key reaches
+        std::size_t
+        home(std::uint64_t h) const
+        {
+            return std::size_t(h >> shift_);
+        }
+
+        void
+        grow()
+        {
+            auto old = std::move(slots_);
+            slots_.assign(old.empty() ? 16 : old.size() * 2, slot { 0, 0, 0 });
+            shift_    = old.empty() ? 60 : shift_ - 1;
+            auto mask = slots_.size() - 1;
+            for (auto &s : old)
+                if (s.generation == generation_)
+                {
+                    auto i = home(s.hash);
+                    while (slots_[i].generation == generation_)
+                        i = (i + 1) & mask;
+                    slots_[i] = s;
+                }
+        }
+
+        std::vector< key_entry > keys_;
+        std::string              arena_;
+        std::size_t              matched_   = 0;
+        /// keys_.size() while matching by position and 0 once hashing, so the matched path tests one bound
+        std::size_t              matchable_ = 0;
+        bool                     hashing_   = false;
+        std::vector< slot >      slots_;
+        std::size_t              count_      = 0;
+        unsigned                 shift_      = 64;
+        std::uint32_t            generation_ = 1;
+    };
+
+    /// tokenizer handler which rejects objects containing duplicate keys with error::duplicate_key,
+    /// forwarding every event to Next. Each nesting level reuses a key_set from a pool owned by the
+    /// handler, so a long-lived parser stops allocating once it has seen its widest and deepest objects.
+    template < class Next = null_handler >
+    struct unique_keys
+    {
+        unique_keys() = default;
+
+        explicit unique_keys(Next next)
+        : next_(std::move(next))
+        {
+        }
+
+        Next &
+        next()
+        {
+            return next_;
+        }
+
+        /// prepare for another document
+        void
+        reset()
+        {
+            depth_ = 0;
+        }
+
+        void
+        on_object_begin(system::error_code &ec)
+        {
+            if (depth_ == pool_.size())
+                pool_.emplace_back();
+            current_ = &pool_[depth_++];
+            current_->clear();
+            next_.on_object_begin(ec);
+        }
+        void
+        on_object_end(system::error_code &ec)
+        {
+            if (--depth_)
+                current_ = &pool_[depth_ - 1];
+            next_.on_object_end(ec);
+        }
+        void
+        on_array_begin(system::error_code &ec)
+        {
+            next_.on_array_begin(ec);
+        }
+        void
+        on_array_end(system::error_code &ec)
+        {
+            next_.on_array_end(ec);
+        }
+        void
+        on_key(std::string_view key, system::error_code &ec)
+        {
+            if (!current_->insert(key))
+                ec = error::duplicate_key;
+            else
+                next_.on_key(key, ec);
+        }
+        void
+        on_string(std::string_view s, system::error_code &ec)
+        {
+            next_.on_string(s, ec);
+        }
+        number_range const *
+        on_number_begin(system::error_code &ec)
+        {
+            return next_.on_number_begin(ec);
+        }
+        void
+        on_number(number const &n, system::error_code &ec)
+        {
+            next_.on_number(n, ec);
+        }
+        void
+        on_bool(bool b, system::error_code &ec)
+        {
+            next_.on_bool(b, ec);
+        }
+        void
+        on_null(system::error_code &ec)
+        {
+            next_.on_null(ec);
+        }
+
+      private:
+        Next                   next_;
+        std::vector< key_set > pool_;
+        std::size_t            depth_   = 0;
+        key_set               *current_ = nullptr;
+    };
+}   // namespace program
@@ -0,0 +1,439 @@
+#pragma once
+
+#include "config.hpp"
+#include "hash.hpp"
+#include "number_parser.hpp"
+#include "tokenizer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace program
+{
+    struct value;
+
+    using array  = std::vector< value >;
+    using member = std::pair< std::string, value >;
+
+    namespace detail
+    {
+        struct object_index;
+    }
+
+    /// JSON object preserving the insertion order of its members.
+    /// Lookups scan the members, until an object of index_min members or more has spent about twice its size
+    /// in comparisons on lookups, when a hash index of member positions is built and used from then on. Keys
+    /// can only be changed by emplace_back and erase, which drop the index. Lookups on a const object may run
+    /// concurrently.
+    struct object
+    {
+        static constexpr std::size_t index_min = 16;
+
+        object() = default;
+        object(object const &other);
+        object(object &&other) noexcept;
+        object &
+        operator=(object const &other);
+        object &
+        operator=(object &&other) noexcept;
+        ~object();
+
+        value const *
+        find(std::string_view key) const;
+
+        value *
+        find(std::string_view key);
+
+        std::size_t
+        size() const
+        {
+            return members_.size();
+        }
+
+        std::vector< member > const &
+        members() const
+        {
+            return members_;
+        }
+
+        /// append a member, whether or not the key is present already
+        value &
+        emplace_back(std::string key, value v);
+
+        /// remove the first member with key. Returns whether there was one.
+        bool
+        erase(std::string_view key);
+
+        void
+        reserve(std::size_t n)
+        {
+            members_.reserve(n);
+        }
+
+        bool
+        indexed() const;
+
+      private:
+        /// drop the hash index, if any
+        void
+        invalidate();
+
+        std::vector< member > members_;
+        mutable std::atomic< detail::object_index const * > index_ { nullptr };
+        mutable std::atomic< std::size_t >                  scanned_ { 0 };
+    };
+
+    /// mutable document object model
+    struct value
+    {
+        using storage = std::variant< std::nullptr_t, bool, number, std::string, array, object >;
+
+        storage data;
+
+        value() = default;
+
+        template < class T, std::enable_if_t< std::is_constructible< storage, T && >::value > * = nullptr >
+        value(T &&x)
+        : data(std::forward< T >(x))
+        {
+        }
+
+        bool
+        is_null() const
+        {
+            return std::holds_alternative< std::nullptr_t >(data);
+        }
+
+        template < class T >
+        T const *
+        if_is() const
+        {
+            return std::get_if< T >(&data);
+        }
+
+        template < class T >
+        T *
+        if_is()
+        {
+            return std::get_if< T >(&data);
+        }
+    };
+
+    namespace detail
+    {
+        /// open addressed table of member positions, kept at most half full. Each slot holds a position plus
+        /// one, or zero; the key at the position is compared to confirm a match.
+        struct object_index
+        {
+            member const *                     data;
+            std::size_t                        size;
+            std::size_t                        mask;
+            std::unique_ptr< std::uint32_t[] > slots;
+
+            explicit object_index(std::vector< member > const &members)
+            : data(members.data())
+            , size(members.size())
+            {
+                std::size_t capacity = 4;
+                while (capacity < 2 * size)
+                    capacity *= 2;
+                mask = capacity - 1;
+                slots.reset(new std::uint32_t[capacity]());
+                for (std::size_t i = 0; i < size; ++i)
+                {
+                    // the first of duplicate keys wins, as in a scan
+                    auto j = probe(members[i].first);
+                    if (!slots[j])
+                        slots[j] = std::uint32_t(i + 1);
+                }
+            }
+
+            /// the slot holding key, or the empty slot where it would go
+            std::size_t
+            probe(std::string_view key) const
+            {
+                auto j = std::size_t(hash_bytes(key)) & mask;
+                while (slots[j] && data[slots[j] - 1].first != key)
+                    j = (j + 1) & mask;
+                return j;
+            }
+
+            member const *
+            find(std::string_view key) const
+            {
+                auto s = slots[probe(key)];
+                return s ? data + s - 1 : nullptr;
+            }
+        };
+    }   // namespace detail
+
+    inline object::object(object const &other)
+    : members_(other.members_)
+    {
+    }
+
+    // the index refers to the members' storage, which moves with them. Nothing else may be using an object
+    // being moved from, so plain loads and stores will do, and avoid the cost of locked exchanges when vectors
+    // of values grow.
+    inline object::object(object &&other) noexcept
+    : members_(std::move(other.members_))
+    , index_(other.index_.load(std::memory_order_relaxed))
+    , scanned_(other.scanned_.load(std::memory_order_relaxed))
+    {
+        other.index_.store(nullptr, std::memory_order_relaxed);
+        other.scanned_.store(0, std::memory_order_relaxed);
+    }
+
+    inline object &
+    object::operator=(object const &other)
+    {
+        if (this != &other)
+        {
+            invalidate();
+            members_ = other.members_;
+        }
+        return *this;
+    }
+
+    inline object &
+    object::operator=(object &&other) noexcept
+    {
+        if (this != &other)
+        {
+            invalidate();
+            members_ = std::move(other.members_);
+            index_.store(other.index_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            scanned_.store(other.scanned_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            other.index_.store(nullptr, std::memory_order_relaxed);
+            other.scanned_.store(0, std::memory_order_relaxed);
+        }
+        return *this;
+    }
+
+    inline object::~object()
+    {
+        delete index_.load(std::memory_order_relaxed);
+    }
+
+    inline void
+    object::invalidate()
+    {
+        if (auto ix = index_.load(std::memory_order_relaxed))
+        {
+            delete ix;
+            index_.store(nullptr, std::memory_order_relaxed);
+        }
+        scanned_.store(0, std::memory_order_relaxed);
+    }
+
+    inline bool
+    object::indexed() const
+    {
+        auto ix = index_.load(std::memory_order_acquire);
+        return ix != nullptr;
+    }
+
+    inline value const *
+    object::find(std::string_view key) const
+    {
+        auto ix = index_.load(std::memory_order_acquire);
+        if (ix)
+        {
+            auto m = ix->find(key);
+            return m ? &m->second : nullptr;
+        }
+
+        value const *result = nullptr;
+        std::size_t  i      = 0;
+        for (; i < members_.size(); ++i)
+            if (members_[i].first == key)
+            {
+                result = &members_[i].second;
+                break;
+            }
+
+        if (members_.size() >= index_min &&
+            scanned_.fetch_add(i + 1, std::memory_order_relaxed) + i + 1 >= 2 * members_.size())
+        {
+            auto                         fresh    = new detail::object_index(members_);
+            detail::object_index const *expected = nullptr;
+            if (!index_.compare_exchange_strong(expected, fresh, std::memory_order_acq_rel))
+                delete fresh;
+        }
+        return result;
+    }
+
+    inline value *
+    object::find(std::string_view key)
+    {
+        return const_cast< value * >(static_cast< object const & >(*this).find(key));
+    }
+
+    inline value &
+    object::emplace_back(std::string key, value v)
+    {
+        invalidate();
+        members_.emplace_back(std::move(key), std::move(v));
+        return members_.back().second;
+    }
+
+    inline bool
+    object::erase(std::string_view key)
+    {
+        auto it = std::find_if(members_.begin(), members_.end(), [&](member const &m) { return m.first == key; });
+        if (it == members_.end())
+            return false;
+        invalidate();
+        members_.erase(it);
+        return true;
+    }
+
+    /// tokenizer handler which assembles a value from the event stream
+    struct value_builder
+    {
+        void
+        on_object_begin(system::error_code &)
+        {
+            push(object {});
+        }
+        void
+        on_object_end(system::error_code &)
+        {
+            pop();
+        }
+        void
+        on_array_begin(system::error_code &)
+        {
+            push(array {});
+        }
+        void
+        on_array_end(system::error_code &)
+        {
+            pop();
+        }
+        void
+        on_key(std::string_view key, system::error_code &)
+        {
+            key_.assign(key.begin(), key.end());
+        }
+        void
+        on_string(std::string_view s, system::error_code &)
+        {
+            insert(std::string(s));
+        }
+        number_range const *
+        on_number_begin(system::error_code &)
+        {
+            return nullptr;
+        }
+        void
+        on_number(number const &n, system::error_code &)
+        {
+            insert(n);
+        }
+        void
+        on_bool(bool b, system::error_code &)
+        {
+            insert(b);
+        }
+        void
+        on_null(system::error_code &)
+        {
+            insert(nullptr);
+        }
+
+        /// the completed document
+        value &
+        get()
+        {
+            return root_;
+        }
+
+      private:
+        value *
+        insert(value v)
+        {
+            if (stack_.empty())
+            {
+                root_ = std::move(v);
+                return &root_;
+            }
+            auto &top = *stack_.back();
+            if (auto a = top.if_is< array >())
+            {
+                a->push_back(std::move(v));
+                return &a->back();
+            }
+            return &std::get< object >(top.data).emplace_back(std::move(key_), std::move(v));
+        }
+
+        void
+        push(value v)
+        {
+            stack_.push_back(insert(std::move(v)));
+        }
+
+        void
+        pop()
+        {
+            stack_.pop_back();
+        }
+
+        value                 root_;
+        std::vector< value * > stack_;
+        std::string           key_;
+    };
+
+    /// parse a complete document held in memory
+    inline value
+    parse(std::string_view input, system::error_code &ec)
+    {
+        basic_tokenizer< value_builder > tk;
+        ec = tokenize(tk, input);
+        return std::move(tk.handler().get());
+    }
+
+    /// parse count complete documents held in memory, as parse would each one, into outputs[i] and errors[i]:
+    /// a document which fails leaves what was built of it before the error, as parse returns. One tokenizer and
+    /// builder serve the whole batch, so their buffers, stacks and number engine state are set up once and stay
+    /// warm in cache from one document to the next. Returns the number of documents which failed.
+    inline std::size_t
+    parse_batch(std::string_view const *inputs, std::size_t count, value *outputs, system::error_code *errors)
+    {
+        basic_tokenizer< value_builder > tk;
+        std::size_t                      failed = 0;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            tk.reset();
+            // take the root whole, leaving null for a document with no value to set it
+            errors[i]  = tokenize(tk, inputs[i]);
+            outputs[i] = std::exchange(tk.handler().get(), value());
+            if (errors[i])
+            {
+                // the builder may be left inside unfinished containers
+                tk.handler() = value_builder();
+                ++failed;
+            }
+        }
+        return failed;
+    }
+
+    inline std::size_t
+    parse_batch(std::vector< std::string_view > const &inputs,
+                std::vector< value > &                  outputs,
+                std::vector< system::error_code > &     errors)
+    {
+        outputs.resize(inputs.size());
+        errors.resize(inputs.size());
+        return parse_batch(inputs.data(), inputs.size(), outputs.data(), errors.data());
+    }
+}   // namespace program
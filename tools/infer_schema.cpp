@@ -0,0 +1,47 @@
+// infer a JSON Schema from the records of an NDJSON file
+//
+//   infer_schema <file> [<threads>]
+//
+// The schema is written to standard output in the dialect compiled_schema accepts, with "format" added for
+// strings which all share one.
+
+#include "config.hpp"
+#include "infer_schema.hpp"
+#include "mapped_file.hpp"
+
+#include <iostream>
+#include <string>
+
+namespace program
+{
+    int
+    run(int argc, char **argv)
+    {
+        if (argc < 2 || argc > 3)
+        {
+            std::cerr << "usage: infer_schema <file> [<threads>]\n";
+            return 2;
+        }
+
+        mapped_file data(argv[1]);
+        auto        schema = argc > 2 ? infer_ndjson_schema(data.view(), unsigned(std::stoul(argv[2])))
+                                      : infer_ndjson_schema(data.view());
+        std::cout << schema.to_json() << '\n';
+        std::cerr << schema.records << " records\n";
+        return 0;
+    }
+}   // namespace program
+
+int
+main(int argc, char **argv)
+{
+    try
+    {
+        return program::run(argc, argv);
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+        return 2;
+    }
+}
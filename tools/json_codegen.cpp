@@ -0,0 +1,80 @@
+// generate a parser and serializer specialised to one shape of document
+//
+//   json_codegen schema <schema.json> <name> [<namespace>] [<output>]
+//   json_codegen samples <file.ndjson> <name> [<namespace>] [<output>]
+//
+// schema reads a JSON Schema; samples infers one from the records of an NDJSON file first. The header is
+// written to output, or to standard output, and includes codegen_support.hpp from this directory's src.
+
+#include "codegen.hpp"
+#include "config.hpp"
+#include "infer_schema.hpp"
+#include "mapped_file.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace program
+{
+    int
+    usage()
+    {
+        std::cerr << "usage: json_codegen schema <schema.json> <name> [<namespace>] [<output>]\n"
+                     "       json_codegen samples <file.ndjson> <name> [<namespace>] [<output>]\n";
+        return 2;
+    }
+
+    int
+    run(int argc, char **argv)
+    {
+        if (argc < 4 || argc > 6)
+            return usage();
+        std::string command = argv[1];
+
+        codegen_options options;
+        options.name = argv[3];
+        if (argc > 4)
+            options.name_space = argv[4];
+
+        mapped_file data(argv[2]);
+        std::string header;
+        if (command == "schema")
+            header = generate_parser(data.view(), options);
+        else if (command == "samples")
+        {
+            auto schema = infer_ndjson_schema(data.view());
+            auto text   = schema.to_json();
+            std::cerr << schema.records << " records\n";
+            header = generate_parser(std::string_view(text), options);
+        }
+        else
+            return usage();
+
+        if (argc > 5)
+        {
+            std::ofstream os(argv[5], std::ios::binary);
+            if (!os)
+                throw system::system_error(system::error_code(errno, system::system_category()),
+                                           std::string("open ") + argv[5]);
+            os << header;
+        }
+        else
+            std::cout << header;
+        return 0;
+    }
+}   // namespace program
+
+int
+main(int argc, char **argv)
+{
+    try
+    {
+        return program::run(argc, argv);
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+        return 2;
+    }
+}
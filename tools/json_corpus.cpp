@@ -0,0 +1,107 @@
+// generate a reproducible synthetic JSON corpus for benchmarks
+//
+//   json_corpus <seed> <bytes> [<shape>] [<output>] [<threads>]
+//
+// The shape is a JSON description (see corpus_shape) given inline or as @file; the output defaults to standard
+// output, also chosen by "-". The same seed and shape always produce the same bytes, whatever the number of
+// threads. Sizes may end in k, M or G.
+
+#include "config.hpp"
+#include "corpus.hpp"
+#include "parse_size.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace program
+{
+    int
+    run(int argc, char **argv)
+    {
+        if (argc < 3 || argc > 6)
+        {
+            std::cerr << "usage: json_corpus <seed> <bytes> [<shape>|@<shape file>] [<output>|-] [<threads>]\n";
+            return 2;
+        }
+
+        corpus_shape shape;
+        if (argc > 3)
+        {
+            std::string description = argv[3];
+            if (!description.empty() && description[0] == '@')
+            {
+                std::ifstream is(description.substr(1));
+                if (!is)
+                    throw system::system_error(system::error_code(errno, system::system_category()),
+                                               "open " + description.substr(1));
+                description.assign(std::istreambuf_iterator< char >(is), {});
+            }
+            shape = corpus_shape::parse(description);
+        }
+
+        auto out = stdout;
+        if (argc > 4 && std::string(argv[4]) != "-" && !(out = std::fopen(argv[4], "wb")))
+            throw system::system_error(system::error_code(errno, system::system_category()),
+                                       std::string("open ") + argv[4]);
+
+        unsigned threads = argc > 5 ? unsigned(std::stoul(argv[5])) : std::thread::hardware_concurrency();
+        threads          = std::max(1u, threads);
+
+        // the corpus is cut into blocks of a fixed size, so the bytes do not depend on the number of threads
+        constexpr std::uint64_t block_size = 1 << 20;
+        auto                    bytes      = parse_size(argv[2]);
+        auto                    blocks     = std::max< std::uint64_t >(1, (bytes + block_size - 1) / block_size);
+
+        std::vector< corpus_generator > gens;
+        gens.reserve(threads);
+        for (unsigned t = 0; t < threads; ++t)
+            gens.emplace_back(shape, std::stoull(argv[1]));
+        std::vector< std::string_view > texts(threads);
+
+        auto write = [&](std::string_view text) {
+            if (std::fwrite(text.data(), 1, text.size(), out) != text.size())
+                throw system::system_error(system::error_code(errno, system::system_category()), "write");
+        };
+
+        for (std::uint64_t first = 0; first < blocks; first += threads)
+        {
+            auto n    = unsigned(std::min< std::uint64_t >(threads, blocks - first));
+            auto make = [&](unsigned t) {
+                auto i   = first + t;
+                texts[t] = gens[t].block(i, std::size_t(std::min(block_size, bytes - std::min(bytes, i * block_size))));
+            };
+            std::vector< std::thread > pool;
+            for (unsigned t = 1; t < n; ++t)
+                pool.emplace_back(make, t);
+            make(0);
+            for (auto &t : pool)
+                t.join();
+            for (unsigned t = 0; t < n; ++t)
+                write(texts[t]);
+        }
+        write(gens[0].finish());
+        if (out != stdout && std::fclose(out) != 0)
+            throw system::system_error(system::error_code(errno, system::system_category()), "close");
+        return 0;
+    }
+}   // namespace program
+
+int
+main(int argc, char **argv)
+{
+    try
+    {
+        return program::run(argc, argv);
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+        return 2;
+    }
+}
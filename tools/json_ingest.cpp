@@ -0,0 +1,119 @@
+// NDJSON ingest server, and a load generator to drive it
+//
+//   json_ingest serve <port> [<threads>] [shared]
+//   json_ingest load <host> <port> <connections> <seconds> <file>
+//
+// serve parses every record received, printing totals each second until interrupted; shared selects one
+// io_context for all the threads instead of one per thread. load sends the records of file over and over on
+// each connection.
+
+#include "config.hpp"
+#include "ingest_server.hpp"
+#include "mapped_file.hpp"
+
+#include <boost/asio/signal_set.hpp>
+
+#include <chrono>
+#include <csignal>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+
+namespace program
+{
+    int
+    usage()
+    {
+        std::cerr << "usage: json_ingest serve <port> [<threads>] [shared]\n"
+                     "       json_ingest load <host> <port> <connections> <seconds> <file>\n";
+        return 2;
+    }
+
+    int
+    serve(int argc, char **argv)
+    {
+        ingest_options options;
+        if (argc > 3)
+            options.threads = unsigned(std::stoul(argv[3]));
+        if (argc > 4)
+        {
+            if (std::string(argv[4]) != "shared")
+                return usage();
+            options.sharded = false;
+        }
+
+        ingest_server server(asio::ip::tcp::endpoint(asio::ip::tcp::v4(), std::uint16_t(std::stoul(argv[2]))),
+                             options);
+        std::thread runner([&] { server.run(); });
+
+        asio::io_context   ioc;
+        asio::signal_set   signals(ioc, SIGINT, SIGTERM);
+        asio::steady_timer timer(ioc);
+        signals.async_wait([&](system::error_code, int) {
+            timer.cancel();
+            server.stop();
+        });
+
+        auto         start    = std::chrono::steady_clock::now();
+        ingest_stats previous = {};
+        std::function< void(system::error_code) > report = [&](system::error_code ec) {
+            if (ec)
+                return;
+            auto s = server.stats();
+            std::cout << s.connections << " connections, " << s.records << " records (" << s.records - previous.records
+                      << "/s), " << (s.bytes - previous.bytes) / 1e6 << " MB/s, " << s.malformed << " malformed"
+                      << std::endl;
+            previous = s;
+            timer.expires_at(timer.expiry() + std::chrono::seconds(1));
+            timer.async_wait(report);
+        };
+        timer.expires_at(start + std::chrono::seconds(1));
+        timer.async_wait(report);
+        ioc.run();
+        runner.join();
+        return 0;
+    }
+
+    int
+    load(int argc, char **argv)
+    {
+        if (argc != 7)
+            return usage();
+        mapped_file data(argv[6]);
+        asio::io_context ioc;
+        auto endpoints = asio::ip::tcp::resolver(ioc).resolve(argv[2], argv[3]);
+        auto result    = ingest_load(endpoints.begin()->endpoint(), unsigned(std::stoul(argv[4])), data.view(),
+                                  std::chrono::duration< double >(std::stod(argv[5])));
+        std::cout << result.bytes << " bytes in " << result.seconds << " s, " << result.bytes / result.seconds / 1e6
+                  << " MB/s\n";
+        return 0;
+    }
+
+    int
+    run(int argc, char **argv)
+    {
+        if (argc < 3)
+            return usage();
+        std::string command = argv[1];
+        if (command == "serve")
+            return serve(argc, argv);
+        if (command == "load")
+            return load(argc, argv);
+        return usage();
+    }
+}   // namespace program
+
+int
+main(int argc, char **argv)
+{
+    try
+    {
+        return program::run(argc, argv);
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+        return 2;
+    }
+}
@@ -0,0 +1,94 @@
+// build and query sidecar key indexes of NDJSON files
+//
+//   ndjson_index build <file> <pointer> [<index>] [<threads>]
+//   ndjson_index find <file> <index> <key>
+//
+// The index defaults to <file>.kix. A key which parses as a JSON string or number is taken as that value, so
+// 42, 42.0 and 4.2e1 all find the same records; anything else is taken as a literal string.
+
+#include "config.hpp"
+#include "mapped_file.hpp"
+#include "ndjson_index.hpp"
+#include "number_parser.hpp"
+#include "projection.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+
+namespace program
+{
+    /// the encoded key for a command line argument
+    std::string
+    argument_key(std::string const &arg)
+    {
+        basic_tokenizer< key_projection > tk(key_projection { {} });
+        system::error_code                ec;
+        if (project_key(tk, arg, ec))
+            return tk.handler().key();
+        return encode_key(std::string_view(arg));
+    }
+
+    int
+    usage()
+    {
+        std::cerr << "usage: ndjson_index build <file> <pointer> [<index>] [<threads>]\n"
+                     "       ndjson_index find <file> <index> <key>\n";
+        return 2;
+    }
+
+    int
+    run(int argc, char **argv)
+    {
+        if (argc < 4)
+            return usage();
+        std::string command = argv[1];
+        mapped_file data(argv[2]);
+
+        if (command == "build")
+        {
+            std::string index   = argc > 4 ? argv[4] : std::string(argv[2]) + ".kix";
+            unsigned    threads = argc > 5 ? unsigned(std::stoul(argv[5])) : std::thread::hardware_concurrency();
+            std::ofstream os(index, std::ios::binary);
+            if (!os)
+                throw system::system_error(system::error_code(errno, system::system_category()), "open " + index);
+            auto stats = build_ndjson_index(data.view(), argv[3], os, threads);
+            std::cout << stats.indexed << " of " << stats.records << " records indexed\n";
+            return 0;
+        }
+
+        if (command == "find" && argc == 5)
+        {
+            ndjson_index       index(argv[3]);
+            system::error_code ec;
+            auto               offsets = index.find(data.view(), argument_key(argv[4]), ec);
+            if (ec)
+                throw system::system_error(ec, "find");
+            auto v = data.view();
+            for (auto offset : offsets)
+            {
+                auto eol = v.find('\n', std::size_t(offset));
+                std::cout << v.substr(std::size_t(offset), eol == std::string_view::npos ? eol : eol - offset)
+                          << '\n';
+            }
+            return offsets.empty() ? 1 : 0;
+        }
+
+        return usage();
+    }
+}   // namespace program
+
+int
+main(int argc, char **argv)
+{
+    try
+    {
+        return program::run(argc, argv);
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+        return 2;
+    }
+}
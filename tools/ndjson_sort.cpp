@@ -0,0 +1,57 @@
+// sort an NDJSON file by the value at a JSON pointer
+//
+//   ndjson_sort <file> <pointer> <output> [<memory MiB>] [<threads>]
+//
+// Numbers sort by value before strings, which sort bytewise. Records without the key come first, and records
+// with equal keys keep their order.
+
+#include "config.hpp"
+#include "external_sort.hpp"
+#include "mapped_file.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace program
+{
+    int
+    run(int argc, char **argv)
+    {
+        if (argc < 4 || argc > 6)
+        {
+            std::cerr << "usage: ndjson_sort <file> <pointer> <output> [<memory MiB>] [<threads>]\n";
+            return 2;
+        }
+
+        external_sort_options options;
+        if (argc > 4)
+            options.memory = std::size_t(std::stoul(argv[4])) << 20;
+        if (argc > 5)
+            options.threads = unsigned(std::stoul(argv[5]));
+
+        mapped_file   data(argv[1]);
+        std::ofstream os(argv[3], std::ios::binary);
+        if (!os)
+            throw system::system_error(system::error_code(errno, system::system_category()),
+                                       std::string("open ") + argv[3]);
+        auto stats = sort_ndjson(data.view(), argv[2], os, options);
+        std::cout << stats.records << " records sorted in " << std::max< std::uint64_t >(stats.runs, 1)
+                  << " runs\n";
+        return 0;
+    }
+}   // namespace program
+
+int
+main(int argc, char **argv)
+{
+    try
+    {
+        return program::run(argc, argv);
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+        return 2;
+    }
+}
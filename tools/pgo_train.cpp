@@ -0,0 +1,138 @@
+// training workload for profile guided builds
+//
+//   pgo_train [<bytes>] [<seed>]
+//
+// Generates a corpus and runs the number parser, the tokenizer and the DOM over it, reporting the throughput
+// of each phase, so that the same program trains a profile and measures what the profile bought. The corpus is
+// NDJSON records of the default shape followed by records heavy in numbers. Sizes may end in k, M or G.
+
+#include "config.hpp"
+#include "corpus.hpp"
+#include "number_parser.hpp"
+#include "parse_size.hpp"
+#include "projection.hpp"
+#include "serializer.hpp"
+#include "tokenizer.hpp"
+#include "value.hpp"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace program
+{
+    /// the text of every number in a document
+    struct number_text_collector : null_handler
+    {
+        std::vector< std::string > *numbers;
+
+        void
+        on_number(number const &n, system::error_code &)
+        {
+            numbers->push_back(n.mantissa.buffer + n.exponent.buffer);
+        }
+    };
+
+    template < class F >
+    void
+    phase(std::string_view name, std::size_t bytes, F &&f)
+    {
+        auto start   = std::chrono::steady_clock::now();
+        f();
+        auto seconds = std::chrono::duration< double >(std::chrono::steady_clock::now() - start).count();
+        std::cout << std::left << std::setw(24) << name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(10) << double(bytes) / seconds / 1e6 << " MB/s" << std::endl;
+    }
+
+    int
+    run(int argc, char **argv)
+    {
+        if (argc > 3)
+        {
+            std::cerr << "usage: pgo_train [<bytes>] [<seed>]\n";
+            return 2;
+        }
+        auto bytes = std::size_t(argc > 1 ? parse_size(argv[1]) : 32 << 20);
+        auto seed  = argc > 2 ? std::stoull(argv[2]) : 1;
+
+        std::string corpus;
+        phase("generate", bytes, [&] {
+            corpus_generator records(corpus_shape(), seed);
+            corpus += records.block(0, bytes - bytes / 4);
+            corpus_generator numbers(
+                corpus_shape::parse(R"({"types":{"number":6,"string":1,"array":1},"depth":2})"), seed);
+            corpus += numbers.block(0, bytes / 4);
+        });
+
+        std::vector< std::string > numbers;
+        std::size_t                number_bytes = 0;
+        {
+            basic_tokenizer< number_text_collector > tk(number_text_collector { {}, &numbers });
+            for_each_record(corpus, 0, corpus.size(), [&](std::string_view record, std::size_t) {
+                tk.reset();
+                tokenize(tk, record);
+            });
+            for (auto &n : numbers)
+                number_bytes += n.size();
+        }
+
+        // whole, then split in two as when a number straddles reads, which takes the paths that yield
+        system::error_code failed;
+        phase("number_parser", 2 * number_bytes, [&] {
+            number_parser np;
+            for (auto &n : numbers)
+                for (std::size_t split : { n.size(), n.size() / 2 })
+                {
+                    np.reset();
+                    auto next = np(n.data(), n.data() + split);
+                    if (!np.is_complete() && !np.error())
+                        np(next, n.data() + n.size());
+                    if (!np.is_complete())
+                        np.finalise();
+                    if (np.error())
+                        failed = np.error();
+                }
+        });
+
+        phase("tokenizer", corpus.size(), [&] {
+            basic_tokenizer< null_handler > tk;
+            for_each_record(corpus, 0, corpus.size(), [&](std::string_view record, std::size_t) {
+                tk.reset();
+                if (auto ec = tokenize(tk, record))
+                    failed = ec;
+            });
+        });
+
+        std::size_t written = 0;
+        phase("parse and serialize", corpus.size(), [&] {
+            for_each_record(corpus, 0, corpus.size(), [&](std::string_view record, std::size_t) {
+                system::error_code ec;
+                auto               v = parse(record, ec);
+                if (ec)
+                    failed = ec;
+                written += serialize(v).size();
+            });
+        });
+
+        if (failed)
+            throw system::system_error(failed, "pgo_train");
+        std::cout << numbers.size() << " numbers, " << written << " bytes written" << std::endl;
+        return 0;
+    }
+}   // namespace program
+
+int
+main(int argc, char **argv)
+{
+    try
+    {
+        return program::run(argc, argv);
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+        return 2;
+    }
+}